@@ -1,35 +1,40 @@
 #include <stdlib.h>
+#include <string.h>
 
+#include "libblast.h"
 #include "utils.h"
 
+// bytes output by one literal and by each word of a back-reference, per type
+static const unsigned char blast_word_size[] = {0, 2, 4, 2, 4, 4, 2};
+
 // 802A5E10 (061650)
 // just a memcpy from a0 to a3
-int decode_block0(unsigned char *in, int length, unsigned char *out)
+int decode_block0(const unsigned char *in, int length, unsigned char *out, int out_len)
 {
-   int ret_len = length;
-   length >>= 3; // a1 - gets number of dwords
-   while (length != 0) {
-      int i;
-      for (i = 0; i < 8; i++) {
-         out[i] = in[i];
-      }
-      in += 8;
-      out += 8;
-      length--;
+   if (length > out_len) {
+      return -1;
    }
-   return ret_len;
+   // game copies whole dwords, the partial one at the end is copied too
+   memcpy(out, in, length);
+   return length;
 }
 
 // 802A5AE0 (061320)
-int decode_block1(unsigned char *in, int length, unsigned char *out)
+int decode_block1(const unsigned char *in, int length, unsigned char *out, int out_len)
 {
    unsigned short t0, t1, t3;
    unsigned char *t2;
    int len = 0;
+   if (length & 1) {
+      return -1;
+   }
    while (length != 0) {
       t0 = read_u16_be(in); // a0
       in += 2; // a0
       if ((t0 & 0x8000) == 0) {
+         if (len + 2 > out_len) {
+            return -1;
+         }
          t1 = (t0 & 0xFFC0) << 1;
          t0 &= 0x3F;
          t0 = t0 | t1;
@@ -41,6 +46,9 @@ int decode_block1(unsigned char *in, int length, unsigned char *out)
          t1 = t0 & 0x1F; // lookback length
          t0 = (t0 & 0x7FFF) >> 5; // lookback offset
          length -= 2; // a1
+         if (t0 > len || len + t1 * 2 > out_len) {
+            return -1;
+         }
          t2 = out - t0; // t2 - lookback pointer from current out
          while (t1 != 0) {
             t3 = read_u16_be(t2);
@@ -56,16 +64,22 @@ int decode_block1(unsigned char *in, int length, unsigned char *out)
 }
 
 // 802A5B90 (0613D0)
-int decode_block2(unsigned char *in, int length, unsigned char *out)
+int decode_block2(const unsigned char *in, int length, unsigned char *out, int out_len)
 {
    unsigned char *look;
    unsigned short t0;
    unsigned int t1, t2, t3;
    int len = 0;
+   if (length & 1) {
+      return -1;
+   }
    while (length != 0) {
       t0 = read_u16_be(in);
       in += 2;
       if ((t0 & 0x8000) == 0) { // t0 >= 0
+         if (len + 4 > out_len) {
+            return -1;
+         }
          t1 = t0 & 0x7800;
          t2 = t0 & 0x0780;
          t1 <<= 17; // 0x11
@@ -86,6 +100,9 @@ int decode_block2(unsigned char *in, int length, unsigned char *out)
          t0 &= 0x7FE0;
          t0 >>= 4;
          length -= 2;
+         if (t0 > len || len + (int)t1 * 4 > out_len) {
+            return -1;
+         }
          look = out - t0; // t2
          while (t1 != 0) {
             t3 = read_u32_be(look); // lw t2
@@ -101,16 +118,22 @@ int decode_block2(unsigned char *in, int length, unsigned char *out)
 }
 
 // 802A5C5C (06149C)
-int decode_block4(unsigned char *in, int length, unsigned char *out, unsigned char *lut)
+int decode_block4(const unsigned char *in, int length, unsigned char *out, int out_len, const unsigned char *lut)
 {
-   unsigned char *look;
+   const unsigned char *look;
    unsigned int t3;
    unsigned short t0, t1, t2;
    int len = 0;
+   if (length & 1) {
+      return -1;
+   }
    while (length != 0) {
       t0 = read_u16_be(in);
       in += 2;
       if ((t0 & 0x8000) == 0) {
+         if (len + 4 > out_len) {
+            return -1;
+         }
          t1 = t0 >> 8;
          t2 = t1 & 0xFE;
          look = lut + t2; // t2 += t4; // t4 set in proc_802A57DC: lw    $t4, 0xc($a0)
@@ -135,6 +158,9 @@ int decode_block4(unsigned char *in, int length, unsigned char *out, unsigned ch
          t0 &= 0x7FE0;
          t0 >>= 4;
          length -= 2;
+         if (t0 > len || len + t1 * 4 > out_len) {
+            return -1;
+         }
          look = out - t0;
          while (t1 != 0) {
             t3 = read_u32_be(look);
@@ -150,16 +176,22 @@ int decode_block4(unsigned char *in, int length, unsigned char *out, unsigned ch
 }
 
 // 802A5D34 (061574)
-int decode_block5(unsigned char *in, int length, unsigned char *out, unsigned char *lut)
+int decode_block5(const unsigned char *in, int length, unsigned char *out, int out_len, const unsigned char *lut)
 {
-   unsigned char *tmp;
+   const unsigned char *tmp;
    unsigned short t0, t1;
    unsigned int t2, t3;
    int len = 0;
+   if (length & 1) {
+      return -1;
+   }
    while (length != 0) {
       t0 = read_u16_be(in);
       in += 2;
       if ((t0 & 0x8000) == 0) { // bltz
+         if (len + 4 > out_len) {
+            return -1;
+         }
          t1 = t0 >> 4;
          t1 = t1 << 1;
          tmp = t1 + lut; // t1 += t4
@@ -184,6 +216,9 @@ int decode_block5(unsigned char *in, int length, unsigned char *out, unsigned ch
          t0 &= 0x7FE0;
          t0 >>= 4;
          length -= 2;
+         if (t0 > len || len + t1 * 4 > out_len) {
+            return -1;
+         }
          tmp = out - t0; // t2
          while (t1 != 0) {
             t3 = read_u32_be(tmp); //t2
@@ -199,15 +234,21 @@ int decode_block5(unsigned char *in, int length, unsigned char *out, unsigned ch
 }
 
 // 802A5A2C (06126C)
-int decode_block3(unsigned char *in, int length, unsigned char *out)
+int decode_block3(const unsigned char *in, int length, unsigned char *out, int out_len)
 {
    unsigned short t0, t1, t3;
    unsigned char *t2;
    int len = 0;
+   if (length & 1) {
+      return -1;
+   }
    while (length != 0) {
       t0 = read_u16_be(in);
       in += 2;
       if ((0x8000 & t0) == 0) {
+         if (len + 2 > out_len) {
+            return -1;
+         }
          t1 = t0 >> 8;
          t1 <<= 1;
          *out = (unsigned char)t1; // sb
@@ -222,6 +263,9 @@ int decode_block3(unsigned char *in, int length, unsigned char *out)
          t0 &= 0x7FFF;
          t0 >>= 5;
          length -= 2;
+         if (t0 > len || len + t1 * 2 > out_len) {
+            return -1;
+         }
          t2 = out - t0;
          while (t1 != 0) {
             t3 = read_u16_be(t2);
@@ -237,16 +281,22 @@ int decode_block3(unsigned char *in, int length, unsigned char *out)
 }
 
 // 802A5958 (061198)
-int decode_block6(unsigned char *in, int length, unsigned char *out)
+int decode_block6(const unsigned char *in, int length, unsigned char *out, int out_len)
 {
    unsigned short t0, t1, t3;
    int len = 0;
+   if (length & 1) {
+      return -1;
+   }
 // .Lproc_802A5958_20: # 802A5978
    while (length != 0) {
       t0 = read_u16_be(in);
       in += 2;
       if ((0x8000 & t0) == 0) {
          unsigned short t2;
+         if (len + 2 > out_len) {
+            return -1;
+         }
          t1 = t0 >> 8;
          t2 = t1 & 0x38;
          t1 = t1 & 0x07;
@@ -270,6 +320,9 @@ int decode_block6(unsigned char *in, int length, unsigned char *out)
          t0 = t0 & 0x7FFF;
          t0 >>= 5;
          length -= 2;
+         if (t0 > len || len + t1 * 2 > out_len) {
+            return -1;
+         }
          t2 = out - t0;
          while (t1 != 0) {
             t3 = read_u16_be(t2);
@@ -284,13 +337,183 @@ int decode_block6(unsigned char *in, int length, unsigned char *out)
    return len;
 }
 
+// expand a run of literal words of given type, same results as the decode_blockN() literal paths
+static void expand_literals(const unsigned char *in, int count, int type, unsigned char *out, const unsigned char *lut)
+{
+   unsigned int t0, t1, t2;
+   int i;
+   switch (type) {
+      case 1: // RGBA5551 with alpha bit from bit 5
+         for (i = 0; i < count; i++) {
+            t0 = (in[2*i] << 8) | in[2*i+1];
+            t1 = ((t0 & 0xFFC0) << 1) | (t0 & 0x3F);
+            out[2*i] = t1 >> 8;
+            out[2*i+1] = t1;
+         }
+         break;
+      case 2: // RGBA32 from 4-bit components
+         for (i = 0; i < count; i++) {
+            out[4*i] = (in[2*i] & 0x78) << 1;
+            out[4*i+1] = ((in[2*i] & 0x07) << 5) | ((in[2*i+1] & 0x80) >> 3);
+            out[4*i+2] = (in[2*i+1] & 0x78) << 1;
+            out[4*i+3] = (in[2*i+1] & 0x07) << 5;
+         }
+         break;
+      case 3: // IA8 pairs
+         for (i = 0; i < 2*count; i++) {
+            out[i] = in[i] << 1;
+         }
+         break;
+      case 4: // IA16 pairs through LUT
+         for (i = 0; i < count; i++) {
+            t1 = read_u16_be(&lut[in[2*i] & 0xFE]);
+            t1 = (t1 << 1) | (in[2*i] & 1);
+            t2 = read_u16_be(&lut[in[2*i+1] & 0xFE]);
+            t2 = (t2 << 1) | (in[2*i+1] & 1);
+            out[4*i] = t1 >> 8;
+            out[4*i+1] = t1;
+            out[4*i+2] = t2 >> 8;
+            out[4*i+3] = t2;
+         }
+         break;
+      case 5: // RGBA32 color through LUT with 4-bit alpha
+         for (i = 0; i < count; i++) {
+            t0 = (in[2*i] << 8) | in[2*i+1];
+            t1 = read_u16_be(&lut[(t0 >> 4) << 1]);
+            out[4*i] = (t1 & 0x7C00) >> 7;
+            out[4*i+1] = (t1 & 0x03E0) >> 2;
+            out[4*i+2] = (t1 & 0x1F) << 3;
+            out[4*i+3] = (t0 & 0xF) << 4;
+         }
+         break;
+      case 6: // IA8 from 3-bit intensity and alpha
+         for (i = 0; i < 2*count; i++) {
+            out[i] = ((in[i] & 0x38) << 2) | ((in[i] & 0x07) << 1);
+         }
+         break;
+   }
+}
+
+// copy count bytes from distance back in the output, matching the one word at a time copy of the game
+static void copy_back(unsigned char *out, unsigned int distance, unsigned int count, unsigned int word)
+{
+   const unsigned char *src = out - distance;
+   unsigned int n;
+   if (distance < word) {
+      // every word read overlaps the word being written
+      for (n = 0; n < count; n += word) {
+         memmove(&out[n], &out[n] - distance, word);
+      }
+      return;
+   }
+   // the copied bytes repeat with period distance, so the source can grow with what was already written
+   while (count > 0) {
+      n = MIN((unsigned int)(out - src), count);
+      memcpy(out, src, n);
+      out += n;
+      count -= n;
+   }
+}
+
+// decoder for types 1-6 that expands literal runs and copies back-references in blocks
+static int decode_fast(const unsigned char *in, int length, int type, unsigned char *out, int out_len,
+                       const unsigned char *lut)
+{
+   unsigned short t0;
+   unsigned int distance;
+   unsigned int count;
+   int word = blast_word_size[type];
+   int len = 0;
+   int run;
+   int i = 0;
+   if (length & 1) {
+      return -1;
+   }
+   while (i < length) {
+      for (run = 0; i + 2*run < length && (in[i + 2*run] & 0x80) == 0; run++);
+      if (run > 0) {
+         if (len + run * word > out_len) {
+            return -1;
+         }
+         expand_literals(&in[i], run, type, &out[len], lut);
+         i += 2 * run;
+         len += run * word;
+         continue;
+      }
+      t0 = read_u16_be(&in[i]);
+      i += 2;
+      // 32-bit types store the lookback offset in half-words
+      distance = (word == 4) ? (t0 & 0x7FE0) >> 4 : (t0 & 0x7FFF) >> 5;
+      count = (t0 & 0x1F) * word;
+      if ((int)distance > len || len + (int)count > out_len) {
+         return -1;
+      }
+      if (distance > 0) {
+         copy_back(&out[len], distance, count, word);
+      }
+      len += count;
+   }
+   return len;
+}
+
+int blast_decode_size(const unsigned char *in, int length, int type)
+{
+   unsigned short t0;
+   unsigned int offset;
+   int word;
+   int size = 0;
+   int i;
+   if (type == 0) {
+      return length;
+   }
+   if (type < 0 || type >= (int)DIM(blast_word_size) || (length & 1)) {
+      return -1;
+   }
+   word = blast_word_size[type];
+   for (i = 0; i < length; i += 2) {
+      t0 = read_u16_be(&in[i]);
+      if ((t0 & 0x8000) == 0) {
+         size += word;
+      } else {
+         // 32-bit types store the lookback offset in half-words
+         offset = (word == 4) ? (t0 & 0x7FE0) >> 4 : (t0 & 0x7FFF) >> 5;
+         if ((int)offset > size) {
+            return -1;
+         }
+         size += (t0 & 0x1F) * word;
+      }
+   }
+   return size;
+}
+
+int blast_decode(const unsigned char *in, int length, int type, unsigned char *out, int out_len, const unsigned char *lut)
+{
+   switch (type) {
+      // a0 - input buffer
+      // a1 - input length
+      // a2 - type (always unused)
+      // a3 - output buffer
+      // t4 - blocks 4 & 5 reference t4 which is set to FP
+      case 0: return decode_block0(in, length, out, out_len);
+      case 1:
+      case 2:
+      case 3:
+      // TODO: need to figure out where last param is set for decoders 4 and 5
+      case 4:
+      case 5:
+      case 6: return decode_fast(in, length, type, out, out_len, lut);
+      default: ERROR("Unknown Blast type %d\n", type); break;
+   }
+   return -1;
+}
+
 int blast_decode_file(char *in_filename, int type, char *out_filename, unsigned char *lut)
 {
    unsigned char *in_buf = NULL;
    unsigned char *out_buf = NULL;
    int in_len;
    int write_len;
-   int out_len = 0;
+   int out_len;
    int ret_val = 0;
 
    in_len = read_file(in_filename, &in_buf);
@@ -298,28 +521,278 @@ int blast_decode_file(char *in_filename, int type, char *out_filename, unsigned
       return 1;
    }
 
-   // estimate worst case size
-   out_buf = malloc(100*in_len);
+   out_len = blast_decode_size(in_buf, in_len, type);
+   if (out_len < 0) {
+      ERROR("Error: corrupt Blast type %d data in %s\n", type, in_filename);
+      ret_val = 3;
+      goto free_all;
+   }
+   // at least one byte so an empty block isn't confused with a failed allocation
+   out_buf = malloc(out_len + 1);
    if (out_buf == NULL) {
       ret_val = 2;
       goto free_all;
    }
 
+   if (blast_decode(in_buf, in_len, type, out_buf, out_len, lut) != out_len) {
+      ERROR("Error: corrupt Blast type %d data in %s\n", type, in_filename);
+      ret_val = 3;
+      goto free_all;
+   }
+
+   write_len = write_file(out_filename, out_buf, out_len);
+   if (write_len != out_len) {
+      ret_val = 2;
+   }
+
+free_all:
+   if (out_buf) {
+      free(out_buf);
+   }
+   if (in_buf) {
+      free(in_buf);
+   }
+
+   return ret_val;
+}
+
+// largest lookback distance and words per back-reference the token fields can hold
+#define BLAST_MAX_DIST_16 0x3FF
+#define BLAST_MAX_DIST_32 0x7FE
+#define BLAST_MAX_COUNT 0x1F
+// candidates checked per position by the match finder
+#define BLAST_MAX_CHAIN 256
+// LUT entries reachable from a literal: first and second half of type 4, color of type 5
+#define BLAST_LUT4_HI 0x40
+#define BLAST_LUT4_LO 0x80
+#define BLAST_LUT5 0x800
+
+// inverse of the type 4 or 5 lookup table: 15-bit value to lowest entry that produces it, -1 if none
+static short *blast_lut_invert(const unsigned char *lut, int type)
+{
+   short *inverse;
+   unsigned int value;
+   int entries = (type == 4) ? BLAST_LUT4_LO : BLAST_LUT5;
+   int i;
+   inverse = malloc(0x8000 * sizeof(*inverse));
+   memset(inverse, 0xFF, 0x8000 * sizeof(*inverse));
+   for (i = entries - 1; i >= 0; i--) {
+      value = read_u16_be(&lut[2*i]) & 0x7FFF;
+      inverse[value] = i;
+   }
+   return inverse;
+}
+
+// literal token that decodes to the word at w, -1 if the type can't represent it
+static int blast_literal(const unsigned char *w, int type, const short *inverse)
+{
+   unsigned int value;
+   int hi, lo;
    switch (type) {
-      // a0 - input buffer
-      // a1 - input length
-      // a2 - type (always unused)
-      // a3 - output buffer
-      // t4 - blocks 4 & 5 reference t4 which is set to FP
-      case 0: out_len = decode_block0(in_buf, in_len, out_buf); break;
-      case 1: out_len = decode_block1(in_buf, in_len, out_buf); break;
-      case 2: out_len = decode_block2(in_buf, in_len, out_buf); break;
-      // TODO: need to figure out where last param is set for decoders 4 and 5
-      case 4: out_len = decode_block4(in_buf, in_len, out_buf, lut); break;
-      case 5: out_len = decode_block5(in_buf, in_len, out_buf, lut); break;
-      case 3: out_len = decode_block3(in_buf, in_len, out_buf); break;
-      case 6: out_len = decode_block6(in_buf, in_len, out_buf); break;
-      default: ERROR("Unknown Blast type %d\n", type); break;
+      case 1: // bit 6 is always clear
+         value = read_u16_be(w);
+         if (value & 0x40) {
+            return -1;
+         }
+         return ((value >> 1) & 0x7FC0) | (value & 0x3F);
+      case 2: // only the high nibble of each byte, and bit 4 of the last one is clear
+         if ((read_u32_be(w) & 0x0F0F0F1F) != 0) {
+            return -1;
+         }
+         return ((w[0] >> 4) << 11) | ((w[1] >> 4) << 7) | ((w[2] >> 4) << 3) | (w[3] >> 5);
+      case 3: // bytes are even
+         if ((w[0] | w[1]) & 1) {
+            return -1;
+         }
+         return ((w[0] >> 1) << 8) | (w[1] >> 1);
+      case 4: // each half is a LUT entry shifted up with the low bit from the token
+         hi = inverse[(read_u16_be(&w[0]) >> 1) & 0x7FFF];
+         lo = inverse[(read_u16_be(&w[2]) >> 1) & 0x7FFF];
+         if (hi < 0 || hi >= BLAST_LUT4_HI || lo < 0) {
+            return -1;
+         }
+         return (((hi << 1) | (w[1] & 1)) << 8) | (lo << 1) | (w[3] & 1);
+      case 5: // RGB555 LUT entry with 4-bit alpha
+         if (((w[0] | w[1] | w[2]) & 0x7) || (w[3] & 0xF)) {
+            return -1;
+         }
+         hi = inverse[((w[0] >> 3) << 10) | ((w[1] >> 3) << 5) | (w[2] >> 3)];
+         if (hi < 0) {
+            return -1;
+         }
+         return (hi << 4) | (w[3] >> 4);
+      case 6: // bits 0 and 4 of each byte are clear
+         if ((w[0] | w[1]) & 0x11) {
+            return -1;
+         }
+         return ((((w[0] >> 2) & 0x38) | ((w[0] >> 1) & 7)) << 8) | ((w[1] >> 2) & 0x38) | ((w[1] >> 1) & 7);
+   }
+   return -1;
+}
+
+// find longest earlier match for data at pos, in whole words
+// head/prev - chains of earlier positions with the same first two bytes
+// max_chain - most candidates to check
+// returns number of words matched (0 if none found) and distance in found_dist
+static int blast_find_match(const unsigned char *in, int length, int pos, int word, const int *head, const int *prev,
+                            int max_chain, int *found_dist)
+{
+   int max_dist = (word == 4) ? BLAST_MAX_DIST_32 : BLAST_MAX_DIST_16;
+   int max_len = MIN(BLAST_MAX_COUNT * word, length - pos);
+   int best_len = 0;
+   int chain;
+   int cand;
+   int dist;
+   int i;
+   *found_dist = 0;
+   if (pos + 2 > length) {
+      return 0;
+   }
+   cand = head[read_u16_be(&in[pos])];
+   for (chain = 0; cand >= 0 && chain < max_chain; cand = prev[cand], chain++) {
+      dist = pos - cand;
+      if (dist > max_dist) {
+         break;
+      }
+      // shorter distances copy whole overlapping words, 32-bit types only store even ones
+      if (dist < word || (word == 4 && (dist & 1))) {
+         continue;
+      }
+      // copies run forward one word at a time, so a match can overlap what it produces
+      for (i = 0; i < max_len && in[cand + i] == in[pos + i]; i++);
+      i -= i % word;
+      if (i > best_len) {
+         best_len = i;
+         *found_dist = dist;
+         if (best_len == max_len) {
+            break;
+         }
+      }
+   }
+   return best_len / word;
+}
+
+int blast_encode_bound(int length, int type)
+{
+   if (type == 0) {
+      return length;
+   }
+   if (type < 0 || type >= (int)DIM(blast_word_size)) {
+      return -1;
+   }
+   // never more than one token per word
+   return length / blast_word_size[type] * 2;
+}
+
+int blast_encode(const unsigned char *in, int length, int type, unsigned char *out, int out_len, const unsigned char *lut)
+{
+   short *inverse = NULL;
+   int *head;
+   int *prev;
+   int word;
+   int literal;
+   int count;
+   int dist;
+   int pos = 0;
+   int added = 0;
+   int len = 0;
+   if (type == 0) {
+      if (length > out_len) {
+         return -1;
+      }
+      memcpy(out, in, length);
+      return length;
+   }
+   if (type < 0 || type >= (int)DIM(blast_word_size)) {
+      ERROR("Unknown Blast type %d\n", type);
+      return -1;
+   }
+   word = blast_word_size[type];
+   if (length % word) {
+      return -1;
+   }
+   if (type == 4 || type == 5) {
+      if (lut == NULL) {
+         return -1;
+      }
+      inverse = blast_lut_invert(lut, type);
+   }
+   head = malloc(0x10000 * sizeof(*head));
+   memset(head, 0xFF, 0x10000 * sizeof(*head));
+   prev = malloc((length + 1) * sizeof(*prev));
+
+   while (pos < length) {
+      for (; added + 2 <= pos; added++) {
+         prev[added] = head[read_u16_be(&in[added])];
+         head[read_u16_be(&in[added])] = added;
+      }
+      if (len + 2 > out_len) {
+         len = -1;
+         break;
+      }
+      count = blast_find_match(in, length, pos, word, head, prev, BLAST_MAX_CHAIN, &dist);
+      literal = blast_literal(&in[pos], type, inverse);
+      // words only a copy can produce may be further back than the usual search goes
+      if (count == 0 && literal < 0) {
+         count = blast_find_match(in, length, pos, word, head, prev, length, &dist);
+      }
+      // a single word costs the same either way, keep literals when possible
+      if (count > 1 || (count == 1 && literal < 0)) {
+         if (word == 4) {
+            write_u16_be(&out[len], 0x8000 | ((dist >> 1) << 5) | count);
+         } else {
+            write_u16_be(&out[len], 0x8000 | (dist << 5) | count);
+         }
+         pos += count * word;
+      } else if (literal >= 0) {
+         write_u16_be(&out[len], literal);
+         pos += word;
+      } else {
+         // nothing earlier matches and the word can't be stored as a literal
+         len = -1;
+         break;
+      }
+      len += 2;
+   }
+
+   free(prev);
+   free(head);
+   if (inverse) {
+      free(inverse);
+   }
+   return len;
+}
+
+int blast_encode_file(char *in_filename, int type, char *out_filename, unsigned char *lut)
+{
+   unsigned char *in_buf = NULL;
+   unsigned char *out_buf = NULL;
+   int in_len;
+   int write_len;
+   int out_len;
+   int ret_val = 0;
+
+   in_len = read_file(in_filename, &in_buf);
+   if (in_len < 0) {
+      return 1;
+   }
+
+   out_len = blast_encode_bound(in_len, type);
+   if (out_len < 0) {
+      ret_val = 3;
+      goto free_all;
+   }
+   out_buf = malloc(out_len + 1);
+   if (out_buf == NULL) {
+      ret_val = 2;
+      goto free_all;
+   }
+
+   out_len = blast_encode(in_buf, in_len, type, out_buf, out_len, lut);
+   if (out_len < 0) {
+      ERROR("Error: %s can't be stored as Blast type %d\n", in_filename, type);
+      ret_val = 3;
+      goto free_all;
    }
 
    write_len = write_file(out_filename, out_buf, out_len);
@@ -346,6 +819,8 @@ free_all:
 
 #include "n64graphics.h"
 
+#define BLAST_VERSION "0.2"
+
 typedef struct
 {
    unsigned char *w0; // source ptr
@@ -354,6 +829,18 @@ typedef struct
    unsigned int wC;
 } block_t;
 
+// lookup table in ROM used by types 4 and 5
+static unsigned char *rom_lut(unsigned char *rom, unsigned int type)
+{
+   switch (type) {
+      case 4: return &rom[0x047480];
+      //case 5: return &rom[0x0998E0];
+      case 5: return &rom[0x152970];
+      //case 5: return &rom[0x1E2C00];
+      default: return rom;
+   }
+}
+
 // 802A57DC (06101C)
 // a0 is only real parameters in ROM
 int proc_802A57DC(block_t *a0, unsigned char **copy, unsigned char *rom)
@@ -361,40 +848,29 @@ int proc_802A57DC(block_t *a0, unsigned char **copy, unsigned char *rom)
    unsigned char *src;
    unsigned int len;
    unsigned int type;
+   unsigned char *lut;
+   int out_len;
    int v0 = -1;
 
    len = a0->w4;
-   *copy = malloc(100*len);
    src = a0->w0;
-
    type = a0->w8;
-   switch (type) {
-      // a0 - input buffer
-      // a1 - input length
-      // a2 - type (always unused)
-      // a3 - output buffer
-      // t4 - blocks 4 & 5 reference t4 which is set to FP
-      case 0: v0 = decode_block0(src, len, *copy); break;
-      case 1: v0 = decode_block1(src, len, *copy); break;
-      case 2: v0 = decode_block2(src, len, *copy); break;
-      // TODO: need to figure out where last param is set for decoders 4 and 5
-      case 4: v0 = decode_block4(src, len, *copy, &rom[0x047480]); break;
-      //case 5: v0 = decode_block5(src, len, *copy, &rom[0x0998E0]); break;
-      case 5: v0 = decode_block5(src, len, *copy, &rom[0x152970]); break;
-      //case 5: v0 = decode_block5(src, len, *copy, &rom[0x1E2C00]); break;
-      case 3: v0 = decode_block3(src, len, *copy); break;
-      case 6: v0 = decode_block6(src, len, *copy); break;
-      default: printf("Need type %d\n", type); break;
+   lut = rom_lut(rom, type);
+   out_len = blast_decode_size(src, len, type);
+   if (out_len < 0) {
+      printf("Bad type %d block\n", type);
+      *copy = NULL;
+      return -1;
    }
+   *copy = malloc(out_len + 1);
+   v0 = blast_decode(src, len, type, *copy, out_len, lut);
    return v0;
 }
 
-static void convert_to_png(char *fname, unsigned short len, unsigned short type)
+static void convert_to_png(char *fname, const unsigned char *raw, unsigned short len, unsigned short type)
 {
    char pngname[512];
    int height, width, depth;
-   rgba *rimg;
-   ia   *img;
    generate_filename(fname, pngname, "png");
    switch (type) {
       case 0:
@@ -412,8 +888,7 @@ static void convert_to_png(char *fname, unsigned short len, unsigned short type)
             default:   width = 32; height = len/width/2; break;
          }
          // RGBA16
-         rimg = file2rgba(fname, 0, width, height, 16);
-         if (rimg) rgba2png(rimg, width, height, pngname);
+         raw2png(pngname, raw, IMG_FORMAT_RGBA, width, height, 16);
          break;
       case 2:
          // guess at dims
@@ -425,8 +900,7 @@ static void convert_to_png(char *fname, unsigned short len, unsigned short type)
             default: width = 32; height = len/width/4; break;
          }
          // RGBA32
-         rimg = file2rgba(fname, 0, width, height, 32);
-         if (rimg) rgba2png(rimg, width, height, pngname);
+         raw2png(pngname, raw, IMG_FORMAT_RGBA, width, height, 32);
          break;
       case 3:
          // guess at dims
@@ -437,8 +911,7 @@ static void convert_to_png(char *fname, unsigned short len, unsigned short type)
             default: width = 32; height = len/width; break;
          }
          // IA8
-         img = file2ia(fname, 0, width, height, 8);
-         if (img) ia2png(img, width, height, pngname);
+         raw2png(pngname, raw, IMG_FORMAT_IA, width, height, 8);
          break;
       case 4:
          // guess at dims
@@ -450,8 +923,7 @@ static void convert_to_png(char *fname, unsigned short len, unsigned short type)
             default: width = 32; height = len/width/2; break;
          }
          // IA16
-         img = file2ia(fname, 0, width, height, 16);
-         if (img) ia2png(img, width, height, pngname);
+         raw2png(pngname, raw, IMG_FORMAT_IA, width, height, 16);
          break;
       case 5:
          // guess at dims
@@ -463,8 +935,7 @@ static void convert_to_png(char *fname, unsigned short len, unsigned short type)
             default: width = 32; height = len/width/2; break;
          }
          // RGBA32
-         rimg = file2rgba(fname, 0, width, height, 32);
-         if (rimg) rgba2png(rimg, width, height, pngname);
+         raw2png(pngname, raw, IMG_FORMAT_RGBA, width, height, 32);
          break;
       case 6:
          // guess at dims
@@ -472,13 +943,32 @@ static void convert_to_png(char *fname, unsigned short len, unsigned short type)
          width = 16;
          height = (len*8/depth)/width;
          // IA8
-         img = file2ia(fname, 0, width, height, depth);
-         if (img) ia2png(img, width, height, pngname);
+         raw2png(pngname, raw, IMG_FORMAT_IA, width, height, depth);
          break;
    }
 }
 
-int main(int argc, char *argv[])
+// check that a decoded block encodes back to data that decodes the same
+static int verify_block(const unsigned char *raw, int raw_len, unsigned int type, const unsigned char *lut)
+{
+   unsigned char *enc;
+   unsigned char *dec;
+   int enc_len;
+   int ret_val = -1;
+   enc = malloc(blast_encode_bound(raw_len, type) + 1);
+   dec = malloc(raw_len + 1);
+   enc_len = blast_encode(raw, raw_len, type, enc, blast_encode_bound(raw_len, type), lut);
+   if (enc_len >= 0 && blast_decode(enc, enc_len, type, dec, raw_len, lut) == raw_len &&
+       !memcmp(raw, dec, raw_len)) {
+      ret_val = enc_len;
+   }
+   free(dec);
+   free(enc);
+   return ret_val;
+}
+
+// extract all blocks from a Blast Corps ROM and check that each one re-encodes
+static int extract_rom(char *rom_filename)
 {
 #define ROM_OFFSET 0x4CE0
 #define END_OFFSET 0xCCE0
@@ -487,15 +977,19 @@ int main(int argc, char *argv[])
    unsigned char *data;
    long size;
    int out_size;
+   int enc_size;
+   int blocks = 0;
+   int verified = 0;
    unsigned int off;
    unsigned char *out;
    int width, height, depth;
    char *format;
 
-   if (argc < 2) return 1;
-
    // read in Blast Corps ROM
-   size = read_file(argv[1], &data);
+   size = read_file(rom_filename, &data);
+   if (size < END_OFFSET) {
+      return 1;
+   }
 
    // loop through from 0x4CE0 to 0xCCE0
    for (off = ROM_OFFSET; off < END_OFFSET; off += 8) {
@@ -510,8 +1004,21 @@ int main(int argc, char *argv[])
          block.w8 = type;
          //printf("%X (%X) %X %d\n", start, start+ROM_OFFSET, len, type);
          out_size = proc_802A57DC(&block, &out, data);
+         if (out_size < 0) {
+            ERROR("Error: bad block at %X type %d\n", start+ROM_OFFSET, type);
+            free(out);
+            continue;
+         }
+         blocks++;
+         enc_size = verify_block(out, out_size, type, rom_lut(data, type));
+         if (enc_size < 0) {
+            ERROR("Error: block at %X type %d does not re-encode\n", start+ROM_OFFSET, type);
+         } else {
+            verified++;
+            INFO("Block at %X type %d: %X -> %X re-encoded to %X\n", start+ROM_OFFSET, type, len, out_size, enc_size);
+         }
          sprintf(out_fname, "%s.%06X.%d.bin",
-               argv[1], start, type);
+               rom_filename, start, type);
          //printf("writing %s: %04X -> %04X\n", out_fname, len, out_size);
          depth = 0;
          switch (type) {
@@ -599,13 +1106,296 @@ int main(int argc, char *argv[])
          }
          write_file(out_fname, out, out_size);
          // attempt to convert to PNG
-         convert_to_png(out_fname, out_size, type);
+         convert_to_png(out_fname, out, out_size, type);
+         free(out);
       }
    }
 
    free(data);
+   printf("%d of %d blocks re-encoded\n", verified, blocks);
 
-   return 0;
+   return verified == blocks ? 0 : 3;
+}
+
+typedef struct
+{
+   char *in_filename;
+   char *out_filename;
+   char *lut_filename;
+   unsigned int lut_offset;
+   int type;
+   int compress;
+} arg_config;
+
+static arg_config default_config =
+{
+   NULL,
+   NULL,
+   NULL,
+   0,
+   -1,
+   0
+};
+
+static void print_usage(void)
+{
+   ERROR("Usage: blast [-c TYPE / -d TYPE] [-l LUT] [-o OFFSET] FILE [OUTPUT]\n"
+         "\n"
+         "blast v" BLAST_VERSION ": Blast Corps compression and decompression tool\n"
+         "\n"
+         "Optional arguments:\n"
+         " -c TYPE      compress raw data into Blast type 0-6\n"
+         " -d TYPE      decompress Blast type 0-6 into raw data\n"
+         " -l LUT       file with the lookup table for types 4 and 5, e.g. the ROM\n"
+         " -o OFFSET    offset of the lookup table in LUT (default: 0)\n"
+         "\n"
+         "File arguments:\n"
+         " FILE        input file, with no -c or -d a Blast Corps ROM to extract and\n"
+         "             re-encode all blocks from\n"
+         " [OUTPUT]    output file (default: FILE.out)\n");
+   exit(1);
+}
+
+// parse command line arguments
+static void parse_arguments(int argc, char *argv[], arg_config *config)
+{
+   int i;
+   int file_count = 0;
+   if (argc < 2) {
+      print_usage();
+   }
+   for (i = 1; i < argc; i++) {
+      if (argv[i][0] == '-') {
+         switch (argv[i][1]) {
+            case 'c':
+            case 'd':
+               config->compress = argv[i][1] == 'c';
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->type = strtol(argv[i], NULL, 0);
+               if (config->type < 0 || config->type >= (int)DIM(blast_word_size)) {
+                  print_usage();
+               }
+               break;
+            case 'l':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->lut_filename = argv[i];
+               break;
+            case 'o':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->lut_offset = strtoul(argv[i], NULL, 0);
+               break;
+            default:
+               print_usage();
+               break;
+         }
+      } else {
+         switch (file_count) {
+            case 0:
+               config->in_filename = argv[i];
+               break;
+            case 1:
+               config->out_filename = argv[i];
+               break;
+            default: // too many
+               print_usage();
+               break;
+         }
+         file_count++;
+      }
+   }
+   if (file_count < 1) {
+      print_usage();
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   char out_filename[FILENAME_MAX];
+   arg_config config;
+   unsigned char *lut_data = NULL;
+   unsigned char *lut = NULL;
+   long lut_len;
+   int ret_val;
+
+   // get configuration from arguments
+   config = default_config;
+   parse_arguments(argc, argv, &config);
+   if (config.type < 0) {
+      return extract_rom(config.in_filename);
+   }
+   if (config.out_filename == NULL) {
+      config.out_filename = out_filename;
+      sprintf(config.out_filename, "%s.out", config.in_filename);
+   }
+   if (config.type == 4 || config.type == 5) {
+      if (config.lut_filename == NULL) {
+         ERROR("Error: Blast type %d needs a lookup table\n", config.type);
+         return 1;
+      }
+      lut_len = read_file(config.lut_filename, &lut_data);
+      // type 5 literals index up to 0x800 half-word entries
+      if (lut_len < 0 || config.lut_offset + 0x1000 > (unsigned long)lut_len) {
+         ERROR("Error reading lookup table at 0x%X from \"%s\"\n", config.lut_offset, config.lut_filename);
+         return 1;
+      }
+      lut = &lut_data[config.lut_offset];
+   }
+
+   // operation
+   if (config.compress) {
+      ret_val = blast_encode_file(config.in_filename, config.type, config.out_filename, lut);
+   } else {
+      ret_val = blast_decode_file(config.in_filename, config.type, config.out_filename, lut);
+   }
+
+   switch (ret_val) {
+      case 1:
+         ERROR("Error opening input file \"%s\"\n", config.in_filename);
+         break;
+      case 2:
+         ERROR("Error writing to output file \"%s\"\n", config.out_filename);
+         break;
+   }
+
+   if (lut_data) {
+      free(lut_data);
+   }
+
+   return ret_val;
 }
 
 #endif // BLAST_STANDALONE
+
+#ifdef BLAST_TEST
+#include <stdio.h>
+
+static unsigned int test_seed = 1;
+
+static unsigned int test_rand(void)
+{
+   test_seed = test_seed * 1103515245 + 12345;
+   return test_seed >> 8;
+}
+
+// random stream of literals and back-references, corrupt ones can look back past the start
+// min_dist - shortest distance to look back, 0 includes copies that overlap a whole word
+static int test_stream(unsigned char *in, int max_words, int type, int corrupt, int min_dist)
+{
+   int word = blast_word_size[type];
+   int max_dist = (word == 4) ? 0x7FE : 0x3FF;
+   int length = (test_rand() % max_words) * 2;
+   int out = 0;
+   int dist;
+   int i;
+   unsigned short t;
+   for (i = 0; i < length; i += 2) {
+      if (out == 0 || (test_rand() & 1)) {
+         t = test_rand() & 0x7FFF;
+         out += word;
+      } else {
+         // favor short distances that overlap the words being copied
+         dist = (test_rand() & 1) ? 8 : max_dist;
+         dist = MIN(out, dist);
+         dist = min_dist + (int)(test_rand() % (dist - min_dist + 1));
+         if (corrupt && (test_rand() & 7) == 0) {
+            dist = max_dist;
+         }
+         if (word == 4) {
+            t = 0x8000 | ((dist >> 1) << 5) | (test_rand() & 0x1F);
+         } else {
+            t = 0x8000 | (dist << 5) | (test_rand() & 0x1F);
+         }
+         out += (t & 0x1F) * word;
+      }
+      write_u16_be(&in[i], t);
+   }
+   return length;
+}
+
+// encode decoded output and check that it decodes back to the same data
+static int test_round_trip(const unsigned char *raw, int raw_len, int type, const unsigned char *lut)
+{
+   static unsigned char enc[0x10000];
+   static unsigned char dec[0x10000];
+   int enc_len;
+   enc_len = blast_encode(raw, raw_len, type, enc, blast_encode_bound(raw_len, type), lut);
+   if (enc_len < 0) {
+      return -1;
+   }
+   if (blast_decode(enc, enc_len, type, dec, raw_len, lut) != raw_len || memcmp(raw, dec, raw_len)) {
+      ERROR("Round trip mismatch type %d length %d\n", type, raw_len);
+      return 1;
+   }
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   static unsigned char lut[0x10000];
+   static unsigned char in[0x800];
+   static unsigned char ref[0x10000];
+   static unsigned char out[0x10000];
+   int iterations = 20000;
+   int failures = 0;
+   int round_trip;
+   int length;
+   int size;
+   int ret_ref;
+   int ret_out;
+   int type;
+   int i;
+
+   if (argc > 1) {
+      iterations = strtol(argv[1], NULL, 0);
+   }
+   for (i = 0; i < (int)sizeof(lut); i++) {
+      lut[i] = test_rand();
+   }
+   for (i = 0; i < iterations; i++) {
+      type = 1 + i % 6;
+      length = test_stream(in, sizeof(in) / 2, type, (i % 10) == 0, 0);
+      size = blast_decode_size(in, length, type);
+      // sometimes short of the space needed
+      size = (size > 0 && (test_rand() & 7) == 0) ? size - 1 : MIN(size, (int)sizeof(out));
+      if (size < 0) {
+         size = sizeof(out);
+      }
+      memset(ref, 0x55, sizeof(ref));
+      memset(out, 0x55, sizeof(out));
+      switch (type) {
+         case 1: ret_ref = decode_block1(in, length, ref, size); break;
+         case 2: ret_ref = decode_block2(in, length, ref, size); break;
+         case 3: ret_ref = decode_block3(in, length, ref, size); break;
+         case 4: ret_ref = decode_block4(in, length, ref, size, lut); break;
+         case 5: ret_ref = decode_block5(in, length, ref, size, lut); break;
+         default: ret_ref = decode_block6(in, length, ref, size); break;
+      }
+      ret_out = blast_decode(in, length, type, out, size, lut);
+      if (ret_ref != ret_out || (ret_ref >= 0 && memcmp(ref, out, ret_ref))) {
+         if (failures < 10) {
+            ERROR("Mismatch type %d length %d: reference %d, fast %d\n", type, length, ret_ref, ret_out);
+         }
+         failures++;
+      }
+      // anything decoded without copies of whole overlapping words can be encoded again
+      length = test_stream(in, sizeof(in) / 4, type, 0, blast_word_size[type]);
+      ret_ref = blast_decode(in, length, type, ref, sizeof(ref), lut);
+      round_trip = test_round_trip(ref, ret_ref, type, lut);
+      if (round_trip != 0) {
+         if (failures < 10) {
+            ERROR("Round trip failed type %d length %d\n", type, ret_ref);
+         }
+         failures++;
+      }
+   }
+   printf("%d/%d streams match and re-encode\n", iterations - failures, iterations);
+
+   return failures != 0;
+}
+#endif // BLAST_TEST
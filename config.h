@@ -1,6 +1,8 @@
 #ifndef CONFIG_H_
 #define CONFIG_H_
 
+#include <stdio.h>
+
 typedef enum
 {
    TYPE_INVALID,
@@ -32,10 +34,13 @@ typedef enum
    TYPE_SM64_LEVEL,
 } section_type;
 
+// strings in a rom_config point into its string pool and are shared when identical
+typedef struct _string_pool string_pool;
+
 typedef struct _label
 {
    unsigned int ram_addr;
-   char name[2048];
+   const char *name;
 } label;
 
 typedef struct _texture
@@ -50,12 +55,12 @@ typedef struct _texture
 
 typedef struct _split_section
 {
-   char label[512];
+   const char *label;
    unsigned int start;
    unsigned int end;
    unsigned int vaddr;
    section_type type;
-   char section_name[512];
+   const char *section_name;
 
    int subtype;
 
@@ -66,10 +71,16 @@ typedef struct _split_section
    int child_count;
 } split_section;
 
+typedef struct _section_index
+{
+   unsigned int addr;
+   int section;
+} section_index;
+
 typedef struct _rom_config
 {
-   char name[128];
-   char basename[128];
+   const char *name;
+   const char *basename;
 
    unsigned int checksum1;
    unsigned int checksum2;
@@ -79,13 +90,61 @@ typedef struct _rom_config
 
    label *labels;
    int label_count;
+
+   // sorted by address, built by config_index_sections()
+   section_index *start_index;
+   section_index *end_index;
+
+   // behavior children by offset, built by config_index_behaviors()
+   int behavior_section;             // index of the TYPE_SM64_BEHAVIOR section, -1 if none
+   int *behavior_index;              // child index + 1 per hash slot, 0 if empty
+   unsigned int behavior_index_size; // number of slots, power of 2
+
+   // backing storage for all strings above
+   string_pool *strings;
 } rom_config;
 
+// load config from YAML file or from binary file written by config_compile()
 int config_parse_file(const char *filename, rom_config *config);
+
+// write config to a compact binary file with a shared string table
+// the result loads through config_parse_file() without any YAML parsing
+// returns 0 on success, negative on error
+int config_compile(const rom_config *config, const char *filename);
+
 void config_print(const rom_config *config);
+// check sections are in range and do not overlap, labels and behaviors are unique
+// out-of-order sections are moved up and invalid ranges emptied
+// max_len: length of ROM the sections must fit in
+// returns 0 if valid, negative on error
 int config_validate(const rom_config *config, unsigned int max_len);
+
+// same as config_validate() and also writes each problem found to 'report' as a tab-separated line:
+//   KIND INDEX NAME START END OTHER_INDEX OTHER_NAME OTHER_START OTHER_END
+// KIND: past_end (OTHER_END is max_len), invalid_range, overlap, duplicate_label_address,
+//       duplicate_label_name, duplicate_behavior_offset, duplicate_behavior_name
+// labels give ram_addr as START and END, OTHER_INDEX is -1 when there is no other item
+int config_validate_report(const rom_config *config, unsigned int max_len, FILE *report);
 void config_free(rom_config *config);
 
+// build sorted start and end address indexes of the top-level sections
+// call once sections are final, e.g. after config_validate()
+void config_index_sections(rom_config *config);
+
+// find section starting (is_end = 0) or ending (is_end = 1) at addr
+// if several match, the first in config order is returned
+// returns section index or -1 if not found
+int config_find_section(const rom_config *config, unsigned int addr, int is_end);
+
+// locate the behavior section and hash its children by offset
+// behaviors are not touched by config_validate(), so this may be called before it
+void config_index_behaviors(rom_config *config);
+
+// find behavior at offset from the start of the behavior section
+// if several match, the first in config order is returned
+// returns behavior or NULL if not found
+const split_section *config_find_behavior(const rom_config *config, unsigned int offset);
+
 section_type config_str2section(const char *type_name);
 const char *config_section2str(section_type section);
 
@@ -36,15 +36,6 @@ typedef struct
    int v_idx_offset;
 } arg_config;
 
-typedef enum
-{
-   IMG_FORMAT_RGBA,
-   IMG_FORMAT_YUV,
-   IMG_FORMAT_CI,
-   IMG_FORMAT_IA,
-   IMG_FORMAT_I,
-} img_format;
-
 static arg_config default_config =
 {
    {0},
@@ -171,6 +162,9 @@ static void add_texture(texture const * const tex)
    texture_count++;
 }
 
+// largest decoded Blast Corps texture: 256x256 RGBA32
+#define BLAST_TEXTURE_MAX (4*256*256)
+
 static void generate_material_file(arg_config *config, char *mtl_filename, char *texture_dir)
 {
    char texture_path[FILENAME_MAX];
@@ -190,7 +184,7 @@ static void generate_material_file(arg_config *config, char *mtl_filename, char
          perror("Error opening ROM file");
          exit(EXIT_FAILURE);
       }
-      img_raw = malloc(4*256*256);
+      img_raw = malloc(BLAST_TEXTURE_MAX);
    }
    fmtl = fopen(mtl_filename, "w");
    if (fmtl) {
@@ -240,17 +234,22 @@ static void generate_material_file(arg_config *config, char *mtl_filename, char
             INFO("Decoding texture %06X->%06X (%d x %d) type %d\n",
                   t->address, rom_addr, t->width, t->height, text_type);
             switch (text_type) {
-               case 0: retval = decode_block0(&rom[rom_addr], length, img_raw); break;
-               case 1: retval = decode_block1(&rom[rom_addr], length, img_raw); break;
-               case 2: retval = decode_block2(&rom[rom_addr], length, img_raw); break;
-               case 3: retval = decode_block3(&rom[rom_addr], length, img_raw); break;
-               case 6: retval = decode_block6(&rom[rom_addr], length, img_raw); break;
+               case 0:
+               case 1:
+               case 2:
+               case 3:
+               case 6:
+                  retval = blast_decode(&rom[rom_addr], length, text_type, img_raw, BLAST_TEXTURE_MAX, NULL);
+                  break;
                default:
                   ERROR("Blast Corps texture %d not supported for %X->%X\n",
                         text_type, t->address, rom_addr);
                   exit(EXIT_FAILURE);
                   break;
             }
+            if (retval < 0) {
+               ERROR("Error decoding Blast Corps texture %X->%X type %d\n", t->address, rom_addr, text_type);
+            }
             if (retval > 0) {
                switch (text_type) {
                   case 0: // IA8
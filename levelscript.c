@@ -0,0 +1,488 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "levelscript.h"
+#include "utils.h"
+
+#define VISITED_EMPTY 0xFFFFFFFF
+
+#define LOAD_FIELDS {{0x03, FIELD_SEGMENT}, {0x04, FIELD_ROM_START}, {0x08, FIELD_ROM_END}}
+#define NO_REF       LEVEL_REF_NONE
+
+static const script_cmd level_cmd_table[] =
+{
+   [0x00] = {"LoadJump0", 0x10, LEVEL_REF_SCRIPT, LOAD_FIELDS},   // load and jump from ROM into a RAM segment
+   [0x01] = {"LoadJump1", 0x10, LEVEL_REF_SCRIPT, LOAD_FIELDS},   // load and jump from ROM into a RAM segment
+   [0x02] = {"EndLevel",  0x04, NO_REF},             // end of level layout data
+   [0x03] = {"Delay03",   0x04, NO_REF},             // delay frames
+   [0x04] = {"Delay04",   0x04, NO_REF},             // delay frames and signal end
+   [0x05] = {"JumpSeg",   0x08, LEVEL_REF_JUMP, {{0x04, FIELD_SEG_ADDR}}}, // jump to level script at segmented address
+   [0x06] = {"PushJump",  0x08, LEVEL_REF_JUMP, {{0x04, FIELD_SEG_ADDR}}}, // push script stack and jump to segmented address
+   [0x07] = {"PopScript", 0x04, NO_REF},             // pop script stack, return to prev 0x06 or 0x0C
+   [0x08] = {"Push16",    0x04, NO_REF},             // push script stack and 16-bit value
+   [0x09] = {"Pop16",     0x04, NO_REF},             // pop script stack and 16-bit value
+   [0x0A] = {"PushNull",  0x04, NO_REF},             // push script stack and 32-bit 0x00000000
+   [0x0B] = {"CondPop",   0x08, NO_REF},             // conditional stack pop
+   [0x0C] = {"CondJump",  0x0C, LEVEL_REF_JUMP, {{0x08, FIELD_SEG_ADDR}}}, // conditional jump to segmented address
+   [0x0D] = {"CondPush",  0x0C, NO_REF},             // conditional stack push
+   [0x0E] = {"CondSkip",  0x08, NO_REF},             // conditional skip over following 0x0F and 0x10 commands
+   [0x0F] = {"SkipNext",  0x04, NO_REF},             // skip over following 0x10 commands
+   [0x10] = {"NoOp",      0x04, NO_REF},             // no operation
+   [0x11] = {"AccumAsm1", 0x08, LEVEL_REF_ASM_CALL, {{0x04, FIELD_CALL}}}, // set accumulator from ASM function
+   [0x12] = {"AccumAsm2", 0x08, LEVEL_REF_ASM_CALL, {{0x04, FIELD_CALL}}}, // actively set accumulator from ASM function
+   [0x13] = {"SetAccum",  0x04, NO_REF},             // set accumulator to constant value
+   [0x14] = {"PushPool",  0x04, NO_REF},             // push pool state
+   [0x15] = {"PopPool",   0x04, NO_REF},             // pop pool state
+   [0x16] = {"LoadASM",   0x10, LEVEL_REF_ASM_LOAD,  // load ASM into RAM
+             {{0x04, FIELD_RAM_DST}, {0x08, FIELD_ROM_START}, {0x0C, FIELD_ROM_END}}},
+   [0x17] = {"ROM->Seg",  0x0C, LEVEL_REF_RAW, LOAD_FIELDS},      // copy uncompressed data from ROM to a RAM segment
+   [0x18] = {"MIO0->Seg", 0x0C, LEVEL_REF_MIO0, LOAD_FIELDS},     // decompress MIO0 data from ROM and copy it into a RAM segment
+   [0x19] = {"MarioFace", 0x04, NO_REF},             // create Mario face for demo screen
+   [0x1A] = {"MIO0Textr", 0x0C, LEVEL_REF_MIO0_TEX, LOAD_FIELDS}, // decompress MIO0 data from ROM and copy it into a RAM segment (for texture only segments?)
+   [0x1B] = {"StartLoad", 0x04, NO_REF},             // start RAM loading sequence (before 17, 18, 1A)
+   [0x1D] = {"EndLoad",   0x04, NO_REF},             // end RAM loading sequence (after 17, 18, 1A)
+   [0x1F] = {"StartArea", 0x08, LEVEL_REF_GEO, {{0x04, FIELD_SEG_ADDR}}},  // start of an area
+   [0x20] = {"EndArea",   0x04, NO_REF},             // end of an area
+   [0x21] = {"LoadPoly",  0x08, LEVEL_REF_DL, {{0x04, FIELD_SEG_ADDR}}},   // load polygon data without geo layout
+   [0x22] = {"LdPolyGeo", 0x08, LEVEL_REF_GEO, {{0x04, FIELD_SEG_ADDR}}},  // load polygon data with geo layout
+   [0x24] = {"PlaceObj",  0x18, LEVEL_REF_BEHAVIOR, {{0x14, FIELD_BEHAVIOR}}}, // place object in level with behavior
+   [0x25] = {"LoadMario", 0x0C, LEVEL_REF_BEHAVIOR, {{0x08, FIELD_BEHAVIOR}}}, // load mario object with behavior
+   [0x26] = {"ConctWarp", 0x08, NO_REF},             // connect warps
+   [0x27] = {"PaintWarp", 0x08, NO_REF},             // level warps for paintings
+   [0x28] = {"Transport", 0x0C, NO_REF},             // transport Mario to an area
+   [0x2B] = {"MarioStrt", 0x0C, NO_REF},             // Mario's default position
+   [0x2E] = {"Collision", 0x08, LEVEL_REF_COLLISION, {{0x04, FIELD_SEG_ADDR}}}, // load collision data
+   [0x2F] = {"RendrArea", 0x08, NO_REF},             // decide which area of level geo to render
+   [0x31] = {"Terrain",   0x04, NO_REF},             // set default terrain type
+   [0x33] = {"FadeColor", 0x08, NO_REF},             // fade/overlay screen with color
+   [0x34] = {"Blackout",  0x04, NO_REF},             // blackout screen
+   [0x36] = {"Music36",   0x08, NO_REF},             // set music
+   [0x37] = {"Music37",   0x04, NO_REF},             // set music
+   [0x39] = {"MulObject", 0x08, LEVEL_REF_MACRO, {{0x04, FIELD_SEG_ADDR}}}, // multiple objects from main level segment
+   [0x3B] = {"JetStream", 0x0C, NO_REF},             // define jet streams that repulse / pull Mario
+   [0x3C] = {"GetPut",    0x04, NO_REF},             // get/put remote value
+};
+
+// geo layout 0x10 layouts, selected by bits 4-6 of byte 1
+static const script_cmd geo_translate_table[] =
+{
+   [0x0] = {"geo_translate_rotate", 0x10, NO_REF, // translate & rotate
+            {{0x01, FIELD_LAYER}, {0x04, FIELD_S16}, {0x06, FIELD_S16}, {0x08, FIELD_S16},
+             {0x0A, FIELD_S16}, {0x0C, FIELD_S16}, {0x0E, FIELD_S16}}, 0, 0x80, FIELD_DL},
+   [0x1] = {"geo_translate",        0x08, NO_REF, // translate
+            {{0x01, FIELD_LAYER}, {0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}}, 0, 0x80, FIELD_DL},
+   [0x2] = {"geo_rotate",           0x08, NO_REF, // rotate
+            {{0x01, FIELD_LAYER}, {0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}}, 0, 0x80, FIELD_DL},
+   [0x3] = {"geo_rotate_y",         0x04, NO_REF, // rotate Y
+            {{0x01, FIELD_LAYER}, {0x02, FIELD_S16}}, 0, 0x80, FIELD_DL},
+   [0x7] = {NULL, 0, NO_REF},
+};
+
+// geo layout commands, fields are the arguments of the macros in geo_commands.inc
+static const script_cmd geo_cmd_table[] =
+{
+   [0x00] = {"geo_branch_and_link",   0x08, NO_REF, {{0x04, FIELD_GEO}}},
+   [0x01] = {"geo_end",               0x04, NO_REF, {{0}}, SCRIPT_CMD_CLOSE | SCRIPT_CMD_END},
+   [0x02] = {"geo_branch",            0x08, NO_REF, {{0x01, FIELD_U8}, {0x04, FIELD_GEO}}},
+   [0x03] = {"geo_return",            0x04, NO_REF, {{0}}, SCRIPT_CMD_END},
+   [0x04] = {"geo_open_node",         0x04, NO_REF, {{0}}, SCRIPT_CMD_OPEN},
+   [0x05] = {"geo_close_node",        0x04, NO_REF, {{0}}, SCRIPT_CMD_CLOSE},
+   [0x06] = {"geo_todo_06",           0x04, NO_REF, {{0x02, FIELD_S16}}},
+   [0x07] = {"geo_update_node_flags", 0x04, NO_REF, {{0x01, FIELD_U8}, {0x02, FIELD_S16}}},
+   [0x08] = {"geo_node_screen_area",  0x0C, NO_REF,
+             {{0x03, FIELD_U8}, {0x04, FIELD_S16}, {0x06, FIELD_S16}, {0x08, FIELD_S16}, {0x0A, FIELD_S16}},
+             SCRIPT_CMD_OPEN},
+   [0x09] = {"geo_todo_09",           0x04, NO_REF, {{0x03, FIELD_U8}}},
+   [0x0A] = {"geo_camera_frustum",    0x08, NO_REF, // function when byte 1 is nonzero
+             {{0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}}, 0, 0xFF, FIELD_FUNC},
+   [0x0B] = {"geo_node_start",        0x04, NO_REF},
+   [0x0C] = {"geo_zbuffer",           0x04, NO_REF, {{0x01, FIELD_U8}}},
+   [0x0D] = {"geo_render_range",      0x08, NO_REF, {{0x04, FIELD_S16}, {0x06, FIELD_S16}}},
+   [0x0E] = {"geo_switch_case",       0x08, NO_REF, {{0x02, FIELD_S16}, {0x04, FIELD_SWITCH}}},
+   [0x0F] = {"geo_todo_0F",           0x14, NO_REF,
+             {{0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}, {0x08, FIELD_S16},
+              {0x0A, FIELD_S16}, {0x0C, FIELD_S16}, {0x0E, FIELD_S16}, {0x10, FIELD_FUNC}}},
+   [0x10] = {"geo_translate_rotate",  0x10, NO_REF, {{0}}, 0, 0, 0, 4, geo_translate_table},
+   [0x11] = {"geo_todo_11",           0x08, NO_REF,
+             {{0x01, FIELD_LAYER_HEX}, {0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}}, 0, 0x80, FIELD_FUNC},
+   [0x12] = {"geo_todo_12",           0x08, NO_REF,
+             {{0x01, FIELD_LAYER_HEX}, {0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}}, 0, 0x80, FIELD_FUNC},
+   [0x13] = {"geo_dl_translated",     0x0C, NO_REF,
+             {{0x01, FIELD_U8_HEX}, {0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}, {0x08, FIELD_DL_OPTIONAL}}},
+   [0x14] = {"geo_billboard",         0x08, NO_REF,
+             {{0x01, FIELD_LAYER_HEX}, {0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}}, 0, 0x80, FIELD_FUNC},
+   [0x15] = {"geo_display_list",      0x08, NO_REF, {{0x01, FIELD_U8_HEX}, {0x04, FIELD_DL}}},
+   [0x16] = {"geo_shadow",            0x08, NO_REF,
+             {{0x03, FIELD_U8_HEX}, {0x05, FIELD_U8_HEX}, {0x06, FIELD_S16}}, SCRIPT_CMD_OPEN},
+   [0x17] = {"geo_todo_17",           0x04, NO_REF},
+   [0x18] = {"geo_asm",               0x08, NO_REF, {{0x02, FIELD_S16}, {0x04, FIELD_FUNC}}},
+   [0x19] = {"geo_background",        0x08, NO_REF, {{0x02, FIELD_S16}, {0x04, FIELD_FUNC}}},
+   [0x1A] = {"geo_nop_1A",            0x08, NO_REF},
+   [0x1B] = {"geo_todo_1B",           0x04, NO_REF, {{0x02, FIELD_S16}}},
+   [0x1C] = {"geo_todo_1C",           0x0C, NO_REF,
+             {{0x01, FIELD_U8_HEX}, {0x02, FIELD_S16}, {0x04, FIELD_S16}, {0x06, FIELD_S16}, {0x08, FIELD_FUNC}}},
+   [0x1D] = {"geo_scale",             0x08, NO_REF, {{0x01, FIELD_LAYER_HEX}, {0x04, FIELD_S32}}, 0, 0x80, FIELD_FUNC},
+   [0x1E] = {"geo_nop_1E",            0x08, NO_REF},
+   [0x1F] = {"geo_nop_1F",            0x10, NO_REF},
+   [0x20] = {"geo_start_distance",    0x04, NO_REF, {{0x02, FIELD_S16}}, SCRIPT_CMD_OPEN},
+};
+
+// behavior commands, words without a field are plain values
+static const script_cmd behavior_cmd_table[] =
+{
+   [0x00] = {"begin",                  0x04, NO_REF},
+   [0x01] = {"delay",                  0x04, NO_REF},
+   [0x02] = {"call",                   0x08, NO_REF, {{0x04, FIELD_FUNC}}},
+   [0x03] = {"return",                 0x04, NO_REF},
+   [0x04] = {"goto",                   0x08, NO_REF, {{0x04, FIELD_FUNC}}},
+   [0x05] = {"begin_repeat",           0x04, NO_REF},
+   [0x06] = {"end_repeat",             0x04, NO_REF},
+   [0x07] = {"end_repeat_continue",    0x04, NO_REF},
+   [0x08] = {"begin_loop",             0x04, NO_REF},
+   [0x09] = {"end_loop",               0x04, NO_REF},
+   [0x0A] = {"break",                  0x04, NO_REF},
+   [0x0B] = {"break_unused",           0x04, NO_REF},
+   [0x0C] = {"call_native",            0x08, NO_REF, {{0x04, FIELD_FUNC}}},
+   [0x0D] = {"add_float",              0x04, NO_REF},
+   [0x0E] = {"set_float",              0x04, NO_REF},
+   [0x0F] = {"add_int",                0x04, NO_REF},
+   [0x10] = {"set_int",                0x04, NO_REF},
+   [0x11] = {"or_int",                 0x04, NO_REF},
+   [0x12] = {"bit_clear",              0x04, NO_REF},
+   [0x13] = {"set_int_rand_rshift",    0x08, NO_REF},
+   [0x14] = {"set_random_float",       0x08, NO_REF},
+   [0x15] = {"set_random_int",         0x08, NO_REF},
+   [0x16] = {"add_random_float",       0x08, NO_REF},
+   [0x17] = {"add_int_rand_rshift",    0x08, NO_REF},
+   [0x18] = {"nop_18",                 0x04, NO_REF},
+   [0x19] = {"nop_19",                 0x04, NO_REF},
+   [0x1A] = {"nop_1A",                 0x04, NO_REF},
+   [0x1B] = {"set_model",              0x04, NO_REF},
+   [0x1C] = {"spawn_child",            0x0C, NO_REF, {{0x08, FIELD_FUNC}}},
+   [0x1D] = {"deactivate",             0x04, NO_REF},
+   [0x1E] = {"drop_to_floor",          0x04, NO_REF},
+   [0x1F] = {"sum_float",              0x04, NO_REF},
+   [0x20] = {"sum_int",                0x04, NO_REF},
+   [0x21] = {"billboard",              0x04, NO_REF},
+   [0x22] = {"hide",                   0x04, NO_REF},
+   [0x23] = {"set_hitbox",             0x08, NO_REF},
+   [0x24] = {"nop_24",                 0x04, NO_REF},
+   [0x25] = {"delay_var",              0x04, NO_REF},
+   [0x26] = {"begin_repeat_unused",    0x04, NO_REF},
+   [0x27] = {"load_animations",        0x08, NO_REF},
+   [0x28] = {"animate",                0x04, NO_REF},
+   [0x29] = {"spawn_child_with_param", 0x0C, NO_REF, {{0x08, FIELD_FUNC}}},
+   [0x2A] = {"load_collision_data",    0x08, NO_REF},
+   [0x2B] = {"set_hitbox_with_offset", 0x0C, NO_REF},
+   [0x2C] = {"spawn_obj",              0x0C, NO_REF, {{0x08, FIELD_FUNC}}},
+   [0x2D] = {"set_home",               0x04, NO_REF},
+   [0x2E] = {"set_hurtbox",            0x08, NO_REF},
+   [0x2F] = {"set_interact_type",      0x08, NO_REF},
+   [0x30] = {"set_obj_physics",        0x14, NO_REF},
+   [0x31] = {"set_interact_subtype",   0x08, NO_REF},
+   [0x32] = {"scale",                  0x04, NO_REF},
+   [0x33] = {"parent_bit_clear",       0x08, NO_REF},
+   [0x34] = {"animate_texture",        0x04, NO_REF},
+   [0x35] = {"disable_rendering",      0x04, NO_REF},
+   [0x36] = {"set_int_unused",         0x08, NO_REF},
+   [0x37] = {"spawn_water_droplet",    0x08, NO_REF},
+};
+
+typedef struct
+{
+   const script_cmd *table;
+   unsigned int count;
+   script_cmd unknown; // returned for commands not in table
+} script_lang_info;
+
+static const script_lang_info script_langs[] =
+{
+   [SCRIPT_LEVEL]    = {level_cmd_table,    DIM(level_cmd_table),    {NULL, 0x00, NO_REF}},
+   [SCRIPT_GEO]      = {geo_cmd_table,      DIM(geo_cmd_table),      {NULL, 0x04, NO_REF}},
+   [SCRIPT_BEHAVIOR] = {behavior_cmd_table, DIM(behavior_cmd_table), {NULL, 0x04, NO_REF}},
+};
+
+#undef LOAD_FIELDS
+#undef NO_REF
+
+static const char *level_ref_names[LEVEL_REF_TYPE_COUNT] =
+{
+   [LEVEL_REF_NONE]      = "none",
+   [LEVEL_REF_SCRIPT]    = "script",
+   [LEVEL_REF_RAW]       = "raw",
+   [LEVEL_REF_MIO0]      = "mio0",
+   [LEVEL_REF_MIO0_TEX]  = "mio0_texture",
+   [LEVEL_REF_ASM_LOAD]  = "asm_load",
+   [LEVEL_REF_ASM_CALL]  = "asm_call",
+   [LEVEL_REF_JUMP]      = "jump",
+   [LEVEL_REF_GEO]       = "geo",
+   [LEVEL_REF_DL]        = "display_list",
+   [LEVEL_REF_BEHAVIOR]  = "behavior",
+   [LEVEL_REF_COLLISION] = "collision",
+   [LEVEL_REF_MACRO]     = "macro",
+};
+
+const script_cmd *script_cmd_get(script_lang lang, const unsigned char *cmd)
+{
+   const script_lang_info *lang_info = &script_langs[lang];
+   const script_cmd *info;
+   if (cmd[0] >= lang_info->count || lang_info->table[cmd[0]].name == NULL) {
+      return &lang_info->unknown;
+   }
+   info = &lang_info->table[cmd[0]];
+   if (info->variants) {
+      info = &info->variants[(cmd[1] >> info->variant_shift) & 0x7];
+      if (info->name == NULL) {
+         return &lang_info->unknown;
+      }
+   }
+   return info;
+}
+
+unsigned int script_cmd_length(script_lang lang, const script_cmd *info, const unsigned char *cmd)
+{
+   // level script commands carry their own length
+   if (lang == SCRIPT_LEVEL) {
+      return cmd[1];
+   }
+   if (cmd[1] & info->ext_mask) {
+      return info->length + 4;
+   }
+   return info->length;
+}
+
+script_field_type script_cmd_field(const script_cmd *info, const unsigned char *cmd, unsigned int offset)
+{
+   for (int f = 0; f < SCRIPT_MAX_FIELDS && info->fields[f].type != FIELD_NONE; f++) {
+      if (info->fields[f].offset == offset) {
+         return info->fields[f].type;
+      }
+   }
+   if ((cmd[1] & info->ext_mask) && offset == info->length) {
+      return info->ext_type;
+   }
+   return FIELD_NONE;
+}
+
+unsigned int script_field_size(script_field_type type)
+{
+   switch (type) {
+      case FIELD_NONE:
+         return 0;
+      case FIELD_U8:
+      case FIELD_U8_HEX:
+      case FIELD_LAYER:
+      case FIELD_LAYER_HEX:
+      case FIELD_SEGMENT:
+         return 1;
+      case FIELD_S16:
+         return 2;
+      default:
+         return 4;
+   }
+}
+
+const script_cmd *level_cmd_get(unsigned char cmd)
+{
+   const unsigned char bytes[2] = {cmd, 0};
+   return script_cmd_get(SCRIPT_LEVEL, bytes);
+}
+
+const char *level_ref_name(level_ref_type type)
+{
+   if (type < LEVEL_REF_TYPE_COUNT) {
+      return level_ref_names[type];
+   }
+   return "unknown";
+}
+
+unsigned int level_decode_cmd(const unsigned char *data, unsigned int length, unsigned int offset, level_ref *ref)
+{
+   const script_cmd *info;
+   const unsigned char *cmd;
+   unsigned int cmd_len;
+   int f;
+
+   memset(ref, 0, sizeof(*ref));
+   ref->type = LEVEL_REF_NONE;
+   ref->offset = offset;
+   if (offset + 2 > length) {
+      return 0;
+   }
+   cmd = &data[offset];
+   ref->cmd = cmd[0];
+   info = script_cmd_get(SCRIPT_LEVEL, cmd);
+   cmd_len = script_cmd_length(SCRIPT_LEVEL, info, cmd);
+   // length = 0 ends level script
+   if (cmd_len == 0) {
+      return 0;
+   }
+   // every field read below must be inside the command and the data
+   if (info->ref == LEVEL_REF_NONE || offset + cmd_len > length) {
+      return cmd_len;
+   }
+   for (f = 0; f < SCRIPT_MAX_FIELDS && info->fields[f].type != FIELD_NONE; f++) {
+      if (info->fields[f].offset + script_field_size(info->fields[f].type) > cmd_len) {
+         return cmd_len;
+      }
+   }
+   ref->type = info->ref;
+   for (f = 0; f < SCRIPT_MAX_FIELDS && info->fields[f].type != FIELD_NONE; f++) {
+      const unsigned char *field = &cmd[info->fields[f].offset];
+      switch (info->fields[f].type) {
+         case FIELD_SEGMENT:
+            ref->dst = field[0];
+            break;
+         case FIELD_RAM_DST:
+            ref->dst = read_u32_be(field);
+            break;
+         case FIELD_ROM_START:
+            ref->start = read_u32_be(field);
+            break;
+         case FIELD_ROM_END:
+            ref->end = read_u32_be(field);
+            break;
+         default: // everything else a level script references is an address
+            ref->start = read_u32_be(field);
+            break;
+      }
+   }
+   return cmd_len;
+}
+
+// loads found by scanning every word must look like real commands
+static int scan_plausible(const unsigned char *data, const level_ref *ref)
+{
+   const script_cmd *info = level_cmd_get(ref->cmd);
+   if (info->length != 0 && data[ref->offset + 1] != info->length) {
+      return 0;
+   }
+   switch (ref->type) {
+      case LEVEL_REF_SCRIPT:
+         // segment loaded matches segment jumped to
+         if (data[ref->offset + 3] != data[ref->offset + 0xC]) {
+            return 0;
+         }
+         // fall through
+      case LEVEL_REF_RAW:
+      case LEVEL_REF_MIO0:
+      case LEVEL_REF_MIO0_TEX:
+         return (ref->start & 0xFF000000) == (ref->end & 0xFF000000);
+      default:
+         return 1;
+   }
+}
+
+static void add_ref(level_graph *graph, const level_ref *ref)
+{
+   if (graph->ref_count >= graph->ref_alloc) {
+      graph->ref_alloc *= 2;
+      graph->refs = realloc(graph->refs, graph->ref_alloc * sizeof(*graph->refs));
+   }
+   graph->refs[graph->ref_count++] = *ref;
+}
+
+static unsigned int visited_slot(const level_graph *graph, unsigned int start)
+{
+   unsigned int slot = (start * 2654435761u) >> 8;
+   slot &= graph->visited_size - 1;
+   while (graph->visited[slot] != VISITED_EMPTY && graph->visited[slot] != start) {
+      slot = (slot + 1) & (graph->visited_size - 1);
+   }
+   return slot;
+}
+
+// queue script for decoding unless it was already visited
+static void add_script(level_graph *graph, unsigned int start, unsigned int end, int parent, unsigned int loaded_at)
+{
+   level_script *script;
+   unsigned int slot = visited_slot(graph, start);
+   if (graph->visited[slot] == start) {
+      return;
+   }
+   INFO("Adding level %06X - %06X\n", start, end);
+   graph->visited[slot] = start;
+   if (graph->script_count >= graph->script_alloc) {
+      graph->script_alloc *= 2;
+      graph->scripts = realloc(graph->scripts, graph->script_alloc * sizeof(*graph->scripts));
+   }
+   script = &graph->scripts[graph->script_count++];
+   script->start = start;
+   script->end = end;
+   script->parent = parent;
+   script->loaded_at = loaded_at;
+   script->first_ref = 0;
+   script->ref_count = 0;
+   // keep load factor under 1/2
+   if (2 * (unsigned int)graph->script_count > graph->visited_size) {
+      unsigned int *old = graph->visited;
+      unsigned int old_size = graph->visited_size;
+      graph->visited_size *= 2;
+      graph->visited = malloc(graph->visited_size * sizeof(*graph->visited));
+      memset(graph->visited, 0xFF, graph->visited_size * sizeof(*graph->visited));
+      for (unsigned int i = 0; i < old_size; i++) {
+         if (old[i] != VISITED_EMPTY) {
+            graph->visited[visited_slot(graph, old[i])] = old[i];
+         }
+      }
+      free(old);
+   }
+}
+
+int level_walk(const unsigned char *data, unsigned int length, unsigned int entry, unsigned int entry_end,
+               int flags, level_graph *graph)
+{
+   graph->script_alloc = 64;
+   graph->script_count = 0;
+   graph->scripts = malloc(graph->script_alloc * sizeof(*graph->scripts));
+   graph->ref_alloc = 256;
+   graph->ref_count = 0;
+   graph->refs = malloc(graph->ref_alloc * sizeof(*graph->refs));
+   graph->visited_size = 256;
+   graph->visited = malloc(graph->visited_size * sizeof(*graph->visited));
+   memset(graph->visited, 0xFF, graph->visited_size * sizeof(*graph->visited));
+
+   add_script(graph, entry, entry_end, -1, entry);
+   // scripts array doubles as the worklist
+   for (int s = 0; s < graph->script_count; s++) {
+      unsigned int a = graph->scripts[s].start;
+      unsigned int end = MIN(graph->scripts[s].end, length);
+      graph->scripts[s].first_ref = graph->ref_count;
+      while (a < end) {
+         level_ref ref;
+         unsigned int cmd_len = level_decode_cmd(data, length, a, &ref);
+         if (flags & LEVEL_WALK_SCAN) {
+            // could increment by command length, but trying to be smart might miss things
+            cmd_len = 4;
+            if (ref.type != LEVEL_REF_NONE && !scan_plausible(data, &ref)) {
+               ref.type = LEVEL_REF_NONE;
+            }
+         } else if (cmd_len == 0) {
+            break;
+         }
+         if (ref.type != LEVEL_REF_NONE) {
+            ref.script = graph->scripts[s].start;
+            add_ref(graph, &ref);
+            if (ref.type == LEVEL_REF_SCRIPT && ref.start < length && ref.start < ref.end) {
+               add_script(graph, ref.start, ref.end, s, ref.offset);
+            }
+         }
+         a += cmd_len;
+      }
+      graph->scripts[s].ref_count = graph->ref_count - graph->scripts[s].first_ref;
+   }
+   return graph->script_count;
+}
+
+void level_graph_free(level_graph *graph)
+{
+   free(graph->scripts);
+   free(graph->refs);
+   free(graph->visited);
+   graph->scripts = NULL;
+   graph->refs = NULL;
+   graph->visited = NULL;
+   graph->script_count = graph->ref_count = 0;
+   graph->script_alloc = graph->ref_alloc = 0;
+   graph->visited_size = 0;
+}
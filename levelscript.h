@@ -0,0 +1,176 @@
+#ifndef LEVELSCRIPT_H_
+#define LEVELSCRIPT_H_
+
+// SM64 level script, geo layout and behavior script decoding, level script traversal
+
+// kind of reference a level script command makes
+typedef enum
+{
+   LEVEL_REF_NONE,
+   LEVEL_REF_SCRIPT,     // 0x00, 0x01: load ROM range into segment and jump to level script in it
+   LEVEL_REF_RAW,        // 0x17: load raw ROM range into segment
+   LEVEL_REF_MIO0,       // 0x18: load MIO0 ROM range into segment
+   LEVEL_REF_MIO0_TEX,   // 0x1A: load MIO0 ROM range into texture segment
+   LEVEL_REF_ASM_LOAD,   // 0x16: load ROM range of code into RAM
+   LEVEL_REF_ASM_CALL,   // 0x11, 0x12: call function in RAM
+   LEVEL_REF_JUMP,       // 0x05, 0x06, 0x0C: jump to segmented address
+   LEVEL_REF_GEO,        // 0x1F, 0x22: geo layout at segmented address
+   LEVEL_REF_DL,         // 0x21: display list at segmented address
+   LEVEL_REF_BEHAVIOR,   // 0x24, 0x25: object behavior at segmented address
+   LEVEL_REF_COLLISION,  // 0x2E: collision data at segmented address
+   LEVEL_REF_MACRO,      // 0x39: macro object list at segmented address
+   LEVEL_REF_TYPE_COUNT
+} level_ref_type;
+
+// script languages with a command table
+typedef enum
+{
+   SCRIPT_LEVEL,    // level scripts, length in byte 1 of each command
+   SCRIPT_GEO,      // geo layouts
+   SCRIPT_BEHAVIOR, // object behavior scripts
+} script_lang;
+
+// how a command field is decoded and printed
+typedef enum
+{
+   FIELD_NONE,        // end of field list
+   FIELD_U8,          // u8, decimal
+   FIELD_U8_HEX,      // u8, hex
+   FIELD_LAYER,       // low nibble of u8, decimal
+   FIELD_LAYER_HEX,   // low nibble of u8, hex
+   FIELD_SEGMENT,     // u8 segment number loaded into
+   FIELD_S16,         // s16, decimal
+   FIELD_S32,         // u32, signed decimal
+   FIELD_WORD,        // u32, hex
+   FIELD_SEG_ADDR,    // segmented address, hex
+   FIELD_ROM_START,   // ROM start offset of a load
+   FIELD_ROM_END,     // ROM end offset of a load
+   FIELD_RAM_DST,     // RAM address code is loaded to
+   FIELD_FUNC,        // RAM address of function or data
+   FIELD_CALL,        // RAM address of function called
+   FIELD_BEHAVIOR,    // segmented address of object behavior
+   FIELD_GEO,         // segmented address of geo layout
+   FIELD_SWITCH,      // RAM address of switch case function
+   FIELD_DL,          // segmented address of display list
+   FIELD_DL_OPTIONAL, // segmented address of display list, omitted when 0
+} script_field_type;
+
+typedef struct
+{
+   unsigned char offset; // byte offset in command
+   unsigned char type;   // script_field_type
+} script_field;
+
+#define SCRIPT_MAX_FIELDS 8
+
+// command flags
+#define SCRIPT_CMD_OPEN  0x1 // following commands are nested one deeper
+#define SCRIPT_CMD_CLOSE 0x2 // this command is nested one less deep
+#define SCRIPT_CMD_END   0x4 // script or branch ends after this command
+
+// static description of one script command
+typedef struct _script_cmd
+{
+   const char *name;          // mnemonic or macro name, NULL if unknown
+   unsigned char length;      // command length without ext field, 0 if not fixed
+   level_ref_type ref;        // kind of reference made by level script commands
+   script_field fields[SCRIPT_MAX_FIELDS]; // fields in print order, ends at first FIELD_NONE
+   unsigned char flags;       // SCRIPT_CMD_* flags
+   unsigned char ext_mask;    // byte 1 & ext_mask nonzero adds the ext field at offset length
+   unsigned char ext_type;    // script_field_type of ext field
+   unsigned char variant_shift; // variants are selected by byte 1 >> variant_shift
+   const struct _script_cmd *variants; // commands with layout depending on byte 1, NULL if fixed
+} script_cmd;
+
+// reference from a level script command
+typedef struct
+{
+   unsigned int script;  // ROM offset of the script containing the command
+   unsigned int offset;  // ROM offset of the command
+   unsigned char cmd;    // command byte
+   level_ref_type type;
+   unsigned int start;   // ROM start for loads, RAM or segmented address otherwise
+   unsigned int end;     // ROM end for loads, 0 otherwise
+   unsigned int dst;     // segment number for segment loads, RAM destination for ASM loads
+} level_ref;
+
+// level script reached during traversal
+typedef struct
+{
+   unsigned int start;   // ROM offset of the script
+   unsigned int end;     // ROM offset of end of the loaded range
+   int parent;           // index of script that first loaded it, -1 for the entry script
+   unsigned int loaded_at; // ROM offset of command that first loaded it, start for the entry script
+   int first_ref;        // index in graph refs of the first reference made from this script
+   int ref_count;        // number of references made from this script
+} level_script;
+
+// all scripts and references reachable from an entry script
+typedef struct
+{
+   level_script *scripts;
+   int script_count;
+   int script_alloc;
+   level_ref *refs;
+   int ref_count;
+   int ref_alloc;
+   // visited set of script start offsets
+   unsigned int *visited;
+   unsigned int visited_size;
+} level_graph;
+
+// walk flags
+#define LEVEL_WALK_SCAN 0x1 // test every word for a command with the expected length instead of
+                            // following command lengths; ignores loads that do not look valid
+
+// get description of command, resolving layout variants
+// lang: script language
+// cmd: command data, at least 2 bytes
+// returns command info, with NULL name for unknown commands
+const script_cmd *script_cmd_get(script_lang lang, const unsigned char *cmd);
+
+// get length of command including its ext field
+// lang: script language
+// info: command info from script_cmd_get()
+// cmd: command data
+// returns length of command in bytes, 0 for level scripts ends here
+unsigned int script_cmd_length(script_lang lang, const script_cmd *info, const unsigned char *cmd);
+
+// get field at byte offset in command, including ext field
+// returns field type or FIELD_NONE if no field starts there
+script_field_type script_cmd_field(const script_cmd *info, const unsigned char *cmd, unsigned int offset);
+
+// get size of field in bytes
+unsigned int script_field_size(script_field_type type);
+
+// get description of level script command
+// cmd: command byte
+// returns command info, with NULL name for unknown commands
+const script_cmd *level_cmd_get(unsigned char cmd);
+
+// get name of reference type
+const char *level_ref_name(level_ref_type type);
+
+// decode the reference made by one command
+// data: ROM data
+// length: length of data
+// offset: offset of command in data
+// ref: filled in with reference, type is LEVEL_REF_NONE if the command makes none
+// returns length of command or 0 if script ends here
+unsigned int level_decode_cmd(const unsigned char *data, unsigned int length, unsigned int offset, level_ref *ref);
+
+// walk level scripts reachable from entry script, visiting each script once
+// data: ROM data
+// length: length of data
+// entry: ROM offset of entry script
+// entry_end: ROM offset of end of entry script
+// flags: LEVEL_WALK_* flags
+// graph: filled in with scripts and references, free with level_graph_free()
+// returns number of scripts walked
+int level_walk(const unsigned char *data, unsigned int length, unsigned int entry, unsigned int entry_end,
+               int flags, level_graph *graph);
+
+// free all memory owned by graph
+void level_graph_free(level_graph *graph);
+
+#endif // LEVELSCRIPT_H_
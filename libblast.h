@@ -1,27 +1,49 @@
 #ifndef LIBBLAST_H_
 #define LIBBLAST_H_
 
+// block decoders take the output capacity in out_len and return the number of bytes written,
+// or -1 if the data is corrupt: odd length, lookback before the start or output past out_len
+// these follow the game's code one word at a time and are kept as the reference for blast_decode()
+
 // 802A5E10 (061650)
 // just a memcpy from a0 to a3
-int decode_block0(unsigned char *in, int length, unsigned char *out);
+int decode_block0(const unsigned char *in, int length, unsigned char *out, int out_len);
 
 // 802A5AE0 (061320)
-int decode_block1(unsigned char *in, int length, unsigned char *out);
+int decode_block1(const unsigned char *in, int length, unsigned char *out, int out_len);
 
 // 802A5B90 (0613D0)
-int decode_block2(unsigned char *in, int length, unsigned char *out);
+int decode_block2(const unsigned char *in, int length, unsigned char *out, int out_len);
 
 // 802A5A2C (06126C)
-int decode_block3(unsigned char *in, int length, unsigned char *out);
+int decode_block3(const unsigned char *in, int length, unsigned char *out, int out_len);
 
 // 802A5C5C (06149C)
-int decode_block4(unsigned char *in, int length, unsigned char *out, unsigned char *lut);
+int decode_block4(const unsigned char *in, int length, unsigned char *out, int out_len, const unsigned char *lut);
 
 // 802A5D34 (061574)
-int decode_block5(unsigned char *in, int length, unsigned char *out, unsigned char *lut);
+int decode_block5(const unsigned char *in, int length, unsigned char *out, int out_len, const unsigned char *lut);
 
 // 802A5958 (061198)
-int decode_block6(unsigned char *in, int length, unsigned char *out);
+int decode_block6(const unsigned char *in, int length, unsigned char *out, int out_len);
+
+// compute exact decoded size of Blast Corps compressed data without decoding it
+// in - compressed data
+// length - length of compressed data
+// type - type of compression: 0-6
+// returns number of bytes the data decodes to, -1 if the type is unknown or the data is corrupt
+int blast_decode_size(const unsigned char *in, int length, int type);
+
+// decode Blast Corps compressed data of given type in to buffer
+// in - compressed data
+// length - length of compressed data
+// type - type of compression: 0-6
+// out - output buffer
+// out_len - capacity of out, blast_decode_size() gives the exact amount needed
+// lut - lookup table to use for types 4 and 5
+// returns number of bytes written to out, -1 on error
+// output is identical to the decode_blockN() functions, literal runs and back-references are copied in bulk
+int blast_decode(const unsigned char *in, int length, int type, unsigned char *out, int out_len, const unsigned char *lut);
 
 // decode Blast Corps compressed data of given type
 // in_filename - input file name of compressed data
@@ -31,4 +53,28 @@ int decode_block6(unsigned char *in, int length, unsigned char *out);
 // returns 0 on success, non-0 otherwise
 int blast_decode_file(char *in_filename, int type, char *out_filename, unsigned char *lut);
 
+// compute the largest size Blast Corps compressed data of given type can encode to
+// length - length of uncompressed data
+// type - type of compression: 0-6
+// returns number of bytes blast_encode() may write, -1 if the type is unknown
+int blast_encode_bound(int length, int type);
+
+// encode data to Blast Corps compressed data of given type
+// in - uncompressed data
+// length - length of uncompressed data, a multiple of the type's word size
+// type - type of compression: 0-6
+// out - output buffer
+// out_len - capacity of out, blast_encode_bound() gives the most needed
+// lut - lookup table to use for types 4 and 5, the one the data is decoded with
+// returns number of bytes written to out, -1 if a word can't be stored in the type or out is too small
+int blast_encode(const unsigned char *in, int length, int type, unsigned char *out, int out_len, const unsigned char *lut);
+
+// encode file to Blast Corps compressed data of given type
+// in_filename - input file name of uncompressed data
+// type - type of compression: 0-6
+// out_filename - output file name of compressed data
+// lut - lookup table to use for types 4 and 5
+// returns 0 on success, non-0 otherwise
+int blast_encode_file(char *in_filename, int type, char *out_filename, unsigned char *lut);
+
 #endif // LIBBLAST_H_
@@ -6,6 +6,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "libsfx.h"
 #include "strutils.h"
@@ -13,13 +18,34 @@
 
 // defines
 
+#define SFX_MAX_PREDICTORS 16
+#define SFX_MAX_ENVELOPE 32
+#define WAV_HEADER_LENGTH 0x2C
+
 // functions
 
-static float sfx_key_table[0x100];
+static void sfx_prepare_book(predictor_data *book);
+
+// read an envelope up to and including its first command, delays of 0 or less end it
+static unsigned *read_envelope(unsigned char *data, unsigned int offset, unsigned int *count)
+{
+   unsigned *adrs = malloc(2 * SFX_MAX_ENVELOPE * sizeof(unsigned));
+   unsigned int k = 0;
+   while (k < 2 * SFX_MAX_ENVELOPE) {
+      adrs[k] = read_u16_be(&data[offset+k*2]);
+      adrs[k+1] = read_u16_be(&data[offset+k*2+2]);
+      k += 2;
+      if (adrs[k-2] == 0 || adrs[k-2] >= 0x8000) {
+         break;
+      }
+   }
+   *count = k;
+   return adrs;
+}
 
 static wave_table * read_wave_table(unsigned char *data, unsigned int wave_offset, unsigned int sound_bank_offset)
 {
-   wave_table *wav = malloc(sizeof(wave_table));
+   wave_table *wav = calloc(1, sizeof(wave_table));
    wav->unknown_1 = read_u32_be(&data[wave_offset]);
    wav->sound_offset = read_u32_be(&data[wave_offset+4]);
    
@@ -27,14 +53,14 @@ static wave_table * read_wave_table(unsigned char *data, unsigned int wave_offse
    unsigned int loop_offset = read_u32_be(&data[wave_offset+8]);
    if(loop_offset != 0) {
      loop_offset += sound_bank_offset + 16;
-     wav->loop = malloc(sizeof(loop_data));
+     wav->loop = calloc(1, sizeof(loop_data));
      wav->loop->start = read_u32_be(&data[loop_offset]);
      wav->loop->end = read_u32_be(&data[loop_offset+4]);
      wav->loop->count = read_u32_be(&data[loop_offset+8]);
      wav->loop->unknown = read_u32_be(&data[loop_offset+12]);
      if(wav->loop->start != 0 || wav->loop->count != 0) {
-       wav->loop->state = malloc(8 * sizeof(unsigned));
-       for (int k = 0; k < 8; k++) {
+       wav->loop->state = malloc(SFX_LOOP_STATE_LENGTH * sizeof(unsigned));
+       for (int k = 0; k < SFX_LOOP_STATE_LENGTH; k++) {
           wav->loop->state[k] = read_u16_be(&data[loop_offset+16+k*2]);
        }
      }
@@ -42,9 +68,10 @@ static wave_table * read_wave_table(unsigned char *data, unsigned int wave_offse
    
    //predictor
    unsigned int predictor_offset = read_u32_be(&data[wave_offset+12]);
+   wav->predictor_offset = predictor_offset;
    if(predictor_offset != 0) {
      predictor_offset += sound_bank_offset + 16;
-     wav->predictor = malloc(sizeof(predictor_data));
+     wav->predictor = calloc(1, sizeof(predictor_data));
      wav->predictor->order = read_u32_be(&data[predictor_offset]);
      wav->predictor->predictor_count = read_u32_be(&data[predictor_offset+4]);
     unsigned int num_predictor = wav->predictor->order * wav->predictor->predictor_count * 8;
@@ -52,6 +79,7 @@ static wave_table * read_wave_table(unsigned char *data, unsigned int wave_offse
      for (unsigned int k = 0; k < num_predictor; k++) {
           wav->predictor->data[k] = read_u16_be(&data[predictor_offset+8+k*2]);
      }
+     sfx_prepare_book(wav->predictor);
    }
    
    wav->sound_length = read_u32_be(&data[wave_offset+16]);
@@ -62,31 +90,78 @@ static wave_table * read_wave_table(unsigned char *data, unsigned int wave_offse
    return wav;
 }
 
-void sfx_initialize_key_table()
+// key table, (d / 12)^2 for notes d semitones away from key 60, computed as
+//   (float)((60.0 - (float)x) / 12.0) * (float)((60.0 - (float)x) / 12.0)
+// for x = 60 - d and x = 60 + d, which give the same value
+#define SFX_KEY_CENTER 60
+static const float sfx_key_table[0x100 - SFX_KEY_CENTER] =
 {
-   for (int x = 0; x < 0xFF; x++)
-   {
-      sfx_key_table[x] = (float)((60.0 - (float)x) / 12.0) * (float)((60.0 - (float)x) / 12.0); //Squared
-   }
-}
+   0.0f, 0.00694444496f, 0.0277777798f, 0.0625f, 0.111111119f, 0.173611104f, 0.25f, 0.340277761f,
+   0.444444478f, 0.5625f, 0.694444418f, 0.840277791f, 1.0f, 1.17361116f, 1.36111104f, 1.5625f,
+   1.77777791f, 2.00694442f, 2.25f, 2.50694466f, 2.77777767f, 3.0625f, 3.36111116f, 3.67361093f,
+   4.0f, 4.34027767f, 4.69444466f, 5.0625f, 5.44444418f, 5.84027815f, 6.25f, 6.67361069f,
+   7.11111164f, 7.5625f, 8.02777767f, 8.50694466f, 9.0f, 9.5069437f, 10.0277786f, 10.5625f,
+   11.1111107f, 11.6736116f, 12.25f, 12.8402777f, 13.4444447f, 14.0625f, 14.6944437f, 15.3402786f,
+   16.0f, 16.6736126f, 17.3611107f, 18.0625f, 18.7777786f, 19.5069427f, 20.25f, 21.0069466f,
+   21.7777767f, 22.5625f, 23.3611126f, 24.1736088f, 25.0f, 25.8402786f, 26.6944427f, 27.5625f,
+   28.4444466f, 29.3402767f, 30.25f, 31.1736126f, 32.1111107f, 33.0625f, 34.0277786f, 35.0069427f,
+   36.0f, 37.0069466f, 38.0277748f, 39.0625f, 40.1111145f, 41.1736107f, 42.25f, 43.3402786f,
+   44.4444427f, 45.5625f, 46.6944466f, 47.8402748f, 49.0f, 50.1736145f, 51.3611107f, 52.5625f,
+   53.7777786f, 55.0069427f, 56.25f, 57.5069466f, 58.7777748f, 60.0625f, 61.3611145f, 62.6736069f,
+   64.0f, 65.340271f, 66.6944504f, 68.0625f, 69.4444427f, 70.8402863f, 72.25f, 73.6736069f,
+   75.1111145f, 76.5625f, 78.027771f, 79.5069504f, 81.0f, 82.5069351f, 84.0277863f, 85.5625f,
+   87.1111069f, 88.6736145f, 90.25f, 91.840271f, 93.4444504f, 95.0625f, 96.6944351f, 98.3402863f,
+   100.0f, 101.673607f, 103.361115f, 105.0625f, 106.777771f, 108.50695f, 110.25f, 112.006935f,
+   113.777786f, 115.5625f, 117.361107f, 119.173615f, 121.0f, 122.840271f, 124.69445f, 126.5625f,
+   128.444443f, 130.340286f, 132.25f, 134.173599f, 136.111115f, 138.0625f, 140.027771f, 142.006958f,
+   144.0f, 146.006943f, 148.027786f, 150.0625f, 152.111099f, 154.173615f, 156.25f, 158.340271f,
+   160.444458f, 162.5625f, 164.694443f, 166.840286f, 169.0f, 171.173599f, 173.361115f, 175.5625f,
+   177.777771f, 180.006958f, 182.25f, 184.506943f, 186.777786f, 189.0625f, 191.361099f, 193.673615f,
+   196.0f, 198.340271f, 200.694458f, 203.0625f, 205.444443f, 207.840286f, 210.25f, 212.673599f,
+   215.111115f, 217.5625f, 220.027771f, 222.506958f, 225.0f, 227.506927f, 230.027786f, 232.5625f,
+   235.111099f, 237.673615f, 240.25f, 242.840271f, 245.444458f, 248.0625f, 250.694427f, 253.340286f,
+   256.0f, 258.673645f, 261.361084f, 264.0625f,
+};
 
+// key whose squared distance in octaves from key 60 is closest to the game's key value
+// same result as the first closest key of a search over keys 0-0xFF: the keys below 60 come
+// first and mirror 61-120, so ties go to the lowest key
 static unsigned char sfx_convert_ead_game_value_to_key_base(float eadKeyvalue)
 {
    float keybaseReal = (((eadKeyvalue - 0.0) < 0.00001) ? 1.0f : eadKeyvalue);
+   float distance;
+   int lo = 0;
+   int hi = DIM(sfx_key_table) - 1;
+   int first, last;
+   int realKey;
+
+   // first entry not below the key value, the closest one is either it or the one before
+   while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (sfx_key_table[mid] < keybaseReal)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   if (lo > 0 && fabsf(keybaseReal - sfx_key_table[lo - 1]) <= fabsf(keybaseReal - sfx_key_table[lo]))
+      lo--;
+   distance = fabsf(keybaseReal - sfx_key_table[lo]);
 
-   float smallestDistance = 9999999999999.0f;
-   unsigned char realKey = 0;
+   // NaN and huge values never got closer than the search's initial distance
+   if (!(distance < 9999999999999.0f))
+      return 0;
 
-   for (int x = 0; x < 0x100; x++)
-   {
-      float distance = (fabsf(keybaseReal - sfx_key_table[x]));
+   // entries the float distance can't tell apart
+   first = last = lo;
+   while (first > 0 && fabsf(keybaseReal - sfx_key_table[first - 1]) == distance)
+      first--;
+   while (last < (int)DIM(sfx_key_table) - 1 && fabsf(keybaseReal - sfx_key_table[last + 1]) == distance)
+      last++;
 
-      if (distance < smallestDistance)
-      {
-         smallestDistance = distance;
-         realKey = x;
-      }
-   }
+   if (first <= SFX_KEY_CENTER)
+      realKey = SFX_KEY_CENTER - MIN(last, SFX_KEY_CENTER);
+   else
+      realKey = SFX_KEY_CENTER + first;
 
    if (realKey > 0x7F)
       realKey = 0x7F;
@@ -105,203 +180,197 @@ static const short sfx_itable[16] =
    -8,-7,-6,-5,-4,-3,-2,-1,
 };
 
-static signed short sfx_sign_extend(unsigned b, // number of bits representing the number in x
-                  int x      // sign extend this b-bit number to r
-)
-{
-   
-
-   int m = 1 << (b - 1); // mask can be pre-computed if b is fixed
+// Each group of 8 samples is a matrix product: output i is
+//   (tmp[i] << 11) + pred1[i] * last[6] + pred2[i] * last[7] + sum(tmp[k] * pred2[i-1-k], k < i)
+// shifted down by 11 and clamped, so the per-predictor Toeplitz matrix is built once per book.
+// Inputs are [last[6], last[7], tmp[0..7]] taken in pairs, matching pmaddwd.
 
-   x = x & ((1 << b) - 1);  // (Skip this if bits in x above position b are already zero.)
-   return (x ^ m) - m;
+// coefficient of the book, 0 past the end of short books
+static signed short sfx_book_coef(const predictor_data *book, unsigned int index)
+{
+   if (index >= 8 * book->order * book->predictor_count)
+      return 0;
+   return (signed short)book->data[index];
 }
 
-static void decode_8( unsigned char *in, signed short *out , int index, signed short * pred1, signed short lastsmp[8])
+// build the decode matrices for every predictor a frame header can select
+// returns 1 if a row can overflow a 32-bit accumulator, 0 otherwise
+static int sfx_build_matrices(const predictor_data *book, vadpcm_matrix *matrix)
 {
-   int i;
-   signed short tmp[8];
-   signed long total = 0;
-   signed short sample =0;
-   memset(out, 0, sizeof(signed short)*8);
-
-   signed short *pred2 = (pred1 + 8);
-
-   //printf("pred2[] = %x\n" , pred2[0]);
-   for(i=0; i<8; i++)
-   {
-      tmp[i] = sfx_itable[(i&1) ? (*in++ & 0xf) : ((*in >> 4) & 0xf)] << index;
-      tmp[i] = sfx_sign_extend(index+4, tmp[i]);
-   }
-
-   for(i=0; i<8; i++)
-   {
-      total = (pred1[i] * lastsmp[6]);
-      total+= (pred2[i] * lastsmp[7]);
-
-      if (i>0)
-      {
-         for(int x=i-1; x>-1; x--)
-         {
-            total += ( tmp[((i-1)-x)] * pred2[x] );
-            //printf("sample: %x - pred: %x - _smp: %x\n" , ((i-1)-x) , pred2[x] , tmp[((i-1)-x)]);
+   unsigned int count = MIN(book->predictor_count, SFX_MAX_PREDICTORS);
+   signed short row[10];
+   int wide = 0;
+   for (unsigned int p = 0; p < count; p++) {
+      for (int i = 0; i < 8; i++) {
+         long magnitude = 0;
+         row[0] = sfx_book_coef(book, p * 16 + i);
+         row[1] = sfx_book_coef(book, p * 16 + 8 + i);
+         for (int k = 0; k < 8; k++) {
+            if (k < i)
+               row[2 + k] = sfx_book_coef(book, p * 16 + 8 + (i - 1 - k));
+            else if (k == i)
+               row[2 + k] = 1 << 0xb;
+            else
+               row[2 + k] = 0;
+         }
+         for (int j = 0; j < 10; j++) {
+            matrix[p].coef[j / 2][i * 2 + (j & 1)] = row[j];
+            magnitude += abs(row[j]);
          }
+         // |sum| <= magnitude * 32768 must stay below 2^31
+         if (magnitude > 0xFFFF)
+            wide = 1;
       }
-
-      //printf("pred = %x | total = %x\n" , pred2[0] , total);
-      float result = ((tmp[i] << 0xb) + total) >> 0xb;
-      if (result > 32767)
-         sample = 32767;
-      else if (result < -32768)
-         sample = -32768;
-      else
-         sample = (signed short)result;
-
-      out[i] = sample;
    }
-   // update the last sample set for subsequent iterations
-   memcpy(lastsmp, out, sizeof(signed short)*8);
+   return wide;
 }
 
-static void decode_8_half( unsigned char *in, signed short *out , int index, signed short * pred1, signed short lastsmp[8])
+// precompute the decode matrices of a book that was just read or designed
+static void sfx_prepare_book(predictor_data *book)
 {
-   int i;
-   signed short tmp[8];
-   signed long total = 0;
-   signed short sample =0;
-   memset(out, 0, sizeof(signed short)*8);
-
-   signed short *pred2 = (pred1 + 8);
-
-   //printf("pred2[] = %x\n" , pred2[0]);
-
-   tmp[0] = (((((*in) & 0xC0) >> 6) & 0x3)) << (index);
-   tmp[0] = sfx_sign_extend(index+2, tmp[0]);
-   tmp[1] = (((((*in) & 0x30) >> 4) & 0x3)) << (index);
-   tmp[1] = sfx_sign_extend(index+2, tmp[1]);
-   tmp[2] = (((((*in) & 0x0C) >> 2) & 0x3)) << (index);
-   tmp[2] = sfx_sign_extend(index+2, tmp[2]);
-   tmp[3] = ((((*in++) & 0x03) & 0x3)) << (index);
-   tmp[3] = sfx_sign_extend(index+2, tmp[3]);
-   tmp[4] = (((((*in) & 0xC0) >> 6) & 0x3)) << (index);
-   tmp[4] = sfx_sign_extend(index+2, tmp[4]);
-   tmp[5] = (((((*in) & 0x30) >> 4) & 0x3)) << (index);
-   tmp[5] = sfx_sign_extend(index+2, tmp[5]);
-   tmp[6] = (((((*in) & 0x0C) >> 2) & 0x3)) << (index);
-   tmp[6] = sfx_sign_extend(index+2, tmp[6]);
-   tmp[7] = ((((*in++) & 0x03) & 0x3)) << (index);
-   tmp[7] = sfx_sign_extend(index+2, tmp[7]);
-
-   for(i=0; i<8; i++)
-   {
-      total = (pred1[i] * lastsmp[6]);
-      total+= (pred2[i] * lastsmp[7]);
+   book->matrix = malloc(MIN(book->predictor_count, SFX_MAX_PREDICTORS) * sizeof(vadpcm_matrix));
+   book->wide = sfx_build_matrices(book, book->matrix);
+}
 
-      if (i>0)
-      {
-         for(int x=i-1; x>-1; x--)
-         {
-            total += ( tmp[((i-1)-x)] * pred2[x] );
-            //printf("sample: %x - pred: %x - _smp: %x\n" , ((i-1)-x) , pred2[x] , tmp[((i-1)-x)]);
-         }
+// decode 8 samples from the inputs [last[6], last[7], tmp[0..7]]
+static void sfx_decode_8(const signed short in[10], const vadpcm_matrix *m, int wide, signed short *out)
+{
+   if (wide) {
+      // reference arithmetic for pathological books
+      for (int i = 0; i < 8; i++) {
+         long long total = 0;
+         for (int j = 0; j < 10; j++)
+            total += (long long)m->coef[j / 2][i * 2 + (j & 1)] * in[j];
+         total >>= 0xb;
+         out[i] = (signed short)(total > 32767 ? 32767 : (total < -32768 ? -32768 : total));
       }
-
-      //printf("pred = %x | total = %x\n" , pred2[0] , total);
-      float result = ((tmp[i] << 0xb) + total) >> 0xb;
-      if (result > 32767)
-         sample = 32767;
-      else if (result < -32768)
-         sample = -32768;
-      else
-         sample = (signed short)result;
-
-      out[i] = sample;
+      return;
    }
-   // update the last sample set for subsequent iterations
-   memcpy(lastsmp, out, sizeof(signed short)*8);
+   unsigned int pairs[5];
+   memcpy(pairs, in, sizeof(pairs));
+#if defined(__AVX2__)
+   __m256i acc = _mm256_setzero_si256();
+   for (int p = 0; p < 5; p++) {
+      __m256i coef = _mm256_loadu_si256((const __m256i *)m->coef[p]);
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_set1_epi32(pairs[p]), coef));
+   }
+   // packs works within 128-bit lanes, gather outputs 0-3 and 4-7 into the low lane
+   acc = _mm256_srai_epi32(acc, 0xb);
+   acc = _mm256_packs_epi32(acc, acc);
+   acc = _mm256_permute4x64_epi64(acc, 0x08);
+   _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(acc));
+#elif defined(__SSE2__)
+   __m128i lo = _mm_setzero_si128();
+   __m128i hi = _mm_setzero_si128();
+   for (int p = 0; p < 5; p++) {
+      __m128i x = _mm_set1_epi32(pairs[p]);
+      lo = _mm_add_epi32(lo, _mm_madd_epi16(x, _mm_loadu_si128((const __m128i *)&m->coef[p][0])));
+      hi = _mm_add_epi32(hi, _mm_madd_epi16(x, _mm_loadu_si128((const __m128i *)&m->coef[p][8])));
+   }
+   _mm_storeu_si128((__m128i *)out, _mm_packs_epi32(_mm_srai_epi32(lo, 0xb), _mm_srai_epi32(hi, 0xb)));
+#else
+   (void)pairs;
+   for (int i = 0; i < 8; i++) {
+      int total = 0;
+      for (int j = 0; j < 10; j++)
+         total += m->coef[j / 2][i * 2 + (j & 1)] * in[j];
+      total >>= 0xb;
+      out[i] = (signed short)(total > 32767 ? 32767 : (total < -32768 ? -32768 : total));
+   }
+#endif
 }
 
+// in: VADPCM frames, 9 bytes each or 5 bytes each if decode8Only
+// out: room for 16 samples per frame
+// returns number of samples decoded
 static unsigned long decode( unsigned char *in, signed short *out, unsigned long len, predictor_data *book, int decode8Only )
 {
-   signed short lastsmp[8];
-
-   for (int x = 0; x < 8; x++)
-      lastsmp[x] = 0;
-
-   int index;
-   int pred;
-
-   int samples = 0;
+   vadpcm_matrix local[SFX_MAX_PREDICTORS];
+   const vadpcm_matrix *matrix = book->matrix;
+   int wide = book->wide;
+   // inputs to sfx_decode_8, history from the previous 8 samples followed by the scaled residuals
+   signed short v[10] = {0};
+   unsigned long frame_len = decode8Only ? 5 : 9;
+   unsigned long frames = len / frame_len;
+
+   if (book->predictor_count == 0)
+      return 0;
 
-   // flip the predictors
-   signed short *preds = (signed short*)malloc( 32 * book->predictor_count );
-   for (unsigned int p = 0; p < (8 * book->order * book->predictor_count); p++)
-   {
-      preds[p] = book->data[p];
+   if (matrix == NULL) {
+      wide = sfx_build_matrices(book, local);
+      matrix = local;
    }
 
-   if (decode8Only == 0)
-   {
-      int _len = (len / 9) * 9;   //make sure length was actually a multiple of 9
+   for (unsigned long f = 0; f < frames; f++) {
+      int index = (*in >> 4) & 0xf;
+      // to not make zelda crash but doesn't fix it
+      const vadpcm_matrix *m = &matrix[(*in & 0xf) % book->predictor_count];
+      in++;
+
+      for (int half = 0; half < 2; half++) {
+         // residuals wrap to 16 bits for scales past 12, same as the original tool
+         if (decode8Only) {
+            for (int i = 0; i < 8; i++) {
+               int code = (in[i >> 2] >> (6 - 2 * (i & 3))) & 0x3;
+               v[2 + i] = (signed short)(((code ^ 0x2) - 0x2) * (1 << index));
+            }
+            in += 2;
+         } else {
+            for (int i = 0; i < 8; i++) {
+               int nibble = (i & 1) ? (in[i >> 1] & 0xf) : (in[i >> 1] >> 4);
+               v[2 + i] = (signed short)(sfx_itable[nibble] * (1 << index));
+            }
+            in += 4;
+         }
+         sfx_decode_8(v, m, wide, out);
+         v[0] = out[6];
+         v[1] = out[7];
+         out += 8;
+      }
+   }
 
-      while(_len > 0)
-      {
-         index = (*in >> 4) & 0xf;
-         pred = (*in & 0xf);
+   return frames * 16;
+}
 
-         // to not make zelda crash but doesn't fix it
-         pred = pred % (book->predictor_count);
 
-         _len--;
+// little endian stores for the .wav header
+static void sfx_write_u16_le(unsigned char *buf, unsigned int val)
+{
+   buf[0] = val & 0xFF;
+   buf[1] = (val >> 8) & 0xFF;
+}
 
-         signed short * pred1 = &preds[ pred * 16] ;
+static void sfx_write_u32_le(unsigned char *buf, unsigned int val)
+{
+   sfx_write_u16_le(buf, val & 0xFFFF);
+   sfx_write_u16_le(buf + 2, (val >> 16) & 0xFFFF);
+}
 
-         decode_8(++in, out, index, pred1, lastsmp);
-         in+=4;   _len-=4;   out+=8;
+void build_raw_sound_smpl(unsigned char *smpl, wave_table *wav, float key_base)
+{
+   memset(smpl, 0, SFX_WAV_SMPL_LENGTH);
+   memcpy(&smpl[0x0], "smpl", 4);
+   sfx_write_u32_le(&smpl[0x4], SFX_WAV_SMPL_LENGTH - 0x8);
 
-         decode_8(in, out, index, pred1, lastsmp);
-         in+=4;   _len-=4;   out+=8;
+   //This value only holds true for Mario/Zelda/StarFox formats
+   smpl[0x14] = sfx_convert_ead_game_value_to_key_base(key_base);
 
-         samples += 16;
-      }
-   }
-   else
+   if (wav->loop != NULL && (wav->loop->start != 0 || wav->loop->count != 0))
    {
-      int _len = (len / 5) * 5;   //make sure length was actually a multiple of 5
+      sfx_write_u32_le(&smpl[0x24], 1);
 
-      while(_len > 0)
+      if (wav->loop->count > 0)
       {
-         index = (*in >> 4) & 0xf;
-         pred = (*in & 0xf);
-
-         // to not make zelda crash but doesn't fix it
-         pred = pred % (book->predictor_count);
-
-         _len--;
-
-         signed short * pred1 = &preds[ pred * 16] ;
-
-         decode_8_half(++in, out, index, pred1, lastsmp);
-         in+=2;   _len-=2;   out+=8;
-
-         decode_8_half(in, out, index, pred1, lastsmp);
-         in+=2;   _len-=2;   out+=8;
-
-         samples += 16;
+         sfx_write_u32_le(&smpl[0x34], wav->loop->start);
+         sfx_write_u32_le(&smpl[0x38], wav->loop->end);
+         // infinite loops are stored as 0
+         sfx_write_u32_le(&smpl[0x40], (wav->loop->count == 0xFFFFFFFF) ? 0 : wav->loop->count);
       }
    }
-
-   free(preds);
-
-   return samples;
 }
 
-
-int extract_raw_sound(char *sound_dir, char *wav_name, wave_table *wav, float key_base, unsigned char *snd_data, unsigned long sampling_rate)
+unsigned char *decode_raw_sound(wave_table *wav, float key_base, unsigned char *snd_data, unsigned long sampling_rate, unsigned long *wav_length)
 {
-   char wav_file[FILENAME_MAX];
-   sprintf(wav_file, "%s/%s.wav", sound_dir, wav_name);
-   
    float sampling_rate_float = (float)sampling_rate;
 
    /*if (!ignoreKeyBase)
@@ -329,181 +398,75 @@ int extract_raw_sound(char *sound_dir, char *wav_name, wave_table *wav, float ke
 
    //This algorithm is only for ADPCM WAVE format
    if ((wav == NULL) || (wav->predictor == NULL))
-      return 0;
-   
-   unsigned char *sndData = malloc(wav->sound_length * sizeof(unsigned char));
-   for(unsigned int i = 0; i < wav->sound_length; i++) {
-      sndData[i] = snd_data[wav->sound_offset+i];
-   }
-   
-
-   signed short* out_raw_data = malloc(wav->sound_length * 4 * sizeof(signed short));
-   int n_samples = decode(sndData, out_raw_data, wav->sound_length, wav->predictor, 0);
-   
-   unsigned long chunk_size = 0x28 + (n_samples * 2) + 0x44 - 0x8;
-   
-   unsigned char *wav_data = malloc((chunk_size + 0x8 + 0x4) * sizeof(unsigned char));
-   
-   wav_data[0x0] = 0x52;
-   wav_data[0x1] = 0x49;
-   wav_data[0x2] = 0x46;
-   wav_data[0x3] = 0x46;
-   wav_data[0x4] = ((chunk_size >> 0) & 0xFF);
-   wav_data[0x5] = ((chunk_size >> 8) & 0xFF);
-   wav_data[0x6] = ((chunk_size >> 16) & 0xFF);
-   wav_data[0x7] = ((chunk_size >> 24) & 0xFF);
-   wav_data[0x8] = 0x57;
-   wav_data[0x9] = 0x41;
-   wav_data[0xA] = 0x56;
-   wav_data[0xB] = 0x45;
-   wav_data[0xC] = 0x66;
-   wav_data[0xD] = 0x6D;
-   wav_data[0xE] = 0x74;
-   wav_data[0xF] = 0x20;
-   wav_data[0x10] = 0x10;
-   wav_data[0x11] = 0x00;
-   wav_data[0x12] = 0x00;
-   wav_data[0x13] = 0x00;
-   wav_data[0x14] = 0x01;
-   wav_data[0x15] = 0x00;
-   wav_data[0x16] = 0x01;
-   wav_data[0x17] = 0x00;
-   wav_data[0x18] = (((unsigned long)sampling_rate_float >> 0) & 0xFF);
-   wav_data[0x19] = (((unsigned long)sampling_rate_float >> 8) & 0xFF);
-   wav_data[0x1A] = (((unsigned long)sampling_rate_float >> 16) & 0xFF);
-   wav_data[0x1B] = (((unsigned long)sampling_rate_float >> 24) & 0xFF);
-   wav_data[0x1C] = ((((unsigned long)sampling_rate_float * 2) >> 0) & 0xFF);
-   wav_data[0x1D] = ((((unsigned long)sampling_rate_float * 2) >> 8) & 0xFF);
-   wav_data[0x1E] = ((((unsigned long)sampling_rate_float * 2) >> 16) & 0xFF);
-   wav_data[0x1F] = ((((unsigned long)sampling_rate_float * 2) >> 24) & 0xFF);
-   wav_data[0x20] = 0x02;
-   wav_data[0x21] = 0x00;
-   wav_data[0x22] = 0x10;
-   wav_data[0x23] = 0x00;
-   wav_data[0x24] = 0x64;
-   wav_data[0x25] = 0x61;
-   wav_data[0x26] = 0x74;
-   wav_data[0x27] = 0x61;
-
-   unsigned long length = (n_samples * 2);
-   
-   wav_data[0x28] = ((length >> 0) & 0xFF);
-   wav_data[0x29] = ((length >> 8) & 0xFF);
-   wav_data[0x2A] = ((length >> 16) & 0xFF);
-   wav_data[0x2B] = ((length >> 24) & 0xFF);
-   
-   for (int x = 0; x < n_samples; x++)
-   {
-      wav_data[0x2C + x * 2] = ((out_raw_data[x] >> 0) & 0xFF);
-      wav_data[0x2C + x * 2 + 1] = ((out_raw_data[x] >> 8) & 0xFF);
-   }
+      return NULL;
+
+   // header, data chunk and smpl chunk in one buffer, samples are decoded straight into the data chunk
+   unsigned long max_samples = (wav->sound_length / 9) * 16;
+   unsigned char *wav_data = malloc(WAV_HEADER_LENGTH + max_samples * 2 + SFX_WAV_SMPL_LENGTH);
+   signed short *pcm = (signed short *)&wav_data[WAV_HEADER_LENGTH];
+   unsigned long n_samples = decode(&snd_data[wav->sound_offset], pcm, wav->sound_length, wav->predictor, 0);
+   unsigned long length = n_samples * 2;
+   unsigned long rate = (unsigned long)sampling_rate_float;
+
+   *wav_length = WAV_HEADER_LENGTH + length + SFX_WAV_SMPL_LENGTH;
+
+   // mono 16-bit PCM
+   memcpy(&wav_data[0x0], "RIFF", 4);
+   sfx_write_u32_le(&wav_data[0x4], *wav_length - 0x8);
+   memcpy(&wav_data[0x8], "WAVEfmt ", 8);
+   sfx_write_u32_le(&wav_data[0x10], 0x10);
+   sfx_write_u16_le(&wav_data[0x14], 1);
+   sfx_write_u16_le(&wav_data[0x16], 1);
+   sfx_write_u32_le(&wav_data[0x18], rate);
+   sfx_write_u32_le(&wav_data[0x1C], rate * 2);
+   sfx_write_u16_le(&wav_data[0x20], 2);
+   sfx_write_u16_le(&wav_data[0x22], 0x10);
+   memcpy(&wav_data[0x24], "data", 4);
+   sfx_write_u32_le(&wav_data[0x28], length);
+
+   // samples were decoded in host order
+   for (unsigned long x = 0; x < n_samples; x++)
+      sfx_write_u16_le(&wav_data[WAV_HEADER_LENGTH + x * 2], (unsigned short)pcm[x]);
+
+   build_raw_sound_smpl(&wav_data[WAV_HEADER_LENGTH + length], wav, key_base);
+
+   return wav_data;
+}
 
-   unsigned long wavIndex = 0x2C + n_samples * 2;
-   
-   if (wav->loop->start != 0 || wav->loop->count != 0)
-   {
-      for (int x = 0; x < 0x44; x++)
-         wav_data[wavIndex + x] = 0x00;
-
-      wav_data[wavIndex + 0x0] = 0x73;
-      wav_data[wavIndex + 0x1] = 0x6D;
-      wav_data[wavIndex + 0x2] = 0x70;
-      wav_data[wavIndex + 0x3] = 0x6C;
-      wav_data[wavIndex + 0x4] = 0x3C;
-      wav_data[wavIndex + 0x5] = 0x00;
-      wav_data[wavIndex + 0x6] = 0x00;
-      wav_data[wavIndex + 0x7] = 0x00;
-      
-      //This value only holds true for Mario/Zelda/StarFox formats
-      {
-         wav_data[wavIndex + 0x14] = sfx_convert_ead_game_value_to_key_base(key_base);
-      }
-      
-      wav_data[wavIndex + 0x15] = 0x00;
-      wav_data[wavIndex + 0x16] = 0x00;
-      wav_data[wavIndex + 0x17] = 0x00;
-      
-      wav_data[wavIndex + 0x24] = 0x01;
-      wav_data[wavIndex + 0x25] = 0x00;
-      wav_data[wavIndex + 0x26] = 0x00;
-      wav_data[wavIndex + 0x27] = 0x00;
+int extract_raw_sound(char *sound_dir, char *wav_name, wave_table *wav, float key_base, unsigned char *snd_data, unsigned long sampling_rate)
+{
+   char wav_file[FILENAME_MAX];
+   unsigned long wav_length;
+   unsigned char *wav_data = decode_raw_sound(wav, key_base, snd_data, sampling_rate, &wav_length);
 
-      if (wav->loop->count > 0)
-      {
-         wav_data[wavIndex + 0x34] = ((wav->loop->start >> 0) & 0xFF);
-         wav_data[wavIndex + 0x35] = ((wav->loop->start >> 8) & 0xFF);
-         wav_data[wavIndex + 0x36] = ((wav->loop->start >> 16) & 0xFF);
-         wav_data[wavIndex + 0x37] = ((wav->loop->start >> 24) & 0xFF);
-         wav_data[wavIndex + 0x38] = (((wav->loop->end) >> 0) & 0xFF);
-         wav_data[wavIndex + 0x39] = (((wav->loop->end) >> 8) & 0xFF);
-         wav_data[wavIndex + 0x3A] = (((wav->loop->end) >> 16) & 0xFF);
-         wav_data[wavIndex + 0x3B] = (((wav->loop->end) >> 24) & 0xFF);
-
-         if (wav->loop->count == 0xFFFFFFFF)
-         {
-            wav_data[wavIndex + 0x40] = 0x00;
-            wav_data[wavIndex + 0x41] = 0x00;
-            wav_data[wavIndex + 0x42] = 0x00;
-            wav_data[wavIndex + 0x43] = 0x00;
-         }
-         else
-         {
-            wav_data[wavIndex + 0x40] = (((wav->loop->count) >> 0) & 0xFF);
-            wav_data[wavIndex + 0x41] = (((wav->loop->count) >> 8) & 0xFF);
-            wav_data[wavIndex + 0x42] = (((wav->loop->count) >> 16) & 0xFF);
-            wav_data[wavIndex + 0x43] = (((wav->loop->count) >> 24) & 0xFF);
-         }
-      }
-   }
-   else
-   {
-      for (int x = 0; x < 0x44; x++)
-         wav_data[wavIndex + x] = 0x00;
-
-      wav_data[wavIndex + 0x0] = 0x73;
-      wav_data[wavIndex + 0x1] = 0x6D;
-      wav_data[wavIndex + 0x2] = 0x70;
-      wav_data[wavIndex + 0x3] = 0x6C;
-      wav_data[wavIndex + 0x4] = 0x3C;
-      wav_data[wavIndex + 0x5] = 0x00;
-      wav_data[wavIndex + 0x6] = 0x00;
-      wav_data[wavIndex + 0x7] = 0x00;
-      
-      //This value only holds true for Mario/Zelda/StarFox formats
-      {
-         wav_data[wavIndex + 0x14] = sfx_convert_ead_game_value_to_key_base(key_base);
-      }
-      wav_data[wavIndex + 0x15] = 0x00;
-      wav_data[wavIndex + 0x16] = 0x00;
-      wav_data[wavIndex + 0x17] = 0x00;
-   }
+   if (wav_data == NULL)
+      return 0;
 
-   write_file(wav_file, wav_data, (chunk_size + 0x8 + 0x4));
+   sprintf(wav_file, "%s/%s.wav", sound_dir, wav_name);
+   write_file_if_changed(wav_file, wav_data, wav_length);
    
    free(wav_data);
-   free(out_raw_data);
 
    return 1;
 }
 
 sound_data_header read_sound_data(unsigned char *data, unsigned int data_offset) {
    
-   unsigned i, j;
+   unsigned i;
    sound_data_header sound_data;
    
+   sound_data.data = NULL;
+   sound_data.length = NULL;
    sound_data.unknown = read_u16_be(&data[data_offset]);
    sound_data.data_count = read_u16_be(&data[data_offset+2]);
    
    if (sound_data.data_count > 0) {
       sound_data.data = malloc(sound_data.data_count * sizeof(*sound_data.data));
+      sound_data.length = malloc(sound_data.data_count * sizeof(*sound_data.length));
       for (i = 0; i < sound_data.data_count; i++) {
          unsigned int sound_data_offset = read_u32_be(&data[data_offset+i*8+4]) + data_offset;
-         unsigned int sound_data_length = read_u32_be(&data[data_offset+i*8+8]);
-
-         sound_data.data[i] = malloc(sound_data_length * sizeof(unsigned char));
-         for(j = 0; j < sound_data_length; j++) {
-            sound_data.data[i][j] = data[sound_data_offset+j];
-         }
+         sound_data.data[i] = &data[sound_data_offset];
+         sound_data.length[i] = read_u32_be(&data[data_offset+i*8+8]);
       }
    }
    
@@ -512,13 +475,14 @@ sound_data_header read_sound_data(unsigned char *data, unsigned int data_offset)
    
 sound_bank_header read_sound_bank(unsigned char *data, unsigned int data_offset) {
    
-   unsigned i, j, k;
+   unsigned i, j;
    sound_bank_header sound_banks;
    
    sound_banks.unknown = read_u16_be(&data[data_offset]);
    sound_banks.bank_count = read_u16_be(&data[data_offset+2]);
+   sound_banks.banks = NULL;
    if (sound_banks.bank_count > 0) {
-      sound_banks.banks = malloc(sound_banks.bank_count * sizeof(*sound_banks.banks));
+      sound_banks.banks = calloc(sound_banks.bank_count, sizeof(*sound_banks.banks));
       for (i = 0; i < sound_banks.bank_count; i++) {
         unsigned int sound_bank_offset = read_u32_be(&data[data_offset+i*8+4]) + data_offset;
         //unsigned int length = read_u32_be(&data[secCtl->start+i*8+8]);
@@ -530,7 +494,7 @@ sound_bank_header read_sound_bank(unsigned char *data, unsigned int data_offset)
        
        //sounds
        if (sound_banks.banks[i].instrument_count > 0) {
-          sound_banks.banks[i].sounds = malloc(sound_banks.banks[i].instrument_count * sizeof(*sound_banks.banks[i].sounds));
+          sound_banks.banks[i].sounds = calloc(sound_banks.banks[i].instrument_count, sizeof(*sound_banks.banks[i].sounds));
          for (j = 0; j < sound_banks.banks[i].instrument_count; j++) {
             unsigned int sound_offset = read_u32_be(&data[sound_bank_offset+20+j*4]);
             
@@ -543,10 +507,7 @@ sound_bank_header read_sound_bank(unsigned char *data, unsigned int data_offset)
                //adrs
                unsigned int adrs_offset = read_u32_be(&data[sound_offset+4]);
                if(adrs_offset != 0) {
-                  sound_banks.banks[i].sounds[j].adrs = malloc(8 * sizeof(unsigned));
-                  for (k = 0; k < 8; k++) {
-                     sound_banks.banks[i].sounds[j].adrs[k] = read_u16_be(&data[adrs_offset+sound_bank_offset+16+k*2]);
-                  }
+                  sound_banks.banks[i].sounds[j].adrs = read_envelope(data, adrs_offset+sound_bank_offset+16, &sound_banks.banks[i].sounds[j].adrs_count);
                }
                
                //wav_prev
@@ -591,7 +552,7 @@ sound_bank_header read_sound_bank(unsigned char *data, unsigned int data_offset)
        if (sound_banks.banks[i].percussion_count > 0) {
          unsigned int perc_table_offset = read_u32_be(&data[sound_bank_offset+16]) + sound_bank_offset + 16;
          
-          sound_banks.banks[i].percussions.items = malloc(sound_banks.banks[i].percussion_count * sizeof(percussion));
+          sound_banks.banks[i].percussions.items = calloc(sound_banks.banks[i].percussion_count, sizeof(percussion));
          for (j = 0; j < sound_banks.banks[i].percussion_count; j++) {
             unsigned int perc_offset = read_u32_be(&data[perc_table_offset+j*4]);
             
@@ -612,10 +573,7 @@ sound_bank_header read_sound_bank(unsigned char *data, unsigned int data_offset)
                //adrs
                unsigned int adrs_offset = read_u32_be(&data[perc_offset+12]);
                if(adrs_offset != 0) {
-                  sound_banks.banks[i].percussions.items[j].adrs = malloc(8 * sizeof(unsigned));
-                 for (k = 0; k < 8; k++) {
-                    sound_banks.banks[i].percussions.items[j].adrs[k] = read_u16_be(&data[adrs_offset+sound_bank_offset+16+k*2]);
-                 }
+                  sound_banks.banks[i].percussions.items[j].adrs = read_envelope(data, adrs_offset+sound_bank_offset+16, &sound_banks.banks[i].percussions.items[j].adrs_count);
               }
             }
          }
@@ -627,3 +585,1518 @@ sound_bank_header read_sound_bank(unsigned char *data, unsigned int data_offset)
 }
    
    
+
+static void free_wave_table(wave_table *wav)
+{
+   if (wav == NULL)
+      return;
+   if (wav->loop != NULL) {
+      free(wav->loop->state);
+      free(wav->loop);
+   }
+   if (wav->predictor != NULL) {
+      free_book(wav->predictor);
+      free(wav->predictor);
+   }
+   free(wav);
+}
+
+void free_sound_bank(sound_bank_header *sound_banks)
+{
+   unsigned i, j;
+   for (i = 0; i < sound_banks->bank_count; i++) {
+      sound_bank *bank = &sound_banks->banks[i];
+      if (bank->sounds != NULL) {
+         for (j = 0; j < bank->instrument_count; j++) {
+            free_wave_table(bank->sounds[j].wav_prev);
+            free_wave_table(bank->sounds[j].wav);
+            free_wave_table(bank->sounds[j].wav_sec);
+            free(bank->sounds[j].adrs);
+         }
+         free(bank->sounds);
+      }
+      if (bank->percussions.items != NULL) {
+         for (j = 0; j < bank->percussion_count; j++) {
+            free_wave_table(bank->percussions.items[j].wav);
+            free(bank->percussions.items[j].adrs);
+         }
+         free(bank->percussions.items);
+      }
+   }
+   free(sound_banks->banks);
+   sound_banks->banks = NULL;
+   sound_banks->bank_count = 0;
+}
+
+void free_sound_data(sound_data_header *sound_data)
+{
+   free(sound_data->data);
+   free(sound_data->length);
+   sound_data->data = NULL;
+   sound_data->length = NULL;
+   sound_data->data_count = 0;
+}
+
+// *************** //
+// .ctl/.tbl Write //
+// *************** //
+
+// output buffer, blobs written for the current bank are shared by identical ones
+typedef struct {
+   unsigned char *data;
+   long length;
+   long allocated;
+   long *blobs;
+   long *blob_lengths;
+   int blob_count;
+   int blob_allocated;
+} sfx_writer;
+
+static void sfx_write_f32_be(unsigned char *buf, float val)
+{
+   union {unsigned int i; float f;} u;
+   u.f = val;
+   write_u32_be(buf, u.i);
+}
+
+// append length zeroed bytes aligned to 16 bytes
+// returns offset of the new bytes
+static long sfx_writer_alloc(sfx_writer *w, long length)
+{
+   long offset = ALIGN(w->length, 16);
+   if (offset + length > w->allocated) {
+      w->allocated = MAX(2 * w->allocated, offset + length + 0x1000);
+      w->data = realloc(w->data, w->allocated);
+   }
+   memset(&w->data[w->length], 0, offset + length - w->length);
+   w->length = offset + length;
+   return offset;
+}
+
+// append bytes unless the same bytes were already written for this bank
+// returns offset of the bytes
+static long sfx_writer_blob(sfx_writer *w, const unsigned char *bytes, long length)
+{
+   long offset;
+   for (int b = 0; b < w->blob_count; b++) {
+      if (w->blob_lengths[b] == length && !memcmp(&w->data[w->blobs[b]], bytes, length)) {
+         return w->blobs[b];
+      }
+   }
+   offset = sfx_writer_alloc(w, length);
+   memcpy(&w->data[offset], bytes, length);
+   if (w->blob_count >= w->blob_allocated) {
+      w->blob_allocated = MAX(2 * w->blob_allocated, 64);
+      w->blobs = realloc(w->blobs, w->blob_allocated * sizeof(*w->blobs));
+      w->blob_lengths = realloc(w->blob_lengths, w->blob_allocated * sizeof(*w->blob_lengths));
+   }
+   w->blobs[w->blob_count] = offset;
+   w->blob_lengths[w->blob_count] = length;
+   w->blob_count++;
+   return offset;
+}
+
+// returns offset of the envelope relative to base, 0 if none
+static unsigned int write_envelope(sfx_writer *w, long base, const unsigned *adrs, unsigned int count)
+{
+   unsigned char bytes[2 * 2 * SFX_MAX_ENVELOPE];
+   if (adrs == NULL || count == 0)
+      return 0;
+   count = MIN(count, 2 * SFX_MAX_ENVELOPE);
+   for (unsigned int k = 0; k < count; k++)
+      write_u16_be(&bytes[k*2], adrs[k]);
+   return sfx_writer_blob(w, bytes, count * 2) - base;
+}
+
+// returns offset of the wave table relative to base, 0 if none
+static unsigned int write_wave_table(sfx_writer *w, long base, const wave_table *wav)
+{
+   unsigned char bytes[0x10 + 2 * SFX_LOOP_STATE_LENGTH];
+   unsigned int loop_offset = 0;
+   unsigned int predictor_offset = 0;
+
+   if (wav == NULL)
+      return 0;
+
+   if (wav->loop != NULL) {
+      long length = 0x10;
+      write_u32_be(&bytes[0x0], wav->loop->start);
+      write_u32_be(&bytes[0x4], wav->loop->end);
+      write_u32_be(&bytes[0x8], wav->loop->count);
+      write_u32_be(&bytes[0xC], wav->loop->unknown);
+      if (wav->loop->state != NULL) {
+         for (int k = 0; k < SFX_LOOP_STATE_LENGTH; k++)
+            write_u16_be(&bytes[0x10+k*2], wav->loop->state[k]);
+         length += 2 * SFX_LOOP_STATE_LENGTH;
+      }
+      loop_offset = sfx_writer_blob(w, bytes, length) - base;
+   }
+
+   if (wav->predictor != NULL) {
+      unsigned int values = 8 * wav->predictor->order * wav->predictor->predictor_count;
+      unsigned char *book = malloc(8 + values * 2);
+      write_u32_be(&book[0x0], wav->predictor->order);
+      write_u32_be(&book[0x4], wav->predictor->predictor_count);
+      for (unsigned int k = 0; k < values; k++)
+         write_u16_be(&book[8+k*2], wav->predictor->data[k]);
+      predictor_offset = sfx_writer_blob(w, book, 8 + values * 2) - base;
+      free(book);
+   }
+
+   write_u32_be(&bytes[0x00], wav->unknown_1);
+   write_u32_be(&bytes[0x04], wav->sound_offset);
+   write_u32_be(&bytes[0x08], loop_offset);
+   write_u32_be(&bytes[0x0C], predictor_offset);
+   write_u32_be(&bytes[0x10], wav->sound_length);
+   write_u32_be(&bytes[0x14], wav->unknown_2);
+   write_u32_be(&bytes[0x18], wav->unknown_3);
+   write_u32_be(&bytes[0x1C], wav->unknown_4);
+   return sfx_writer_blob(w, bytes, 0x20) - base;
+}
+
+// returns offset of the instrument relative to base, 0 for empty slots
+static unsigned int write_sound(sfx_writer *w, long base, const sound *snd)
+{
+   unsigned char bytes[0x20];
+   unsigned int adrs_offset, wav_prev_offset, wav_offset, wav_sec_offset;
+
+   if (snd->unknown == 0 && snd->adrs == NULL && snd->wav_prev == NULL && snd->wav == NULL && snd->wav_sec == NULL)
+      return 0;
+
+   adrs_offset = write_envelope(w, base, snd->adrs, snd->adrs_count);
+   wav_prev_offset = write_wave_table(w, base, snd->wav_prev);
+   wav_offset = write_wave_table(w, base, snd->wav);
+   wav_sec_offset = write_wave_table(w, base, snd->wav_sec);
+
+   write_u32_be(&bytes[0x00], snd->unknown);
+   write_u32_be(&bytes[0x04], adrs_offset);
+   write_u32_be(&bytes[0x08], wav_prev_offset);
+   sfx_write_f32_be(&bytes[0x0C], snd->key_base_prev);
+   write_u32_be(&bytes[0x10], wav_offset);
+   sfx_write_f32_be(&bytes[0x14], snd->key_base);
+   write_u32_be(&bytes[0x18], wav_sec_offset);
+   sfx_write_f32_be(&bytes[0x1C], snd->key_base_sec);
+   return sfx_writer_blob(w, bytes, 0x20) - base;
+}
+
+// returns offset of the percussion relative to base, 0 for empty slots
+static unsigned int write_percussion(sfx_writer *w, long base, const percussion *perc)
+{
+   unsigned char bytes[0x10];
+   unsigned int wav_offset, adrs_offset;
+
+   if (perc->unknown_1 == 0 && perc->pan == 0 && perc->unknown_2 == 0 && perc->wav == NULL && perc->adrs == NULL)
+      return 0;
+
+   wav_offset = write_wave_table(w, base, perc->wav);
+   adrs_offset = write_envelope(w, base, perc->adrs, perc->adrs_count);
+
+   bytes[0x0] = perc->unknown_1;
+   bytes[0x1] = perc->pan;
+   write_u16_be(&bytes[0x2], perc->unknown_2);
+   write_u32_be(&bytes[0x4], wav_offset);
+   sfx_write_f32_be(&bytes[0x8], perc->key_base);
+   write_u32_be(&bytes[0xC], adrs_offset);
+   return sfx_writer_blob(w, bytes, 0x10) - base;
+}
+
+// returns offset of the bank
+static long write_bank(sfx_writer *w, const sound_bank *bank)
+{
+   long start = sfx_writer_alloc(w, 0x10 + 4 + bank->instrument_count * 4);
+   long base = start + 0x10;
+   unsigned int offset;
+
+   // nothing is shared across banks, offsets are relative to each bank
+   w->blob_count = 0;
+
+   write_u32_be(&w->data[start+0x0], bank->instrument_count);
+   write_u32_be(&w->data[start+0x4], bank->percussion_count);
+   write_u32_be(&w->data[start+0x8], bank->unknown_1);
+   write_u32_be(&w->data[start+0xC], bank->unknown_2);
+
+   if (bank->percussion_count > 0 && bank->percussions.items != NULL) {
+      long table = sfx_writer_alloc(w, bank->percussion_count * 4);
+      write_u32_be(&w->data[base], table - base);
+      for (unsigned int j = 0; j < bank->percussion_count; j++) {
+         offset = write_percussion(w, base, &bank->percussions.items[j]);
+         write_u32_be(&w->data[table+j*4], offset);
+      }
+   }
+
+   if (bank->sounds != NULL) {
+      for (unsigned int j = 0; j < bank->instrument_count; j++) {
+         offset = write_sound(w, base, &bank->sounds[j]);
+         write_u32_be(&w->data[base+4+j*4], offset);
+      }
+   }
+
+   return start;
+}
+
+long write_sound_bank(const sound_bank_header *sound_banks, unsigned char **ctl)
+{
+   sfx_writer w = {0};
+
+   sfx_writer_alloc(&w, 4 + sound_banks->bank_count * 8);
+   write_u16_be(&w.data[0], sound_banks->unknown);
+   write_u16_be(&w.data[2], sound_banks->bank_count);
+
+   for (unsigned int i = 0; i < sound_banks->bank_count; i++) {
+      long start = write_bank(&w, &sound_banks->banks[i]);
+      write_u32_be(&w.data[4+i*8], start);
+      write_u32_be(&w.data[8+i*8], w.length - start);
+   }
+   sfx_writer_alloc(&w, 0);
+
+   free(w.blobs);
+   free(w.blob_lengths);
+   *ctl = w.data;
+   return w.length;
+}
+
+long write_sound_data(const sound_data_header *sound_data, unsigned char **tbl)
+{
+   sfx_writer w = {0};
+
+   sfx_writer_alloc(&w, 4 + sound_data->data_count * 8);
+   write_u16_be(&w.data[0], sound_data->unknown);
+   write_u16_be(&w.data[2], sound_data->data_count);
+
+   for (unsigned int i = 0; i < sound_data->data_count; i++) {
+      long offset = -1;
+      // banks can share their sound data
+      for (unsigned int j = 0; j < i; j++) {
+         if (sound_data->data[j] == sound_data->data[i] && sound_data->length[j] == sound_data->length[i]) {
+            offset = read_u32_be(&w.data[4+j*8]);
+            break;
+         }
+      }
+      if (offset < 0) {
+         offset = sfx_writer_alloc(&w, sound_data->length[i]);
+         memcpy(&w.data[offset], sound_data->data[i], sound_data->length[i]);
+      }
+      write_u32_be(&w.data[4+i*8], offset);
+      write_u32_be(&w.data[8+i*8], sound_data->length[i]);
+   }
+   sfx_writer_alloc(&w, 0);
+
+   *tbl = w.data;
+   return w.length;
+}
+
+// *************** //
+// VADPCM Encoding //
+// *************** //
+
+// largest scale that does not wrap 16 bits
+#define SFX_MAX_SCALE 12
+// frames quieter than this do not take part in the book design
+#define SFX_SILENCE (16.0 * 4 * 4)
+// pole radius limit of the designed predictors
+#define SFX_STABLE 0.999
+#define SFX_LLOYD_ITERATIONS 20
+
+static unsigned int sfx_read_u16_le(const unsigned char *buf)
+{
+   return buf[0] | (buf[1] << 8);
+}
+
+static unsigned int sfx_read_u32_le(const unsigned char *buf)
+{
+   return sfx_read_u16_le(buf) | ((unsigned int)sfx_read_u16_le(buf + 2) << 16);
+}
+
+signed short *read_raw_sound(const unsigned char *wav_data, long wav_length, unsigned long *n_samples, loop_data *loop, int *has_loop)
+{
+   const unsigned char *fmt = NULL;
+   const unsigned char *pcm = NULL;
+   unsigned long pcm_length = 0;
+   signed short *samples;
+   long offset = 12;
+
+   *has_loop = 0;
+   if (wav_length < 12 || memcmp(&wav_data[0x0], "RIFF", 4) || memcmp(&wav_data[0x8], "WAVE", 4))
+      return NULL;
+
+   while (offset + 8 <= wav_length) {
+      const unsigned char *chunk = &wav_data[offset];
+      unsigned long size = sfx_read_u32_le(&chunk[4]);
+      if (size > (unsigned long)(wav_length - offset - 8))
+         size = wav_length - offset - 8;
+      if (!memcmp(chunk, "fmt ", 4) && size >= 0x10) {
+         fmt = &chunk[8];
+      } else if (!memcmp(chunk, "data", 4)) {
+         pcm = &chunk[8];
+         pcm_length = size;
+      } else if (!memcmp(chunk, "smpl", 4) && size >= SFX_WAV_SMPL_LENGTH - 8) {
+         // first loop only, same fields as build_raw_sound_smpl
+         unsigned int start = sfx_read_u32_le(&chunk[0x34]);
+         unsigned int end = sfx_read_u32_le(&chunk[0x38]);
+         unsigned int count = sfx_read_u32_le(&chunk[0x40]);
+         if (sfx_read_u32_le(&chunk[0x24]) > 0 && end > start) {
+            loop->start = start;
+            loop->end = end;
+            loop->count = (count == 0) ? 0xFFFFFFFF : count;
+            *has_loop = 1;
+         }
+      }
+      offset += 8 + size + (size & 1);
+   }
+
+   if (fmt == NULL || pcm == NULL)
+      return NULL;
+   if (sfx_read_u16_le(&fmt[0x0]) != 1 || sfx_read_u16_le(&fmt[0x2]) != 1 || sfx_read_u16_le(&fmt[0xE]) != 16)
+      return NULL;
+
+   *n_samples = pcm_length / 2;
+   samples = malloc((*n_samples + 1) * sizeof(*samples));
+   for (unsigned long x = 0; x < *n_samples; x++)
+      samples[x] = (signed short)sfx_read_u16_le(&pcm[x*2]);
+   return samples;
+}
+
+static long sfx_round(double val)
+{
+   return (val >= 0) ? (long)(val + 0.5) : -(long)(-val + 0.5);
+}
+
+// order 2 predictor minimizing the prediction error of an autocorrelation matrix
+// r[i][j]: sum of x[n-i] * x[n-j]
+// a: set to the coefficients of x[n-1] and x[n-2]
+static void sfx_solve_predictor(double r[3][3], double a[2])
+{
+   double det = r[1][1] * r[2][2] - r[1][2] * r[1][2];
+   double limit;
+
+   a[0] = a[1] = 0;
+   if (det > 1e-9 * r[1][1] * r[2][2] && det > 0) {
+      a[0] = (r[0][1] * r[2][2] - r[0][2] * r[1][2]) / det;
+      a[1] = (r[0][2] * r[1][1] - r[0][1] * r[1][2]) / det;
+   } else if (r[1][1] > 0) {
+      // singular, fall back to order 1
+      a[0] = r[0][1] / r[1][1];
+   }
+
+   // keep both poles inside the unit circle
+   a[1] = MAX(-SFX_STABLE, MIN(SFX_STABLE, a[1]));
+   limit = SFX_STABLE - a[1];
+   a[0] = MAX(-limit, MIN(limit, a[0]));
+}
+
+// prediction error of coefficients a over an autocorrelation matrix
+static double sfx_predictor_error(double r[3][3], const double a[2])
+{
+   return r[0][0] - 2 * (a[0] * r[0][1] + a[1] * r[0][2])
+        + a[0] * a[0] * r[1][1] + 2 * a[0] * a[1] * r[1][2] + a[1] * a[1] * r[2][2];
+}
+
+int design_book(const signed short *pcm, unsigned long n_samples, unsigned int predictor_count, predictor_data *book)
+{
+   unsigned long frame_count = (n_samples + SFX_FRAME_SAMPLES - 1) / SFX_FRAME_SAMPLES;
+   unsigned long used = 0;
+   double (*stats)[3][3];
+   double (*sums)[3][3];
+   double centroid[SFX_MAX_PREDICTORS][2] = {{0}};
+   double total[3][3] = {{0}};
+
+   if (predictor_count == 0 || predictor_count > SFX_MAX_PREDICTORS || !is_power2(predictor_count))
+      return -1;
+
+   // autocorrelation of each frame, samples before the start are silence
+   stats = malloc((frame_count + 1) * sizeof(*stats));
+   sums = malloc(SFX_MAX_PREDICTORS * sizeof(*sums));
+   for (unsigned long f = 0; f < frame_count; f++) {
+      double (*r)[3] = stats[used];
+      memset(r, 0, sizeof(stats[used]));
+      for (unsigned long n = f * SFX_FRAME_SAMPLES; n < (f + 1) * SFX_FRAME_SAMPLES; n++) {
+         double x[3];
+         for (int k = 0; k < 3; k++)
+            x[k] = (n >= (unsigned long)k && n - k < n_samples) ? pcm[n-k] : 0;
+         for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+               r[i][j] += x[i] * x[j];
+      }
+      if (r[0][0] > SFX_SILENCE) {
+         for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+               total[i][j] += r[i][j];
+         used++;
+      }
+   }
+   sfx_solve_predictor(total, centroid[0]);
+
+   // split every predictor in two and refine with Lloyd iterations on the prediction error
+   for (unsigned int count = 1; count < predictor_count && used > 0; count *= 2) {
+      double last_error = -1;
+      for (unsigned int c = 0; c < count; c++) {
+         centroid[c+count][0] = centroid[c][0] - 0.01;
+         centroid[c+count][1] = centroid[c][1] - 0.01;
+         centroid[c][0] += 0.01;
+         centroid[c][1] += 0.01;
+      }
+      for (int iteration = 0; iteration < SFX_LLOYD_ITERATIONS; iteration++) {
+         unsigned long members[SFX_MAX_PREDICTORS] = {0};
+         double error = 0;
+         memset(sums, 0, SFX_MAX_PREDICTORS * sizeof(*sums));
+         for (unsigned long f = 0; f < used; f++) {
+            unsigned int best = 0;
+            double best_error = sfx_predictor_error(stats[f], centroid[0]);
+            for (unsigned int c = 1; c < 2 * count; c++) {
+               double e = sfx_predictor_error(stats[f], centroid[c]);
+               if (e < best_error) {
+                  best_error = e;
+                  best = c;
+               }
+            }
+            for (int i = 0; i < 3; i++)
+               for (int j = 0; j < 3; j++)
+                  sums[best][i][j] += stats[f][i][j];
+            members[best]++;
+            error += best_error;
+         }
+         // empty predictors keep their coefficients
+         for (unsigned int c = 0; c < 2 * count; c++) {
+            if (members[c] > 0)
+               sfx_solve_predictor(sums[c], centroid[c]);
+         }
+         if (last_error >= 0 && last_error - error <= 1e-6 * last_error)
+            break;
+         last_error = error;
+      }
+   }
+   free(stats);
+   free(sums);
+
+   // the book holds the first 8 outputs of each predictor started from x[-2] = 1 and from x[-1] = 1
+   book->order = 2;
+   book->predictor_count = predictor_count;
+   book->data = malloc(16 * predictor_count * sizeof(unsigned));
+   for (unsigned int p = 0; p < predictor_count; p++) {
+      for (int column = 0; column < 2; column++) {
+         double x2 = (column == 0) ? 1 : 0;
+         double x1 = (column == 0) ? 0 : 1;
+         for (int i = 0; i < 8; i++) {
+            double x = centroid[p][0] * x1 + centroid[p][1] * x2;
+            long coef = sfx_round(x * (1 << 0xb));
+            coef = MAX(-0x8000, MIN(0x7FFF, coef));
+            book->data[p * 16 + column * 8 + i] = (unsigned short)coef;
+            x2 = x1;
+            x1 = x;
+         }
+      }
+   }
+   sfx_prepare_book(book);
+
+   return 0;
+}
+
+void free_book(predictor_data *book)
+{
+   free(book->data);
+   free(book->matrix);
+   book->data = NULL;
+   book->matrix = NULL;
+}
+
+unsigned long encode_bound(unsigned long n_samples)
+{
+   return (n_samples + SFX_FRAME_SAMPLES - 1) / SFX_FRAME_SAMPLES * SFX_FRAME_LENGTH;
+}
+
+// quantize one frame with a predictor and scale, then decode it the way the console will
+// target: 16 samples to encode
+// v: history [last[6], last[7]] on entry, history after the frame on return
+// nibbles: set to the 16 residual codes
+// returns squared error of the decoded frame
+static long long sfx_encode_frame(const signed short target[16], signed short v[10], const vadpcm_matrix *m, int wide, int scale, unsigned char nibbles[16])
+{
+   signed short out[8];
+   long long error = 0;
+   int round = (1 << scale) >> 1;
+
+   for (int half = 0; half < 2; half++) {
+      // each residual corrects the prediction from the samples decoded before it
+      for (int i = 0; i < 8; i++) {
+         long long prediction = 0;
+         int residual, n;
+         for (int j = 0; j < 2 + i; j++)
+            prediction += (long long)m->coef[j / 2][i * 2 + (j & 1)] * v[j];
+         residual = target[half * 8 + i] - (int)(prediction >> 0xb);
+         n = (residual >= 0) ? ((residual + round) >> scale) : -((-residual + round) >> scale);
+         n = MAX(-8, MIN(7, n));
+         nibbles[half * 8 + i] = n & 0xf;
+         v[2 + i] = (signed short)(n * (1 << scale));
+      }
+      sfx_decode_8(v, m, wide, out);
+      for (int i = 0; i < 8; i++) {
+         long long d = out[i] - target[half * 8 + i];
+         error += d * d;
+      }
+      v[0] = out[6];
+      v[1] = out[7];
+   }
+
+   return error;
+}
+
+unsigned long encode_raw_sound(const signed short *pcm, unsigned long n_samples, const predictor_data *book, unsigned char *out)
+{
+   vadpcm_matrix local[SFX_MAX_PREDICTORS];
+   const vadpcm_matrix *matrix = book->matrix;
+   int wide = book->wide;
+   unsigned int count = MIN(book->predictor_count, SFX_MAX_PREDICTORS);
+   unsigned long frames = (n_samples + SFX_FRAME_SAMPLES - 1) / SFX_FRAME_SAMPLES;
+   signed short history[2] = {0, 0};
+
+   if (count == 0)
+      return 0;
+
+   if (matrix == NULL) {
+      wide = sfx_build_matrices(book, local);
+      matrix = local;
+   }
+
+   for (unsigned long f = 0; f < frames; f++) {
+      signed short target[SFX_FRAME_SAMPLES];
+      unsigned char nibbles[SFX_FRAME_SAMPLES];
+      unsigned char best_nibbles[SFX_FRAME_SAMPLES];
+      signed short best_history[2] = {0, 0};
+      long long best_error = -1;
+      unsigned char header = 0;
+
+      for (int i = 0; i < SFX_FRAME_SAMPLES; i++)
+         target[i] = (f * SFX_FRAME_SAMPLES + i < n_samples) ? pcm[f * SFX_FRAME_SAMPLES + i] : 0;
+
+      // exhaustive search over predictor and scale
+      for (unsigned int p = 0; p < count && best_error != 0; p++) {
+         for (int scale = 0; scale <= SFX_MAX_SCALE; scale++) {
+            signed short v[10] = {history[0], history[1]};
+            long long error = sfx_encode_frame(target, v, &matrix[p], wide, scale, nibbles);
+            if (best_error < 0 || error < best_error) {
+               best_error = error;
+               header = (scale << 4) | p;
+               memcpy(best_nibbles, nibbles, sizeof(best_nibbles));
+               best_history[0] = v[0];
+               best_history[1] = v[1];
+            }
+         }
+      }
+
+      out[0] = header;
+      for (int k = 0; k < 8; k++)
+         out[1 + k] = (best_nibbles[2 * k] << 4) | best_nibbles[2 * k + 1];
+      out += SFX_FRAME_LENGTH;
+      history[0] = best_history[0];
+      history[1] = best_history[1];
+   }
+
+   return frames * SFX_FRAME_LENGTH;
+}
+
+#ifdef SFX_STANDALONE
+#include "workpool.h"
+
+#define SFX_VERSION "0.1"
+
+// longest exported name, "Bank%uPercussion%u" with two 10 digit numbers
+#define SFX_NAME_LENGTH (sizeof("BankPercussion") + 2 * 10)
+
+typedef struct
+{
+   char *rom_filename;
+   char *sound_dir;
+   char *ctl_filename;
+   char *tbl_filename;
+   unsigned int ctl_offset;
+   unsigned int tbl_offset;
+   unsigned int predictor_count;
+   int threads;
+} arg_config;
+
+static arg_config default_config =
+{
+   NULL,
+   NULL,
+   NULL,
+   NULL,
+   0x57B720, // Super Mario 64 (U) sfx.ctl
+   0x593560, // Super Mario 64 (U) sfx.tbl
+   4,
+   0
+};
+
+// a sound as n64split exports it, unique per bank
+typedef struct
+{
+   unsigned int bank;
+   const wave_table *wav;
+   // set by import_job when the .wav was changed
+   int encoded;
+   unsigned char *data;
+   unsigned long length;
+   predictor_data book;
+   loop_data loop;
+   int has_loop;
+   unsigned state[SFX_LOOP_STATE_LENGTH];
+   unsigned int offset;
+} sfx_sample;
+
+// every reference is exported under its own name, all of them decode the same
+typedef struct
+{
+   wave_table *wav;
+   unsigned int sample;
+   char name[SFX_NAME_LENGTH];
+} sfx_reference;
+
+typedef struct
+{
+   const arg_config *config;
+   const sound_data_header *sound_data;
+   sfx_sample *samples;
+   unsigned int sample_count;
+   sfx_reference *refs;
+   unsigned int ref_count;
+} sfx_import_state;
+
+// add a reference to the sample it shares with earlier references in the bank
+static void add_reference(sfx_import_state *state, unsigned int bank, unsigned int bank_start, wave_table *wav, const char *name)
+{
+   unsigned int s;
+
+   // same as export_sound, only ADPCM sounds are exported
+   if (wav == NULL || wav->predictor == NULL)
+      return;
+
+   for (s = bank_start; s < state->sample_count; s++) {
+      const wave_table *first = state->samples[s].wav;
+      if (first->sound_offset == wav->sound_offset && first->sound_length == wav->sound_length &&
+          first->predictor_offset == wav->predictor_offset)
+         break;
+   }
+   if (s == state->sample_count) {
+      state->samples = realloc(state->samples, (s + 1) * sizeof(*state->samples));
+      memset(&state->samples[s], 0, sizeof(*state->samples));
+      state->samples[s].bank = bank;
+      state->samples[s].wav = wav;
+      state->sample_count++;
+   }
+   state->refs = realloc(state->refs, (state->ref_count + 1) * sizeof(*state->refs));
+   state->refs[state->ref_count].wav = wav;
+   state->refs[state->ref_count].sample = s;
+   snprintf(state->refs[state->ref_count].name, sizeof(state->refs[state->ref_count].name), "%s", name);
+   state->ref_count++;
+}
+
+// collect the sounds of every bank in the order n64split exports them
+static void collect_samples(sfx_import_state *state, sound_bank_header *sound_banks)
+{
+   char name[SFX_NAME_LENGTH];
+   for (unsigned int i = 0; i < sound_banks->bank_count && i < state->sound_data->data_count; i++) {
+      sound_bank *bank = &sound_banks->banks[i];
+      unsigned int bank_start = state->sample_count;
+      for (unsigned int j = 0; j < bank->instrument_count; j++) {
+         sound *snd = &bank->sounds[j];
+         snprintf(name, sizeof(name), "Bank%uSound%uPrev", i, j);
+         add_reference(state, i, bank_start, snd->wav_prev, name);
+         snprintf(name, sizeof(name), "Bank%uSound%u", i, j);
+         add_reference(state, i, bank_start, snd->wav, name);
+         snprintf(name, sizeof(name), "Bank%uSound%uSec", i, j);
+         add_reference(state, i, bank_start, snd->wav_sec, name);
+      }
+      for (unsigned int j = 0; j < bank->percussion_count; j++) {
+         snprintf(name, sizeof(name), "Bank%uPercussion%u", i, j);
+         add_reference(state, i, bank_start, bank->percussions.items[j].wav, name);
+      }
+   }
+}
+
+// read a .wav and check whether it still matches the ROM
+// returns its samples if it was changed, NULL if not or if it can't be read
+static signed short *read_changed_sound(const char *wav_file, const signed short *decoded, unsigned long decoded_samples,
+                                        const loop_data *rom_loop, unsigned long *n_samples, loop_data *loop, int *has_loop)
+{
+   unsigned char *wav_data;
+   signed short *pcm;
+   long wav_length;
+   int looped;
+
+   wav_length = read_file(wav_file, &wav_data);
+   if (wav_length < 0) {
+      return NULL;
+   }
+   pcm = read_raw_sound(wav_data, wav_length, n_samples, loop, has_loop);
+   free(wav_data);
+   if (pcm == NULL) {
+      ERROR("Error: \"%s\" is not 16-bit mono PCM, ignoring it\n", wav_file);
+      return NULL;
+   }
+
+   // same loop points as build_raw_sound_smpl writes
+   looped = rom_loop != NULL && rom_loop->count > 0 && rom_loop->end > rom_loop->start;
+   if (*n_samples == decoded_samples && !memcmp(decoded, pcm, decoded_samples * sizeof(*pcm)) && *has_loop == looped &&
+       (!looped || (loop->start == rom_loop->start && loop->end == rom_loop->end && loop->count == rom_loop->count))) {
+      free(pcm);
+      return NULL;
+   }
+   return pcm;
+}
+
+// re-encode one sample if any of its .wav files no longer matches the ROM
+// encoding is lossy, sounds that were not edited keep their ROM data
+static void import_job(void *ctx, int index)
+{
+   const sfx_import_state *state = ctx;
+   sfx_sample *s = &state->samples[index];
+   const wave_table *wav = s->wav;
+   unsigned char *snd_data = state->sound_data->data[s->bank];
+   char wav_file[FILENAME_MAX];
+   signed short *pcm = NULL;
+   signed short *decoded;
+   unsigned long n_samples, decoded_samples, padded;
+   loop_data loop = {0};
+   int has_loop = 0;
+
+   decoded = malloc(((wav->sound_length / SFX_FRAME_LENGTH) * SFX_FRAME_SAMPLES + 1) * sizeof(*decoded));
+   decoded_samples = decode(&snd_data[wav->sound_offset], decoded, wav->sound_length, wav->predictor, 0);
+   for (unsigned int r = 0; r < state->ref_count && pcm == NULL; r++) {
+      if (state->refs[r].sample == (unsigned int)index) {
+         sprintf(wav_file, "%s/%s.wav", state->config->sound_dir, state->refs[r].name);
+         pcm = read_changed_sound(wav_file, decoded, decoded_samples, wav->loop, &n_samples, &loop, &has_loop);
+      }
+   }
+   free(decoded);
+   if (pcm == NULL) {
+      return;
+   }
+
+   INFO("Encoding \"%s\": %lu samples\n", wav_file, n_samples);
+   design_book(pcm, n_samples, state->config->predictor_count, &s->book);
+   s->data = malloc(encode_bound(n_samples) + 1);
+   s->length = encode_raw_sound(pcm, n_samples, &s->book, s->data);
+   padded = s->length / SFX_FRAME_LENGTH * SFX_FRAME_SAMPLES;
+   free(pcm);
+
+   // loop points from the .wav, sounds that don't loop play to their end
+   s->has_loop = has_loop || wav->loop != NULL;
+   s->loop.unknown = (wav->loop != NULL) ? wav->loop->unknown : 0;
+   if (has_loop) {
+      s->loop.end = MIN(loop.end, padded);
+      s->loop.start = MIN(loop.start, s->loop.end);
+      s->loop.count = loop.count;
+   } else {
+      s->loop.start = 0;
+      s->loop.end = padded;
+      s->loop.count = 0;
+   }
+
+   // decoder state at the loop start
+   s->loop.state = NULL;
+   if (s->loop.start != 0 || s->loop.count != 0) {
+      decoded = malloc((padded + 1) * sizeof(*decoded));
+      decode(s->data, decoded, s->length, &s->book, 0);
+      for (int k = 0; k < SFX_LOOP_STATE_LENGTH; k++) {
+         long n = (long)s->loop.start - SFX_LOOP_STATE_LENGTH + k;
+         s->state[k] = (n >= 0) ? (unsigned short)decoded[n] : 0;
+      }
+      free(decoded);
+      s->loop.state = s->state;
+   }
+
+   s->encoded = 1;
+}
+
+// point a wave table at its re-encoded sample, with its own copy of the book and loop
+static void update_wave_table(wave_table *wav, const sfx_sample *s)
+{
+   predictor_data *book = wav->predictor;
+   unsigned int values = 8 * s->book.order * s->book.predictor_count;
+
+   wav->sound_offset = s->offset;
+   wav->sound_length = s->length;
+
+   free_book(book);
+   book->order = s->book.order;
+   book->predictor_count = s->book.predictor_count;
+   book->data = malloc(values * sizeof(*book->data));
+   memcpy(book->data, s->book.data, values * sizeof(*book->data));
+   sfx_prepare_book(book);
+
+   if (wav->loop != NULL) {
+      free(wav->loop->state);
+      free(wav->loop);
+      wav->loop = NULL;
+   }
+   if (s->has_loop) {
+      wav->loop = malloc(sizeof(*wav->loop));
+      *wav->loop = s->loop;
+      if (s->loop.state != NULL) {
+         wav->loop->state = malloc(SFX_LOOP_STATE_LENGTH * sizeof(unsigned));
+         memcpy(wav->loop->state, s->state, SFX_LOOP_STATE_LENGTH * sizeof(unsigned));
+      }
+   }
+}
+
+static void print_usage(void)
+{
+   ERROR("Usage: n64sfx [-c CTL_OFFSET] [-t TBL_OFFSET] [-p PREDICTORS] [-j JOBS] [-v] ROM SOUND_DIR CTL TBL\n"
+         "\n"
+         "n64sfx v" SFX_VERSION ": N64 VADPCM sound bank builder\n"
+         "\n"
+         "Optional arguments:\n"
+         " -c CTL_OFFSET  offset of the sound banks in ROM (default: 0x%X)\n"
+         " -t TBL_OFFSET  offset of the sound data in ROM (default: 0x%X)\n"
+         " -p PREDICTORS  predictors in each new book, 1, 2, 4, 8 or 16 (default: %u)\n"
+         " -j JOBS        number of sounds to encode in parallel (default: number of CPUs)\n"
+         " -v             verbose progress output\n"
+         "\n"
+         "File arguments:\n"
+         " ROM        ROM the sounds were split from\n"
+         " SOUND_DIR  directory of .wav files exported by n64split\n"
+         " CTL        output sound bank file\n"
+         " TBL        output sound data file\n",
+         default_config.ctl_offset, default_config.tbl_offset, default_config.predictor_count);
+   exit(1);
+}
+
+// parse command line arguments
+static void parse_arguments(int argc, char *argv[], arg_config *config)
+{
+   int i;
+   int file_count = 0;
+   if (argc < 5) {
+      print_usage();
+   }
+   for (i = 1; i < argc; i++) {
+      if (argv[i][0] == '-') {
+         switch (argv[i][1]) {
+            case 'c':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->ctl_offset = strtoul(argv[i], NULL, 0);
+               break;
+            case 't':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->tbl_offset = strtoul(argv[i], NULL, 0);
+               break;
+            case 'p':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->predictor_count = strtoul(argv[i], NULL, 0);
+               if (config->predictor_count > SFX_MAX_PREDICTORS || !is_power2(config->predictor_count)) {
+                  print_usage();
+               }
+               break;
+            case 'j':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->threads = strtol(argv[i], NULL, 0);
+               break;
+            case 'v':
+               g_verbosity = 1;
+               break;
+            default:
+               print_usage();
+               break;
+         }
+      } else {
+         switch (file_count) {
+            case 0: config->rom_filename = argv[i]; break;
+            case 1: config->sound_dir = argv[i]; break;
+            case 2: config->ctl_filename = argv[i]; break;
+            case 3: config->tbl_filename = argv[i]; break;
+            default: // too many
+               print_usage();
+               break;
+         }
+         file_count++;
+      }
+   }
+   if (file_count < 4) {
+      print_usage();
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   arg_config config;
+   sfx_import_state state = {0};
+   sound_bank_header sound_banks;
+   sound_data_header sound_data;
+   unsigned char **bank_data;
+   unsigned char *rom;
+   unsigned char *ctl;
+   unsigned char *tbl;
+   long rom_length, ctl_length, tbl_length;
+   unsigned int encoded = 0;
+   int ret_val = 0;
+
+   // get configuration from arguments
+   config = default_config;
+   parse_arguments(argc, argv, &config);
+
+   rom_length = read_file(config.rom_filename, &rom);
+   if (rom_length < 0) {
+      ERROR("Error reading input file \"%s\"\n", config.rom_filename);
+      return 1;
+   }
+   if (config.ctl_offset + 4 > (unsigned long)rom_length || config.tbl_offset + 4 > (unsigned long)rom_length) {
+      ERROR("Error: sound offsets 0x%X and 0x%X are past the end of \"%s\"\n", config.ctl_offset, config.tbl_offset, config.rom_filename);
+      free(rom);
+      return 1;
+   }
+
+   sound_banks = read_sound_bank(rom, config.ctl_offset);
+   sound_data = read_sound_data(rom, config.tbl_offset);
+
+   state.config = &config;
+   state.sound_data = &sound_data;
+   collect_samples(&state, &sound_banks);
+   if (state.sample_count > 0) {
+      workpool_run(state.sample_count, config.threads, import_job, &state);
+   }
+
+   // re-encoded sounds are appended to their bank so the others keep their offsets
+   bank_data = calloc(sound_data.data_count + 1, sizeof(*bank_data));
+   for (unsigned int i = 0; i < state.sample_count; i++) {
+      sfx_sample *s = &state.samples[i];
+      if (s->encoded) {
+         sfx_writer w = {0};
+         if (bank_data[s->bank] == NULL) {
+            long offset = sfx_writer_alloc(&w, sound_data.length[s->bank]);
+            memcpy(&w.data[offset], sound_data.data[s->bank], sound_data.length[s->bank]);
+         } else {
+            w.data = bank_data[s->bank];
+            w.length = w.allocated = sound_data.length[s->bank];
+         }
+         s->offset = sfx_writer_alloc(&w, s->length);
+         memcpy(&w.data[s->offset], s->data, s->length);
+         bank_data[s->bank] = sound_data.data[s->bank] = w.data;
+         sound_data.length[s->bank] = w.length;
+         encoded++;
+      }
+   }
+   for (unsigned int r = 0; r < state.ref_count; r++) {
+      const sfx_sample *s = &state.samples[state.refs[r].sample];
+      if (s->encoded) {
+         update_wave_table(state.refs[r].wav, s);
+      }
+   }
+
+   ctl_length = write_sound_bank(&sound_banks, &ctl);
+   tbl_length = write_sound_data(&sound_data, &tbl);
+   if (write_file(config.ctl_filename, ctl, ctl_length) != ctl_length) {
+      ERROR("Error writing output file \"%s\"\n", config.ctl_filename);
+      ret_val = 2;
+   }
+   if (write_file(config.tbl_filename, tbl, tbl_length) != tbl_length) {
+      ERROR("Error writing output file \"%s\"\n", config.tbl_filename);
+      ret_val = 2;
+   }
+   printf("%u of %u sounds re-encoded, 0x%lX bytes of sound banks, 0x%lX bytes of sound data\n",
+          encoded, state.sample_count, ctl_length, tbl_length);
+
+   // free used memory
+   for (unsigned int i = 0; i < state.sample_count; i++) {
+      free(state.samples[i].data);
+      free_book(&state.samples[i].book);
+   }
+   for (unsigned int i = 0; i < sound_data.data_count; i++) {
+      free(bank_data[i]);
+   }
+   free(bank_data);
+   free(state.samples);
+   free(state.refs);
+   free(ctl);
+   free(tbl);
+   free_sound_bank(&sound_banks);
+   free_sound_data(&sound_data);
+   free(rom);
+
+   return ret_val;
+}
+
+#endif // SFX_STANDALONE
+
+#ifdef SFX_TEST
+// original decoder, checked against decode()
+
+static signed short sfx_sign_extend(unsigned b, // number of bits representing the number in x
+                  int x      // sign extend this b-bit number to r
+)
+{
+   
+
+   int m = 1 << (b - 1); // mask can be pre-computed if b is fixed
+
+   x = x & ((1 << b) - 1);  // (Skip this if bits in x above position b are already zero.)
+   return (x ^ m) - m;
+}
+
+static void decode_8( unsigned char *in, signed short *out , int index, signed short * pred1, signed short lastsmp[8])
+{
+   int i;
+   signed short tmp[8];
+   signed long total = 0;
+   signed short sample =0;
+   memset(out, 0, sizeof(signed short)*8);
+
+   signed short *pred2 = (pred1 + 8);
+
+   //printf("pred2[] = %x\n" , pred2[0]);
+   for(i=0; i<8; i++)
+   {
+      tmp[i] = sfx_itable[(i&1) ? (*in++ & 0xf) : ((*in >> 4) & 0xf)] << index;
+      tmp[i] = sfx_sign_extend(index+4, tmp[i]);
+   }
+
+   for(i=0; i<8; i++)
+   {
+      total = (pred1[i] * lastsmp[6]);
+      total+= (pred2[i] * lastsmp[7]);
+
+      if (i>0)
+      {
+         for(int x=i-1; x>-1; x--)
+         {
+            total += ( tmp[((i-1)-x)] * pred2[x] );
+            //printf("sample: %x - pred: %x - _smp: %x\n" , ((i-1)-x) , pred2[x] , tmp[((i-1)-x)]);
+         }
+      }
+
+      //printf("pred = %x | total = %x\n" , pred2[0] , total);
+      float result = ((tmp[i] << 0xb) + total) >> 0xb;
+      if (result > 32767)
+         sample = 32767;
+      else if (result < -32768)
+         sample = -32768;
+      else
+         sample = (signed short)result;
+
+      out[i] = sample;
+   }
+   // update the last sample set for subsequent iterations
+   memcpy(lastsmp, out, sizeof(signed short)*8);
+}
+
+static void decode_8_half( unsigned char *in, signed short *out , int index, signed short * pred1, signed short lastsmp[8])
+{
+   int i;
+   signed short tmp[8];
+   signed long total = 0;
+   signed short sample =0;
+   memset(out, 0, sizeof(signed short)*8);
+
+   signed short *pred2 = (pred1 + 8);
+
+   //printf("pred2[] = %x\n" , pred2[0]);
+
+   tmp[0] = (((((*in) & 0xC0) >> 6) & 0x3)) << (index);
+   tmp[0] = sfx_sign_extend(index+2, tmp[0]);
+   tmp[1] = (((((*in) & 0x30) >> 4) & 0x3)) << (index);
+   tmp[1] = sfx_sign_extend(index+2, tmp[1]);
+   tmp[2] = (((((*in) & 0x0C) >> 2) & 0x3)) << (index);
+   tmp[2] = sfx_sign_extend(index+2, tmp[2]);
+   tmp[3] = ((((*in++) & 0x03) & 0x3)) << (index);
+   tmp[3] = sfx_sign_extend(index+2, tmp[3]);
+   tmp[4] = (((((*in) & 0xC0) >> 6) & 0x3)) << (index);
+   tmp[4] = sfx_sign_extend(index+2, tmp[4]);
+   tmp[5] = (((((*in) & 0x30) >> 4) & 0x3)) << (index);
+   tmp[5] = sfx_sign_extend(index+2, tmp[5]);
+   tmp[6] = (((((*in) & 0x0C) >> 2) & 0x3)) << (index);
+   tmp[6] = sfx_sign_extend(index+2, tmp[6]);
+   tmp[7] = ((((*in++) & 0x03) & 0x3)) << (index);
+   tmp[7] = sfx_sign_extend(index+2, tmp[7]);
+
+   for(i=0; i<8; i++)
+   {
+      total = (pred1[i] * lastsmp[6]);
+      total+= (pred2[i] * lastsmp[7]);
+
+      if (i>0)
+      {
+         for(int x=i-1; x>-1; x--)
+         {
+            total += ( tmp[((i-1)-x)] * pred2[x] );
+            //printf("sample: %x - pred: %x - _smp: %x\n" , ((i-1)-x) , pred2[x] , tmp[((i-1)-x)]);
+         }
+      }
+
+      //printf("pred = %x | total = %x\n" , pred2[0] , total);
+      float result = ((tmp[i] << 0xb) + total) >> 0xb;
+      if (result > 32767)
+         sample = 32767;
+      else if (result < -32768)
+         sample = -32768;
+      else
+         sample = (signed short)result;
+
+      out[i] = sample;
+   }
+   // update the last sample set for subsequent iterations
+   memcpy(lastsmp, out, sizeof(signed short)*8);
+}
+
+static unsigned long decode_reference( unsigned char *in, signed short *out, unsigned long len, predictor_data *book, int decode8Only )
+{
+   signed short lastsmp[8];
+
+   for (int x = 0; x < 8; x++)
+      lastsmp[x] = 0;
+
+   int index;
+   int pred;
+
+   int samples = 0;
+
+   // flip the predictors
+   signed short *preds = (signed short*)malloc( 32 * book->predictor_count );
+   for (unsigned int p = 0; p < (8 * book->order * book->predictor_count); p++)
+   {
+      preds[p] = book->data[p];
+   }
+
+   if (decode8Only == 0)
+   {
+      int _len = (len / 9) * 9;   //make sure length was actually a multiple of 9
+
+      while(_len > 0)
+      {
+         index = (*in >> 4) & 0xf;
+         pred = (*in & 0xf);
+
+         // to not make zelda crash but doesn't fix it
+         pred = pred % (book->predictor_count);
+
+         _len--;
+
+         signed short * pred1 = &preds[ pred * 16] ;
+
+         decode_8(++in, out, index, pred1, lastsmp);
+         in+=4;   _len-=4;   out+=8;
+
+         decode_8(in, out, index, pred1, lastsmp);
+         in+=4;   _len-=4;   out+=8;
+
+         samples += 16;
+      }
+   }
+   else
+   {
+      int _len = (len / 5) * 5;   //make sure length was actually a multiple of 5
+
+      while(_len > 0)
+      {
+         index = (*in >> 4) & 0xf;
+         pred = (*in & 0xf);
+
+         // to not make zelda crash but doesn't fix it
+         pred = pred % (book->predictor_count);
+
+         _len--;
+
+         signed short * pred1 = &preds[ pred * 16] ;
+
+         decode_8_half(++in, out, index, pred1, lastsmp);
+         in+=2;   _len-=2;   out+=8;
+
+         decode_8_half(in, out, index, pred1, lastsmp);
+         in+=2;   _len-=2;   out+=8;
+
+         samples += 16;
+      }
+   }
+
+   free(preds);
+
+   return samples;
+}
+
+static unsigned int test_seed = 1;
+
+static unsigned int test_rand(void)
+{
+   test_seed = test_seed * 1103515245 + 12345;
+   return test_seed >> 8;
+}
+
+// original key table and search, entry 0xFF was never set
+static unsigned char convert_key_base_reference(float eadKeyvalue)
+{
+   static float key_table[0x100];
+   float keybaseReal = (((eadKeyvalue - 0.0) < 0.00001) ? 1.0f : eadKeyvalue);
+   float smallestDistance = 9999999999999.0f;
+   unsigned char realKey = 0;
+
+   for (int x = 0; x < 0xFF; x++)
+      key_table[x] = (float)((60.0 - (float)x) / 12.0) * (float)((60.0 - (float)x) / 12.0); //Squared
+
+   for (int x = 0; x < 0x100; x++) {
+      float distance = (fabsf(keybaseReal - key_table[x]));
+      if (distance < smallestDistance) {
+         smallestDistance = distance;
+         realKey = x;
+      }
+   }
+
+   if (realKey > 0x7F)
+      realKey = 0x7F;
+
+   return realKey;
+}
+
+static float test_float(unsigned int bits)
+{
+   union {unsigned int i; float f;} u;
+   u.i = bits;
+   return u.f;
+}
+
+static unsigned int test_float_bits(float val)
+{
+   union {unsigned int i; float f;} u;
+   u.f = val;
+   return u.i;
+}
+
+static int test_key_base_value(float val)
+{
+   unsigned char key = sfx_convert_ead_game_value_to_key_base(val);
+   unsigned char ref = convert_key_base_reference(val);
+   if (key != ref) {
+      ERROR("Key base of %.9g (0x%08X) is 0x%02X, expected 0x%02X\n", val, test_float_bits(val), key, ref);
+      return 1;
+   }
+   return 0;
+}
+
+// compare the key base lookup against the original search
+// every float around the table entries and the midpoints between them, plus a sweep of all floats
+static int test_key_base(void)
+{
+   static const unsigned int special[] = {
+      0x00000000, 0x80000000, 0x00000001, 0x3727C5AC, 0x3727C5AD, 0x3F800000, 0xBF800000,
+      0x7F7FFFFF, 0xFF7FFFFF, 0x7F800000, 0xFF800000, 0x7FC00000, 0xFFC00000, 0x551184E7,
+   };
+   int failures = 0;
+   unsigned long count = 0;
+
+   for (unsigned int i = 0; i < DIM(special); i++) {
+      failures += test_key_base_value(test_float(special[i]));
+      count++;
+   }
+   for (unsigned int d = 0; d < DIM(sfx_key_table); d++) {
+      unsigned int entry = test_float_bits(sfx_key_table[d]);
+      unsigned int middle = entry;
+      if (d + 1 < DIM(sfx_key_table))
+         middle = test_float_bits((sfx_key_table[d] + sfx_key_table[d + 1]) / 2);
+      for (int k = -256; k <= 256; k++) {
+         if ((int)entry + k >= 0)
+            failures += test_key_base_value(test_float(entry + k));
+         failures += test_key_base_value(test_float(middle + k));
+         count += 2;
+      }
+   }
+   for (unsigned int step = 0; step <= 0xFFFFFFFF / 4093 && failures < 10; step++) {
+      failures += test_key_base_value(test_float(step * 4093));
+      count++;
+   }
+
+   printf("%lu/%lu key bases match\n", count - failures, count);
+   return failures;
+}
+
+// random book, wide ones use the whole coefficient range
+static void test_book(predictor_data *book, unsigned *data, int wide)
+{
+   book->order = 2;
+   book->predictor_count = 1 + test_rand() % SFX_MAX_PREDICTORS;
+   book->data = data;
+   for (unsigned int k = 0; k < 16 * book->predictor_count; k++) {
+      if (wide)
+         data[k] = test_rand() & 0xFFFF;
+      else
+         data[k] = (unsigned short)((int)(test_rand() % 0x2000) - 0x1000);
+   }
+}
+
+// decaying resonators with a little noise, like an instrument sample
+static void test_signal(signed short *pcm, unsigned long n_samples)
+{
+   double c = 1.98 - (test_rand() % 1000) / 300.0;
+   double x1 = 0, x2 = 0;
+   double amplitude = 2000 + test_rand() % 4000;
+   for (unsigned long n = 0; n < n_samples; n++) {
+      double x = c * x1 - 0.999 * x2 + ((n % 2000) == 0 ? amplitude : 0);
+      x2 = x1;
+      x1 = x;
+      x += (int)(test_rand() % 64) - 32;
+      pcm[n] = (signed short)MAX(-0x8000, MIN(0x7FFF, x));
+   }
+}
+
+// encode random signals and check the decoded signal to noise ratio
+static int test_encode(int count)
+{
+   static signed short pcm[4000];
+   static signed short decoded[4000 + SFX_FRAME_SAMPLES];
+   static unsigned char encoded[(4000 + SFX_FRAME_SAMPLES) / SFX_FRAME_SAMPLES * SFX_FRAME_LENGTH];
+   int failures = 0;
+   double worst = -1;
+   for (int i = 0; i < count; i++) {
+      predictor_data book;
+      unsigned long n_samples = 1 + test_rand() % DIM(pcm);
+      unsigned long length;
+      double signal = 0, noise = 0;
+      test_signal(pcm, n_samples);
+      if (design_book(pcm, n_samples, 1 << (i % 5), &book) < 0) {
+         ERROR("design_book failed for %d predictors\n", 1 << (i % 5));
+         failures++;
+         continue;
+      }
+      length = encode_raw_sound(pcm, n_samples, &book, encoded);
+      if (length != encode_bound(n_samples) || decode(encoded, decoded, length, &book, 0) < n_samples) {
+         ERROR("Encoded length %lu for %lu samples\n", length, n_samples);
+         failures++;
+      }
+      for (unsigned long n = 0; n < n_samples; n++) {
+         double d = decoded[n] - pcm[n];
+         signal += (double)pcm[n] * pcm[n];
+         noise += d * d;
+      }
+      // 20 dB at least
+      if (noise * 100 > signal) {
+         ERROR("Signal %f noise %f for %lu samples\n", signal, noise, n_samples);
+         failures++;
+      }
+      if (noise > 0 && (worst < 0 || signal / noise < worst))
+         worst = signal / noise;
+      free_book(&book);
+   }
+   printf("%d/%d sounds encode (worst signal/noise %.0f)\n", count - failures, count, worst);
+   return failures;
+}
+
+// write a bank, read it back and check that writing it again gives the same bytes
+static int test_write(void)
+{
+   static signed short pcm[992];
+   static unsigned char encoded[992 / SFX_FRAME_SAMPLES * SFX_FRAME_LENGTH];
+   static unsigned envelope[] = {1, 32700, 0xFFFF, 0};
+   static unsigned state[SFX_LOOP_STATE_LENGTH];
+   predictor_data book;
+   loop_data loop = {0, 992, 0xFFFFFFFF, 0, state};
+   wave_table wav = {0, 0, &loop, &book, 0, 0, 0, 0, 0};
+   wave_table wav_plain = {0, 0x100, NULL, &book, 0x100, 0, 0, 0, 0};
+   sound sounds[3] = {
+      {0, envelope, DIM(envelope), NULL, 0, &wav, 1.0f, NULL, 0},
+      {0},
+      {5, envelope, DIM(envelope), &wav_plain, 0.5f, &wav, 1.0f, &wav_plain, 2.0f},
+   };
+   percussion items[2] = {
+      {0, 64, 0, &wav, 1.5f, envelope, DIM(envelope)},
+      {0},
+   };
+   sound_bank banks[2] = {
+      {3, 2, 0, 0, {items}, sounds},
+      {3, 0, 1, 0, {NULL}, sounds},
+   };
+   sound_bank_header header = {3, 2, banks};
+   unsigned char *snd_data[2] = {encoded, encoded};
+   unsigned lengths[2] = {sizeof(encoded), sizeof(encoded)};
+   sound_data_header data = {1, 2, snd_data, lengths};
+   sound_bank_header read_banks;
+   sound_data_header read_data;
+   unsigned char *ctl, *ctl2, *tbl, *tbl2;
+   long ctl_length, ctl2_length, tbl_length, tbl2_length;
+   int failures = 0;
+
+   test_signal(pcm, DIM(pcm));
+   design_book(pcm, DIM(pcm), 4, &book);
+   wav.sound_length = encode_raw_sound(pcm, DIM(pcm), &book, encoded);
+
+   ctl_length = write_sound_bank(&header, &ctl);
+   tbl_length = write_sound_data(&data, &tbl);
+   read_banks = read_sound_bank(ctl, 0);
+   read_data = read_sound_data(tbl, 0);
+   ctl2_length = write_sound_bank(&read_banks, &ctl2);
+   tbl2_length = write_sound_data(&read_data, &tbl2);
+
+   if (ctl_length != ctl2_length || memcmp(ctl, ctl2, ctl_length)) {
+      ERROR("Sound bank differs after reading it back\n");
+      failures++;
+   }
+   if (tbl_length != tbl2_length || memcmp(tbl, tbl2, tbl_length) || read_data.data[0] != read_data.data[1]) {
+      ERROR("Sound data differs after reading it back\n");
+      failures++;
+   }
+   if (read_banks.banks[0].sounds[0].wav->predictor_offset != read_banks.banks[0].sounds[2].wav_prev->predictor_offset) {
+      ERROR("Predictor book is not shared\n");
+      failures++;
+   }
+
+   printf("%s: %ld bytes of .ctl, %ld bytes of .tbl\n", failures ? "write failed" : "write matches", ctl_length, tbl_length);
+
+   free_sound_bank(&read_banks);
+   free_sound_data(&read_data);
+   free(ctl);
+   free(ctl2);
+   free(tbl);
+   free(tbl2);
+   free_book(&book);
+   return failures;
+}
+
+int main(int argc, char *argv[])
+{
+   static unsigned data[16 * SFX_MAX_PREDICTORS];
+   static unsigned char in[9 * 64];
+   static signed short ref[16 * sizeof(in) / 5];
+   static signed short out[16 * sizeof(in) / 5];
+   vadpcm_matrix matrix[SFX_MAX_PREDICTORS];
+   predictor_data book;
+   int iterations = 20000;
+   int failures = 0;
+   int wide_books = 0;
+   int wide;
+
+   if (argc > 1) {
+      iterations = strtol(argv[1], NULL, 0);
+   }
+
+   for (int i = 0; i < iterations; i++) {
+      int decode8Only = i & 1;
+      unsigned long len = test_rand() % sizeof(in);
+      unsigned long ref_samples, samples;
+      test_book(&book, data, (i & 6) == 6);
+      for (unsigned long k = 0; k < len; k++) {
+         in[k] = test_rand() & 0xFF;
+      }
+      // alternate between precomputed and on the fly matrices
+      wide = sfx_build_matrices(&book, matrix);
+      wide_books += wide;
+      book.matrix = (i & 8) ? matrix : NULL;
+      book.wide = (i & 8) ? wide : 0;
+      ref_samples = decode_reference(in, ref, len, &book, decode8Only);
+      samples = decode(in, out, len, &book, decode8Only);
+      if (samples != ref_samples || memcmp(ref, out, samples * sizeof(*out))) {
+         ERROR("Mismatch iteration %d length %lu decode8Only %d\n", i, len, decode8Only);
+         failures++;
+      }
+   }
+
+   printf("%d/%d sounds match (%d wide books)\n", iterations - failures, iterations, wide_books);
+
+   failures += test_encode(iterations / 200 + 1);
+   failures += test_write();
+   failures += test_key_base();
+
+   return failures ? 1 : 0;
+}
+#endif // SFX_TEST
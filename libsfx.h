@@ -3,12 +3,29 @@
 
 // defines
 
+// length of the smpl chunk that ends each extracted .wav
+#define SFX_WAV_SMPL_LENGTH 0x44
+
+// VADPCM frames hold 16 samples in 9 bytes
+#define SFX_FRAME_SAMPLES 16
+#define SFX_FRAME_LENGTH 9
+
+// decoder state saved with a loop: the 16 samples before the loop start
+#define SFX_LOOP_STATE_LENGTH 16
+
 // typedefs
 
+   // decode matrix of one predictor, coefficient pairs of the 8 outputs
+   typedef struct {
+      signed short coef[5][16];
+   } vadpcm_matrix;
+
    typedef struct {
       unsigned int order;
       unsigned int predictor_count;
       unsigned *data;
+      vadpcm_matrix *matrix; // precomputed from data
+      int wide; // matrix rows can overflow a 32-bit accumulator
    } predictor_data;
    
    typedef struct {
@@ -28,6 +45,7 @@
       unsigned int unknown_2;
       unsigned int unknown_3;
       unsigned int unknown_4;
+      unsigned int predictor_offset; // offset of the predictor book in the bank, 0 if none
    } wave_table;
    
    typedef struct {
@@ -37,6 +55,7 @@
      wave_table *wav;
      float key_base;
      unsigned *adrs;
+     unsigned int adrs_count; // number of values in adrs
    } percussion;
    
    typedef struct {
@@ -46,6 +65,7 @@
    typedef struct {
       unsigned int unknown;
       unsigned *adrs;
+      unsigned int adrs_count; // number of values in adrs
       wave_table *wav_prev;
       float key_base_prev;
       wave_table *wav;
@@ -73,27 +93,42 @@
       unsigned unknown;
       unsigned data_count;
       unsigned char **data;
+      unsigned *length;
    } sound_data_header;
 
 // function prototypes
 
 //NEEDS COMMENTS!!!
 
-// initialize the key table for vadpcm decoding
-void sfx_initialize_key_table();
-
 // read the sound bank table
 // data: buffer containing sound bank data
 // data_offset: offset in data where the sound bank begins
 // returns a sound_data_header which contains info about all the sounds stored in the rom
 sound_bank_header read_sound_bank(unsigned char *data, unsigned int data_offset);
 
+// free everything allocated by read_sound_bank
+void free_sound_bank(sound_bank_header *sound_banks);
+
 // read the sound data table
 // data: buffer containing sound data
 // data_offset: offset in data where the sound data begins
-// returns a sound_data_header which contains the raw, encoded sound data
+// returns a sound_data_header which points at the raw, encoded sound data in data
 sound_data_header read_sound_data(unsigned char *data, unsigned int data_offset);
 
+// free the table allocated by read_sound_data, the sound data itself belongs to the caller
+void free_sound_data(sound_data_header *sound_data);
+
+// decode encoded sound data into a .wav image in memory
+// wav, key_base, snd_data, sampling_rate: same as extract_raw_sound
+// wav_length: set to the length of the .wav image
+// returns the .wav image, which the caller frees, or NULL if the sound is not ADPCM
+unsigned char *decode_raw_sound(wave_table *wav, float key_base, unsigned char *snd_data, unsigned long sampling_rate, unsigned long *wav_length);
+
+// build the smpl chunk that ends a .wav image, holding the key base and loop points
+// smpl: buffer of SFX_WAV_SMPL_LENGTH bytes
+// wav, key_base: same as extract_raw_sound
+void build_raw_sound_smpl(unsigned char *smpl, wave_table *wav, float key_base);
+
 // create a .wav file from provided encoded sound data
 // sound_dir: directory to store the .wav file in
 // wav_name: name for the new .wav file
@@ -104,4 +139,46 @@ sound_data_header read_sound_data(unsigned char *data, unsigned int data_offset)
 // returns 1 if the .wav file was created, 0 if not
 int extract_raw_sound(char *sound_dir, char *wav_name, wave_table *wav, float key_base, unsigned char *snd_data, unsigned long sampling_rate);
 
+// serialize sound banks into .ctl data that read_sound_bank reads back
+// identical wave tables, loops, predictor books and envelopes within a bank are stored once
+// sound_banks: banks to write
+// ctl: set to a new buffer with the .ctl data, which the caller frees
+// returns length of the .ctl data
+long write_sound_bank(const sound_bank_header *sound_banks, unsigned char **ctl);
+
+// serialize sound data into .tbl data that read_sound_data reads back
+// sound_data: data and length of each bank
+// tbl: set to a new buffer with the .tbl data, which the caller frees
+// returns length of the .tbl data
+long write_sound_data(const sound_data_header *sound_data, unsigned char **tbl);
+
+// read 16-bit mono PCM samples from a .wav image such as the ones written by extract_raw_sound
+// wav_data, wav_length: the .wav image
+// n_samples: set to the number of samples
+// loop: set to the loop points in the smpl chunk, count 0xFFFFFFFF for infinite loops
+// has_loop: set to 1 if the smpl chunk has loop points, 0 if not
+// returns new buffer of samples in host order, which the caller frees, or NULL if not 16-bit mono PCM
+signed short *read_raw_sound(const unsigned char *wav_data, long wav_length, unsigned long *n_samples, loop_data *loop, int *has_loop);
+
+// estimate an order 2 VADPCM predictor book for a sound
+// each frame's autocorrelation gives its best predictor, frames are then clustered by prediction error
+// pcm, n_samples: 16-bit samples to design the book for
+// predictor_count: number of predictors, a power of 2 up to 16
+// book: filled in with a new book, free with free_book
+// returns 0 on success, negative on error
+int design_book(const signed short *pcm, unsigned long n_samples, unsigned int predictor_count, predictor_data *book);
+
+// free the data of a book filled in by design_book
+void free_book(predictor_data *book);
+
+// maximum encoded length of n_samples samples
+unsigned long encode_bound(unsigned long n_samples);
+
+// encode samples into VADPCM frames, trying every predictor and scale for each frame
+// pcm, n_samples: 16-bit samples, padded with silence to a whole frame
+// book: predictor book from design_book or read_sound_bank
+// out: buffer of at least encode_bound(n_samples) bytes
+// returns number of bytes written
+unsigned long encode_raw_sound(const signed short *pcm, unsigned long n_samples, const predictor_data *book, unsigned char *out);
+
 #endif // LIBMIO0_H_
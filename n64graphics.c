@@ -1,7 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 
+#include <zlib.h>
+
 #define STBI_NO_LINEAR
 #define STBI_NO_HDR
 #define STBI_NO_TGA
@@ -21,13 +24,52 @@
 #define SCALE_3_8(VAL_) ((VAL_) * 0x24)
 #define SCALE_8_3(VAL_) ((VAL_) / 0x24)
 
-typedef enum
+typedef struct
 {
-   IMG_FORMAT_RGBA,
-   IMG_FORMAT_IA,
-   IMG_FORMAT_I,
-   IMG_FORMAT_CI,
-} img_format;
+   const char *name;
+   img_format format;
+   int depth;
+} format_entry;
+
+static const format_entry format_table[] =
+{
+   {"rgba16", IMG_FORMAT_RGBA, 16},
+   {"rgba32", IMG_FORMAT_RGBA, 32},
+   {"ia1",    IMG_FORMAT_IA,    1},
+   {"ia4",    IMG_FORMAT_IA,    4},
+   {"ia8",    IMG_FORMAT_IA,    8},
+   {"ia16",   IMG_FORMAT_IA,   16},
+   {"i4",     IMG_FORMAT_I,     4},
+   {"i8",     IMG_FORMAT_I,     8},
+   {"ci4",    IMG_FORMAT_CI,    4},
+   {"ci8",    IMG_FORMAT_CI,    8},
+};
+
+//---------------------------------------------------------
+// format names
+//---------------------------------------------------------
+
+const char *img_format_name(img_format format, int depth)
+{
+   for (unsigned i = 0; i < DIM(format_table); i++) {
+      if (format == format_table[i].format && depth == format_table[i].depth) {
+         return format_table[i].name;
+      }
+   }
+   return "unknown";
+}
+
+int img_format_parse(const char *name, img_format *format, int *depth)
+{
+   for (unsigned i = 0; i < DIM(format_table); i++) {
+      if (!strcasecmp(name, format_table[i].name)) {
+         *format = format_table[i].format;
+         *depth = format_table[i].depth;
+         return 1;
+      }
+   }
+   return 0;
+}
 
 
 //---------------------------------------------------------
@@ -310,11 +352,311 @@ int i2raw(uint8_t *raw, const ia *img, int width, int height, int depth)
    return size;
 }
 
+// CI conversion works on RGBA16 colors since that is what the palette stores
+#define CI_HASH_SIZE 1024 // power of 2, at least twice the largest palette
+
+typedef struct
+{
+   uint16_t color[CI_HASH_SIZE];
+   int16_t index[CI_HASH_SIZE]; // palette index or -1 if slot unused
+} ci_hash;
+
+typedef struct
+{
+   int start;       // first entry in color list
+   int count;       // number of unique colors in box
+   uint64_t weight; // number of pixels covered by box
+} ci_box;
+
+static uint16_t rgba2rgba16(const rgba *col)
+{
+   uint8_t r, g, b, a;
+   r = SCALE_8_5(col->red);
+   g = SCALE_8_5(col->green);
+   b = SCALE_8_5(col->blue);
+   a = col->alpha ? 0x1 : 0x0;
+   return (r << 11) | (g << 6) | (b << 1) | a;
+}
+
+// extract 5-bit channel from RGBA16 color, alpha is expanded to 0 or 0x1F
+static inline int rgba16_channel(uint16_t col, int channel)
+{
+   switch (channel) {
+      case 0:  return (col >> 11) & 0x1F;
+      case 1:  return (col >> 6) & 0x1F;
+      case 2:  return (col >> 1) & 0x1F;
+      default: return (col & 0x1) ? 0x1F : 0x00;
+   }
+}
+
+// find hash slot holding 'col' or the empty slot where it belongs
+static inline unsigned ci_hash_slot(const ci_hash *hash, uint16_t col)
+{
+   unsigned slot = ((col * 0x9E3779B1u) >> 22) & (CI_HASH_SIZE - 1);
+   while (hash->index[slot] >= 0 && hash->color[slot] != col) {
+      slot = (slot + 1) & (CI_HASH_SIZE - 1);
+   }
+   return slot;
+}
+
+// build palette directly from image colors
+// returns number of palette entries used or -1 if there are too many colors
+static int ci_palette_exact(const uint16_t *img16, int count, uint8_t *indices, uint16_t *palette, int max_colors)
+{
+   ci_hash hash;
+   int used = 0;
+
+   memset(hash.index, 0xFF, sizeof(hash.index));
+   for (int i = 0; i < count; i++) {
+      unsigned slot = ci_hash_slot(&hash, img16[i]);
+      if (hash.index[slot] < 0) {
+         if (used >= max_colors) {
+            return -1;
+         }
+         hash.color[slot] = img16[i];
+         hash.index[slot] = used;
+         palette[used] = img16[i];
+         used++;
+      }
+      indices[i] = hash.index[slot];
+   }
+   return used;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+   uint64_t va = *(const uint64_t *)a;
+   uint64_t vb = *(const uint64_t *)b;
+   return (va > vb) - (va < vb);
+}
+
+// reduce image colors to 'max_colors' using median cut on RGBA16 colors
+// returns number of palette entries used or -1 on error
+static int ci_palette_quantize(const uint16_t *img16, int count, uint8_t *indices, uint16_t *palette, int max_colors)
+{
+   ci_box boxes[256];
+   uint32_t *hist;
+   uint64_t *entries; // [pixel count:40][color:16]
+   uint8_t *color_map;
+   int unique = 0;
+   int box_count;
+
+   hist = calloc(0x10000, sizeof(*hist));
+   color_map = malloc(0x10000);
+   if (!hist || !color_map) {
+      ERROR("Error allocating color histogram\n");
+      free(hist);
+      free(color_map);
+      return -1;
+   }
+   for (int i = 0; i < count; i++) {
+      if (hist[img16[i]]++ == 0) {
+         unique++;
+      }
+   }
+   entries = malloc(unique * sizeof(*entries));
+   if (!entries) {
+      ERROR("Error allocating %d colors\n", unique);
+      free(hist);
+      free(color_map);
+      return -1;
+   }
+   unique = 0;
+   for (unsigned c = 0; c < 0x10000; c++) {
+      if (hist[c]) {
+         entries[unique++] = ((uint64_t)hist[c] << 16) | c;
+      }
+   }
+   free(hist);
+
+   boxes[0].start = 0;
+   boxes[0].count = unique;
+   boxes[0].weight = count;
+   box_count = 1;
+   while (box_count < max_colors) {
+      int split = -1;
+      int split_channel = 0;
+      int split_range = 0;
+      // pick the box with the widest channel range
+      for (int b = 0; b < box_count; b++) {
+         if (boxes[b].count < 2) {
+            continue;
+         }
+         for (int ch = 0; ch < 4; ch++) {
+            int lo = 0x1F, hi = 0;
+            for (int e = boxes[b].start; e < boxes[b].start + boxes[b].count; e++) {
+               int val = rgba16_channel(entries[e] & 0xFFFF, ch);
+               lo = MIN(lo, val);
+               hi = MAX(hi, val);
+            }
+            if (hi - lo > split_range ||
+                (hi - lo == split_range && split >= 0 && boxes[b].weight > boxes[split].weight)) {
+               split = b;
+               split_channel = ch;
+               split_range = hi - lo;
+            }
+         }
+      }
+      if (split < 0 || split_range == 0) {
+         break;
+      }
+
+      // sort box entries by channel, stashing the channel in the top byte
+      ci_box *box = &boxes[split];
+      uint64_t *first = &entries[box->start];
+      for (int e = 0; e < box->count; e++) {
+         first[e] |= (uint64_t)rgba16_channel(first[e] & 0xFFFF, split_channel) << 56;
+      }
+      qsort(first, box->count, sizeof(*first), compare_u64);
+      for (int e = 0; e < box->count; e++) {
+         first[e] &= 0x00FFFFFFFFFFFFFFULL;
+      }
+
+      // split at weighted median, leaving at least one color on each side
+      uint64_t acc = 0;
+      int cut = 1;
+      for (int e = 0; e < box->count - 1; e++) {
+         acc += first[e] >> 16;
+         cut = e + 1;
+         if (2 * acc >= box->weight) {
+            break;
+         }
+      }
+      boxes[box_count].start = box->start + cut;
+      boxes[box_count].count = box->count - cut;
+      boxes[box_count].weight = box->weight - acc;
+      box->count = cut;
+      box->weight = acc;
+      box_count++;
+   }
+
+   // weighted average of each box becomes a palette entry
+   for (int b = 0; b < box_count; b++) {
+      uint64_t sum[4] = {0, 0, 0, 0};
+      for (int e = boxes[b].start; e < boxes[b].start + boxes[b].count; e++) {
+         uint64_t weight = entries[e] >> 16;
+         for (int ch = 0; ch < 4; ch++) {
+            sum[ch] += weight * rgba16_channel(entries[e] & 0xFFFF, ch);
+         }
+      }
+      uint64_t half = boxes[b].weight / 2;
+      int r = (sum[0] + half) / boxes[b].weight;
+      int g = (sum[1] + half) / boxes[b].weight;
+      int bl = (sum[2] + half) / boxes[b].weight;
+      int a = (2 * sum[3] >= 0x1F * boxes[b].weight) ? 1 : 0;
+      palette[b] = (r << 11) | (g << 6) | (bl << 1) | a;
+   }
+
+   // map every unique color to its nearest palette entry
+   for (int e = 0; e < unique; e++) {
+      uint16_t col = entries[e] & 0xFFFF;
+      int best = 0;
+      int best_dist = 0x7FFFFFFF;
+      for (int p = 0; p < box_count; p++) {
+         int dist = 0;
+         for (int ch = 0; ch < 4; ch++) {
+            int diff = rgba16_channel(col, ch) - rgba16_channel(palette[p], ch);
+            // alpha mismatches are much more visible than color error
+            dist += (ch == 3 ? 4 : 1) * diff * diff;
+         }
+         if (dist < best_dist) {
+            best_dist = dist;
+            best = p;
+         }
+      }
+      color_map[col] = best;
+   }
+   for (int i = 0; i < count; i++) {
+      indices[i] = color_map[img16[i]];
+   }
+
+   free(entries);
+   free(color_map);
+   return box_count;
+}
+
+int rgba2rawci(uint8_t *raw, uint8_t *out_palette, int *pal_len, const rgba *img, int width, int height, int depth)
+{
+   uint16_t palette[256];
+   uint16_t *img16;
+   uint8_t *indices;
+   int count = width * height;
+   int size = count * depth / 8;
+   int max_colors;
+   int used;
+   INFO("Converting RGBA %dx%d to raw CI%d\n", width, height, depth);
+
+   if (depth != 4 && depth != 8) {
+      ERROR("Error invalid depth %d\n", depth);
+      return -1;
+   }
+   max_colors = 1 << depth;
+
+   img16 = malloc(count * sizeof(*img16));
+   indices = malloc(count);
+   if (!img16 || !indices) {
+      ERROR("Error allocating %d bytes\n", 3 * count);
+      free(img16);
+      free(indices);
+      return -1;
+   }
+
+   for (int i = 0; i < count; i++) {
+      img16[i] = rgba2rgba16(&img[i]);
+   }
+
+   used = ci_palette_exact(img16, count, indices, palette, max_colors);
+   if (used < 0) {
+      INFO("More than %d colors, quantizing palette\n", max_colors);
+      used = ci_palette_quantize(img16, count, indices, palette, max_colors);
+   }
+
+   if (used < 0) {
+      size = -1;
+   } else {
+      if (depth == 8) {
+         memcpy(raw, indices, count);
+      } else {
+         for (int i = 0; i < count; i++) {
+            uint8_t old = raw[i/2];
+            if (i % 2) {
+               raw[i/2] = (old & 0xF0) | indices[i];
+            } else {
+               raw[i/2] = (old & 0x0F) | (indices[i] << 4);
+            }
+         }
+      }
+      for (int i = 0; i < max_colors; i++) {
+         uint16_t col = (i < used) ? palette[i] : 0x0000;
+         write_u16_be(&out_palette[2*i], col);
+      }
+      *pal_len = used;
+   }
+
+   free(img16);
+   free(indices);
+
+   return size;
+}
+
 
 //---------------------------------------------------------
 // internal RGBA/IA -> PNG
 //---------------------------------------------------------
 
+// encode PNG in memory and only replace png_filename if the encoded file differs
+static int write_png_if_changed(const char *png_filename, const uint8_t *data, int width, int height, int comp)
+{
+   int png_len = 0;
+   int ret = 0;
+   uint8_t *png = stbi_write_png_to_mem(data, 0, width, height, comp, &png_len);
+   if (png) {
+      ret = write_file_if_changed(png_filename, png, png_len) >= 0;
+      free(png);
+   }
+   return ret;
+}
+
 int rgba2png(const char *png_filename, const rgba *img, int width, int height)
 {
    int ret = 0;
@@ -333,7 +675,7 @@ int rgba2png(const char *png_filename, const rgba *img, int width, int height)
          }
       }
 
-      ret = stbi_write_png(png_filename, width, height, 4, data, 0);
+      ret = write_png_if_changed(png_filename, data, width, height, 4);
 
       free(data);
    }
@@ -357,7 +699,7 @@ int ia2png(const char *png_filename, const ia *img, int width, int height)
          }
       }
 
-      ret = stbi_write_png(png_filename, width, height, 2, data, 0);
+      ret = write_png_if_changed(png_filename, data, width, height, 2);
 
       free(data);
    }
@@ -365,6 +707,199 @@ int ia2png(const char *png_filename, const ia *img, int width, int height)
    return ret;
 }
 
+//---------------------------------------------------------
+// N64 raw -> streamed PNG
+//---------------------------------------------------------
+
+// rows converted per call to raw2rgba()/raw2ia()/raw2i()
+#define PNG_STREAM_ROWS 16
+// maximum size of each IDAT chunk
+#define PNG_IDAT_SIZE (64*KB)
+
+typedef struct
+{
+   FILE *fp;
+   z_stream strm;
+   uint8_t idat[PNG_IDAT_SIZE];
+} png_stream;
+
+static int png_write_chunk(FILE *fp, const char *type, const uint8_t *data, uint32_t length)
+{
+   uint8_t buf[4];
+   uLong crc = crc32(0L, (const Bytef *)type, 4);
+   if (length > 0) {
+      crc = crc32(crc, data, length);
+   }
+   write_u32_be(buf, length);
+   fwrite(buf, 1, 4, fp);
+   fwrite(type, 1, 4, fp);
+   if (length > 0) {
+      fwrite(data, 1, length, fp);
+   }
+   write_u32_be(buf, (uint32_t)crc);
+   return fwrite(buf, 1, 4, fp) == 4;
+}
+
+// compress input into IDAT chunks, emitting each chunk as it fills
+static int png_stream_deflate(png_stream *ps, const uint8_t *data, unsigned length, int flush)
+{
+   int ret;
+   ps->strm.next_in = (Bytef *)data;
+   ps->strm.avail_in = length;
+   do {
+      ret = deflate(&ps->strm, flush);
+      if (ret == Z_STREAM_ERROR) {
+         return 0;
+      }
+      if (ps->strm.avail_out == 0 || (flush == Z_FINISH && ps->strm.avail_out < PNG_IDAT_SIZE)) {
+         png_write_chunk(ps->fp, "IDAT", ps->idat, PNG_IDAT_SIZE - ps->strm.avail_out);
+         ps->strm.next_out = ps->idat;
+         ps->strm.avail_out = PNG_IDAT_SIZE;
+      }
+   } while (ps->strm.avail_in > 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+   return 1;
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+   int p = a + b - c;
+   int pa = abs(p - a);
+   int pb = abs(p - b);
+   int pc = abs(p - c);
+   if (pa <= pb && pa <= pc) {
+      return a;
+   }
+   return (pb <= pc) ? b : c;
+}
+
+// apply each PNG filter type to a row and keep the one with the smallest sum of absolute values
+// filtered: 5 buffers of (1 + row_len) bytes; returns index of the chosen one
+static int png_filter_row(uint8_t *filtered, const uint8_t *row, const uint8_t *prev, int row_len, int bpp)
+{
+   int best = 0;
+   unsigned best_sum = ~0U;
+   for (int f = 0; f < 5; f++) {
+      uint8_t *out = &filtered[f * (row_len + 1)];
+      unsigned sum = 0;
+      out[0] = f;
+      for (int i = 0; i < row_len; i++) {
+         uint8_t a = i >= bpp ? row[i - bpp] : 0;
+         uint8_t b = prev ? prev[i] : 0;
+         uint8_t c = (prev && i >= bpp) ? prev[i - bpp] : 0;
+         uint8_t v;
+         switch (f) {
+            case 0: v = row[i]; break;
+            case 1: v = row[i] - a; break;
+            case 2: v = row[i] - b; break;
+            case 3: v = row[i] - ((a + b) >> 1); break;
+            default: v = row[i] - paeth(a, b, c); break;
+         }
+         out[1 + i] = v;
+         sum += (v < 128) ? v : 256 - v;
+      }
+      if (sum < best_sum) {
+         best_sum = sum;
+         best = f;
+      }
+   }
+   return best;
+}
+
+int raw2png(const char *png_filename, const uint8_t *raw, img_format format, int width, int height, int depth)
+{
+   static const uint8_t png_sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+   png_stream *ps;
+   uint8_t ihdr[13];
+   uint8_t *rows;
+   uint8_t *filtered;
+   int channels = (format == IMG_FORMAT_RGBA) ? 4 : 2;
+   int row_len = width * channels;
+   int raw_row_len = width * depth / 8;
+   int ret = 0;
+
+   if (format == IMG_FORMAT_CI || width <= 0 || height <= 0 || (width * depth) % 8) {
+      return 0;
+   }
+   INFO("Streaming %s %dx%d to \"%s\"\n", img_format_name(format, depth), width, height, png_filename);
+
+   ps = malloc(sizeof(*ps));
+   // current band of converted rows plus the last row of the previous band for filtering
+   rows = malloc((PNG_STREAM_ROWS + 1) * row_len);
+   filtered = malloc(5 * (row_len + 1));
+   if (!ps || !rows || !filtered) {
+      goto free_all;
+   }
+   memset(&ps->strm, 0, sizeof(ps->strm));
+   if (deflateInit(&ps->strm, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      goto free_all;
+   }
+   ps->strm.next_out = ps->idat;
+   ps->strm.avail_out = PNG_IDAT_SIZE;
+   ps->fp = fopen_if_changed(png_filename);
+   if (!ps->fp) {
+      deflateEnd(&ps->strm);
+      goto free_all;
+   }
+
+   fwrite(png_sig, 1, sizeof(png_sig), ps->fp);
+   write_u32_be(&ihdr[0], width);
+   write_u32_be(&ihdr[4], height);
+   ihdr[8] = 8; // bit depth
+   ihdr[9] = (format == IMG_FORMAT_RGBA) ? 6 : 4; // RGBA or grayscale + alpha
+   ihdr[10] = 0; // deflate
+   ihdr[11] = 0; // adaptive filtering
+   ihdr[12] = 0; // no interlace
+   png_write_chunk(ps->fp, "IHDR", ihdr, sizeof(ihdr));
+
+   ret = 1;
+   for (int y = 0; y < height && ret; y += PNG_STREAM_ROWS) {
+      int band = MIN(PNG_STREAM_ROWS, height - y);
+      uint8_t *band_rows = &rows[row_len];
+      const uint8_t *band_raw = &raw[y * raw_row_len];
+      if (format == IMG_FORMAT_RGBA) {
+         rgba *img = raw2rgba(band_raw, width, band, depth);
+         if (!img) {
+            ret = 0;
+            break;
+         }
+         memcpy(band_rows, img, band * row_len);
+         free(img);
+      } else {
+         ia *img = (format == IMG_FORMAT_IA) ? raw2ia(band_raw, width, band, depth)
+                                             : raw2i(band_raw, width, band, depth);
+         if (!img) {
+            ret = 0;
+            break;
+         }
+         memcpy(band_rows, img, band * row_len);
+         free(img);
+      }
+      for (int r = 0; r < band && ret; r++) {
+         const uint8_t *row = &band_rows[r * row_len];
+         const uint8_t *prev = (y + r > 0) ? row - row_len : NULL;
+         int f = png_filter_row(filtered, row, prev, row_len, channels);
+         ret = png_stream_deflate(ps, &filtered[f * (row_len + 1)], row_len + 1, Z_NO_FLUSH);
+      }
+      // keep last row of this band for filtering the first row of the next
+      memcpy(rows, &band_rows[(band - 1) * row_len], row_len);
+   }
+   if (ret) {
+      ret = png_stream_deflate(ps, NULL, 0, Z_FINISH);
+   }
+   deflateEnd(&ps->strm);
+   png_write_chunk(ps->fp, "IEND", NULL, 0);
+   if (fclose_if_changed(ps->fp, png_filename) < 0) {
+      ret = 0;
+   }
+
+free_all:
+   free(filtered);
+   free(rows);
+   free(ps);
+   return ret;
+}
+
+
 //---------------------------------------------------------
 // PNG -> internal RGBA/IA
 //---------------------------------------------------------
@@ -505,9 +1040,11 @@ const char *n64graphics_get_write_version(void)
 }
 
 #ifdef N64GRAPHICS_STANDALONE
-#define N64GRAPHICS_VERSION "0.3"
+#define N64GRAPHICS_VERSION "0.5"
 #include <string.h>
 
+#include "workpool.h"
+
 typedef enum
 {
    MODE_EXPORT,
@@ -518,6 +1055,8 @@ typedef struct
 {
    char *img_filename;
    char *bin_filename;
+   char *pal_filename;
+   char *manifest_filename;
    tool_mode mode;
    unsigned int offset;
    img_format format;
@@ -525,12 +1064,15 @@ typedef struct
    int width;
    int height;
    int truncate;
+   int threads;
 } graphics_config;
 
 static const graphics_config default_config =
 {
    .img_filename = NULL,
    .bin_filename = NULL,
+   .pal_filename = NULL,
+   .manifest_filename = NULL,
    .mode = MODE_EXPORT,
    .offset = 0,
    .format = IMG_FORMAT_RGBA,
@@ -538,54 +1080,18 @@ static const graphics_config default_config =
    .width = 32,
    .height = 32,
    .truncate = 1,
+   .threads = 0,
 };
 
-typedef struct
-{
-   const char *name;
-   img_format format;
-   int depth;
-} format_entry;
-
-static const format_entry format_table[] =
-{
-   {"rgba16", IMG_FORMAT_RGBA, 16},
-   {"rgba32", IMG_FORMAT_RGBA, 32},
-   {"ia1",    IMG_FORMAT_IA,    1},
-   {"ia4",    IMG_FORMAT_IA,    4},
-   {"ia8",    IMG_FORMAT_IA,    8},
-   {"ia16",   IMG_FORMAT_IA,   16},
-   {"i4",     IMG_FORMAT_I,     4},
-   {"i8",     IMG_FORMAT_I,     8},
-   {"ci8",    IMG_FORMAT_CI,    8},
-   {"ci16",   IMG_FORMAT_CI,   16},
-};
-
-static const char *format2str(img_format format, int depth)
-{
-   for (unsigned i = 0; i < DIM(format_table); i++) {
-      if (format == format_table[i].format && depth == format_table[i].depth) {
-         return format_table[i].name;
-      }
-   }
-   return "unknown";
-}
-
 static int parse_format(graphics_config *config, const char *str)
 {
-   for (unsigned i = 0; i < DIM(format_table); i++) {
-      if (!strcasecmp(str, format_table[i].name)) {
-         config->format = format_table[i].format;
-         config->depth = format_table[i].depth;
-         return 1;
-      }
-   }
-   return 0;
+   return img_format_parse(str, &config->format, &config->depth);
 }
 
 static void print_usage(void)
 {
-   ERROR("Usage: n64graphics -e/-i BIN_FILE -g PNG_FILE [-o offset] [-f FORMAT] [-w WIDTH] [-h HEIGHT] [-V]\n"
+   ERROR("Usage: n64graphics -e/-i BIN_FILE -g PNG_FILE [-o offset] [-f FORMAT] [-p PAL_FILE] [-w WIDTH] [-h HEIGHT] [-V]\n"
+         "       n64graphics -m MANIFEST [-j JOBS]\n"
          "\n"
          "n64graphics v" N64GRAPHICS_VERSION ": N64 graphics manipulator\n"
          "\n"
@@ -593,14 +1099,18 @@ static void print_usage(void)
          " -e BIN_FILE  export from BIN_FILE to PNG_FILE\n"
          " -i BIN_FILE  import from PNG_FILE to BIN_FILE\n"
          " -g PNG_FILE  graphics file to import/export (.png)\n"
+         " -m MANIFEST  batch import/export every texture listed in MANIFEST, one per line:\n"
+         "              MODE(e/i) FORMAT OFFSET WIDTH HEIGHT BIN_FILE PNG_FILE [PAL_FILE]\n"
          "Optional arguments:\n"
          " -o OFFSET    starting offset in BIN_FILE (prevents truncation during import)\n"
-         " -f FORMAT    texture format: rgba16, rgba32, ia1, ia4, ia8, ia16, i4, i8, ci8, ci16 (default: %s)\n"
+         " -f FORMAT    texture format: rgba16, rgba32, ia1, ia4, ia8, ia16, i4, i8, ci4, ci8 (default: %s)\n"
+         " -p PAL_FILE  RGBA16 palette file for CI formats (written on import, read on export)\n"
          " -w WIDTH     export texture width (default: %d)\n"
          " -h HEIGHT    export texture height (default: %d)\n"
+         " -j JOBS      number of batch worker threads (default: number of CPUs)\n"
          " -v           verbose logging\n"
          " -V           print version information\n",
-         format2str(default_config.format, default_config.depth),
+         img_format_name(default_config.format, default_config.depth),
          default_config.width,
          default_config.height);
 }
@@ -643,11 +1153,23 @@ static int parse_arguments(int argc, char *argv[], graphics_config *config)
                if (++i >= argc) return 0;
                config->height = strtoul(argv[i], NULL, 0);
                break;
+            case 'j':
+               if (++i >= argc) return 0;
+               config->threads = strtoul(argv[i], NULL, 0);
+               break;
+            case 'm':
+               if (++i >= argc) return 0;
+               config->manifest_filename = argv[i];
+               break;
             case 'o':
                if (++i >= argc) return 0;
                config->offset = strtoul(argv[i], NULL, 0);
                config->truncate = 0;
                break;
+            case 'p':
+               if (++i >= argc) return 0;
+               config->pal_filename = argv[i];
+               break;
             case 'w':
                if (++i >= argc) return 0;
                config->width = strtoul(argv[i], NULL, 0);
@@ -670,11 +1192,333 @@ static int parse_arguments(int argc, char *argv[], graphics_config *config)
    return 1;
 }
 
+// convert PNG to raw data according to config
+// raw: allocated buffer of converted data, caller must free
+// palette: output RGBA16 palette for CI formats, room for 256 entries
+// returns length of raw data or <= 0 on error
+static int import_image(graphics_config *config, uint8_t **raw, uint8_t *palette, int *pal_len)
+{
+   rgba *imgr = NULL;
+   ia *imgi = NULL;
+   int raw_size;
+   int length = 0;
+
+   switch (config->format) {
+      case IMG_FORMAT_RGBA:
+      case IMG_FORMAT_CI:
+         imgr = png2rgba(config->img_filename, &config->width, &config->height);
+         break;
+      case IMG_FORMAT_IA:
+      case IMG_FORMAT_I:
+         imgi = png2ia(config->img_filename, &config->width, &config->height);
+         break;
+      default:
+         return -1;
+   }
+   if (!imgr && !imgi) {
+      return -1;
+   }
+   raw_size = config->width * config->height * config->depth / 8;
+   *raw = malloc(raw_size);
+   if (!*raw) {
+      ERROR("Error allocating %u bytes\n", raw_size);
+      length = -1;
+   } else {
+      switch (config->format) {
+         case IMG_FORMAT_RGBA:
+            length = rgba2raw(*raw, imgr, config->width, config->height, config->depth);
+            break;
+         case IMG_FORMAT_IA:
+            length = ia2raw(*raw, imgi, config->width, config->height, config->depth);
+            break;
+         case IMG_FORMAT_I:
+            length = i2raw(*raw, imgi, config->width, config->height, config->depth);
+            break;
+         case IMG_FORMAT_CI:
+            length = rgba2rawci(*raw, palette, pal_len, imgr, config->width, config->height, config->depth);
+            break;
+         default:
+            length = -1;
+            break;
+      }
+   }
+   free(imgr);
+   free(imgi);
+   return length;
+}
+
+// convert raw data to PNG according to config
+// raw: buffer containing at least width * height * depth / 8 bytes
+// returns 1 on success, 0 on error
+static int export_image(const graphics_config *config, const uint8_t *raw)
+{
+   rgba *imgr = NULL;
+   ia *imgi = NULL;
+   int res = 0;
+
+   switch (config->format) {
+      case IMG_FORMAT_RGBA:
+         imgr = raw2rgba(raw, config->width, config->height, config->depth);
+         res = rgba2png(config->img_filename, imgr, config->width, config->height);
+         break;
+      case IMG_FORMAT_IA:
+         imgi = raw2ia(raw, config->width, config->height, config->depth);
+         res = ia2png(config->img_filename, imgi, config->width, config->height);
+         break;
+      case IMG_FORMAT_I:
+         imgi = raw2i(raw, config->width, config->height, config->depth);
+         res = ia2png(config->img_filename, imgi, config->width, config->height);
+         break;
+      case IMG_FORMAT_CI:
+      {
+         uint8_t *palette = NULL;
+         uint8_t *indices;
+         long pal_size;
+         if (!config->pal_filename) {
+            ERROR("Error: CI export requires palette file (-p)\n");
+            return 0;
+         }
+         pal_size = read_file(config->pal_filename, &palette);
+         if (pal_size < 2 * (1 << config->depth)) {
+            ERROR("Error reading palette from \"%s\"\n", config->pal_filename);
+            free(palette);
+            return 0;
+         }
+         // rawci2rgba() expects one index per byte
+         indices = malloc(config->width * config->height);
+         for (int i = 0; i < config->width * config->height; i++) {
+            if (config->depth == 4) {
+               indices[i] = (i % 2) ? (raw[i/2] & 0xF) : (raw[i/2] >> 4);
+            } else {
+               indices[i] = raw[i];
+            }
+         }
+         imgr = rawci2rgba(indices, palette, config->width, config->height, 16);
+         res = rgba2png(config->img_filename, imgr, config->width, config->height);
+         free(indices);
+         free(palette);
+         break;
+      }
+      default:
+         return 0;
+   }
+   free(imgr);
+   free(imgi);
+   return res;
+}
+
+// batch mode: one manifest line per texture
+// MODE FORMAT OFFSET WIDTH HEIGHT BIN_FILE PNG_FILE [PAL_FILE]
+#define BATCH_MAX_FIELDS 8
+
+typedef struct
+{
+   graphics_config config;
+   const uint8_t *src;    // export: raw data in shared bin buffer
+   uint8_t *raw;          // import: converted raw data
+   int length;
+   int status;
+} batch_job;
+
+typedef struct
+{
+   char *filename;
+   uint8_t *data;
+   long size;
+} batch_bin;
+
+typedef struct
+{
+   batch_job *jobs;
+   int job_count;
+   batch_bin *bins;
+   int bin_count;
+} batch_state;
+
+static int batch_find_bin(const batch_state *state, const char *filename)
+{
+   for (int i = 0; i < state->bin_count; i++) {
+      if (!strcmp(state->bins[i].filename, filename)) {
+         return i;
+      }
+   }
+   return -1;
+}
+
+static int parse_manifest(const char *filename, batch_state *state)
+{
+   char line[4 * FILENAME_MAX];
+   char *fields[BATCH_MAX_FIELDS];
+   int alloc_count = 0;
+   int line_num = 0;
+   FILE *fp;
+
+   fp = fopen(filename, "r");
+   if (!fp) {
+      ERROR("Error opening manifest \"%s\"\n", filename);
+      return -1;
+   }
+   state->jobs = NULL;
+   state->job_count = 0;
+   while (fgets(line, sizeof(line), fp)) {
+      graphics_config *config;
+      char *tok;
+      int field_count = 0;
+      line_num++;
+      for (tok = strtok(line, " \t\r\n"); tok && *tok != '#'; tok = strtok(NULL, " \t\r\n")) {
+         if (field_count >= BATCH_MAX_FIELDS) {
+            break;
+         }
+         fields[field_count++] = tok;
+      }
+      if (field_count == 0) {
+         continue;
+      }
+      if (field_count < 7 || (fields[0][0] != 'e' && fields[0][0] != 'i')) {
+         ERROR("%s:%d: expected MODE FORMAT OFFSET WIDTH HEIGHT BIN_FILE PNG_FILE [PAL_FILE]\n", filename, line_num);
+         fclose(fp);
+         return -1;
+      }
+      if (state->job_count >= alloc_count) {
+         alloc_count = alloc_count ? 2 * alloc_count : 64;
+         state->jobs = realloc(state->jobs, alloc_count * sizeof(*state->jobs));
+      }
+      memset(&state->jobs[state->job_count], 0, sizeof(state->jobs[0]));
+      config = &state->jobs[state->job_count].config;
+      *config = default_config;
+      config->mode = (fields[0][0] == 'i') ? MODE_IMPORT : MODE_EXPORT;
+      if (!parse_format(config, fields[1])) {
+         ERROR("%s:%d: unknown format \"%s\"\n", filename, line_num, fields[1]);
+         fclose(fp);
+         return -1;
+      }
+      config->offset = strtoul(fields[2], NULL, 0);
+      config->width = strtoul(fields[3], NULL, 0);
+      config->height = strtoul(fields[4], NULL, 0);
+      config->bin_filename = strdup(fields[5]);
+      config->img_filename = strdup(fields[6]);
+      config->pal_filename = field_count > 7 ? strdup(fields[7]) : NULL;
+      config->truncate = 0;
+      state->job_count++;
+   }
+   fclose(fp);
+   return state->job_count;
+}
+
+static void batch_run_job(void *ctx, int index)
+{
+   batch_state *state = ctx;
+   batch_job *job = &state->jobs[index];
+   if (job->config.mode == MODE_IMPORT) {
+      uint8_t palette[2*256];
+      int pal_len = 0;
+      job->length = import_image(&job->config, &job->raw, palette, &pal_len);
+      job->status = job->length > 0;
+      if (job->status && job->config.format == IMG_FORMAT_CI) {
+         if (!job->config.pal_filename ||
+             write_file(job->config.pal_filename, palette, 2 * (1 << job->config.depth)) < 0) {
+            ERROR("Error writing palette for \"%s\"\n", job->config.img_filename);
+            job->status = 0;
+         }
+      }
+      if (!job->status) {
+         ERROR("Error converting \"%s\" to raw format\n", job->config.img_filename);
+      }
+   } else if (job->src) {
+      job->status = export_image(&job->config, job->src);
+      if (!job->status) {
+         ERROR("Error writing to \"%s\"\n", job->config.img_filename);
+      }
+   }
+}
+
+// run every job in a manifest; bin files are read and written once each
+// returns number of failed jobs
+static int run_batch(const char *manifest, int thread_count)
+{
+   batch_state state;
+   int failures = 0;
+
+   if (parse_manifest(manifest, &state) < 0) {
+      return 1;
+   }
+   state.bins = calloc(state.job_count, sizeof(*state.bins));
+   state.bin_count = 0;
+
+   // load each bin file once; exports share it read-only, imports are merged into it
+   for (int i = 0; i < state.job_count; i++) {
+      batch_job *job = &state.jobs[i];
+      int b = batch_find_bin(&state, job->config.bin_filename);
+      if (b < 0) {
+         b = state.bin_count++;
+         state.bins[b].filename = job->config.bin_filename;
+         state.bins[b].size = read_file(job->config.bin_filename, &state.bins[b].data);
+         if (state.bins[b].size < 0) {
+            state.bins[b].data = NULL;
+            state.bins[b].size = 0;
+         }
+      }
+      if (job->config.mode == MODE_EXPORT) {
+         long raw_size = job->config.width * job->config.height * job->config.depth / 8;
+         if (raw_size <= 0 || job->config.offset + raw_size > state.bins[b].size) {
+            ERROR("Error reading %ld bytes at 0x%X from \"%s\"\n", raw_size, job->config.offset, job->config.bin_filename);
+         } else {
+            job->src = state.bins[b].data + job->config.offset;
+         }
+      }
+   }
+
+   INFO("Running %d jobs from \"%s\"\n", state.job_count, manifest);
+   workpool_run(state.job_count, thread_count, batch_run_job, &state);
+
+   // merge imported textures into their bin files in manifest order
+   for (int b = 0; b < state.bin_count; b++) {
+      batch_bin *bin = &state.bins[b];
+      int dirty = 0;
+      for (int i = 0; i < state.job_count; i++) {
+         batch_job *job = &state.jobs[i];
+         if (job->config.mode != MODE_IMPORT || strcmp(job->config.bin_filename, bin->filename)) {
+            continue;
+         }
+         if (job->status) {
+            long end = job->config.offset + job->length;
+            if (end > bin->size) {
+               bin->data = realloc(bin->data, end);
+               memset(bin->data + bin->size, 0, end - bin->size);
+               bin->size = end;
+            }
+            memcpy(bin->data + job->config.offset, job->raw, job->length);
+            dirty = 1;
+         }
+      }
+      if (dirty) {
+         INFO("Writing 0x%lX bytes to \"%s\"\n", bin->size, bin->filename);
+         if (write_file(bin->filename, bin->data, bin->size) != bin->size) {
+            ERROR("Error writing %ld bytes to \"%s\"\n", bin->size, bin->filename);
+            failures++;
+         }
+      }
+      free(bin->data);
+   }
+
+   for (int i = 0; i < state.job_count; i++) {
+      batch_job *job = &state.jobs[i];
+      if (!job->status) {
+         failures++;
+      }
+      free(job->raw);
+      free(job->config.bin_filename);
+      free(job->config.img_filename);
+      free(job->config.pal_filename);
+   }
+   free(state.bins);
+   free(state.jobs);
+   return failures;
+}
+
 int main(int argc, char *argv[])
 {
    graphics_config config = default_config;
-   rgba *imgr;
-   ia   *imgi;
    FILE *fp;
    uint8_t *raw;
    int raw_size;
@@ -683,12 +1527,21 @@ int main(int argc, char *argv[])
    int res;
 
    int valid = parse_arguments(argc, argv, &config);
-   if (!valid || !config.bin_filename || !config.bin_filename) {
+   if (valid && config.manifest_filename) {
+      return run_batch(config.manifest_filename, config.threads) ? EXIT_FAILURE : EXIT_SUCCESS;
+   }
+   if (!valid || !config.bin_filename || !config.img_filename) {
       print_usage();
       exit(EXIT_FAILURE);
    }
 
    if (config.mode == MODE_IMPORT) {
+      uint8_t palette[2*256];
+      int pal_len = 0;
+      if (config.format == IMG_FORMAT_CI && !config.pal_filename) {
+         ERROR("Error: CI import requires palette file (-p)\n");
+         return EXIT_FAILURE;
+      }
       if (config.truncate) {
          fp = fopen(config.bin_filename, "w");
       } else {
@@ -701,47 +1554,25 @@ int main(int argc, char *argv[])
       if (!config.truncate) {
          fseek(fp, config.offset, SEEK_SET);
       }
-      switch (config.format) {
-         case IMG_FORMAT_RGBA:
-            imgr = png2rgba(config.img_filename, &config.width, &config.height);
-            raw_size = config.width * config.height * config.depth / 8;
-            raw = malloc(raw_size);
-            if (!raw) {
-               ERROR("Error allocating %u bytes\n", raw_size);
-            }
-            length = rgba2raw(raw, imgr, config.width, config.height, config.depth);
-            break;
-         case IMG_FORMAT_IA:
-            imgi = png2ia(config.img_filename, &config.width, &config.height);
-            raw_size = config.width * config.height * config.depth / 8;
-            raw = malloc(raw_size);
-            if (!raw) {
-               ERROR("Error allocating %u bytes\n", raw_size);
-            }
-            length = ia2raw(raw, imgi, config.width, config.height, config.depth);
-            break;
-         case IMG_FORMAT_I:
-            imgi = png2ia(config.img_filename, &config.width, &config.height);
-            raw_size = config.width * config.height * config.depth / 8;
-            raw = malloc(raw_size);
-            if (!raw) {
-               ERROR("Error allocating %u bytes\n", raw_size);
-            }
-            length = i2raw(raw, imgi, config.width, config.height, config.depth);
-            break;
-         default:
-            return EXIT_FAILURE;
-      }
+      raw = NULL;
+      length = import_image(&config, &raw, palette, &pal_len);
       if (length <= 0) {
          ERROR("Error converting to raw format\n");
          return EXIT_FAILURE;
       }
+      if (config.format == IMG_FORMAT_CI) {
+         INFO("Writing %d palette entries to \"%s\"\n", pal_len, config.pal_filename);
+         if (write_file(config.pal_filename, palette, 2 * (1 << config.depth)) < 0) {
+            return EXIT_FAILURE;
+         }
+      }
       INFO("Writing 0x%X bytes to offset 0x%X of \"%s\"\n", length, config.offset, config.bin_filename);
       flength = fwrite(raw, 1, length, fp);
       if (flength != length) {
          ERROR("Error writing %d bytes to \"%s\"\n", length, config.bin_filename);
       }
       fclose(fp);
+      free(raw);
 
    } else {
       if (config.width <= 0 || config.height <= 0 || config.depth <= 0) {
@@ -762,22 +1593,9 @@ int main(int argc, char *argv[])
       if (flength != raw_size) {
          ERROR("Error reading %d bytes from \"%s\"\n", raw_size, config.bin_filename);
       }
-      switch (config.format) {
-         case IMG_FORMAT_RGBA:
-            imgr = raw2rgba(raw, config.width, config.height, config.depth);
-            res = rgba2png(config.img_filename, imgr, config.width, config.height);
-            break;
-         case IMG_FORMAT_IA:
-            imgi = raw2ia(raw, config.width, config.height, config.depth);
-            res = ia2png(config.img_filename, imgi, config.width, config.height);
-            break;
-         case IMG_FORMAT_I:
-            imgi = raw2i(raw, config.width, config.height, config.depth);
-            res = ia2png(config.img_filename, imgi, config.width, config.height);
-            break;
-         default:
-            return EXIT_FAILURE;
-      }
+      fclose(fp);
+      res = export_image(&config, raw);
+      free(raw);
       if (!res) {
          ERROR("Error writing to \"%s\"\n", config.img_filename);
       }
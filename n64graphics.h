@@ -18,6 +18,28 @@ typedef struct _ia
    uint8_t alpha;
 } ia;
 
+// texture formats, in N64 G_IM_FMT order
+typedef enum
+{
+   IMG_FORMAT_RGBA,
+   IMG_FORMAT_YUV,
+   IMG_FORMAT_CI,
+   IMG_FORMAT_IA,
+   IMG_FORMAT_I,
+} img_format;
+
+//---------------------------------------------------------
+// format names
+//---------------------------------------------------------
+
+// get texture format name such as "rgba16" or "ia8"
+// returns "unknown" if format/depth combination is invalid
+const char *img_format_name(img_format format, int depth);
+
+// parse texture format name such as "rgba16" or "ia8"
+// returns 1 if name is valid, 0 otherwise
+int img_format_parse(const char *name, img_format *format, int *depth);
+
 //---------------------------------------------------------
 // N64 RGBA/IA/I/CI -> intermediate RGBA/IA
 //---------------------------------------------------------
@@ -49,9 +71,12 @@ int ia2raw(uint8_t *raw, const ia *img, int width, int height, int depth);
 // intermediate IA -> N64 raw I4/I8
 int i2raw(uint8_t *raw, const ia *img, int width, int height, int depth);
 
-// intermediate RGBA -> N64 raw CI + palette
-// TODO
-// int rgba2rawci(uint8_t *raw, uint8_t *out_palette, int *pal_len, const rgba *img, int width, int height, int depth);
+// intermediate RGBA -> N64 raw CI4/CI8 + RGBA16 palette
+// colors are matched exactly when they fit in the palette, otherwise quantized
+// raw: output index data, width * height * depth / 8 bytes
+// out_palette: output big-endian RGBA16 palette, room for (1 << depth) entries
+// pal_len: number of palette entries used
+int rgba2rawci(uint8_t *raw, uint8_t *out_palette, int *pal_len, const rgba *img, int width, int height, int depth);
 
 
 //---------------------------------------------------------
@@ -59,12 +84,26 @@ int i2raw(uint8_t *raw, const ia *img, int width, int height, int depth);
 //---------------------------------------------------------
 
 // intermediate RGBA write to PNG file
+// an existing file with identical contents is left untouched
 int rgba2png(const char *png_filename, const rgba *img, int width, int height);
 
 // intermediate IA write to grayscale PNG file
+// an existing file with identical contents is left untouched
 int ia2png(const char *png_filename, const ia *img, int width, int height);
 
 
+//---------------------------------------------------------
+// N64 raw -> streamed PNG
+//---------------------------------------------------------
+
+// N64 raw RGBA/IA/I -> PNG file, converted and compressed a few rows at a time
+// memory use is bounded by the image width, not its height
+// an existing file with identical contents is left untouched
+// raw: N64 raw data, width * height * depth / 8 bytes
+// returns 1 on success, 0 on error
+int raw2png(const char *png_filename, const uint8_t *raw, img_format format, int width, int height, int depth);
+
+
 //---------------------------------------------------------
 // PNG -> intermediate RGBA/IA
 //---------------------------------------------------------
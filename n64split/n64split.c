@@ -9,15 +9,24 @@ static const arg_config default_args =
 {
    .input_file = "",
    .config_file = "",
+   .compile_file = "",
+   .report_file = "",
    .output_dir = "",
    .model_scale = 1024.0f,
    .raw_texture = false,
    .large_texture = false,
+   .large_texture_format = IMG_FORMAT_RGBA,
    .large_texture_depth = 16,
+   .large_texture_width = 32,
    .keep_going = false,
    .merge_pseudo = false,
+   .incremental = false,
+   .threads = 0,
 };
 
+// references collected by the script writers while split_file() runs
+static ref_index *split_refs = NULL;
+
 const char asm_header[] = 
    "# %s disassembly and split file\n"
    "# generated by n64split v%s - N64 ROM splitter\n"
@@ -99,30 +108,28 @@ int config_section_lookup(rom_config *config, unsigned int addr, char *label, in
    // check for ROM offsets
    switch (is_end) {
       case 0:
-         for (i = 0; i < config->section_count; i++) {
-            // TODO: hack until mario_animation gets moved or AT() is used
-            if (config->sections[i].start == addr && addr != 0x4EC000) {
-               if (config->sections[i].label[0] != '\0') {
-                  sprintf(label, "%s", config->sections[i].label);
-               } else {
-                  sprintf(label, "%s_%06X", config_section2str(config->sections[i].type), addr);
-               }
-               INFO("Found 0 %06X: %s\n", addr, label);
-               return 0;
+         // TODO: hack until mario_animation gets moved or AT() is used
+         i = (addr != 0x4EC000) ? config_find_section(config, addr, 0) : -1;
+         if (i >= 0) {
+            if (config->sections[i].label[0] != '\0') {
+               sprintf(label, "%s", config->sections[i].label);
+            } else {
+               sprintf(label, "%s_%06X", config_section2str(config->sections[i].type), addr);
             }
+            INFO("Found 0 %06X: %s\n", addr, label);
+            return 0;
          }
          break;
       case 1:
-         for (i = 0; i < config->section_count; i++) {
-            if (config->sections[i].end == addr) {
-               if (config->sections[i].label[0] != '\0') {
-                  sprintf(label, "%s_end", config->sections[i].label);
-               } else {
-                  sprintf(label, "%s_%06X", config_section2str(config->sections[i].type), addr);
-               }
-               INFO("Found 1 %06X: %s\n", addr, label);
-               return 0;
+         i = config_find_section(config, addr, 1);
+         if (i >= 0) {
+            if (config->sections[i].label[0] != '\0') {
+               sprintf(label, "%s_end", config->sections[i].label);
+            } else {
+               sprintf(label, "%s_%06X", config_section2str(config->sections[i].type), addr);
             }
+            INFO("Found 1 %06X: %s\n", addr, label);
+            return 0;
          }
          break;
       default:
@@ -132,115 +139,154 @@ int config_section_lookup(rom_config *config, unsigned int addr, char *label, in
    return -1;
 }
 
+// print one command field, returns 0 if the field is omitted
+static int sprint_field(char *buf, script_field_type type, const unsigned char *field, rom_config *config,
+                        disasm_state *state, unsigned int offset, const char **load_prefix)
+{
+   char label[128];
+   unsigned int val = 0;
+   if (script_field_size(type) == 4) {
+      val = read_u32_be(field);
+   }
+   switch (type) {
+      case FIELD_NONE:
+         return 0;
+      case FIELD_U8:
+      case FIELD_SEGMENT:
+         sprintf(buf, "%d", field[0]);
+         break;
+      case FIELD_U8_HEX:
+         sprintf(buf, "0x%02X", field[0]);
+         break;
+      case FIELD_LAYER:
+         sprintf(buf, "%d", field[0] & 0xF);
+         break;
+      case FIELD_LAYER_HEX:
+         sprintf(buf, "0x%02X", field[0] & 0xF);
+         break;
+      case FIELD_S16:
+         sprintf(buf, "%d", read_s16_be(field));
+         break;
+      case FIELD_S32:
+         sprintf(buf, "%d", (int)val);
+         break;
+      case FIELD_WORD:
+      case FIELD_SEG_ADDR:
+         sprintf(buf, "0x%08X", val);
+         break;
+      case FIELD_ROM_START:
+         config_section_lookup(config, val, label, 0);
+         // behaviors are linked at their segmented address, load them from where they are placed in ROM
+         *load_prefix = (0 == strcmp("behavior_data", label)) ? "__load_" : "";
+         sprintf(buf, "%s%s", *load_prefix, label);
+         break;
+      case FIELD_ROM_END:
+         config_section_lookup(config, val, label, 1);
+         sprintf(buf, "%s%s", *load_prefix, label);
+         break;
+      case FIELD_RAM_DST:
+      case FIELD_FUNC:
+         disasm_label_lookup(state, val, buf);
+         break;
+      case FIELD_CALL:
+         disasm_label_lookup(state, val, label);
+         sprintf(buf, "%s # %08X", label, val);
+         break;
+      case FIELD_BEHAVIOR:
+         if (config->behavior_section >= 0) {
+            const split_section *beh = config_find_behavior(config, val & 0xFFFFFF);
+            if (beh == NULL) {
+               ERROR("Error: cannot find behavior %04X needed at offset %X\n", val & 0xFFFFFF, offset);
+               return 0;
+            }
+            sprintf(buf, "%s", beh->label);
+         } else {
+            sprintf(buf, "0x%08X", val);
+         }
+         break;
+      case FIELD_GEO:
+         sprintf(buf, "geo_layout_%08X # 0x%08X", val, val);
+         break;
+      case FIELD_SWITCH:
+         sprintf(buf, "geo_switch_case_%08X", val);
+         break;
+      case FIELD_DL_OPTIONAL:
+         if (val == 0) {
+            return 0;
+         }
+         // fall through
+      case FIELD_DL:
+         sprintf(buf, "seg%X_dl_%08X", field[0], val);
+         break;
+   }
+   return 1;
+}
+
+void write_script_cmd(FILE *out, const unsigned char *data, unsigned int offset, const script_cmd *info,
+                      unsigned int length, int as_words, rom_config *config, disasm_state *state)
+{
+   char field[256];
+   const char *load_prefix = "";
+   const unsigned char *cmd = &data[offset];
+   unsigned int i;
+   int f;
+   if (as_words) {
+      fprintf(out, ".word 0x%08X", read_u32_be(cmd));
+      for (i = 4; i < length; i += 4) {
+         script_field_type type = script_cmd_field(info, cmd, i);
+         if (script_field_size(type) != 4) {
+            type = FIELD_WORD;
+         }
+         if (sprint_field(field, type, &cmd[i], config, state, offset, &load_prefix)) {
+            fprintf(out, ", %s", field);
+         }
+         if (split_refs) {
+            refs_add_field(split_refs, type, &cmd[i]);
+         }
+      }
+   } else {
+      const char *sep = " ";
+      fprintf(out, "%s", info->name);
+      for (f = 0; f < SCRIPT_MAX_FIELDS && info->fields[f].type != FIELD_NONE; f++) {
+         if (sprint_field(field, info->fields[f].type, &cmd[info->fields[f].offset], config, state, offset, &load_prefix)) {
+            fprintf(out, "%s%s", sep, field);
+            sep = ", ";
+         }
+         if (split_refs) {
+            refs_add_field(split_refs, info->fields[f].type, &cmd[info->fields[f].offset]);
+         }
+      }
+      if (length > info->length) {
+         if (sprint_field(field, info->ext_type, &cmd[info->length], config, state, offset, &load_prefix)) {
+            fprintf(out, "%s%s", sep, field);
+         }
+         if (split_refs) {
+            refs_add_field(split_refs, info->ext_type, &cmd[info->length]);
+         }
+      }
+   }
+   fprintf(out, "\n");
+}
+
 void write_level(FILE *out, unsigned char *data, rom_config *config, int s, disasm_state *state)
 {
-   char start_label[128];
-   char end_label[128];
-   char dst_label[128];
    split_section *sec;
-   unsigned int ptr_start;
-   unsigned int ptr_end;
-   unsigned int dst;
+   const script_cmd *info;
+   unsigned int cmd_len;
    unsigned int a;
-   int i;
-   int beh_i;
 
    sec = &config->sections[s];
 
-   beh_i = -1;
-   // see if there is a behavior section
-   for (i = 0; i < config->section_count; i++) {
-      if (config->sections[i].type == TYPE_SM64_BEHAVIOR) {
-         beh_i = i;
-         break;
-      }
-   }
    a = sec->start;
    while (a < sec->end) {
+      info = script_cmd_get(SCRIPT_LEVEL, &data[a]);
+      cmd_len = script_cmd_length(SCRIPT_LEVEL, info, &data[a]);
       // length = 0 ends level script
-      if (data[a+1] == 0) {
+      if (cmd_len == 0) {
          break;
       }
-      switch (data[a]) {
-         case 0x00: // load and jump from ROM into a RAM segment
-         case 0x01: // load and jump from ROM into a RAM segment
-         case 0x17: // copy uncompressed data from ROM to a RAM segment
-         case 0x18: // decompress MIO0 data from ROM and copy it into a RAM segment
-         case 0x1A: // decompress MIO0 data from ROM and copy it into a RAM segment (for texture only segments?)
-            ptr_start = read_u32_be(&data[a+4]);
-            ptr_end = read_u32_be(&data[a+8]);
-            config_section_lookup(config, ptr_start, start_label, 0);
-            config_section_lookup(config,   ptr_end,   end_label, 1);
-            fprintf(out, ".word 0x");
-            for (i = 0; i < 4; i++) {
-               fprintf(out, "%02X", data[a+i]);
-            }
-            if (0 == strcmp("behavior_data", start_label)) {
-               fprintf(out, ", __load_%s, __load_%s", start_label, end_label);
-            } else {
-               fprintf(out, ", %s, %s", start_label, end_label);
-            }
-            for (i = 12; i < data[a+1]; i++) {
-               if ((i & 0x3) == 0) {
-                  fprintf(out, ", 0x");
-               }
-               fprintf(out, "%02X", data[a+i]);
-            }
-            fprintf(out, "\n");
-            break;
-         case 0x11: // call function
-         case 0x12: // call function
-            ptr_start = read_u32_be(&data[a+0x4]);
-            disasm_label_lookup(state, ptr_start, start_label);
-            fprintf(out, ".word 0x%08X, %s # %08X\n", read_u32_be(&data[a]), start_label, ptr_start);
-            break;
-         case 0x16: // load ASM into RAM
-            dst       = read_u32_be(&data[a+0x4]);
-            ptr_start = read_u32_be(&data[a+0x8]);
-            ptr_end   = read_u32_be(&data[a+0xc]);
-            // TODO: differentiate between start/end
-            disasm_label_lookup(state, dst, dst_label);
-            config_section_lookup(config, ptr_start, start_label, 0);
-            config_section_lookup(config, ptr_end, end_label, 1);
-            fprintf(out, ".word 0x");
-            for (i = 0; i < 4; i++) {
-               fprintf(out, "%02X", data[a+i]);
-            }
-            fprintf(out, ", %s, %s, %s\n", dst_label, start_label, end_label);
-            break;
-         case 0x25: // load mario object with behavior
-         case 0x24: // load object with behavior
-            fprintf(out, ".word 0x%08X", read_u32_be(&data[a]));
-            for (i = 4; i < data[a+1]-4; i+=4) {
-               fprintf(out, ", 0x%08X", read_u32_be(&data[a+i]));
-            }
-            dst = read_u32_be(&data[a+i]);
-            if (beh_i >= 0) {
-               unsigned int offset = dst & 0xFFFFFF;
-               split_section *beh = config->sections[beh_i].children;
-               for (i = 0; i < config->sections[beh_i].child_count; i++) {
-                  if (offset == beh[i].start) {
-                     fprintf(out, ", %s", beh[i].label);
-                     break;
-                  }
-               }
-               if (i >= config->sections[beh_i].child_count) {
-                  ERROR("Error: cannot find behavior %04X needed at offset %X\n", offset, a);
-               }
-            } else {
-               fprintf(out, ", 0x%08X", dst);
-            }
-            fprintf(out, "\n");
-            break;
-         default:
-            fprintf(out, ".word 0x%08X", read_u32_be(&data[a]));
-            for (i = 4; i < data[a+1]; i+=4) {
-               fprintf(out, ", 0x%08X", read_u32_be(&data[a+i]));
-            }
-            fprintf(out, "\n");
-            break;
-      }
-      a += data[a+1];
+      write_script_cmd(out, data, a, info, cmd_len, 1, config, state);
+      a += cmd_len;
    }
    // align to next 16-byte boundary
    if (a & 0x0F) {
@@ -252,7 +298,7 @@ void write_level(FILE *out, unsigned char *data, rom_config *config, int s, disa
    }
    // remaining is geo layout script
    fprintf(out, "# begin %s geo 0x%X\n", sec->label, a);
-   write_geolayout(out, &data[sec->start], a - sec->start, sec->end - sec->start, state);
+   write_geolayout(out, &data[sec->start], a - sec->start, sec->end - sec->start, config, state);
 }
 
 void generate_globals(arg_config *args, rom_config *config)
@@ -260,7 +306,7 @@ void generate_globals(arg_config *args, rom_config *config)
    char globalfilename[FILENAME_MAX];
    FILE *fglobal;
    sprintf(globalfilename, "%s/%s", args->output_dir, GLOBALS_FILE);
-   fglobal = fopen(globalfilename, "w");
+   fglobal = fopen_if_changed(globalfilename);
    if (fglobal == NULL) {
       ERROR("Error opening %s\n", globalfilename);
       exit(3);
@@ -272,7 +318,7 @@ void generate_globals(arg_config *args, rom_config *config)
    }
    fprintf(fglobal, "\n");
 
-   fclose(fglobal);
+   fclose_if_changed(fglobal, globalfilename);
 }
 
 void generate_macros(arg_config *args)
@@ -280,7 +326,7 @@ void generate_macros(arg_config *args)
    char incfilename[FILENAME_MAX];
    FILE *finc;
    sprintf(incfilename, "%s/%s", args->output_dir, MACROS_FILE);
-   finc = fopen(incfilename, "w");
+   finc = fopen_if_changed(incfilename);
    if (finc == NULL) {
       ERROR("Error opening %s\n", incfilename);
       exit(3);
@@ -291,7 +337,7 @@ void generate_macros(arg_config *args)
                  ".macro vertex \\x, \\y, \\z, \\u, \\v, \\r=0xFF, \\g=0xFF, \\b=0xFF, \\a=0xFF\n"
                  "   .hword \\x, \\y, \\z, 0, \\u, \\v\n   .byte \\r, \\g, \\b, \\a\n"
                  ".endm\n");
-   fclose(finc);
+   fclose_if_changed(finc, incfilename);
 }
 
 
@@ -300,7 +346,7 @@ void generate_ld_script(arg_config *args, rom_config *config)
    char ldfilename[FILENAME_MAX];
    FILE *fld;
    sprintf(ldfilename, "%s/%s.ld", args->output_dir, config->basename);
-   fld = fopen(ldfilename, "w");
+   fld = fopen_if_changed(ldfilename);
    if (fld == NULL) {
       ERROR("Error opening %s\n", ldfilename);
       exit(3);
@@ -359,10 +405,10 @@ void generate_ld_script(arg_config *args, rom_config *config)
    }
    fprintf(fld, "}\n");
 
-   fclose(fld);
+   fclose_if_changed(fld, ldfilename);
 }
 
-void section_sm64_geo(unsigned char *data, arg_config *args, rom_config *config, disasm_state *state, split_section *sec, char* start_label, char* outfilename, char* outfilepath, FILE *fasm, strbuf *makeheader_level) {
+void section_sm64_geo(unsigned char *data, arg_config *args, rom_config *config, disasm_state *state, split_section *sec, char* start_label, char* outfilename, char* outfilepath, FILE *fasm, strbuf *makeheader_level, int write_geo) {
    char geofilename[FILENAME_MAX];
    FILE *fgeo;
    if (sec->label == NULL || sec->label[0] == '\0') {
@@ -376,13 +422,15 @@ void section_sm64_geo(unsigned char *data, arg_config *args, rom_config *config,
    sprintf(outfilepath, "%s/%s", args->output_dir, outfilename);
 
    // decode and write level data out
-   fgeo = fopen(outfilepath, "w");
-   if (fgeo == NULL) {
-      perror(outfilepath);
-      exit(1);
+   if (write_geo) {
+      fgeo = fopen_if_changed(outfilepath);
+      if (fgeo == NULL) {
+         perror(outfilepath);
+         exit(1);
+      }
+      write_geolayout(fgeo, &data[sec->start], 0, sec->end - sec->start, config, state);
+      fclose_if_changed(fgeo, outfilepath);
    }
-   write_geolayout(fgeo, &data[sec->start], 0, sec->end - sec->start, state);
-   fclose(fgeo);
 
    fprintf(fasm, "\n.align 4, 0x01\n");
    fprintf(fasm, ".global %s\n", start_label);
@@ -393,8 +441,8 @@ void section_sm64_geo(unsigned char *data, arg_config *args, rom_config *config,
    strbuf_sprintf(makeheader_level, " \\\n$(GEO_DIR)/%s", geofilename);
 }
 
-void write_bin_type(split_section *sec, char* outfilename, char* start_label, FILE* fasm, unsigned char *data, char* outfilepath, arg_config * args, rom_config *config) {
-   char* output_dir=BIN_SUBDIR;
+void write_bin_type(split_section *sec, char* outfilename, char* start_label, FILE* fasm, unsigned char *data, char* outfilepath, arg_config * args, rom_config *config, int write_data) {
+   const char *output_dir = BIN_SUBDIR;
    char bin_dir[FILENAME_MAX];
    if (sec->section_name != NULL) {
       output_dir=sec->section_name;
@@ -408,7 +456,9 @@ void write_bin_type(split_section *sec, char* outfilename, char* start_label, FI
       sprintf(outfilename, "%s/%s.%06X.%s.%s", output_dir, config->basename, sec->start, sec->label,sec->section_name);
    }
    sprintf(outfilepath, "%s/%s", args->output_dir, outfilename);
-   write_file(outfilepath, &data[sec->start], sec->end - sec->start);
+   if (write_data) {
+      write_file_if_changed(outfilepath, &data[sec->start], sec->end - sec->start);
+   }
    if (sec->label == NULL || sec->label[0] == '\0') {
       sprintf(start_label, "L%06X", sec->start);
    } else {
@@ -419,6 +469,419 @@ void write_bin_type(split_section *sec, char* outfilename, char* start_label, FI
    fprintf(fasm, "%s_end:\n", start_label);
 }
 
+// Makefile rule rebuilding a segment bin from the PNGs of its textures
+static void write_texture_deps(FILE *fmake, const char *start_label, const split_section *sec)
+{
+   fprintf(fmake, "$(MIO0_DIR)/%s.bin: $(TEXTURE_DIR)/%s.manifest", start_label, start_label);
+   for (int t = 0; t < sec->child_count; t++) {
+      const texture *tex = &sec->children[t].tex;
+      switch (tex->format) {
+         case TYPE_TEX_IA:
+            fprintf(fmake, " $(TEXTURE_DIR)/%s.%05X.ia%d.png", start_label, tex->offset, tex->depth);
+            break;
+         case TYPE_TEX_I:
+            fprintf(fmake, " $(TEXTURE_DIR)/%s.%05X.i%d.png", start_label, tex->offset, tex->depth);
+            break;
+         case TYPE_TEX_RGBA:
+            fprintf(fmake, " $(TEXTURE_DIR)/%s.%05X.rgba%d.png", start_label, tex->offset, tex->depth);
+            break;
+         case TYPE_TEX_SKYBOX:
+            fprintf(fmake, " $(TEXTURE_DIR)/%s.%05X.skybox.png", start_label, tex->offset);
+            break;
+         default:
+            break;
+      }
+   }
+   fprintf(fmake, "\n\t$(N64GRAPHICS) -m $<\n\n");
+}
+
+// label and file names of a compressed section: the compressed file in the mio0 directory
+// start_label - section label, or L followed by its start
+// outfilename - compressed file name relative to the mio0 directory
+// mio0filename - compressed file path
+static void compressed_names(const split_section *sec, const char *mio0_dir, char *start_label, char *outfilename,
+                             char *mio0filename)
+{
+   char extension[8] = {0};
+   if (sec->label == NULL || sec->label[0] == '\0') {
+      sprintf(start_label, "L%06X", sec->start);
+   } else {
+      strcpy(start_label, sec->label);
+   }
+   switch (sec->type) {
+      case TYPE_BLAST: sprintf(extension, "bc%d", sec->subtype); break;
+      case TYPE_MIO0:  strcpy(extension, "mio0"); break;
+      case TYPE_GZIP:  strcpy(extension, "gz"); break;
+      default: break;
+   }
+   sprintf(outfilename, "%s.%s", start_label, extension);
+   sprintf(mio0filename, "%s/%s", mio0_dir, outfilename);
+}
+
+// write compressed section and decode it to its bin, textures and bin assembly
+// only touches files belonging to this section, so sections can be extracted on separate threads
+static void extract_compressed(unsigned char *data, const arg_config *args, const split_section *sec, char *start_label,
+                               char *mio0filename, const char *bin_dir, const char *texture_dir, const char *model_dir)
+{
+   char binfilename[FILENAME_MAX];
+   char tmpfilename[FILENAME_MAX];
+   char binasmfilename[FILENAME_MAX];
+   char outfilename[FILENAME_MAX];
+   char outfilepath[FILENAME_MAX];
+   int seg_changed;
+   unsigned char *lut;
+   FILE *binasm;
+   FILE *fmanifest;
+   unsigned char *binfilecontents = NULL;
+   long binfilelen = 0;
+   unsigned int w, h;
+
+   sprintf(binfilename, "%s.s", start_label);
+   sprintf(binasmfilename, "%s/%s", bin_dir, binfilename);
+   // decode and write
+   binasm = fopen_if_changed(binasmfilename);
+   if (binasm == NULL) {
+      perror(binasmfilename);
+      exit(1);
+   }
+   fprintf(binasm, "# generated by n64split\n.section .rodata\n\n.include \"%s\"\n", MACROS_FILE);
+   sprintf(binfilename, "%s/%s.bin", bin_dir, start_label);
+   seg_changed = write_file_if_changed(mio0filename, &data[sec->start], sec->end - sec->start) != 0;
+
+   // TODO: use in-memory decompression?
+   // extract compressed data, only replacing the bin if it changed
+   sprintf(tmpfilename, "%s.tmp", binfilename);
+   switch (sec->type) {
+      case TYPE_BLAST:
+         // TODO: make this configurable?
+         switch (sec->subtype) {
+            case 4: lut = &data[0x047480]; break;
+            case 5: lut = &data[0x0998E0]; break; // TODO: fix this
+            default: lut = data; break;
+         }
+         blast_decode_file(mio0filename, sec->subtype, tmpfilename, lut);
+         break;
+      case TYPE_MIO0:
+         mio0_decode_file(mio0filename, 0, tmpfilename);
+         break;
+      case TYPE_GZIP:
+         gzip_decode_file(mio0filename, 0, tmpfilename);
+         break;
+      default:
+         break;
+   }
+   seg_changed |= rename_if_changed(tmpfilename, binfilename) != 0;
+   binfilelen = read_file(binfilename, &binfilecontents);
+
+   // extract texture data
+   if (sec->children) {
+      unsigned int offset = 0;
+      unsigned int next_offset = 0;
+      // TODO: add segment base to config file
+      const unsigned int segment_base = 0x07000000;
+      unsigned int seg_address = segment_base + offset;
+      // textures are listed in a per-segment manifest so n64graphics can rebuild the bin in one run
+      sprintf(outfilepath, "%s/%s.manifest", texture_dir, start_label);
+      fmanifest = fopen_if_changed(outfilepath);
+      if (fmanifest == NULL) {
+         ERROR("Error opening %s\n", outfilepath);
+         exit(3);
+      }
+      fprintf(fmanifest, "# MODE FORMAT OFFSET WIDTH HEIGHT BIN_FILE PNG_FILE\n");
+      INFO("Extracting textures from %s\n", start_label);
+      for (int t = 0; t < sec->child_count; t++) {
+         split_section *child = &sec->children[t];
+         texture *tex = &child->tex;
+         w = tex->width;
+         h = tex->height;
+         if (next_offset > child->start) {
+            ERROR("Error section overlap region %d (%X > %X)\n", t, next_offset, child->start);
+            exit(1);
+         }
+         if (next_offset != child->start) {
+            unsigned int gap_len = child->start - next_offset;
+            INFO("Filling gap before region %d (%d bytes)\n", t, gap_len);
+            fprintf(binasm, "# Unknown region %06X-%06X [%X]\n", next_offset, child->start, gap_len);
+            while (gap_len > 0) {
+               int group_len = MIN(gap_len, 0x10);
+               fprintf(binasm, ".byte ");
+               fprint_hex_source(binasm, &binfilecontents[next_offset], group_len);
+               fprintf(binasm, "\n");
+               gap_len -= group_len;
+               next_offset += group_len;
+            }
+         }
+         offset = tex->offset;
+         seg_address = segment_base + offset;
+         if (child->end) {
+            next_offset = child->end;
+         } else if (tex->format == TYPE_F3D_LIGHT) {
+            next_offset = child->start + 0x18;
+         } else { // assume texture
+            next_offset = child->start + w * h * tex->depth / 8;
+         }
+         fprintf(binasm, "\n");
+         switch (tex->format) {
+            case TYPE_TEX_IA:
+            {
+               sprintf(outfilename, "%s.%05X.ia%d", start_label, offset, tex->depth);
+               ia *img = raw2ia(&binfilecontents[offset], w, h, tex->depth);
+               if (img) {
+                  sprintf(outfilepath, "%s/%s.png", texture_dir, outfilename);
+                  ia2png(outfilepath, img, w, h);
+                  free(img);
+                  fprintf(fmanifest, "i ia%d 0x%05X %d %d %s/%s.bin %s/%s.png\n", tex->depth, offset, w, h,
+                          MIO0_SUBDIR, start_label, TEXTURE_SUBDIR, outfilename);
+               }
+               if (args->raw_texture && binfilelen > 0) {
+                  INFO("Saving raw texture for %s\n", start_label);
+                  int len = w*h*tex->depth/8;
+                  sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
+                  write_file_if_changed(outfilepath, &binfilecontents[offset], len);
+               }
+               fprintf(binasm, "texture_%08X: # 0x%08X\n", seg_address, seg_address);
+               fprintf(binasm, ".incbin \"%s\"\n", outfilename);
+               break;
+            }
+            case TYPE_TEX_I:
+            {
+               sprintf(outfilename, "%s.%05X.i%d", start_label, offset, tex->depth);
+               ia *img = raw2i(&binfilecontents[offset], w, h, tex->depth);
+               if (img) {
+                  sprintf(outfilepath, "%s/%s.png", texture_dir, outfilename);
+                  ia2png(outfilepath, img, w, h);
+                  free(img);
+                  fprintf(fmanifest, "i i%d 0x%05X %d %d %s/%s.bin %s/%s.png\n", tex->depth, offset, w, h,
+                          MIO0_SUBDIR, start_label, TEXTURE_SUBDIR, outfilename);
+               }
+               if (args->raw_texture && binfilelen > 0) {
+                  INFO("Saving raw texture for %s\n", start_label);
+                  int len = w*h*tex->depth/8;
+                  sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
+                  write_file_if_changed(outfilepath, &binfilecontents[offset], len);
+               }
+               fprintf(binasm, "texture_%08X: # 0x%08X\n", seg_address, seg_address);
+               fprintf(binasm, ".incbin \"%s\"\n", outfilename);
+               break;
+            }
+            case TYPE_TEX_RGBA:
+            {
+               sprintf(outfilename, "%s.%05X.rgba%d", start_label, offset, tex->depth);
+               rgba *img = raw2rgba(&binfilecontents[offset], w, h, tex->depth);
+               if (img) {
+                  sprintf(outfilepath, "%s/%s.png", texture_dir, outfilename);
+                  rgba2png(outfilepath, img, w, h);
+                  free(img);
+                  fprintf(fmanifest, "i rgba%d 0x%05X %d %d %s/%s.bin %s/%s.png\n", tex->depth, offset, w, h,
+                          MIO0_SUBDIR, start_label, TEXTURE_SUBDIR, outfilename);
+               }
+               if (args->raw_texture && binfilelen > 0) {
+                  INFO("Saving raw texture for %s\n", start_label);
+                  int len = w*h*tex->depth/8;
+                  sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
+                  write_file_if_changed(outfilepath, &binfilecontents[offset], len);
+               }
+               fprintf(binasm, "texture_%08X: # 0x%08X\n", seg_address, seg_address);
+               fprintf(binasm, ".incbin \"%s\"\n", outfilename);
+               break;
+            }
+            case TYPE_TEX_SKYBOX:
+            {
+               // read in grid of MxN 32x32 tiles and save them as M*31xN*31 image
+               rgba *img;
+               unsigned int sky_offset = offset;
+               int m, n;
+               int tx, ty;
+               m = w/32;
+               n = h/32;
+               img = malloc(w*h*sizeof(rgba));
+               w -= m; // adjust for overlap
+               h -= n;
+               for (ty = 0; ty < n; ty++) {
+                  for (tx = 0; tx < m; tx++) {
+                     rgba *tile = raw2rgba(&binfilecontents[sky_offset], 32, 32, tex->depth);
+                     int cx, cy;
+                     for (cy = 0; cy < 31; cy++) {
+                        for (cx = 0; cx < 31; cx++) {
+                           int out_off = 31*w*ty + 31*tx + w*cy + cx;
+                           int in_off = 32*cy+cx;
+                           img[out_off] = tile[in_off];
+                        }
+                     }
+                     free(tile);
+                     sky_offset += 32*32*2;
+                  }
+               }
+               sprintf(outfilename, "%s.%05X.skybox.png", start_label, offset);
+               sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
+               rgba2png(outfilepath, img, w, h);
+               free(img);
+               break;
+            }
+            case TYPE_F3D_DL:
+            {
+               int sec_len = child->end - child->start;
+               fprintf(binasm, "f3d_%08X: # 0x%08X\n", seg_address, seg_address);
+               for (int o = 0; o < sec_len; o += 8) {
+                  unsigned char cmd = binfilecontents[offset + o];
+                  unsigned int second = read_u32_be(&binfilecontents[offset + o + 4]);
+                  fprintf(binasm, ".word 0x%08X, ", read_u32_be(&binfilecontents[offset + o]));
+                  switch (cmd) {
+                     case 0x03: // light
+                        fprintf(binasm, "light_%08X\n", second);
+                        break;
+                     case 0x04: // vertex
+                        fprintf(binasm, "vertex_%08X\n", second);
+                        break;
+                     case 0x06: // f3d
+                        fprintf(binasm, "f3d_%08X\n", second);
+                        break;
+                     case 0xFD: // texture
+                        fprintf(binasm, "texture_%08X\n", second);
+                        break;
+                     default:
+                        fprintf(binasm, "0x%08X\n", second);
+                        break;
+                  }
+               }
+               break;
+            }
+            case TYPE_F3D_LIGHT:
+            {
+               fprintf(binasm, "light_%08X: # 0x%08X\n", seg_address, seg_address);
+               fprintf(binasm, ".byte ");
+               fprint_hex_source(binasm, &binfilecontents[offset], 8);
+               fprintf(binasm, "\n");
+               fprintf(binasm, "light_%08X: # 0x%08X\n", seg_address + 8, seg_address + 8);
+               fprintf(binasm, ".byte ");
+               fprint_hex_source(binasm, &binfilecontents[offset + 8], 8);
+               fprintf(binasm, "\n.byte ");
+               fprint_hex_source(binasm, &binfilecontents[offset + 16], 8);
+               fprintf(binasm, "\n");
+               break;
+            }
+            case TYPE_F3D_VERTEX:
+            {
+               int sec_len = child->end - child->start;
+               fprintf(binasm, "vertex_%08X: # 0x%08X\n", seg_address, seg_address);
+               for (int o = 0; o < sec_len; o += 16) {
+                  fprintf(binasm, "vertex ");
+                  for (int h = 0; h < 6; h++) {
+                     // X, Y, Z, UNUSED, U, V
+                     if (h != 3) {
+                        fprintf(binasm, "%6d, ", read_s16_be(&binfilecontents[offset + o + h*2]));
+                     }
+                  }
+                  // R, G, B, A
+                  fprint_hex_source(binasm, &binfilecontents[offset + o + 12], 4);
+                  fprintf(binasm, "\n");
+               }
+               break;
+            }
+            case TYPE_SM64_COLLISION:
+            {
+               int sec_len = 0;
+               sprintf(outfilename, "%s.%05X.collision", start_label, offset);
+               sprintf(outfilepath, "%s/%s.obj", model_dir, outfilename);
+               INFO("Generating collision model %s\n", outfilename);
+               sec_len = collision2obj(binfilename, offset, outfilepath, start_label, args->model_scale);
+               if (args->raw_texture && binfilelen > 0) {
+                  INFO("Saving raw collision for %s\n", start_label);
+                  sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
+                  write_file_if_changed(outfilepath, &binfilecontents[offset], sec_len);
+               }
+               fprintf(binasm, "collision_%06X: # 0x%08X\n", seg_address, seg_address);
+               fprintf(binasm, ".incbin \"%s\"\n", outfilename);
+               break;
+            }
+            default:
+               ERROR("Don't know what to do with format %d\n", tex->format);
+               exit(1);
+         }
+      }
+      sprintf(outfilepath, "%s/%s.manifest", texture_dir, start_label);
+      seg_changed |= fclose_if_changed(fmanifest, outfilepath) != 0;
+   }
+
+   // extract texture data
+   if (args->large_texture && binfilelen > 0) {
+      INFO("Generating large texture for %s\n", start_label);
+      w = args->large_texture_width;
+      // parse_arguments() only accepts widths with whole, non-zero bytes per row
+      h = binfilelen * 8 / (w * args->large_texture_depth);
+      if (h > 0) {
+         sprintf(outfilename, "%s.ALL.png", start_label);
+         sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
+         if (!raw2png(outfilepath, binfilecontents, args->large_texture_format, w, h, args->large_texture_depth)) {
+            ERROR("Error writing large texture \"%s\"\n", outfilepath);
+         }
+      }
+   }
+   // TODO: write files in correct order to avoid this
+   // touch bin, then mio0 files so 'make' doesn't rebuild them right away
+   // unchanged segments keep the timestamps from the previous split
+   if (seg_changed) {
+      touch_file(binfilename);
+      touch_file(mio0filename);
+   }
+   fclose_if_changed(binasm, binasmfilename);
+   free(binfilecontents);
+}
+
+typedef struct
+{
+   unsigned char *data;
+   const arg_config *args;
+   const rom_config *config;
+   const int *sections; // section index of each job
+   const char *bin_dir;
+   const char *mio0_dir;
+   const char *texture_dir;
+   const char *model_dir;
+} blast_extract_state;
+
+static void blast_extract_job(void *ctx, int index)
+{
+   const blast_extract_state *state = ctx;
+   const split_section *sec = &state->config->sections[state->sections[index]];
+   char start_label[256];
+   char outfilename[FILENAME_MAX];
+   char mio0filename[FILENAME_MAX];
+   compressed_names(sec, state->mio0_dir, start_label, outfilename, mio0filename);
+   extract_compressed(state->data, state->args, sec, start_label, mio0filename, state->bin_dir, state->texture_dir,
+                      state->model_dir);
+}
+
+// Blast Corps ROMs have thousands of small independent blocks, decode and convert them on worker threads
+static void extract_blast_sections(unsigned char *data, const arg_config *args, const rom_config *config,
+                                   const unsigned char *dirty, const char *bin_dir, const char *mio0_dir,
+                                   const char *texture_dir, const char *model_dir)
+{
+   blast_extract_state state;
+   int *sections;
+   int count = 0;
+   int s;
+   sections = malloc(config->section_count * sizeof(*sections));
+   for (s = 0; s < config->section_count; s++) {
+      if (config->sections[s].type == TYPE_BLAST && dirty[s]) {
+         sections[count++] = s;
+      }
+   }
+   if (count > 0) {
+      INFO("Extracting %d Blast sections\n", count);
+      state.data = data;
+      state.args = args;
+      state.config = config;
+      state.sections = sections;
+      state.bin_dir = bin_dir;
+      state.mio0_dir = mio0_dir;
+      state.texture_dir = texture_dir;
+      state.model_dir = model_dir;
+      workpool_run(count, args->threads, blast_extract_job, &state);
+   }
+   free(sections);
+}
+
 void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_config *config, disasm_state *state)
 {
 
@@ -435,7 +898,11 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
    char outfilename[FILENAME_MAX];
    char outfilepath[FILENAME_MAX];
    char mio0filename[FILENAME_MAX];
+   char refsfilename[FILENAME_MAX];
+   char manifestfilename[FILENAME_MAX];
    char start_label[256];
+   ref_index refs;
+   unsigned char *dirty;
    strbuf makeheader_mio0;
    strbuf makeheader_level;
    strbuf makeheader_music;
@@ -444,7 +911,6 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
    int s;
    int i;
    unsigned int a;
-   unsigned int w, h;
    unsigned int prev_end = 0;
    unsigned int ptr;
    split_section *sections = config->sections;
@@ -471,13 +937,18 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
 
    // open main assembly file and write header
    sprintf(asmfilename, "%s/%s.s", args->output_dir, config->basename);
-   fasm = fopen(asmfilename, "w");
+   fasm = fopen_if_changed(asmfilename);
    if (fasm == NULL) {
       ERROR("Error opening %s\n", asmfilename);
       exit(3);
    }
    fprintf(fasm, asm_header, config->name, N64SPLIT_VERSION);
 
+   refs_init(&refs, data, length);
+   split_refs = &refs;
+   dirty = split_plan(args, config, data, &refs);
+   extract_blast_sections(data, args, config, dirty, bin_dir, mio0_dir, texture_dir, model_dir);
+
    // generate globals include file
    generate_globals(args, config);
    // generate common macros
@@ -519,7 +990,9 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
             // TODO move gap fillers into a different subdirectory
             sprintf(outfilename, "%s/%s.%06X.bin", BIN_SUBDIR, config->basename, prev_end);
             sprintf(outfilepath, "%s/%s", args->output_dir, outfilename);
-            write_file(outfilepath, &data[prev_end], gap_len);
+            if (dirty[s]) {
+               write_file_if_changed(outfilepath, &data[prev_end], gap_len);
+            }
             fprintf(fasm, ".incbin \"%s\"\n", outfilename);
          }
          fprintf(fasm, "\n");
@@ -556,7 +1029,7 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
             fprintf(fasm, ".byte  0x%02X       # version\n\n", data[sec->start + 0x3F]);
             break;
          case TYPE_BIN:
-            write_bin_type(sec, outfilename, start_label, fasm, data, outfilepath, args, config);
+            write_bin_type(sec, outfilename, start_label, fasm, data, outfilepath, args, config, dirty[s]);
             break;
          case TYPE_BLAST:
          case TYPE_MIO0:
@@ -575,12 +1048,14 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
             fprintf(fasm, "%s:\n", start_label);
             for (a = sec->start; a < sec->end; a += 4) {
                ptr = read_u32_be(&data[a]);
+               refs_add(&refs, &data[a], ptr, REF_KIND_PTR);
                disasm_label_lookup(state, ptr, start_label);
                fprintf(fasm, ".word %s", start_label);
                if (sec->child_count > 0) {
                   for (i = 1; i < sec->child_count; i++) {
                      a += 4;
                      ptr = read_u32_be(&data[a]);
+                     refs_add(&refs, &data[a], ptr, REF_KIND_PTR);
                      disasm_label_lookup(state, ptr, start_label);
                      fprintf(fasm, ", %s", start_label);
                   }
@@ -597,10 +1072,12 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
             fprintf(fasm, ".include \"asm/%s.s\" \n", sec->label);
 
             // Open seperate .s file for this section
-            FILE *section_fasm = fopen(section_asmfilename, "w");
-            fprintf(section_fasm, "\n.section .text%08X, \"ax\"\n\n", sec->vaddr);
-            mipsdisasm_pass2(section_fasm, state, sec->start);
-            fclose(section_fasm);
+            if (dirty[s]) {
+               FILE *section_fasm = fopen_if_changed(section_asmfilename);
+               fprintf(section_fasm, "\n.section .text%08X, \"ax\"\n\n", sec->vaddr);
+               mipsdisasm_pass2(section_fasm, state, sec->start);
+               fclose_if_changed(section_fasm, section_asmfilename);
+            }
             break;
          case TYPE_SM64_LEVEL:
             // relocate level scripts to .mio0 area
@@ -632,7 +1109,7 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
          default:
             // printf("Treating custom file format as binary %s %s %s\n", sec->section_name, outfilepath, outfilename);
             // ERROR("Don't know what to do with type %d\n", sec->type);
-            write_bin_type(sec, outfilename, start_label, fasm, data, outfilepath, args, config);
+            write_bin_type(sec, outfilename, start_label, fasm, data, outfilepath, args, config, dirty[s]);
             break;
       }
       prev_end = sec->end;
@@ -644,7 +1121,7 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
    strbuf_alloc(&makeheader_level, 1024);
    strbuf_sprintf(&makeheader_level, "LEVEL_FILES =");
 
-   fmake = fopen(makefile_name, "w");
+   fmake = fopen_if_changed(makefile_name);
    fprintf(fmake, "TARGET = %s\n", config->basename);
    fprintf(fmake, "LD_SCRIPT = $(TARGET).ld\n");
    fprintf(fmake, "MIO0_DIR = %s\n", MIO0_SUBDIR);
@@ -659,54 +1136,27 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
       switch (sec->type) {
          case TYPE_SM64_GEO:
          {
-            section_sm64_geo(data, args, config, state, sec, start_label, outfilename, outfilepath, fasm, &makeheader_level);
+            section_sm64_geo(data, args, config, state, sec, start_label, outfilename, outfilepath, fasm, &makeheader_level, dirty[s]);
             break;
          }
          case TYPE_BLAST:
          case TYPE_GZIP:
          case TYPE_MIO0:
          {
-            char binfilename[FILENAME_MAX];
-            char extension[8] = {0};
-            unsigned char *lut;
-            char binasmfilename[FILENAME_MAX];
-            FILE *binasm;
-            unsigned char *binfilecontents = NULL;
-            long binfilelen = 0;
-            if (sec->label == NULL || sec->label[0] == '\0') {
-               sprintf(start_label, "L%06X", sec->start);
-            } else {
-               strcpy(start_label, sec->label);
-            }
-            sprintf(binfilename, "%s.s", start_label);
-            sprintf(binasmfilename, "%s/%s", bin_dir, binfilename);
-            // decode and write
-            binasm = fopen(binasmfilename, "w");
-            if (binasm == NULL) {
-               perror(binasmfilename);
-               exit(1);
-            }
-            fprintf(binasm, "# generated by n64split\n.section .rodata\n\n.include \"%s\"\n", MACROS_FILE);
             switch (sec->type) {
                case TYPE_BLAST:
                   INFO("Section Blast: %d %s %X-%X\n", sec->subtype, sec->label, sec->start, sec->end);
-                  sprintf(extension, "bc%d", sec->subtype);
                   break;
                case TYPE_MIO0:
                   INFO("Section MIO0: %s %X-%X\n", sec->label, sec->start, sec->end);
-                  strcpy(extension, "mio0");
                   break;
                case TYPE_GZIP:
                   INFO("Section GZIP: %s %X-%X\n", sec->label, sec->start, sec->end);
-                  strcpy(extension, "gz");
                   break;
                default:
                   break;
             }
-            sprintf(outfilename, "%s.%s", start_label, extension);
-            sprintf(binfilename, "%s/%s.bin", bin_dir, start_label);
-            sprintf(mio0filename, "%s/%s", mio0_dir, outfilename);
-            write_file(mio0filename, &data[sec->start], sec->end - sec->start);
+            compressed_names(sec, mio0_dir, start_label, outfilename, mio0filename);
 
             fprintf(fasm, "\n.align 4, 0x01\n");
             fprintf(fasm, ".global %s\n", start_label);
@@ -716,270 +1166,18 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
 
             // append to Makefile
             strbuf_sprintf(&makeheader_mio0, " \\\n$(MIO0_DIR)/%s", outfilename);
-
-            // TODO: use in-memory decompression?
-            // extract compressed data
-            switch (sec->type) {
-               case TYPE_BLAST:
-                  // TODO: make this configurable?
-                  switch (sec->subtype) {
-                     case 4: lut = &data[0x047480]; break;
-                     case 5: lut = &data[0x0998E0]; break; // TODO: fix this
-                     default: lut = data; break;
-                  }
-                  blast_decode_file(mio0filename, sec->subtype, binfilename, lut);
-                  break;
-               case TYPE_MIO0:
-                  mio0_decode_file(mio0filename, 0, binfilename);
-                  break;
-               case TYPE_GZIP:
-                  gzip_decode_file(mio0filename, 0, binfilename);
-                  break;
-               default:
-                  break;
-            }
-            binfilelen = read_file(binfilename, &binfilecontents);
-
-            // extract texture data
             if (sec->children) {
-               unsigned int offset = 0;
-               unsigned int next_offset = 0;
-               // TODO: add segment base to config file
-               const unsigned int segment_base = 0x07000000;
-               unsigned int seg_address = segment_base + offset;
-               fprintf(fmake, "$(MIO0_DIR)/%s.bin:", start_label);
-               INFO("Extracting textures from %s\n", start_label);
-               for (int t = 0; t < sec->child_count; t++) {
-                  split_section *child = &sec->children[t];
-                  texture *tex = &child->tex;
-                  w = tex->width;
-                  h = tex->height;
-                  if (next_offset > child->start) {
-                     ERROR("Error section overlap region %d (%X > %X)\n", t, next_offset, child->start);
-                     exit(1);
-                  }
-                  if (next_offset != child->start) {
-                     unsigned int gap_len = child->start - next_offset;
-                     INFO("Filling gap before region %d (%d bytes)\n", t, gap_len);
-                     fprintf(binasm, "# Unknown region %06X-%06X [%X]\n", next_offset, child->start, gap_len);
-                     while (gap_len > 0) {
-                        int group_len = MIN(gap_len, 0x10);
-                        fprintf(binasm, ".byte ");
-                        fprint_hex_source(binasm, &binfilecontents[next_offset], group_len);
-                        fprintf(binasm, "\n");
-                        gap_len -= group_len;
-                        next_offset += group_len;
-                     }
-                  }
-                  offset = tex->offset;
-                  seg_address = segment_base + offset;
-                  if (child->end) {
-                     next_offset = child->end;
-                  } else if (tex->format == TYPE_F3D_LIGHT) {
-                     next_offset = child->start + 0x18;
-                  } else { // assume texture
-                     next_offset = child->start + w * h * tex->depth / 8;
-                  }
-                  fprintf(binasm, "\n");
-                  switch (tex->format) {
-                     case TYPE_TEX_IA:
-                     {
-                        sprintf(outfilename, "%s.%05X.ia%d", start_label, offset, tex->depth);
-                        ia *img = raw2ia(&binfilecontents[offset], w, h, tex->depth);
-                        if (img) {
-                           sprintf(outfilepath, "%s/%s.png", texture_dir, outfilename);
-                           ia2png(outfilepath, img, w, h);
-                           free(img);
-                           fprintf(fmake, " $(TEXTURE_DIR)/%s", outfilename);
-                        }
-                        if (args->raw_texture && binfilelen > 0) {
-                           INFO("Saving raw texture for %s\n", start_label);
-                           int len = w*h*tex->depth/8;
-                           sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
-                           write_file(outfilepath, &binfilecontents[offset], len);
-                        }
-                        fprintf(binasm, "texture_%08X: # 0x%08X\n", seg_address, seg_address);
-                        fprintf(binasm, ".incbin \"%s\"\n", outfilename);
-                        break;
-                     }
-                     case TYPE_TEX_I:
-                     {
-                        sprintf(outfilename, "%s.%05X.i%d", start_label, offset, tex->depth);
-                        ia *img = raw2i(&binfilecontents[offset], w, h, tex->depth);
-                        if (img) {
-                           sprintf(outfilepath, "%s/%s.png", texture_dir, outfilename);
-                           ia2png(outfilepath, img, w, h);
-                           free(img);
-                           fprintf(fmake, " $(TEXTURE_DIR)/%s", outfilename);
-                        }
-                        if (args->raw_texture && binfilelen > 0) {
-                           INFO("Saving raw texture for %s\n", start_label);
-                           int len = w*h*tex->depth/8;
-                           sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
-                           write_file(outfilepath, &binfilecontents[offset], len);
-                        }
-                        fprintf(binasm, "texture_%08X: # 0x%08X\n", seg_address, seg_address);
-                        fprintf(binasm, ".incbin \"%s\"\n", outfilename);
-                        break;
-                     }
-                     case TYPE_TEX_RGBA:
-                     {
-                        sprintf(outfilename, "%s.%05X.rgba%d", start_label, offset, tex->depth);
-                        rgba *img = raw2rgba(&binfilecontents[offset], w, h, tex->depth);
-                        if (img) {
-                           sprintf(outfilepath, "%s/%s.png", texture_dir, outfilename);
-                           rgba2png(outfilepath, img, w, h);
-                           free(img);
-                           fprintf(fmake, " $(TEXTURE_DIR)/%s", outfilename);
-                        }
-                        if (args->raw_texture && binfilelen > 0) {
-                           INFO("Saving raw texture for %s\n", start_label);
-                           int len = w*h*tex->depth/8;
-                           sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
-                           write_file(outfilepath, &binfilecontents[offset], len);
-                        }
-                        fprintf(binasm, "texture_%08X: # 0x%08X\n", seg_address, seg_address);
-                        fprintf(binasm, ".incbin \"%s\"\n", outfilename);
-                        break;
-                     }
-                     case TYPE_TEX_SKYBOX:
-                     {
-                        // read in grid of MxN 32x32 tiles and save them as M*31xN*31 image
-                        rgba *img;
-                        unsigned int sky_offset = offset;
-                        int m, n;
-                        int tx, ty;
-                        m = w/32;
-                        n = h/32;
-                        img = malloc(w*h*sizeof(rgba));
-                        w -= m; // adjust for overlap
-                        h -= n;
-                        for (ty = 0; ty < n; ty++) {
-                           for (tx = 0; tx < m; tx++) {
-                              rgba *tile = raw2rgba(&binfilecontents[sky_offset], 32, 32, tex->depth);
-                              int cx, cy;
-                              for (cy = 0; cy < 31; cy++) {
-                                 for (cx = 0; cx < 31; cx++) {
-                                    int out_off = 31*w*ty + 31*tx + w*cy + cx;
-                                    int in_off = 32*cy+cx;
-                                    img[out_off] = tile[in_off];
-                                 }
-                              }
-                              free(tile);
-                              sky_offset += 32*32*2;
-                           }
-                        }
-                        sprintf(outfilename, "%s.%05X.skybox.png", start_label, offset);
-                        sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
-                        rgba2png(outfilepath, img, w, h);
-                        free(img);
-                        fprintf(fmake, " $(TEXTURE_DIR)/%s", outfilename);
-                        break;
-                     }
-                     case TYPE_F3D_DL:
-                     {
-                        int sec_len = child->end - child->start;
-                        fprintf(binasm, "f3d_%08X: # 0x%08X\n", seg_address, seg_address);
-                        for (int o = 0; o < sec_len; o += 8) {
-                           unsigned char cmd = binfilecontents[offset + o];
-                           unsigned int second = read_u32_be(&binfilecontents[offset + o + 4]);
-                           fprintf(binasm, ".word 0x%08X, ", read_u32_be(&binfilecontents[offset + o]));
-                           switch (cmd) {
-                              case 0x03: // light
-                                 fprintf(binasm, "light_%08X\n", second);
-                                 break;
-                              case 0x04: // vertex
-                                 fprintf(binasm, "vertex_%08X\n", second);
-                                 break;
-                              case 0x06: // f3d
-                                 fprintf(binasm, "f3d_%08X\n", second);
-                                 break;
-                              case 0xFD: // texture
-                                 fprintf(binasm, "texture_%08X\n", second);
-                                 break;
-                              default:
-                                 fprintf(binasm, "0x%08X\n", second);
-                                 break;
-                           }
-                        }
-                        break;
-                     }
-                     case TYPE_F3D_LIGHT:
-                     {
-                        fprintf(binasm, "light_%08X: # 0x%08X\n", seg_address, seg_address);
-                        fprintf(binasm, ".byte ");
-                        fprint_hex_source(binasm, &binfilecontents[offset], 8);
-                        fprintf(binasm, "\n");
-                        fprintf(binasm, "light_%08X: # 0x%08X\n", seg_address + 8, seg_address + 8);
-                        fprintf(binasm, ".byte ");
-                        fprint_hex_source(binasm, &binfilecontents[offset + 8], 8);
-                        fprintf(binasm, "\n.byte ");
-                        fprint_hex_source(binasm, &binfilecontents[offset + 16], 8);
-                        fprintf(binasm, "\n");
-                        break;
-                     }
-                     case TYPE_F3D_VERTEX:
-                     {
-                        int sec_len = child->end - child->start;
-                        fprintf(binasm, "vertex_%08X: # 0x%08X\n", seg_address, seg_address);
-                        for (int o = 0; o < sec_len; o += 16) {
-                           fprintf(binasm, "vertex ");
-                           for (int h = 0; h < 6; h++) {
-                              // X, Y, Z, UNUSED, U, V
-                              if (h != 3) {
-                                 fprintf(binasm, "%6d, ", read_s16_be(&binfilecontents[offset + o + h*2]));
-                              }
-                           }
-                           // R, G, B, A
-                           fprint_hex_source(binasm, &binfilecontents[offset + o + 12], 4);
-                           fprintf(binasm, "\n");
-                        }
-                        break;
-                     }
-                     case TYPE_SM64_COLLISION:
-                     {
-                        int sec_len = 0;
-                        sprintf(outfilename, "%s.%05X.collision", start_label, offset);
-                        sprintf(outfilepath, "%s/%s.obj", model_dir, outfilename);
-                        INFO("Generating collision model %s\n", outfilename);
-                        sec_len = collision2obj(binfilename, offset, outfilepath, start_label, args->model_scale);
-                        if (args->raw_texture && binfilelen > 0) {
-                           INFO("Saving raw collision for %s\n", start_label);
-                           sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
-                           write_file(outfilepath, &binfilecontents[offset], sec_len);
-                        }
-                        fprintf(binasm, "collision_%06X: # 0x%08X\n", seg_address, seg_address);
-                        fprintf(binasm, ".incbin \"%s\"\n", outfilename);
-                        break;
-                     }
-                     default:
-                        ERROR("Don't know what to do with format %d\n", tex->format);
-                        exit(1);
-                  }
-               }
-               fprintf(fmake, "\n\t$(N64GRAPHICS) $@ $^\n\n");
+               write_texture_deps(fmake, start_label, sec);
+            }
+            // segment and its textures are unchanged since the last split
+            if (!dirty[s]) {
+               break;
             }
 
-            // extract texture data
-            if (args->large_texture) {
-               INFO("Generating large texture for %s\n", start_label);
-               w = 32;
-               h = filesize(binfilename) / (w * (args->large_texture_depth / 8));
-               rgba *img = raw2rgba(binfilecontents, w, h, args->large_texture_depth);
-               if (img) {
-                  sprintf(outfilename, "%s.ALL.png", start_label);
-                  sprintf(outfilepath, "%s/%s", texture_dir, outfilename);
-                  rgba2png(outfilepath, img, w, h);
-                  free(img);
-                  fprintf(fmake, " $(TEXTURE_DIR)/%s", outfilename);
-                  img = NULL;
-               }
+            // Blast sections are extracted on worker threads before this loop
+            if (sec->type != TYPE_BLAST) {
+               extract_compressed(data, args, sec, start_label, mio0filename, bin_dir, texture_dir, model_dir);
             }
-            // TODO: write files in correct order to avoid this
-            // touch bin, then mio0 files so 'make' doesn't rebuild them right away
-            touch_file(binfilename);
-            touch_file(mio0filename);
-            fclose(binasm);
             break;
          }
          case TYPE_SM64_LEVEL:
@@ -997,19 +1195,21 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
             sprintf(outfilepath, "%s/%s", args->output_dir, outfilename);
 
             // decode and write level data out
-            flevel = fopen(outfilepath, "w");
-            if (flevel == NULL) {
-               perror(outfilepath);
-               exit(1);
+            if (dirty[s]) {
+               flevel = fopen_if_changed(outfilepath);
+               if (flevel == NULL) {
+                  perror(outfilepath);
+                  exit(1);
+               }
+               fprintf(flevel, "# level script %s from %X-%X\n\n", start_label, sec->start, sec->end);
+               fprintf(flevel, ".section .mio0\n\n");
+               fprintf(flevel, ".global %s\n", start_label);
+               fprintf(flevel, ".align 4, 0x01\n");
+               fprintf(flevel, "%s:\n", start_label);
+               write_level(flevel, data, config, s, state);
+               fprintf(flevel, "%s_end:\n", start_label);
+               fclose_if_changed(flevel, outfilepath);
             }
-            fprintf(flevel, "# level script %s from %X-%X\n\n", start_label, sec->start, sec->end);
-            fprintf(flevel, ".section .mio0\n\n");
-            fprintf(flevel, ".global %s\n", start_label);
-            fprintf(flevel, ".align 4, 0x01\n");
-            fprintf(flevel, "%s:\n", start_label);
-            write_level(flevel, data, config, s, state);
-            fprintf(flevel, "%s_end:\n", start_label);
-            fclose(flevel);
 
             if (sec->label == NULL || sec->label[0] == '\0') {
                sprintf(start_label, "L%06X", sec->start);
@@ -1034,13 +1234,15 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
             sprintf(outfilename, "%s/%s", BEHAVIOR_SUBDIR, beh_filename);
             sprintf(outfilepath, "%s/%s", args->output_dir, outfilename);
             // decode and write level data out
-            f_beh = fopen(outfilepath, "w");
-            if (f_beh == NULL) {
-               perror(outfilepath);
-               exit(1);
+            if (dirty[s]) {
+               f_beh = fopen_if_changed(outfilepath);
+               if (f_beh == NULL) {
+                  perror(outfilepath);
+                  exit(1);
+               }
+               write_behavior(f_beh, data, config, s, state);
+               fclose_if_changed(f_beh, outfilepath);
             }
-            write_behavior(f_beh, data, config, s, state);
-            fclose(f_beh);
 
             fprintf(fasm, "\n.section .behavior, \"a\"\n");
             fprintf(fasm, "\n.global %s\n", sec->label);
@@ -1066,45 +1268,67 @@ void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_
    strbuf_free(&makeheader_mio0);
    strbuf_free(&makeheader_level);
    strbuf_free(&makeheader_music);
-   fclose(fmake);
-   fclose(fasm);
+   fclose_if_changed(fmake, makefile_name);
+   fclose_if_changed(fasm, asmfilename);
 
    // output top-level makefile
    sprintf(makefile_name, "%s/Makefile", args->output_dir);
-   fmake = fopen(makefile_name, "w");
+   fmake = fopen_if_changed(makefile_name);
    fprintf(fmake, makefile_data);
-   fclose(fmake);
+   fclose_if_changed(fmake, makefile_name);
 
    // output collision model material file
    sprintf(makefile_name, "%s/collision.mtl", model_dir);
-   fmake = fopen(makefile_name, "w");
+   fmake = fopen_if_changed(makefile_name);
    fprintf(fmake, collision_mtl_data);
-   fclose(fmake);
+   fclose_if_changed(fmake, makefile_name);
 
    generate_ld_script(args, config);
    generate_geo_macros(args);
+
+   // output reference index and the manifest the next incremental split compares against
+   split_refs = NULL;
+   sprintf(refsfilename, "%s/%s%s", args->output_dir, config->basename, REFS_EXT);
+   if (refs_write(&refs, refsfilename, config) < 0) {
+      ERROR("Error writing %s\n", refsfilename);
+   }
+   refs_free(&refs);
+   sprintf(manifestfilename, "%s/%s%s", args->output_dir, config->basename, MANIFEST_EXT);
+   if (split_manifest_write(manifestfilename, args, config, data) < 0) {
+      ERROR("Error writing %s\n", manifestfilename);
+   }
+   free(dirty);
 }
 
 void print_usage(void)
 {
-   ERROR("Usage: n64split [-c CONFIG] [-k] [-m] [-o OUTPUT_DIR] [-s SCALE] [-t] [-v] [-V] ROM\n"
+   ERROR("Usage: n64split [-c CONFIG] [-i] [-j JOBS] [-k] [-m] [-o OUTPUT_DIR] [-R REPORT] [-s SCALE] [-t] [-f FORMAT] [-w WIDTH] [-v] [-V] ROM\n"
+         "       n64split -c CONFIG -C OUTPUT [-R REPORT] [-v]\n"
          "\n"
          "n64split v" N64SPLIT_VERSION ": N64 ROM splitter, resource ripper, disassembler\n"
          "\n"
          "Optional arguments:\n"
-         " -c CONFIG     ROM configuration file (default: determine from checksum)\n"
+         " -c CONFIG     ROM configuration file, YAML or compiled (default: determine from checksum)\n"
+         " -C OUTPUT     validate CONFIG and compile it to binary file OUTPUT, then exit\n"
+         " -i            incremental: only write sections changed since the last split to OUTPUT_DIR\n"
+         " -j JOBS       number of worker threads for Blast sections (default: number of CPUs)\n"
          " -k            keep going as much as possible after error\n"
          " -m            merge related instructions in to pseudoinstructions\n"
          " -o OUTPUT_DIR output directory (default: {CONFIG.basename}.split)\n"
+         " -R REPORT     write config validation problems to REPORT as tab-separated lines\n"
          " -r            output raw texture binaries\n"
          " -s SCALE      amount to scale models by (default: %.1f)\n"
          " -t            generate large texture for MIO0 blocks\n"
+         " -f FORMAT     large texture format: rgba16, rgba32, ia1, ia4, ia8, ia16, i4, i8 (default: %s)\n"
+         " -w WIDTH      large texture width (default: %d)\n"
          " -v            verbose progress output\n"
          " -V            print version information\n"
          "\n"
          "File arguments:\n"
          " ROM        input ROM file\n",
-         default_args.model_scale);
+         default_args.model_scale,
+         img_format_name(default_args.large_texture_format, default_args.large_texture_depth),
+         default_args.large_texture_width);
    exit(1);
 }
 
@@ -1136,6 +1360,21 @@ void parse_arguments(int argc, char *argv[], arg_config *config)
                }
                strcpy(config->config_file, argv[i]);
                break;
+            case 'C':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               strcpy(config->compile_file, argv[i]);
+               break;
+            case 'i':
+               config->incremental = true;
+               break;
+            case 'j':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->threads = strtoul(argv[i], NULL, 0);
+               break;
             case 'k':
                config->keep_going = true;
                break;
@@ -1151,6 +1390,12 @@ void parse_arguments(int argc, char *argv[], arg_config *config)
             case 'r':
                config->raw_texture = true;
                break;
+            case 'R':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               strcpy(config->report_file, argv[i]);
+               break;
             case 's':
                if (++i >= argc) {
                   print_usage();
@@ -1160,6 +1405,25 @@ void parse_arguments(int argc, char *argv[], arg_config *config)
             case 't':
                config->large_texture = true;
                break;
+            case 'f':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               if (!img_format_parse(argv[i], &config->large_texture_format, &config->large_texture_depth) ||
+                   config->large_texture_format == IMG_FORMAT_CI) {
+                  ERROR("Error: unsupported large texture format \"%s\"\n", argv[i]);
+                  print_usage();
+               }
+               break;
+            case 'w':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->large_texture_width = strtoul(argv[i], NULL, 0);
+               if (config->large_texture_width <= 0) {
+                  print_usage();
+               }
+               break;
             case 'v':
                g_verbosity = 1;
                break;
@@ -1181,39 +1445,166 @@ void parse_arguments(int argc, char *argv[], arg_config *config)
          file_count++;
       }
    }
-   if (file_count < 1) {
+   if (config->compile_file[0] != '\0') {
+      // compile mode takes no ROM, but needs a config
+      if (file_count > 0 || config->config_file[0] == '\0') {
+         print_usage();
+      }
+   } else if (file_count < 1) {
       print_usage();
    }
+   // large texture rows must be whole bytes
+   if (config->large_texture_width * config->large_texture_depth < 8 ||
+       (config->large_texture_width * config->large_texture_depth) % 8 != 0) {
+      ERROR("Error: large texture width %d of %s is not a whole number of bytes\n", config->large_texture_width,
+            img_format_name(config->large_texture_format, config->large_texture_depth));
+      print_usage();
+   }
+}
+
+#define CONFIGS_DIR "configs"
+#define CONFIG_INDEX_FILE CONFIGS_DIR "/checksums.idx"
+
+// cached checksums of a config file, valid while its size and mtime are unchanged
+typedef struct
+{
+   char path[FILENAME_MAX];
+   long long mtime;
+   long size;
+   unsigned int checksum1;
+   unsigned int checksum2;
+} config_index_entry;
+
+// load checksum index, returns number of entries read
+static int load_config_index(config_index_entry **entries)
+{
+   char line[FILENAME_MAX + 64];
+   int count = 0;
+   int alloc_count = 0;
+   FILE *fidx;
+
+   *entries = NULL;
+   fidx = fopen(CONFIG_INDEX_FILE, "r");
+   if (fidx == NULL) {
+      return 0;
+   }
+   while (fgets(line, sizeof(line), fidx)) {
+      config_index_entry e;
+      if (line[0] == '#') {
+         continue;
+      }
+      if (sscanf(line, "%X %X %lld %ld %[^\n]", &e.checksum1, &e.checksum2, &e.mtime, &e.size, e.path) != 5) {
+         continue;
+      }
+      if (count >= alloc_count) {
+         alloc_count = alloc_count ? 2 * alloc_count : 32;
+         *entries = realloc(*entries, alloc_count * sizeof(**entries));
+      }
+      (*entries)[count++] = e;
+   }
+   fclose(fidx);
+   return count;
+}
+
+static void save_config_index(const config_index_entry *entries, int count)
+{
+   FILE *fidx = fopen_if_changed(CONFIG_INDEX_FILE);
+   if (fidx == NULL) {
+      INFO("Unable to write config index %s\n", CONFIG_INDEX_FILE);
+      return;
+   }
+   fprintf(fidx, "# n64split config index: checksum1 checksum2 mtime size path\n");
+   for (int i = 0; i < count; i++) {
+      fprintf(fidx, "%08X %08X %lld %ld %s\n", entries[i].checksum1, entries[i].checksum2,
+              entries[i].mtime, entries[i].size, entries[i].path);
+   }
+   fclose_if_changed(fidx, CONFIG_INDEX_FILE);
 }
 
 // Auto detect a config file based on the 2 checksums
+// checksums of each config are cached in CONFIG_INDEX_FILE so only stale configs and the match are parsed
 int detect_config_file(unsigned int c1, unsigned int c2, rom_config *config)
 {
-#define CONFIGS_DIR "configs"
    dir_list list;
-   int config_ret;
+   config_index_entry *cached;
+   config_index_entry *entries;
+   int cached_count;
+   int dirty;
    int ret_val = 0;
    int i;
 
    dir_list_ext(CONFIGS_DIR, ".yaml", &list);
 
+   cached_count = load_config_index(&cached);
+   dirty = (cached_count != list.count);
+   entries = calloc(list.count, sizeof(*entries));
    for (i = 0; i < list.count; i++) {
-      config_ret = config_parse_file(list.files[i], config);
-      INFO("Checking config file '%s' (%X, %X)\n", list.files[i], config->checksum1, config->checksum2);
-      if (config_ret == 0 && c1 == config->checksum1 && c2 == config->checksum2) {
-         ERROR("Using config file: %s\n", list.files[i]);
-         ret_val = 1;
-         break;
+      config_index_entry *e = &entries[i];
+      int j;
+      strcpy(e->path, list.files[i]);
+      e->mtime = filemtime(e->path);
+      e->size = filesize(e->path);
+      for (j = 0; j < cached_count; j++) {
+         if (!strcmp(cached[j].path, e->path)) {
+            break;
+         }
+      }
+      if (j < cached_count && cached[j].mtime == e->mtime && cached[j].size == e->size) {
+         e->checksum1 = cached[j].checksum1;
+         e->checksum2 = cached[j].checksum2;
       } else {
+         INFO("Indexing config file '%s'\n", e->path);
+         if (config_parse_file(e->path, config) == 0) {
+            e->checksum1 = config->checksum1;
+            e->checksum2 = config->checksum2;
+         }
          config_free(config);
+         dirty = 1;
       }
    }
+   if (dirty) {
+      save_config_index(entries, list.count);
+   }
 
+   for (i = 0; i < list.count; i++) {
+      INFO("Checking config file '%s' (%X, %X)\n", entries[i].path, entries[i].checksum1, entries[i].checksum2);
+      if (c1 == entries[i].checksum1 && c2 == entries[i].checksum2) {
+         if (config_parse_file(entries[i].path, config) == 0 &&
+             c1 == config->checksum1 && c2 == config->checksum2) {
+            ERROR("Using config file: %s\n", entries[i].path);
+            ret_val = 1;
+            break;
+         }
+         config_free(config);
+      }
+   }
+
+   free(entries);
+   free(cached);
    dir_list_free(&list);
 
    return ret_val;
 }
 
+// validate config, writing problems to the report file if one was requested
+static int validate_config(rom_config *config, unsigned int max_len, const arg_config *args)
+{
+   FILE *report = NULL;
+   int ret_val;
+   if (args->report_file[0] != '\0') {
+      report = fopen(args->report_file, "w");
+      if (report == NULL) {
+         ERROR("Error opening report file \"%s\"\n", args->report_file);
+         return -1;
+      }
+   }
+   ret_val = config_validate_report(config, max_len, report);
+   if (report) {
+      fclose(report);
+   }
+   return ret_val;
+}
+
 int main(int argc, char *argv[])
 {
    arg_config args;
@@ -1230,6 +1621,19 @@ int main(int argc, char *argv[])
    args = default_args;
    parse_arguments(argc, argv, &args);
 
+   if (args.compile_file[0] != '\0') {
+      if (config_parse_file(args.config_file, &config) != 0) {
+         return 1;
+      }
+      // no ROM to check section bounds against
+      if (validate_config(&config, 0xFFFFFFFF, &args)) {
+         return 3;
+      }
+      ret_val = config_compile(&config, args.compile_file);
+      config_free(&config);
+      return ret_val ? 1 : 0;
+   }
+
    len = read_file(args.input_file, &data);
 
    if (len <= 0) {
@@ -1268,9 +1672,11 @@ int main(int argc, char *argv[])
       }
    }
 
-   if (config_validate(&config, len)) {
+   config_index_behaviors(&config);
+   if (validate_config(&config, len, &args)) {
       return 3;
    }
+   config_index_sections(&config);
 
    // if no output directory specified, construct one from config file
    if (0 == strcmp(args.output_dir, "")) {
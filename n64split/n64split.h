@@ -7,6 +7,7 @@
 #include <zlib.h>
 
 #include "config.h"
+#include "levelscript.h"
 #include "libblast.h"
 #include "libmio0.h"
 #include "libsfx.h"
@@ -14,6 +15,7 @@
 #include "n64graphics.h"
 #include "strutils.h"
 #include "utils.h"
+#include "workpool.h"
 
 
 //================================================================================
@@ -36,6 +38,12 @@
 #define MODEL_SUBDIR    "models"
 #define BEHAVIOR_SUBDIR "."
 
+// reference index and section manifest sidecars written next to the main assembly file
+#define REFS_EXT ".refs"
+#define MANIFEST_EXT ".manifest"
+// reference kind of pointer table entries, script fields use their script_field_type
+#define REF_KIND_PTR 0x80
+
 
 //================================================================================
 //    Structure Definitions
@@ -46,15 +54,38 @@ typedef struct _arg_config
 {
    char input_file[FILENAME_MAX];
    char config_file[FILENAME_MAX];
+   char compile_file[FILENAME_MAX];
+   char report_file[FILENAME_MAX];
    char output_dir[FILENAME_MAX];
    float model_scale;
    bool raw_texture; // TODO: this should be the default path once n64graphics is updated
    bool large_texture;
-   bool large_texture_depth;
+   img_format large_texture_format;
+   int large_texture_depth;
+   int large_texture_width;
    bool keep_going;
    bool merge_pseudo;
+   bool incremental;
+   int threads;
 } arg_config;
 
+/* References */
+typedef struct
+{
+   unsigned int source; // ROM offset of the pointer
+   unsigned int target; // address as stored: ROM offset, segmented or RAM address
+   unsigned int kind;   // script_field_type or REF_KIND_PTR
+} split_ref;
+
+typedef struct
+{
+   const unsigned char *rom;
+   unsigned int rom_len;
+   split_ref *refs;
+   unsigned int count;
+   unsigned int alloc;
+} ref_index;
+
 typedef enum {
    N64_ROM_INVALID,
    N64_ROM_Z64,
@@ -72,16 +103,6 @@ typedef struct
 extern const terrain_t terrain_table[];
 
 
-/* Geo */
-typedef struct
-{
-   int length;
-   const char *macro;
-} geo_command;
-
-extern geo_command geo_table[];
-
-
 //================================================================================
 //    Function Declarations
 //================================================================================
@@ -91,6 +112,8 @@ void print_spaces(FILE *fp, int count);
 n64_rom_format n64_rom_type(unsigned char *buf, unsigned int length);
 void gzip_decode_file(char *gzfilename, int offset, char *binfilename);
 int config_section_lookup(rom_config *config, unsigned int addr, char *label, int is_end);
+void write_script_cmd(FILE *out, const unsigned char *data, unsigned int offset, const script_cmd *info,
+                      unsigned int length, int as_words, rom_config *config, disasm_state *state);
 void write_level(FILE *out, unsigned char *data, rom_config *config, int s, disasm_state *state);
 
 void generate_globals(arg_config *args, rom_config *config);
@@ -99,10 +122,10 @@ void generate_ld_script(arg_config *args, rom_config *config);
 
 void section_sm64_geo(unsigned char *data, arg_config *args, rom_config *config,
                       disasm_state *state, split_section *sec, char* start_label,
-                      char* outfilename, char* outfilepath, FILE *fasm, strbuf *makeheader_level);
+                      char* outfilename, char* outfilepath, FILE *fasm, strbuf *makeheader_level, int write_geo);
 
 void write_bin_type(split_section *sec, char* outfilename, char* start_label, FILE* fasm,
-                    unsigned char *data, char* outfilepath, arg_config * args, rom_config *config);
+                    unsigned char *data, char* outfilepath, arg_config * args, rom_config *config, int write_data);
 
 void split_file(unsigned char *data, unsigned int length, arg_config *args, rom_config *config, disasm_state *state);
 
@@ -123,10 +146,27 @@ int collision2obj(char *binfilename, unsigned int binoffset, char *objfilename,
 
 
 /* Geo */
-void write_geolayout(FILE *out, unsigned char *data, unsigned int start, unsigned int end, disasm_state *state);
+void write_geolayout(FILE *out, unsigned char *data, unsigned int start, unsigned int end, rom_config *config, disasm_state *state);
 void generate_geo_macros(arg_config *args);
 
 
+/* References */
+void refs_init(ref_index *refs, const unsigned char *rom, unsigned int rom_len);
+void refs_add_offset(ref_index *refs, unsigned int source, unsigned int target, unsigned int kind);
+void refs_add(ref_index *refs, const unsigned char *source, unsigned int target, unsigned int kind);
+void refs_add_field(ref_index *refs, script_field_type type, const unsigned char *field);
+int refs_write(ref_index *refs, const char *filename, const rom_config *config);
+int refs_load(ref_index *refs, const char *filename, const rom_config *config);
+void refs_free(ref_index *refs);
+
+
+/* Manifest */
+// flag the sections split_file() has to write, only those changed since the last split and their dependents
+// when incremental, references of the other sections are carried over in to refs from the previous split
+unsigned char *split_plan(const arg_config *args, const rom_config *config, const unsigned char *data, ref_index *refs);
+int split_manifest_write(const char *filename, const arg_config *args, const rom_config *config, const unsigned char *data);
+
+
 /* Sound */
 void parse_music_sequences(FILE *out, unsigned char *data, split_section *sec, arg_config *args, strbuf *makeheader);
 void parse_instrument_set(FILE *out, unsigned char *data, split_section *sec);
@@ -0,0 +1,389 @@
+#include "n64split.h"
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x00000100000001B3ULL
+
+typedef struct
+{
+   unsigned int start;
+   unsigned int end;
+   unsigned int vaddr;
+   int type;
+   int subtype;
+   unsigned long long hash;
+   int matched; // a clean section still covers this entry
+} manifest_entry;
+
+typedef struct
+{
+   unsigned long long options;
+   unsigned long long labels;
+   manifest_entry *entries;
+   int count;
+} split_manifest;
+
+static unsigned long long hash_bytes(unsigned long long h, const void *buf, size_t len)
+{
+   const unsigned char *bytes = buf;
+   for (size_t i = 0; i < len; i++) {
+      h = (h ^ bytes[i]) * FNV_PRIME;
+   }
+   return h;
+}
+
+static unsigned long long hash_u32(unsigned long long h, unsigned int val)
+{
+   unsigned char buf[4];
+   write_u32_be(buf, val);
+   return hash_bytes(h, buf, sizeof(buf));
+}
+
+static unsigned long long hash_str(unsigned long long h, const char *str)
+{
+   if (str == NULL) {
+      str = "";
+   }
+   return hash_bytes(h, str, strlen(str) + 1);
+}
+
+// everything outside the config that changes what the section writers produce
+static unsigned long long options_hash(const arg_config *args, const rom_config *config)
+{
+   unsigned long long h = FNV_OFFSET;
+   h = hash_str(h, N64SPLIT_VERSION);
+   h = hash_str(h, config->name);
+   h = hash_str(h, config->basename);
+   h = hash_bytes(h, &args->model_scale, sizeof(args->model_scale));
+   h = hash_u32(h, args->raw_texture);
+   h = hash_u32(h, args->large_texture);
+   h = hash_u32(h, args->large_texture_format);
+   h = hash_u32(h, args->large_texture_depth);
+   h = hash_u32(h, args->large_texture_width);
+   h = hash_u32(h, args->merge_pseudo);
+   return h;
+}
+
+static unsigned long long labels_hash(const rom_config *config)
+{
+   unsigned long long h = FNV_OFFSET;
+   for (int i = 0; i < config->label_count; i++) {
+      h = hash_u32(h, config->labels[i].ram_addr);
+      h = hash_str(h, config->labels[i].name);
+   }
+   return h;
+}
+
+// section contents including the gap before it, which is written along with it
+static unsigned long long section_hash(const rom_config *config, int s, const unsigned char *data)
+{
+   const split_section *sec = &config->sections[s];
+   unsigned int prev_end = s > 0 ? config->sections[s - 1].end : 0;
+   unsigned long long h = FNV_OFFSET;
+   if (prev_end < sec->start) {
+      h = hash_bytes(h, &data[prev_end], sec->end - prev_end);
+   } else {
+      h = hash_bytes(h, &data[sec->start], sec->end - sec->start);
+   }
+   h = hash_u32(h, sec->type);
+   h = hash_u32(h, sec->subtype);
+   h = hash_u32(h, sec->vaddr);
+   h = hash_str(h, sec->label);
+   h = hash_str(h, sec->section_name);
+   h = hash_u32(h, sec->child_count);
+   for (int i = 0; i < sec->child_count; i++) {
+      const split_section *child = &sec->children[i];
+      h = hash_u32(h, child->start);
+      h = hash_u32(h, child->end);
+      h = hash_u32(h, child->type);
+      h = hash_str(h, child->label);
+      h = hash_u32(h, child->tex.offset);
+      h = hash_u32(h, child->tex.palette);
+      h = hash_u32(h, child->tex.width);
+      h = hash_u32(h, child->tex.height);
+      h = hash_u32(h, child->tex.depth);
+      h = hash_u32(h, child->tex.format);
+   }
+   return h;
+}
+
+// sections written into the main assembly file are cheap and always emitted
+static int section_always_emitted(section_type type)
+{
+   switch (type) {
+      case TYPE_HEADER:
+      case TYPE_PTR:
+      case TYPE_M64:
+      case TYPE_SFX_CTL:
+      case TYPE_SFX_TBL:
+      case TYPE_INSTRUMENT_SET:
+         return 1;
+      default:
+         return 0;
+   }
+}
+
+static int manifest_load(split_manifest *man, const char *filename)
+{
+   char line[512];
+   int alloc = 256;
+   FILE *fp = fopen(filename, "r");
+   if (fp == NULL) {
+      return -1;
+   }
+   man->options = 0;
+   man->labels = 0;
+   man->count = 0;
+   man->entries = malloc(alloc * sizeof(*man->entries));
+   while (fgets(line, sizeof(line), fp)) {
+      manifest_entry *ent;
+      if (line[0] == '#' || line[0] == '\n') {
+         continue;
+      }
+      if (1 == sscanf(line, "options %llx", &man->options) || 1 == sscanf(line, "labels %llx", &man->labels)) {
+         continue;
+      }
+      if (man->count >= alloc) {
+         alloc *= 2;
+         man->entries = realloc(man->entries, alloc * sizeof(*man->entries));
+      }
+      ent = &man->entries[man->count];
+      if (6 != sscanf(line, "section %x %x %d %d %x %llx", &ent->start, &ent->end,
+                      &ent->type, &ent->subtype, &ent->vaddr, &ent->hash)) {
+         ERROR("Error: bad manifest line in %s: %s", filename, line);
+         fclose(fp);
+         free(man->entries);
+         return -1;
+      }
+      ent->matched = 0;
+      man->count++;
+   }
+   fclose(fp);
+   return 0;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+   const manifest_entry *ea = a;
+   const manifest_entry *eb = b;
+   if (ea->start != eb->start) {
+      return ea->start < eb->start ? -1 : 1;
+   }
+   return 0;
+}
+
+// section containing ROM offset, index holds the sections ordered by start
+static int find_section(const rom_config *config, const section_index *index, unsigned int offset)
+{
+   int lo = 0;
+   int hi = config->section_count - 1;
+   while (lo <= hi) {
+      int mid = lo + (hi - lo) / 2;
+      const split_section *sec = &config->sections[index[mid].section];
+      if (offset < sec->start) {
+         hi = mid - 1;
+      } else if (offset >= sec->end) {
+         lo = mid + 1;
+      } else {
+         return index[mid].section;
+      }
+   }
+   return -1;
+}
+
+static int section_index_cmp(const void *a, const void *b)
+{
+   const section_index *ia = a;
+   const section_index *ib = b;
+   if (ia->addr != ib->addr) {
+      return ia->addr < ib->addr ? -1 : 1;
+   }
+   return 0;
+}
+
+// config_section_lookup() labels ROM range starts and ends that match a section exactly
+static int range_resolves_to(unsigned int offset, int is_end, unsigned int start, unsigned int end)
+{
+   return is_end ? offset == end : offset == start;
+}
+
+// changed sections a ROM offset referenced from a script may resolve to, removed sections included
+static int in_changed_range(const split_manifest *man, const rom_config *config, const unsigned char *changed,
+                            unsigned int offset, int is_end)
+{
+   for (int i = 0; i < man->count; i++) {
+      if (!man->entries[i].matched && range_resolves_to(offset, is_end, man->entries[i].start, man->entries[i].end)) {
+         return 1;
+      }
+   }
+   for (int s = 0; s < config->section_count; s++) {
+      if (changed[s] && range_resolves_to(offset, is_end, config->sections[s].start, config->sections[s].end)) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+unsigned char *split_plan(const arg_config *args, const rom_config *config, const unsigned char *data, ref_index *refs)
+{
+   char filename[FILENAME_MAX];
+   split_manifest man;
+   ref_index old_refs;
+   unsigned char *dirty;
+   unsigned char *changed;
+   section_index *index;
+   int asm_changed = 0;
+   int behavior_changed = 0;
+   int changed_count = 0;
+   int emitted = 0;
+   size_t count;
+   int s;
+   unsigned int i;
+
+   // nothing to split, callers still get a buffer to free
+   if (config->section_count <= 0) {
+      return calloc(1, 1);
+   }
+   count = config->section_count;
+
+   dirty = malloc(count);
+   memset(dirty, 1, count);
+   if (!args->incremental) {
+      return dirty;
+   }
+
+   sprintf(filename, "%s/%s%s", args->output_dir, config->basename, MANIFEST_EXT);
+   if (manifest_load(&man, filename) < 0) {
+      INFO("No usable manifest %s, splitting everything\n", filename);
+      return dirty;
+   }
+   refs_init(&old_refs, NULL, 0);
+   sprintf(filename, "%s/%s%s", args->output_dir, config->basename, REFS_EXT);
+   if (refs_load(&old_refs, filename, config) < 0) {
+      INFO("No usable reference index %s, splitting everything\n", filename);
+      refs_free(&old_refs);
+      free(man.entries);
+      return dirty;
+   }
+   if (man.options != options_hash(args, config) || man.labels != labels_hash(config)) {
+      INFO("Options or labels changed since the last split, splitting everything\n");
+      refs_free(&old_refs);
+      free(man.entries);
+      return dirty;
+   }
+
+   // sections identical to an entry of the previous run are clean
+   qsort(man.entries, man.count, sizeof(*man.entries), entry_cmp);
+   for (s = 0; s < config->section_count; s++) {
+      const split_section *sec = &config->sections[s];
+      manifest_entry key;
+      manifest_entry *ent;
+      key.start = sec->start;
+      ent = bsearch(&key, man.entries, man.count, sizeof(*man.entries), entry_cmp);
+      if (ent && !ent->matched && ent->end == sec->end && ent->type == (int)sec->type &&
+          ent->subtype == sec->subtype && ent->vaddr == sec->vaddr &&
+          ent->hash == section_hash(config, s, data)) {
+         ent->matched = 1;
+         dirty[s] = section_always_emitted(sec->type);
+      }
+   }
+
+   // what changed, removed sections included
+   for (i = 0; i < (unsigned int)man.count; i++) {
+      if (!man.entries[i].matched) {
+         asm_changed |= man.entries[i].type == TYPE_ASM;
+         behavior_changed |= man.entries[i].type == TYPE_SM64_BEHAVIOR;
+      }
+   }
+   changed = calloc(count, 1);
+   for (s = 0; s < config->section_count; s++) {
+      if (dirty[s] && !section_always_emitted(config->sections[s].type)) {
+         asm_changed |= config->sections[s].type == TYPE_ASM;
+         behavior_changed |= config->sections[s].type == TYPE_SM64_BEHAVIOR;
+         changed[s] = 1;
+         changed_count++;
+      }
+   }
+
+   // disassembly output depends on labels from every code section
+   if (asm_changed) {
+      for (s = 0; s < config->section_count; s++) {
+         if (config->sections[s].type == TYPE_ASM) {
+            dirty[s] = 1;
+         }
+      }
+   }
+
+   // clean sections are dependents when a pointer they hold resolves to a label that may have changed
+   index = malloc(count * sizeof(*index));
+   for (s = 0; s < config->section_count; s++) {
+      index[s].addr = config->sections[s].start;
+      index[s].section = s;
+   }
+   qsort(index, count, sizeof(*index), section_index_cmp);
+   for (i = 0; i < old_refs.count; i++) {
+      const split_ref *ref = &old_refs.refs[i];
+      int dep;
+      s = find_section(config, index, ref->source);
+      if (s < 0 || dirty[s]) {
+         continue;
+      }
+      switch (ref->kind) {
+         case FIELD_ROM_START:
+         case FIELD_ROM_END:
+            dep = in_changed_range(&man, config, changed, ref->target, ref->kind == FIELD_ROM_END);
+            break;
+         case FIELD_BEHAVIOR:
+            dep = behavior_changed;
+            break;
+         case FIELD_RAM_DST:
+         case FIELD_FUNC:
+         case FIELD_CALL:
+            dep = asm_changed;
+            break;
+         default:
+            dep = 0;
+            break;
+      }
+      if (dep) {
+         dirty[s] = 1;
+      }
+   }
+
+   // sections that are not written again keep their references
+   for (i = 0; i < old_refs.count; i++) {
+      s = find_section(config, index, old_refs.refs[i].source);
+      if (s >= 0 && !dirty[s]) {
+         refs_add_offset(refs, old_refs.refs[i].source, old_refs.refs[i].target, old_refs.refs[i].kind);
+      }
+   }
+
+   for (s = 0; s < config->section_count; s++) {
+      emitted += dirty[s] && !section_always_emitted(config->sections[s].type);
+   }
+   INFO("Incremental split: %d sections changed, re-emitting %d of %d sections\n",
+        changed_count, emitted, config->section_count);
+
+   free(index);
+   free(changed);
+   refs_free(&old_refs);
+   free(man.entries);
+   return dirty;
+}
+
+int split_manifest_write(const char *filename, const arg_config *args, const rom_config *config, const unsigned char *data)
+{
+   FILE *fp = fopen_if_changed(filename);
+   if (fp == NULL) {
+      return -1;
+   }
+   fprintf(fp, "# n64split v%s section manifest for %s\n", N64SPLIT_VERSION, config->name);
+   fprintf(fp, "options %016llX\n", options_hash(args, config));
+   fprintf(fp, "labels %016llX\n", labels_hash(config));
+   fprintf(fp, "# START END TYPE SUBTYPE VADDR HASH LABEL\n");
+   for (int s = 0; s < config->section_count; s++) {
+      const split_section *sec = &config->sections[s];
+      fprintf(fp, "section %06X %06X %d %d %08X %016llX %s\n", sec->start, sec->end, sec->type, sec->subtype,
+              sec->vaddr, section_hash(config, s, data), sec->label ? sec->label : "");
+   }
+   return fclose_if_changed(fp, filename) < 0 ? -1 : 0;
+}
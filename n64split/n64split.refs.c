@@ -0,0 +1,150 @@
+#include "n64split.h"
+
+#define REFS_BIN_MAGIC "N64SPREF"
+#define REFS_BIN_VERSION 1
+#define REFS_BIN_HEADER_SIZE 0x18
+#define REFS_BIN_RECORD_SIZE 0xC
+
+void refs_init(ref_index *refs, const unsigned char *rom, unsigned int rom_len)
+{
+   refs->rom = rom;
+   refs->rom_len = rom_len;
+   refs->count = 0;
+   refs->alloc = 1024;
+   refs->refs = malloc(refs->alloc * sizeof(*refs->refs));
+}
+
+void refs_add_offset(ref_index *refs, unsigned int source, unsigned int target, unsigned int kind)
+{
+   if (refs->count >= refs->alloc) {
+      refs->alloc *= 2;
+      refs->refs = realloc(refs->refs, refs->alloc * sizeof(*refs->refs));
+   }
+   refs->refs[refs->count].source = source;
+   refs->refs[refs->count].target = target;
+   refs->refs[refs->count].kind = kind;
+   refs->count++;
+}
+
+void refs_add(ref_index *refs, const unsigned char *source, unsigned int target, unsigned int kind)
+{
+   // only fields read straight from the ROM have a source offset
+   if (source < refs->rom || source >= refs->rom + refs->rom_len) {
+      return;
+   }
+   refs_add_offset(refs, source - refs->rom, target, kind);
+}
+
+void refs_add_field(ref_index *refs, script_field_type type, const unsigned char *field)
+{
+   unsigned int val;
+   switch (type) {
+      case FIELD_SEG_ADDR:
+      case FIELD_ROM_START:
+      case FIELD_ROM_END:
+      case FIELD_RAM_DST:
+      case FIELD_FUNC:
+      case FIELD_CALL:
+      case FIELD_BEHAVIOR:
+      case FIELD_GEO:
+      case FIELD_SWITCH:
+      case FIELD_DL:
+         refs_add(refs, field, read_u32_be(field), type);
+         break;
+      case FIELD_DL_OPTIONAL:
+         val = read_u32_be(field);
+         if (val != 0) {
+            refs_add(refs, field, val, FIELD_DL);
+         }
+         break;
+      default:
+         break;
+   }
+}
+
+static int ref_cmp(const void *a, const void *b)
+{
+   const split_ref *ra = a;
+   const split_ref *rb = b;
+   if (ra->source != rb->source) {
+      return ra->source < rb->source ? -1 : 1;
+   }
+   if (ra->target != rb->target) {
+      return ra->target < rb->target ? -1 : 1;
+   }
+   return (int)ra->kind - (int)rb->kind;
+}
+
+int refs_write(ref_index *refs, const char *filename, const rom_config *config)
+{
+   unsigned char *buf;
+   unsigned char *rec;
+   unsigned int count = 0;
+   unsigned int i;
+   long length;
+
+   qsort(refs->refs, refs->count, sizeof(*refs->refs), ref_cmp);
+   buf = malloc(REFS_BIN_HEADER_SIZE + refs->count * REFS_BIN_RECORD_SIZE);
+   rec = &buf[REFS_BIN_HEADER_SIZE];
+   for (i = 0; i < refs->count; i++) {
+      // sections decoded more than once record the same field again
+      if (i > 0 && 0 == ref_cmp(&refs->refs[i - 1], &refs->refs[i])) {
+         continue;
+      }
+      write_u32_be(&rec[0x0], refs->refs[i].source);
+      write_u32_be(&rec[0x4], refs->refs[i].target);
+      write_u32_be(&rec[0x8], refs->refs[i].kind);
+      rec += REFS_BIN_RECORD_SIZE;
+      count++;
+   }
+
+   memcpy(&buf[0x00], REFS_BIN_MAGIC, 8);
+   write_u32_be(&buf[0x08], REFS_BIN_VERSION);
+   write_u32_be(&buf[0x0C], config->checksum1);
+   write_u32_be(&buf[0x10], config->checksum2);
+   write_u32_be(&buf[0x14], count);
+
+   length = write_file_if_changed(filename, buf, REFS_BIN_HEADER_SIZE + count * REFS_BIN_RECORD_SIZE);
+   INFO("Wrote %u references to %s\n", count, filename);
+   free(buf);
+   return length < 0 ? -1 : 0;
+}
+
+int refs_load(ref_index *refs, const char *filename, const rom_config *config)
+{
+   unsigned char *buf;
+   unsigned char *rec;
+   unsigned int count;
+   unsigned int i;
+   long length;
+
+   length = read_file(filename, &buf);
+   if (length < REFS_BIN_HEADER_SIZE) {
+      if (length >= 0) {
+         free(buf);
+      }
+      return -1;
+   }
+   count = read_u32_be(&buf[0x14]);
+   if (memcmp(buf, REFS_BIN_MAGIC, 8) || read_u32_be(&buf[0x08]) != REFS_BIN_VERSION ||
+       read_u32_be(&buf[0x0C]) != config->checksum1 || read_u32_be(&buf[0x10]) != config->checksum2 ||
+       (unsigned long)length != REFS_BIN_HEADER_SIZE + (unsigned long)count * REFS_BIN_RECORD_SIZE) {
+      free(buf);
+      return -1;
+   }
+   rec = &buf[REFS_BIN_HEADER_SIZE];
+   for (i = 0; i < count; i++) {
+      refs_add_offset(refs, read_u32_be(&rec[0x0]), read_u32_be(&rec[0x4]), read_u32_be(&rec[0x8]));
+      rec += REFS_BIN_RECORD_SIZE;
+   }
+   free(buf);
+   return count;
+}
+
+void refs_free(ref_index *refs)
+{
+   free(refs->refs);
+   refs->refs = NULL;
+   refs->count = 0;
+   refs->alloc = 0;
+}
@@ -1,230 +1,42 @@
 #include "n64split.h"
 
-geo_command geo_table[] =
-{
-   /* 0x00 */ {0x08, "geo_branch_and_link"},
-   /* 0x01 */ {0x04, "geo_end"},
-   /* 0x02 */ {0x08, "geo_branch"},
-   /* 0x03 */ {0x04, "geo_return"},
-   /* 0x04 */ {0x04, "geo_open_node"},
-   /* 0x05 */ {0x04, "geo_close_node"},
-   /* 0x06 */ {0x04, "geo_todo_06"},
-   /* 0x07 */ {0x04, "geo_update_node_flags"},
-   /* 0x08 */ {0x0C, "geo_node_screen_area"},
-   /* 0x09 */ {0x04, "geo_todo_09"},
-   /* 0x0A */ {0x08, "geo_camera_frustum"}, // 8-12 variable
-   /* 0x0B */ {0x04, "geo_node_start"},
-   /* 0x0C */ {0x04, "geo_zbuffer"},
-   /* 0x0D */ {0x08, "geo_render_range"},
-   /* 0x0E */ {0x08, "geo_switch_case"},
-   /* 0x0F */ {0x14, "geo_todo_0F"},
-   /* 0x10 */ {0x10, "geo_translate_rotate"}, // variable
-   /* 0x11 */ {0x08, "geo_todo_11"}, // variable
-   /* 0x12 */ {0x08, "geo_todo_12"}, // variable
-   /* 0x13 */ {0x0C, "geo_dl_translated"},
-   /* 0x14 */ {0x08, "geo_billboard"},
-   /* 0x15 */ {0x08, "geo_display_list"},
-   /* 0x16 */ {0x08, "geo_shadow"},
-   /* 0x17 */ {0x04, "geo_todo_17"},
-   /* 0x18 */ {0x08, "geo_asm"},
-   /* 0x19 */ {0x08, "geo_background"},
-   /* 0x1A */ {0x08, "geo_nop_1A"},
-   /* 0x1B */ {0x04, "geo_todo_1B"},
-   /* 0x1C */ {0x0C, "geo_todo_1C"},
-   /* 0x1D */ {0x08, "geo_scale"}, // variable
-   /* 0x1E */ {0x08, "geo_nop_1E"},
-   /* 0x1F */ {0x10, "geo_nop_1F"},
-   /* 0x20 */ {0x04, "geo_start_distance"},
-};
-
-void write_geolayout(FILE *out, unsigned char *data, unsigned int start, unsigned int end, disasm_state *state)
+void write_geolayout(FILE *out, unsigned char *data, unsigned int start, unsigned int end, rom_config *config, disasm_state *state)
 {
    const int INDENT_AMOUNT = 3;
    const int INDENT_START = INDENT_AMOUNT;
-   char label[128];
+   const script_cmd *info;
    unsigned int a = start;
-   unsigned int tmp;
+   unsigned int cmd_len;
    int indent;
-   int cmd_len;
    int print_label = 1;
    indent = INDENT_START;
    fprintf(out, ".include \"macros.inc\"\n"
                 ".include \"geo_commands.inc\"\n\n"
                 ".section .geo, \"a\"\n\n");
    while (a < end) {
-      unsigned int cmd = data[a];
+      info = script_cmd_get(SCRIPT_GEO, &data[a]);
+      cmd_len = script_cmd_length(SCRIPT_GEO, info, &data[a]);
       if (print_label) {
          fprintf(out, "glabel geo_layout_X_%06X # %04X\n", a, a);
          print_label = 0;
       }
-      if ((cmd == 0x01 || cmd == 0x05) && indent > INDENT_AMOUNT) {
+      if ((info->flags & SCRIPT_CMD_CLOSE) && indent > INDENT_AMOUNT) {
          indent -= INDENT_AMOUNT;
       }
       print_spaces(out, indent);
-      if (cmd < DIM(geo_table)) {
-         if (cmd != 0x10) { // special case 0x10 since multiple pseudo
-            fprintf(out, "%s", geo_table[cmd].macro);
-         }
+      if (info->name) {
+         write_script_cmd(out, data, a, info, cmd_len, 0, config, state);
       } else {
-         ERROR("Unknown geo layout command: 0x%02X\n", cmd);
-      }
-      cmd_len = geo_table[cmd].length;
-      switch (cmd) {
-         case 0x00: // 00 00 00 00 [SS SS SS SS]: branch and store
-            tmp = read_u32_be(&data[a+4]);
-            fprintf(out, " geo_layout_%08X # 0x%08X", tmp, tmp);
-            break;
-         case 0x01: // 01 00 00 00: terminate
-         case 0x03: // 03 00 00 00: return from branch
-            // no params
-            fprintf(out, "\n");
-            indent = INDENT_START;
-            print_label = 1;
-            break;
-         case 0x04: // 04 00 00 00: open node
-         case 0x05: // 05 00 00 00: close node
-         case 0x0B: // 05 00 00 00: start geo layout
-         case 0x17: // 17 00 00 00: set up object rendering
-         case 0x1A: // 1A 00 00 00 00 00 00 00: no op
-         case 0x1E: // 1E 00 00 00 00 00 00 00: no op
-         case 0x1F: // 1E 00 00 00 00 00 00 00 00 00 00 00: no op
-            // no params
-            break;
-         case 0x02: // 02 [AA] 00 00 [SS SS SS SS]
-            tmp = read_u32_be(&data[a+4]);
-            fprintf(out, " %d, geo_layout_%08X # 0x%08X", data[a+1], tmp, tmp);
-            break;
-         case 0x08: // 08 00 00 [AA] [XX XX] [YY YY] [WW WW] [HH HH]
-            fprintf(out, " %d, %d, %d, %d, %d", data[a+3],
-                  read_s16_be(&data[a+4]), read_s16_be(&data[a+6]),
-                  read_s16_be(&data[a+8]), read_s16_be(&data[a+10]));
-            break;
-         case 0x09: // 09 00 00 [AA]
-            fprintf(out, " %d", data[a+3]);
-            break;
-         case 0x0A: // 0A [AA] [BB BB] [NN NN] [FF FF] {EE EE EE EE}: set camera frustum
-            fprintf(out, " %d, %d, %d", read_s16_be(&data[a+2]), read_s16_be(&data[a+4]), read_s16_be(&data[a+6]));
-            if (data[a+1] > 0) {
-               cmd_len += 4;
-               disasm_label_lookup(state, read_u32_be(&data[a+8]), label);
-               fprintf(out, ", %s", label);
-            }
-            break;
-         case 0x0C: // 0C [AA] 00 00: enable/disable Z-buffer
-            fprintf(out, " %d", data[a+1]);
-            break;
-         case 0x0D: // 0D 00 00 00 [AA AA] [BB BB]: set render range
-            fprintf(out, " %d, %d", read_s16_be(&data[a+4]), read_s16_be(&data[a+6]));
-            break;
-         case 0x0E: // 0E 00 [NN NN] [AA AA AA AA]: switch/case
-            fprintf(out, " %d, geo_switch_case_%08X", read_s16_be(&data[a+2]), read_u32_be(&data[a+4]));
-            break;
-         case 0x0F: // 0F 00 [TT TT] [XX XX] [YY YY] [ZZ ZZ] [UU UU] [VV VV] [WW WW] [AA AA AA AA]
-            fprintf(out, " %d, %d, %d, %d, %d, %d, %d", read_s16_be(&data[a+2]),
-                  read_s16_be(&data[a+4]), read_s16_be(&data[a+6]), read_s16_be(&data[a+8]),
-                  read_s16_be(&data[a+10]), read_s16_be(&data[a+12]), read_s16_be(&data[a+14]));
-            disasm_label_lookup(state, read_u32_be(&data[a+0x10]), label);
-            fprintf(out, ", %s", label);
-            break;
-         case 0x10: // 10 [AA] [BB BB] [XX XX] [YY YY] [ZZ ZZ] [RX RX] [RY RY] [RZ RZ] {SS SS SS SS}: translate & rotate
-         {
-            unsigned char params = data[a+1];
-            unsigned char field_type = (params & 0x70) >> 4;
-            unsigned char layer = params & 0xF;
-            switch (field_type) {
-               case 0: // 10 [0L] 00 00 [TX TX] [TY TY] [TZ TZ] [RX RX] [RY RY] [RZ RZ] {SS SS SS SS}: translate & rotate
-                  fprintf(out, "geo_translate_rotate %d, %d, %d, %d, %d, %d, %d", layer,
-                          read_s16_be(&data[a+4]), read_s16_be(&data[a+6]), read_s16_be(&data[a+8]),
-                          read_s16_be(&data[a+10]), read_s16_be(&data[a+12]), read_s16_be(&data[a+14]));
-                  cmd_len = 16;
-                  break;
-               case 1: // 10 [1L] [TX TX] [TY TY] [TZ TZ] {SS SS SS SS}: translate
-                  fprintf(out, "geo_translate %d, %d, %d, %d", layer,
-                          read_s16_be(&data[a+2]), read_s16_be(&data[a+4]), read_s16_be(&data[a+6]));
-                  cmd_len = 8;
-                  break;
-               case 2: // 10 [2L] [RX RX] [RY RY] [RZ RZ] {SS SS SS SS}: rotate
-                  fprintf(out, "geo_rotate %d, %d, %d, %d", layer,
-                          read_s16_be(&data[a+2]), read_s16_be(&data[a+4]), read_s16_be(&data[a+6]));
-                  cmd_len = 8;
-                  break;
-               case 3: // 10 [3L] [RY RY] {SS SS SS SS}: rotate Y
-                  fprintf(out, "geo_rotate_y %d, %d", layer, read_s16_be(&data[a+2]));
-                  cmd_len = 4;
-                  break;
-            }
-            if (params & 0x80) {
-               tmp = read_u32_be(&data[a+cmd_len]);
-               fprintf(out, ", seg%X_dl_%08X", (tmp >> 24) & 0xFF, tmp);
-               cmd_len += 4;
-            }
-            break;
-         }
-         case 0x11: // 11 [P][L] [XX XX] [YY YY] [ZZ ZZ] {SS SS SS SS}: ? scene graph node, optional DL
-         case 0x12: // 12 [P][L] [XX XX] [YY YY] [ZZ ZZ] {SS SS SS SS}: ? scene graph node, optional DL
-         case 0x14: // 14 [P][L] [XX XX] [YY YY] [ZZ ZZ] {SS SS SS SS}: billboard model
-            fprintf(out, " 0x%02X, %d, %d, %d", data[a+1] & 0xF, read_s16_be(&data[a+2]),
-                  read_s16_be(&data[a+4]), read_s16_be(&data[a+6]));
-            if (data[a+1] & 0x80) {
-               disasm_label_lookup(state, read_u32_be(&data[a+8]), label);
-               fprintf(out, ", %s", label);
-               cmd_len += 4;
-            }
-            break;
-         case 0x13: // 13 [LL] [XX XX] [YY YY] [ZZ ZZ] [AA AA AA AA]: scene graph node with layer and translation
-            fprintf(out, " 0x%02X, %d, %d, %d", data[a+1],
-                    read_s16_be(&data[a+2]), read_s16_be(&data[a+4]), read_s16_be(&data[a+6]));
-            tmp = read_u32_be(&data[a+8]);
-            if (tmp != 0x0) {
-               fprintf(out, ", seg%X_dl_%08X", data[a+8], tmp);
-            }
-            break;
-         case 0x15: // 15 [LL] 00 00 [AA AA AA AA]: load display list
-            fprintf(out, " 0x%02X, seg%X_dl_%08X", data[a+1], data[a+4], read_u32_be(&data[a+4]));
-            break;
-         case 0x16: // 16 00 00 [AA] 00 [BB] [CC CC]: start geo layout with shadow
-            fprintf(out, " 0x%02X, 0x%02X, %d", data[a+3], data[a+5], read_s16_be(&data[a+6]));
-            break;
-         case 0x18: // 18 00 [XX XX] [AA AA AA AA]: load polygons from asm
-         case 0x19: // 19 00 [TT TT] [AA AA AA AA]: set background/skybox
-            disasm_label_lookup(state, read_u32_be(&data[a+4]), label);
-            fprintf(out, " %d, %s", read_s16_be(&data[a+2]), label);
-            break;
-         case 0x1B: // 1B 00 [XX XX]: ??
-            fprintf(out, " %d", read_s16_be(&data[a+2]));
-            break;
-         case 0x1C: // 1C [PP] [XX XX] [YY YY] [ZZ ZZ] [AA AA AA AA]
-            disasm_label_lookup(state, read_u32_be(&data[a+8]), label);
-            fprintf(out, " 0x%02X, %d, %d, %d, %s", data[a+1], read_s16_be(&data[a+2]),
-                    read_s16_be(&data[a+4]), read_s16_be(&data[a+6]), label);
-            break;
-         case 0x1D: // 1D [P][L] 00 00 [MM MM MM MM] {SS SS SS SS}: scale model
-            fprintf(out, " 0x%02X, %d", data[a+1] & 0xF, read_u32_be(&data[a+4]));
-            if (data[a+1] & 0x80) {
-               disasm_label_lookup(state, read_u32_be(&data[a+8]), label);
-               fprintf(out, ", %s", label);
-               cmd_len += 4;
-            }
-            break;
-         case 0x20: // 20 00 [AA AA]: start geo layout with rendering area
-            fprintf(out, " %d", read_s16_be(&data[a+2]));
-            break;
-         default:
-            ERROR("Unknown geo layout command: 0x%02X\n", cmd);
-            break;
+         ERROR("Unknown geo layout command: 0x%02X\n", data[a]);
+         write_script_cmd(out, data, a, info, cmd_len, 1, config, state);
       }
-      fprintf(out, "\n");
-      switch (cmd) {
-         case 0x04: // open_node
-         case 0x08: // node_screen_area
-         //case 0x0B: // node_start
-         case 0x16: // geo_shadow
-         case 0x20: // start_distance
-            indent += INDENT_AMOUNT;
-         default:
-            break;
+      if (info->flags & SCRIPT_CMD_OPEN) {
+         indent += INDENT_AMOUNT;
       }
-      if (cmd == 0x01 || cmd == 0x03) { // end or return
+      if (info->flags & SCRIPT_CMD_END) { // end or return
+         fprintf(out, "\n");
+         indent = INDENT_START;
+         print_label = 1;
          a += cmd_len;
          cmd_len = 0;
          while (a < end && 0 == read_u32_be(&data[a])) {
@@ -241,7 +53,7 @@ void generate_geo_macros(arg_config *args)
    char macrofilename[FILENAME_MAX];
    FILE *fmacro;
    sprintf(macrofilename, "%s/geo_commands.inc", args->output_dir);
-   fmacro = fopen(macrofilename, "w");
+   fmacro = fopen_if_changed(macrofilename);
    if (fmacro == NULL) {
       ERROR("Error opening %s\n", macrofilename);
       exit(3);
@@ -669,4 +481,5 @@ void generate_geo_macros(arg_config *args)
 ".endm\n"
 "\n"
    );
+   fclose_if_changed(fmacro, macrofilename);
 }
\ No newline at end of file
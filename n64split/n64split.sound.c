@@ -1,6 +1,24 @@
 #include "n64split.h"
 
 #define MUSIC_SUBDIR "music"
+#define SOUND_SAMPLE_RATE 16000
+
+// decoded sound shared by every reference to the same samples and predictor book in a bank
+typedef struct {
+   unsigned int sound_offset;
+   unsigned int sound_length;
+   unsigned int predictor_offset;
+   unsigned char *wav_data;
+   unsigned long wav_length;
+   char wav_file[FILENAME_MAX];
+} sound_cache_entry;
+
+typedef struct {
+   sound_cache_entry *entries;
+   unsigned int count;
+   unsigned int allocated;
+   unsigned int links; // references that became links to an earlier file
+} sound_cache;
 
 void parse_music_sequences(FILE *out, unsigned char *data, split_section *sec, arg_config *args, strbuf *makeheader)
 {
@@ -50,7 +68,7 @@ void parse_music_sequences(FILE *out, unsigned char *data, split_section *sec, a
       fprintf(out, "\n%s:", seq_name);
 
       sprintf(m64_file, "%s/%s.m64", music_dir, seq_name);
-      write_file(m64_file, &data[sec->start + seq_bank.seq[i].start], seq_bank.seq[i].length);
+      write_file_if_changed(m64_file, &data[sec->start + seq_bank.seq[i].start], seq_bank.seq[i].length);
 
       sprintf(m64_file_rel, "%s/%s.m64", MUSIC_SUBDIR, seq_name);
       fprintf(out, "\n.incbin \"%s\"\n", m64_file_rel);
@@ -98,6 +116,127 @@ void parse_instrument_set(FILE *out, unsigned char *data, split_section *sec)
    fprintf(out, "\ninstrument_sets_end:\n");
 }
 
+// export one reference to a sound, decoding its samples only the first time they are seen in the bank
+// later references with the same key base and loop are hard linked to the first file
+// returns 1 if the sound was exported, 0 if it is not ADPCM
+static int export_sound(sound_cache *cache, const char *sound_dir, const char *name, wave_table *wav, float key_base, unsigned char *snd_data)
+{
+   unsigned char smpl[SFX_WAV_SMPL_LENGTH];
+   char wav_file[FILENAME_MAX];
+   sound_cache_entry *entry = NULL;
+   unsigned int i;
+
+   if (wav == NULL || wav->predictor == NULL) {
+      return 0;
+   }
+
+   sprintf(wav_file, "%s/%s.wav", sound_dir, name);
+
+   for (i = 0; i < cache->count; i++) {
+      if (cache->entries[i].sound_offset == wav->sound_offset &&
+          cache->entries[i].sound_length == wav->sound_length &&
+          cache->entries[i].predictor_offset == wav->predictor_offset) {
+         entry = &cache->entries[i];
+         break;
+      }
+   }
+
+   if (entry == NULL) {
+      if (cache->count >= cache->allocated) {
+         cache->allocated = cache->allocated ? 2 * cache->allocated : 16;
+         cache->entries = realloc(cache->entries, cache->allocated * sizeof(*cache->entries));
+      }
+      entry = &cache->entries[cache->count++];
+      entry->sound_offset = wav->sound_offset;
+      entry->sound_length = wav->sound_length;
+      entry->predictor_offset = wav->predictor_offset;
+      entry->wav_data = decode_raw_sound(wav, key_base, snd_data, SOUND_SAMPLE_RATE, &entry->wav_length);
+      strcpy(entry->wav_file, wav_file);
+      write_file_if_changed(wav_file, entry->wav_data, entry->wav_length);
+      return 1;
+   }
+
+   // same samples, only the smpl chunk can differ
+   build_raw_sound_smpl(smpl, wav, key_base);
+   if (!memcmp(smpl, &entry->wav_data[entry->wav_length - SFX_WAV_SMPL_LENGTH], SFX_WAV_SMPL_LENGTH)) {
+      if (link_file(entry->wav_file, wav_file) < 0) {
+         ERROR("Error linking %s to %s\n", wav_file, entry->wav_file);
+      }
+      cache->links++;
+   } else {
+      FILE *fp = fopen_if_changed(wav_file);
+      if (fp) {
+         fwrite(entry->wav_data, 1, entry->wav_length - SFX_WAV_SMPL_LENGTH, fp);
+         fwrite(smpl, 1, SFX_WAV_SMPL_LENGTH, fp);
+         fclose_if_changed(fp, wav_file);
+      }
+   }
+   return 1;
+}
+
+static void sound_cache_free(sound_cache *cache)
+{
+   unsigned int i;
+   for (i = 0; i < cache->count; i++) {
+      free(cache->entries[i].wav_data);
+   }
+   free(cache->entries);
+}
+
+// counts for the summary of one bank
+typedef struct {
+   unsigned int sound_count;
+   unsigned int percussion_count;
+   unsigned int unique_count;
+   unsigned int link_count;
+} sound_bank_export;
+
+typedef struct {
+   const char *sound_dir;
+   const sound_bank_header *sound_banks;
+   const sound_data_header *sound_data;
+   sound_bank_export *results;
+} sound_export_state;
+
+// export all sounds and percussion of one bank, banks share no samples or files
+static void sound_export_job(void *ctx, int index)
+{
+   const sound_export_state *state = ctx;
+   const sound_bank *bank = &state->sound_banks->banks[index];
+   sound_bank_export *result = &state->results[index];
+   sound_cache cache = {0};
+   char sfx_file[FILENAME_MAX];
+   unsigned char *snd_data;
+   unsigned int i = (unsigned int)index;
+   unsigned int j;
+
+   if (i >= state->sound_data->data_count) {
+      ERROR("Sound bank %u has no sound data\n", i);
+      return;
+   }
+   snd_data = state->sound_data->data[i];
+
+   for (j = 0; j < bank->instrument_count; j++) {
+      const sound *snd = &bank->sounds[j];
+      sprintf(sfx_file, "Bank%uSound%uPrev", i, j);
+      result->sound_count += export_sound(&cache, state->sound_dir, sfx_file, snd->wav_prev, snd->key_base_prev, snd_data);
+      sprintf(sfx_file, "Bank%uSound%u", i, j);
+      result->sound_count += export_sound(&cache, state->sound_dir, sfx_file, snd->wav, snd->key_base, snd_data);
+      sprintf(sfx_file, "Bank%uSound%uSec", i, j);
+      result->sound_count += export_sound(&cache, state->sound_dir, sfx_file, snd->wav_sec, snd->key_base_sec, snd_data);
+   }
+
+   for (j = 0; j < bank->percussion_count; j++) {
+      const percussion *perc = &bank->percussions.items[j];
+      sprintf(sfx_file, "Bank%uPercussion%u", i, j);
+      result->percussion_count += export_sound(&cache, state->sound_dir, sfx_file, perc->wav, perc->key_base, snd_data);
+   }
+
+   result->unique_count = cache.count;
+   result->link_count = cache.links;
+   sound_cache_free(&cache);
+}
+
 void parse_sound_banks(FILE *out, unsigned char *data, split_section *secCtl, split_section *secTbl, arg_config *args, strbuf *makeheader)
 {
    // TODO: unused parameters
@@ -105,47 +244,39 @@ void parse_sound_banks(FILE *out, unsigned char *data, split_section *secCtl, sp
    (void)makeheader;
 
    char sound_dir[FILENAME_MAX];
-   char sfx_file[FILENAME_MAX];
-   unsigned int i, j, sound_count;
+   sound_export_state state;
+   sound_bank_export total = {0};
+   unsigned int i;
 
-   sfx_initialize_key_table();
-   
    sprintf(sound_dir, "%s/%s", args->output_dir, SOUNDS_SUBDIR);
    make_dir(sound_dir);
 
    sound_data_header sound_data = read_sound_data(data, secTbl->start);
    sound_bank_header sound_banks = read_sound_bank(data, secCtl->start);
-   
-   sound_count = 0;
-   
-   for (i = 0; i < sound_banks.bank_count; i++) {
-      for (j = 0; j < sound_banks.banks[i].instrument_count; j++) {
-        if(sound_banks.banks[i].sounds[j].wav_prev != NULL) {
-          sprintf(sfx_file, "Bank%uSound%uPrev", i, j);
-          extract_raw_sound(sound_dir, sfx_file, sound_banks.banks[i].sounds[j].wav_prev, sound_banks.banks[i].sounds[j].key_base_prev, sound_data.data[i], 16000);
-          sound_count++;
-       }
-        if(sound_banks.banks[i].sounds[j].wav != NULL) {
-          sprintf(sfx_file, "Bank%uSound%u", i, j);
-          extract_raw_sound(sound_dir, sfx_file, sound_banks.banks[i].sounds[j].wav, sound_banks.banks[i].sounds[j].key_base, sound_data.data[i], 16000);
-          sound_count++;
-       }
-        if(sound_banks.banks[i].sounds[j].wav_sec != NULL) {
-          sprintf(sfx_file, "Bank%uSound%uSec", i, j);
-          extract_raw_sound(sound_dir, sfx_file, sound_banks.banks[i].sounds[j].wav_sec, sound_banks.banks[i].sounds[j].key_base_sec, sound_data.data[i], 16000);
-          sound_count++;
-       }
-     }
-     
-     // Todo: add percussion export here
-   }
 
-   // free used memory
+   state.sound_dir = sound_dir;
+   state.sound_banks = &sound_banks;
+   state.sound_data = &sound_data;
+   state.results = calloc(sound_banks.bank_count, sizeof(*state.results));
    if (sound_banks.bank_count > 0) {
-      free(sound_banks.banks);
+      workpool_run(sound_banks.bank_count, args->threads, sound_export_job, &state);
    }
-   
+
+   for (i = 0; i < sound_banks.bank_count; i++) {
+      total.sound_count += state.results[i].sound_count;
+      total.percussion_count += state.results[i].percussion_count;
+      total.unique_count += state.results[i].unique_count;
+      total.link_count += state.results[i].link_count;
+   }
+
    INFO("Successfully exported sounds:\n");
    INFO("  # of banks: %u\n", sound_banks.bank_count);
-   INFO("  # of sounds: %u\n", sound_count);
+   INFO("  # of sounds: %u\n", total.sound_count);
+   INFO("  # of percussion: %u\n", total.percussion_count);
+   INFO("  # of unique sounds: %u (%u linked)\n", total.unique_count, total.link_count);
+
+   // free used memory
+   free(state.results);
+   free_sound_bank(&sound_banks);
+   free_sound_data(&sound_data);
 }
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "levelscript.h"
 #include "libmio0.h"
 #include "libsm64.h"
 #include "utils.h"
@@ -176,66 +177,43 @@ static void add_ref(block *blk, unsigned level_script, unsigned offset, unsigned
 
 static int walk_scripts(block *blocks, int block_count, unsigned char *buf, unsigned int in_length, unsigned level_script, unsigned script_end)
 {
-   unsigned off = level_script;
-   while (off < script_end) {
-      unsigned cmd = read_u32_be(&buf[off]);
-      switch (buf[off]) {
-         case 0x00: // level script
-         case 0x01: // level script
-            if (buf[off+1] == 0x10) {
-               unsigned block_off = read_u32_be(&buf[off+4]);
-               unsigned block_end = read_u32_be(&buf[off+8]);
-               if ((block_off & 0xFF000000) == (block_end & 0xFF000000) && buf[off+0x3] == buf[off+0xC]) {
-                  INFO("%07X: %08X %08X %08X %08X\n", off, cmd, block_off, block_end, read_u32_be(&buf[off+0xC]));
-                  int idx = find_block(blocks, block_count, block_off);
-                  if (idx < 0) {
-                     idx = block_count;
-                     blocks[idx].old = block_off;
-                     blocks[idx].old_end = block_end;
+   level_graph graph;
+   level_walk(buf, in_length, level_script, script_end, LEVEL_WALK_SCAN, &graph);
+   for (int r = 0; r < graph.ref_count; r++) {
+      const level_ref *ref = &graph.refs[r];
+      int idx;
+      switch (ref->type) {
+         case LEVEL_REF_SCRIPT:   // level script
+         case LEVEL_REF_RAW:      // raw data
+         case LEVEL_REF_MIO0:     // MIO0
+         case LEVEL_REF_MIO0_TEX: // MIO0
+            INFO("%07X: %08X %08X %08X\n", ref->offset, read_u32_be(&buf[ref->offset]), ref->start, ref->end);
+            idx = find_block(blocks, block_count, ref->start);
+            if (idx < 0) {
+               idx = block_count;
+               blocks[idx].old = ref->start;
+               blocks[idx].old_end = ref->end;
+               switch (ref->type) {
+                  case LEVEL_REF_SCRIPT:
                      blocks[idx].type = BLOCK_LEVEL;
-                     block_count++;
-                     // recurse
-                     block_count = walk_scripts(blocks, block_count, buf, in_length, block_off, block_end);
-                  }
-                  add_ref(&blocks[idx], level_script, off - level_script, buf[off]);
-               }
-            }
-            break;
-         case 0x17: // raw data
-         case 0x18: // MIO0
-         case 0x1A: // MIO0
-            if (buf[off+1] == 0x0C) {
-               unsigned block_off = read_u32_be(&buf[off+4]);
-               unsigned block_end = read_u32_be(&buf[off+8]);
-               if ((block_off & 0xFF000000) == (block_end & 0xFF000000)) {
-                  INFO("%07X: %08X %08X %08X\n", off, cmd, block_off, block_end);
-                  int idx = find_block(blocks, block_count, block_off);
-                  if (idx < 0) {
-                     idx = block_count;
-                     blocks[idx].old = block_off;
-                     blocks[idx].old_end = block_end;
-                     switch (buf[off]) {
-                        case 0x17: // raw data
-                           blocks[idx].type = BLOCK_RAW;
-                           blocks[idx].compressible = 1;
-                           break;
-                        case 0x18: // MIO0
-                        case 0x1A: // MIO0
-                           blocks[idx].type = BLOCK_MIO0;
-                           break;
-                     }
-                     block_count++;
-                  }
-                  add_ref(&blocks[idx], level_script, off - level_script, buf[off]);
+                     break;
+                  case LEVEL_REF_RAW:
+                     blocks[idx].type = BLOCK_RAW;
+                     blocks[idx].compressible = 1;
+                     break;
+                  default:
+                     blocks[idx].type = BLOCK_MIO0;
+                     break;
                }
+               block_count++;
             }
+            add_ref(&blocks[idx], ref->script, ref->offset - ref->script, ref->cmd);
             break;
          default:
             break;
       }
-      // could increment by buf[off+1] command length, but trying to be smart might miss things
-      off += 0x4;
    }
+   level_graph_free(&graph);
    return block_count;
 }
 
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "levelscript.h"
 #include "utils.h"
 
 #define SM64GEO_VERSION "0.1"
@@ -32,77 +33,31 @@ static void print_spaces(FILE *fp, int count)
 
 void print_geo(FILE *out, unsigned char *data, unsigned int offset, unsigned int length)
 {
+   const script_cmd *info;
    unsigned int a = offset;
+   unsigned int cmd_len;
    int indent = 0;
-   int i;
    while (a < offset + length) {
-      switch (data[a]) {
-         case 0x00: // end
-         case 0x01:
-         case 0x03:
-         case 0x04:
-         case 0x05:
-         case 0x09:
-         case 0x0B:
-         case 0x0C:
-         case 0x17:
-         case 0x20:
-            i = 4;
-            break;
-         case 0x02:
-         case 0x0D:
-         case 0x0E:
-         case 0x12:
-         case 0x14:
-         case 0x15:
-         case 0x16:
-         case 0x18:
-         case 0x19:
-            i = 8;
-            break;
-         case 0x08:
-         case 0x13:
-         case 0x1C:
-            i = 12;
-            break;
-         case 0x10:
-            i = 16;
-            break;
-         case 0x0F:
-            i = 20;
-            break;
-         case 0x0A:
-            i = 8;
-            if (data[a+1]) {
-               i += 4;
-            }
-            break;
-         case 0x11:
-         case 0x1D:
-            i = 8;
-            if (data[a+1] & 0x80) {
-               i += 4;
-            }
-            break;
-         default:
-            i = 4;
-            ERROR("WHY? %06X %2X\n", a, data[a]);
+      info = script_cmd_get(SCRIPT_GEO, &data[a]);
+      cmd_len = script_cmd_length(SCRIPT_GEO, info, &data[a]);
+      if (info->name == NULL) {
+         ERROR("WHY? %06X %2X\n", a, data[a]);
       }
-      if (data[a] == 0x05 && indent > 1) {
+      if ((info->flags & SCRIPT_CMD_CLOSE) && indent > 1) {
          indent -= 2;
       }
-      if (data[a] == 0x01) {
+      if (info->flags & SCRIPT_CMD_END) {
          indent = 0;
       }
       fprintf(out, "%4X: ", a);
       print_spaces(out, indent);
       fprintf(out, "[ ");
-      fprint_hex(out, &data[a], i);
+      fprint_hex(out, &data[a], cmd_len);
       fprintf(out, "]\n");
-      if (data[a] == 0x04) {
+      if (info->flags & SCRIPT_CMD_OPEN) {
          indent += 2;
       }
-      a += i;
+      a += cmd_len;
    }
 }
 
@@ -2,49 +2,134 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "levelscript.h"
 #include "libsm64.h"
+#include "strutils.h"
 #include "utils.h"
+#include "workpool.h"
 
-#define SM64WALK_VERSION "0.1"
+#define SM64WALK_VERSION "0.2"
+
+typedef enum
+{
+   OUTPUT_LISTING, // decoded commands of every script
+   OUTPUT_GRAPH,   // tab-separated references
+   OUTPUT_JSON,    // one JSON object per ROM per line
+   OUTPUT_CSV,     // one CSV row per reference
+} output_format;
+
+typedef struct
+{
+   char **in_filenames;
+   int file_count;
+   unsigned offset;
+   char region;
+   output_format format;
+   int diff;
+   int threads;
+} walk_config;
+
+// everything known about one ROM after walking it
+typedef struct
+{
+   const char *filename;
+   char region;
+   unsigned offset;
+   unsigned char *data;
+   long size;
+   level_graph graph;
+   strbuf out;
+   char error[128];
+} walk_result;
+
+typedef struct
+{
+   const walk_config *config;
+   walk_result *results;
+} walk_state;
+
+static const walk_config default_config =
+{
+   NULL,           // input filenames
+   0,              // file count
+   0xFFFFFFFF,     // offset: auto-detect
+   0,              // region: auto-detect
+   OUTPUT_LISTING, // output format
+   0,              // diff
+   0,              // threads: number of processors
+};
 
 static void print_usage(void)
 {
-   ERROR("Usage: sm64walk [-o OFFSET] [-r REGION] [-v] FILE\n"
+   ERROR("Usage: sm64walk [-g] [-f FORMAT] [-j JOBS] [-o OFFSET] [-r REGION] [-v] FILE [FILE ...]\n"
+         "       sm64walk -d [-o OFFSET] [-r REGION] [-v] FILE1 FILE2\n"
          "\n"
          "sm64walk v" SM64WALK_VERSION ": Super Mario 64 script walker\n"
          "\n"
          "Optional arguments:\n"
+         " -d           print differences between script graphs of FILE1 and FILE2\n"
+         " -f FORMAT    output format: listing, graph, json, csv (default: listing)\n"
+         " -g           print script graph, one tab-separated line per reference (same as -f graph)\n"
+         " -j JOBS      number of ROMs to walk in parallel (default: number of processors)\n"
          " -o OFFSET    start decoding level scripts at OFFSET (default: auto-detect)\n"
          " -r REGION    region to use. valid: Europe, US, JP, Shindou\n"
          " -v           verbose progress output\n"
          "\n"
          "File arguments:\n"
-         " FILE        input ROM file\n");
+         " FILE        input ROM file(s), walked in parallel and output in order\n");
    exit(EXIT_FAILURE);
 }
 
 // parse command line arguments
-static void parse_arguments(int argc, char *argv[], unsigned *offset, char *region, char *in_filename)
+static void parse_arguments(int argc, char *argv[], walk_config *config)
 {
    int i;
-   int file_count = 0;
    if (argc < 2) {
       print_usage();
    }
+   config->in_filenames = malloc(argc * sizeof(*config->in_filenames));
    for (i = 1; i < argc; i++) {
       if (argv[i][0] == '-') {
          switch (argv[i][1]) {
+            case 'd':
+               config->diff = 1;
+               break;
+            case 'f':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               if (!strcmp(argv[i], "listing")) {
+                  config->format = OUTPUT_LISTING;
+               } else if (!strcmp(argv[i], "graph")) {
+                  config->format = OUTPUT_GRAPH;
+               } else if (!strcmp(argv[i], "json")) {
+                  config->format = OUTPUT_JSON;
+               } else if (!strcmp(argv[i], "csv")) {
+                  config->format = OUTPUT_CSV;
+               } else {
+                  print_usage();
+               }
+               break;
+            case 'g':
+               config->format = OUTPUT_GRAPH;
+               break;
+            case 'j':
+               if (++i >= argc) {
+                  print_usage();
+               }
+               config->threads = strtoul(argv[i], NULL, 0);
+               break;
             case 'o':
                if (++i >= argc) {
                   print_usage();
                }
-               *offset = strtoul(argv[i], NULL, 0);
+               config->offset = strtoul(argv[i], NULL, 0);
                break;
             case 'r':
                if (++i >= argc) {
                   print_usage();
                }
-               *region = argv[i][0];
+               config->region = argv[i][0];
                break;
             case 'v':
                g_verbosity = 1;
@@ -54,156 +139,150 @@ static void parse_arguments(int argc, char *argv[], unsigned *offset, char *regi
                break;
          }
       } else {
-         switch (file_count) {
-            case 0:
-               strcpy(in_filename, argv[i]);
-               break;
-            default: // too many
-               print_usage();
-               break;
-         }
-         file_count++;
+         config->in_filenames[config->file_count++] = argv[i];
       }
    }
-   if (file_count < 1) {
+   if (config->file_count < 1 || (config->diff && config->file_count != 2)) {
       print_usage();
    }
 }
 
-typedef struct
-{
-   unsigned start;
-   unsigned end;
-} level_t;
-
-static void add_level(level_t levels[], unsigned *lcount, unsigned start, unsigned end)
-{
-   unsigned i;
-   INFO("Adding level %06X - %06X\n", start, end);
-   for (i = 0; i < *lcount; i++) {
-      if (levels[i].start == start) {
-         return;
-      }
-   }
-   levels[*lcount].start = start;
-   levels[*lcount].end = end;
-   (*lcount)++;
-}
-
-static void decode_level(unsigned char *data, level_t levels[], unsigned int l, unsigned *lcount)
+static void decode_level(strbuf *out, const unsigned char *data, unsigned int length, const level_script *script)
 {
-   unsigned int ptr_start;
-   unsigned int ptr_end;
-   unsigned int dst;
+   level_ref ref;
+   unsigned int cmd_len;
    unsigned int a;
    int i;
 
-   printf("Decoding level script %X\n", levels[l].start);
+   strbuf_sprintf(out, "Decoding level script %X\n", script->start);
 
-   a = levels[l].start;
+   a = script->start;
    // length = 0 ends level script
-   while (a < levels[l].end && data[a+1] != 0) {
-      printf("%06X [%03X] ", a, a - levels[l].start);
-      switch (data[a]) {
-         case 0x00: printf("LoadJump0"); break; // load and jump from ROM into a RAM segment
-         case 0x01: printf("LoadJump1"); break; // load and jump from ROM into a RAM segment
-         case 0x02: printf("EndLevel "); break; // end of level layout data
-         case 0x03: printf("Delay03  "); break; // delay frames
-         case 0x04: printf("Delay04  "); break; // delay frames and signal end
-         case 0x05: printf("JumpSeg  "); break; // jump to level script at segmented address
-         case 0x06: printf("PushJump "); break; // push script stack and jump to segmented address
-         case 0x07: printf("PopScript"); break; // pop script stack, return to prev 0x06 or 0x0C
-         case 0x08: printf("Push16   "); break; // push script stack and 16-bit value
-         case 0x09: printf("Pop16    "); break; // pop script stack and 16-bit value
-         case 0x0A: printf("PushNull "); break; // push script stack and 32-bit 0x00000000
-         case 0x0B: printf("CondPop  "); break; // conditional stack pop
-         case 0x0C: printf("CondJump "); break; // conditional jump to segmented address
-         case 0x0D: printf("CondPush "); break; // conditional stack push
-         case 0x0E: printf("CondSkip "); break; // conditional skip over following 0x0F and 0x10 commands
-         case 0x0F: printf("SkipNext "); break; // skip over following 0x10 commands
-         case 0x10: printf("NoOp     "); break; // no operation
-         case 0x11: printf("AccumAsm1"); break; // set accumulator from ASM function
-         case 0x12: printf("AccumAsm2"); break; // actively set accumulator from ASM function
-         case 0x13: printf("SetAccum "); break; // set accumulator to constant value
-         case 0x14: printf("PushPool "); break; // push pool state
-         case 0x15: printf("PopPool  "); break; // pop pool state
-         case 0x16: printf("LoadASM  "); break; // load ASM into RAM
-         case 0x17: printf("ROM->Seg "); break; // copy uncompressed data from ROM to a RAM segment
-         case 0x18: printf("MIO0->Seg"); break; // decompress MIO0 data from ROM and copy it into a RAM segment
-         case 0x19: printf("MarioFace"); break; // create Mario face for demo screen
-         case 0x1A: printf("MIO0Textr"); break; // decompress MIO0 data from ROM and copy it into a RAM segment (for texture only segments?)
-         case 0x1B: printf("StartLoad"); break; // start RAM loading sequence (before 17, 18, 1A)
-         case 0x1D: printf("EndLoad  "); break; // end RAM loading sequence (after 17, 18, 1A)
-         case 0x1F: printf("StartArea"); break; // start of an area
-         case 0x20: printf("EndArea  "); break; // end of an area
-         case 0x21: printf("LoadPoly "); break; // load polygon data without geo layout
-         case 0x22: printf("LdPolyGeo"); break; // load polygon data with geo layout
-         case 0x24: printf("PlaceObj "); break; // place object in level with behavior
-         case 0x25: printf("LoadMario"); break; // load mario object with behavior
-         case 0x26: printf("ConctWarp"); break; // connect warps
-         case 0x27: printf("PaintWarp"); break; // level warps for paintings
-         case 0x28: printf("Transport"); break; // transport Mario to an area
-         case 0x2B: printf("MarioStrt"); break; // Mario's default position
-         case 0x2E: printf("Collision"); break; // load collision data
-         case 0x2F: printf("RendrArea"); break; // decide which area of level geo to render
-         case 0x31: printf("Terrain  "); break; // set default terrain type
-         case 0x33: printf("FadeColor"); break; // fade/overlay screen with color
-         case 0x34: printf("Blackout "); break; // blackout screen
-         case 0x36: printf("Music36  "); break; // set music
-         case 0x37: printf("Music37  "); break; // set music
-         case 0x39: printf("MulObject"); break; // multiple objects from main level segment
-         case 0x3B: printf("JetStream"); break; // define jet streams that repulse / pull Mario
-         case 0x3C: printf("GetPut   "); break; // get/put remote value
-         default:   printf("         "); break;
-      }
-      printf(" %02X %02X %02X%02X ", data[a], data[a+1], data[a+2], data[a+3]);
-      switch (data[a]) {
-         case 0x00: // load and jump from ROM into a RAM segment
-         case 0x01: // load and jump from ROM into a RAM segment
-            ptr_start = read_u32_be(&data[a+4]);
-            ptr_end = read_u32_be(&data[a+8]);
-            printf("%08X %08X %08X\n", ptr_start, ptr_end, read_u32_be(&data[a+0xc]));
-            add_level(levels, lcount, ptr_start, ptr_end);
+   while (a < script->end && (cmd_len = level_decode_cmd(data, length, a, &ref)) != 0) {
+      const script_cmd *info = level_cmd_get(data[a]);
+      strbuf_sprintf(out, "%06X [%03X] ", a, a - script->start);
+      strbuf_sprintf(out, "%-9s", info->name ? info->name : "");
+      strbuf_sprintf(out, " %02X %02X %02X%02X ", data[a], data[a+1], data[a+2], data[a+3]);
+      switch (ref.type) {
+         case LEVEL_REF_SCRIPT: // load and jump from ROM into a RAM segment
+            strbuf_sprintf(out, "%08X %08X %08X\n", ref.start, ref.end, read_u32_be(&data[a+0xc]));
             break;
-         case 0x17: // copy uncompressed data from ROM to a RAM segment
-         case 0x18: // decompress MIO0 data from ROM and copy it into a RAM segment
-         case 0x1A: // decompress MIO0 data from ROM and copy it into a RAM segment (for texture only segments?)
-            ptr_start = read_u32_be(&data[a+4]);
-            ptr_end = read_u32_be(&data[a+8]);
-            printf("%08X %08X\n", ptr_start, ptr_end);
+         case LEVEL_REF_RAW:      // copy uncompressed data from ROM to a RAM segment
+         case LEVEL_REF_MIO0:     // decompress MIO0 data from ROM and copy it into a RAM segment
+         case LEVEL_REF_MIO0_TEX: // decompress MIO0 data from ROM and copy it into a RAM segment (for texture only segments?)
+            strbuf_sprintf(out, "%08X %08X\n", ref.start, ref.end);
             break;
-         case 0x11: // call function
-         case 0x12: // call function
-            ptr_start = read_u32_be(&data[a+0x4]);
-            printf("%08X\n", ptr_start);
+         case LEVEL_REF_ASM_CALL: // call function
+            strbuf_sprintf(out, "%08X\n", ref.start);
             break;
-         case 0x16: // load ASM into RAM
-            dst       = read_u32_be(&data[a+0x4]);
-            ptr_start = read_u32_be(&data[a+0x8]);
-            ptr_end   = read_u32_be(&data[a+0xc]);
-            printf("%08X %08X %08X\n", dst, ptr_start, ptr_end);
+         case LEVEL_REF_ASM_LOAD: // load ASM into RAM
+            strbuf_sprintf(out, "%08X %08X %08X\n", ref.dst, ref.start, ref.end);
             break;
-         case 0x25: // load mario object with behavior
-         case 0x24: // load object with behavior
-            printf("%08X", read_u32_be(&data[a]));
+         case LEVEL_REF_BEHAVIOR: // load object with behavior
+            strbuf_sprintf(out, "%08X", read_u32_be(&data[a]));
             for (i = 4; i < data[a+1]-4; i+=4) {
-               printf(" %08X", read_u32_be(&data[a+i]));
+               strbuf_sprintf(out, " %08X", read_u32_be(&data[a+i]));
             }
-            dst = read_u32_be(&data[a+i]);
-            printf(" %08X\n", dst);
+            strbuf_sprintf(out, " %08X\n", ref.start);
             break;
          default:
             for (i = 4; i < data[a+1]; i+=4) {
-               printf("%08X ", read_u32_be(&data[a+i]));
+               strbuf_sprintf(out, "%08X ", read_u32_be(&data[a+i]));
             }
-            printf("\n");
+            strbuf_sprintf(out, "\n");
             break;
       }
-      a += data[a+1];
+      a += cmd_len;
+   }
+   strbuf_sprintf(out, "Done %X\n\n", script->start);
+}
+
+// one line per reference: script offset, command offset, command, kind, start, end, dst
+static void print_graph(strbuf *out, const level_graph *graph)
+{
+   strbuf_sprintf(out, "# script\toffset\tcmd\tkind\tstart\tend\tdst\n");
+   for (int r = 0; r < graph->ref_count; r++) {
+      const level_ref *ref = &graph->refs[r];
+      strbuf_sprintf(out, "%06X\t%06X\t%02X\t%s\t%08X\t%08X\t%08X\n", ref->script, ref->offset, ref->cmd,
+                     level_ref_name(ref->type), ref->start, ref->end, ref->dst);
+   }
+}
+
+static void json_string(strbuf *out, const char *str)
+{
+   strbuf_sprintf(out, "\"");
+   for (; *str; str++) {
+      if (*str == '"' || *str == '\\') {
+         strbuf_sprintf(out, "\\%c", *str);
+      } else if ((unsigned char)*str < 0x20) {
+         strbuf_sprintf(out, "\\u%04x", (unsigned char)*str);
+      } else {
+         strbuf_sprintf(out, "%c", *str);
+      }
+   }
+   strbuf_sprintf(out, "\"");
+}
+
+// compact JSON on a single line:
+// {"rom":FILE,"region":R,"entry":N,"scripts":[[start,end,parent,loaded_at],...],
+//  "refs":[[script,offset,cmd,kind,start,end,dst],...]}
+// where parent and script are indexes into scripts
+static void print_json(strbuf *out, const walk_result *res)
+{
+   const level_graph *graph = &res->graph;
+   strbuf_sprintf(out, "{\"rom\":");
+   json_string(out, res->filename);
+   if (res->error[0]) {
+      strbuf_sprintf(out, ",\"error\":");
+      json_string(out, res->error);
+      strbuf_sprintf(out, "}\n");
+      return;
+   }
+   strbuf_sprintf(out, ",\"region\":\"%c\",\"entry\":%u,\"scripts\":[", res->region ? res->region : '?', res->offset);
+   for (int s = 0; s < graph->script_count; s++) {
+      const level_script *script = &graph->scripts[s];
+      strbuf_sprintf(out, "%s[%u,%u,%d,%u]", s ? "," : "", script->start, script->end, script->parent, script->loaded_at);
+   }
+   strbuf_sprintf(out, "],\"refs\":[");
+   for (int s = 0; s < graph->script_count; s++) {
+      const level_script *script = &graph->scripts[s];
+      for (int r = script->first_ref; r < script->first_ref + script->ref_count; r++) {
+         const level_ref *ref = &graph->refs[r];
+         strbuf_sprintf(out, "%s[%d,%u,%u,\"%s\",%u,%u,%u]", r ? "," : "", s, ref->offset, ref->cmd,
+                        level_ref_name(ref->type), ref->start, ref->end, ref->dst);
+      }
    }
-   printf("Done %X\n\n", levels[l].start);
+   strbuf_sprintf(out, "]}\n");
 }
 
+// CSV rows: rom,script,offset,cmd,kind,start,end,dst
+static void print_csv(strbuf *out, const walk_result *res)
+{
+   char rom[2 * FILENAME_MAX + 3];
+   const char *c;
+   int i = 0;
+   // quote file name, doubling embedded quotes
+   rom[i++] = '"';
+   for (c = res->filename; *c && i < (int)sizeof(rom) - 3; c++) {
+      if (*c == '"') {
+         rom[i++] = '"';
+      }
+      rom[i++] = *c;
+   }
+   rom[i++] = '"';
+   rom[i] = '\0';
+   if (res->error[0]) {
+      strbuf_sprintf(out, "%s,,,,error,,,\n", rom);
+      return;
+   }
+   for (int r = 0; r < res->graph.ref_count; r++) {
+      const level_ref *ref = &res->graph.refs[r];
+      strbuf_sprintf(out, "%s,0x%06X,0x%06X,0x%02X,%s,0x%08X,0x%08X,0x%08X\n", rom, ref->script, ref->offset,
+                     ref->cmd, level_ref_name(ref->type), ref->start, ref->end, ref->dst);
+   }
+}
+
+// returns region letter or 0 if checksum is not recognized
 char detectRegion(unsigned char *data)
 {
    unsigned checksum = read_u32_be(&data[0x10]);
@@ -214,8 +293,7 @@ char detectRegion(unsigned char *data)
       case 0xD6FBA4A8: return 'S'; // Shindou Edition (J)
       case 0x635A2BFF: return 'U';
       default:
-         ERROR("Unknown ROM checksum: 0x%08X\n", checksum);
-         exit(1);
+         return 0;
    }
 }
 
@@ -233,62 +311,249 @@ unsigned getRegionOffset(char region)
    return 0;
 }
 
-static void walk_scripts(unsigned char *data, unsigned offset)
-{
-   level_t levelscripts[100];
-   unsigned lcount = 0;
-   unsigned l = 0;
-   levelscripts[0].start = offset;
-   levelscripts[0].end   = offset + 0x30;
-   lcount++;
-   while (l < lcount) {
-      decode_level(data, levelscripts, l, &lcount);
-      l++;
-   }
-}
-
-int main(int argc, char *argv[])
+// read ROM and walk its scripts
+// returns 0 on success, negative with res->error set on failure
+static int walk_rom_file(walk_result *res)
 {
-   char in_filename[FILENAME_MAX];
-   unsigned char *in_buf = NULL;
-   unsigned offset = 0xFFFFFFFF;
-   long in_size;
    int rom_type;
-   char region = 0;
-
-   // get configuration from arguments
-   parse_arguments(argc, argv, &offset, &region, in_filename);
 
    // read input file into memory
-   in_size = read_file(in_filename, &in_buf);
-   if (in_size <= 0) {
-      ERROR("Error reading input file \"%s\"\n", in_filename);
-      exit(EXIT_FAILURE);
+   res->size = read_file(res->filename, &res->data);
+   if (res->size <= 0) {
+      sprintf(res->error, "Error reading input file");
+      return -1;
    }
 
    // confirm valid SM64
-   rom_type = sm64_rom_type(in_buf, in_size);
+   rom_type = sm64_rom_type(res->data, res->size);
    if (rom_type < 0) {
-      ERROR("This does not appear to be a valid SM64 ROM\n");
-      exit(EXIT_FAILURE);
+      sprintf(res->error, "This does not appear to be a valid SM64 ROM");
+      return -1;
    } else if (rom_type == 1) {
       // byte-swapped BADC format, swap to big-endian ABCD format for processing
       INFO("Byte-swapping ROM\n");
-      swap_bytes(in_buf, in_size);
+      swap_bytes(res->data, res->size);
    }
 
-   if (offset == 0xFFFFFFFF) {
-      if (region == 0) {
-         region = detectRegion(in_buf);
+   if (res->offset == 0xFFFFFFFF) {
+      if (res->region == 0) {
+         res->region = detectRegion(res->data);
+         if (res->region == 0) {
+            sprintf(res->error, "Unknown ROM checksum: 0x%08X", read_u32_be(&res->data[0x10]));
+            return -1;
+         }
       }
-      offset = getRegionOffset(region);
+      res->offset = getRegionOffset(res->region);
    }
 
    // walk those scripts
-   walk_scripts(in_buf, offset);
+   level_walk(res->data, res->size, res->offset, res->offset + 0x30, 0, &res->graph);
+   return 0;
+}
+
+// walk and format one ROM, run from the work pool
+static void walk_rom(void *ctx, int index)
+{
+   walk_state *state = ctx;
+   const walk_config *config = state->config;
+   walk_result *res = &state->results[index];
+   int status;
+
+   res->filename = config->in_filenames[index];
+   res->region = config->region;
+   res->offset = config->offset;
+   strbuf_alloc(&res->out, 4096);
+   status = walk_rom_file(res);
+
+   switch (config->format) {
+      case OUTPUT_LISTING:
+         if (status < 0) {
+            break;
+         }
+         for (int s = 0; s < res->graph.script_count; s++) {
+            decode_level(&res->out, res->data, res->size, &res->graph.scripts[s]);
+         }
+         break;
+      case OUTPUT_GRAPH:
+         if (status < 0) {
+            break;
+         }
+         print_graph(&res->out, &res->graph);
+         break;
+      case OUTPUT_JSON:
+         print_json(&res->out, res);
+         break;
+      case OUTPUT_CSV:
+         print_csv(&res->out, res);
+         break;
+   }
+
+   // only the graph is needed past this point, don't hold every ROM in memory
+   free(res->data);
+   res->data = NULL;
+}
+
+// reference keyed by the path of script loads leading to it, so moved scripts still match up
+typedef struct
+{
+   const char *path;
+   unsigned int rel; // offset of command in its script
+   const level_ref *ref;
+} diff_entry;
+
+static int compare_diff_entry(const void *a, const void *b)
+{
+   const diff_entry *ea = a;
+   const diff_entry *eb = b;
+   int cmp = strcmp(ea->path, eb->path);
+   if (cmp) {
+      return cmp;
+   }
+   if (ea->rel != eb->rel) {
+      return ea->rel < eb->rel ? -1 : 1;
+   }
+   return (int)ea->ref->cmd - (int)eb->ref->cmd;
+}
+
+// path of each script: entry is "0", others append offset of the loading command in their parent
+static char **script_paths(const level_graph *graph)
+{
+   char **paths = malloc((graph->script_count ? graph->script_count : 1) * sizeof(*paths));
+   for (int s = 0; s < graph->script_count; s++) {
+      const level_script *script = &graph->scripts[s];
+      if (script->parent < 0) {
+         paths[s] = malloc(2);
+         strcpy(paths[s], "0");
+      } else {
+         // parents are always walked before their children
+         const level_script *parent = &graph->scripts[script->parent];
+         const char *parent_path = paths[script->parent];
+         paths[s] = malloc(strlen(parent_path) + 16);
+         sprintf(paths[s], "%s/%X", parent_path, script->loaded_at - parent->start);
+      }
+   }
+   return paths;
+}
+
+static diff_entry *diff_entries(const level_graph *graph, char **paths)
+{
+   diff_entry *entries = malloc((graph->ref_count ? graph->ref_count : 1) * sizeof(*entries));
+   for (int s = 0; s < graph->script_count; s++) {
+      const level_script *script = &graph->scripts[s];
+      for (int r = script->first_ref; r < script->first_ref + script->ref_count; r++) {
+         entries[r].path = paths[s];
+         entries[r].rel = graph->refs[r].offset - script->start;
+         entries[r].ref = &graph->refs[r];
+      }
+   }
+   qsort(entries, graph->ref_count, sizeof(*entries), compare_diff_entry);
+   return entries;
+}
+
+static void print_diff_entry(char sign, const diff_entry *e)
+{
+   printf("%c\t%s\t%X\t%02X\t%s\t%08X\t%08X\t%08X\n", sign, e->path, e->rel, e->ref->cmd,
+          level_ref_name(e->ref->type), e->ref->start, e->ref->end, e->ref->dst);
+}
+
+// print references only in a as '-', only in b as '+', and changed ones as both
+// returns number of differences
+static int diff_graphs(const walk_result *a, const walk_result *b)
+{
+   char **paths_a = script_paths(&a->graph);
+   char **paths_b = script_paths(&b->graph);
+   diff_entry *ea = diff_entries(&a->graph, paths_a);
+   diff_entry *eb = diff_entries(&b->graph, paths_b);
+   int ia = 0, ib = 0;
+   int diffs = 0;
+
+   printf("--- %s\n+++ %s\n", a->filename, b->filename);
+   printf("# sign\tpath\toffset\tcmd\tkind\tstart\tend\tdst\n");
+   while (ia < a->graph.ref_count || ib < b->graph.ref_count) {
+      int cmp;
+      if (ia >= a->graph.ref_count) {
+         cmp = 1;
+      } else if (ib >= b->graph.ref_count) {
+         cmp = -1;
+      } else {
+         cmp = compare_diff_entry(&ea[ia], &eb[ib]);
+      }
+      if (cmp < 0) {
+         print_diff_entry('-', &ea[ia++]);
+         diffs++;
+      } else if (cmp > 0) {
+         print_diff_entry('+', &eb[ib++]);
+         diffs++;
+      } else {
+         const level_ref *ra = ea[ia].ref;
+         const level_ref *rb = eb[ib].ref;
+         if (ra->type != rb->type || ra->start != rb->start || ra->end != rb->end || ra->dst != rb->dst) {
+            print_diff_entry('-', &ea[ia]);
+            print_diff_entry('+', &eb[ib]);
+            diffs++;
+         }
+         ia++;
+         ib++;
+      }
+   }
+
+   for (int s = 0; s < a->graph.script_count; s++) {
+      free(paths_a[s]);
+   }
+   for (int s = 0; s < b->graph.script_count; s++) {
+      free(paths_b[s]);
+   }
+   free(paths_a);
+   free(paths_b);
+   free(ea);
+   free(eb);
+   return diffs;
+}
+
+int main(int argc, char *argv[])
+{
+   walk_config config;
+   walk_state state;
+   int ret_val = EXIT_SUCCESS;
+   int i;
+
+   // get configuration from arguments
+   config = default_config;
+   parse_arguments(argc, argv, &config);
+
+   // walk all ROMs in parallel, output is kept in input order
+   state.config = &config;
+   state.results = calloc(config.file_count, sizeof(*state.results));
+   workpool_run(config.file_count, config.threads, walk_rom, &state);
+
+   if (config.format == OUTPUT_CSV && !config.diff) {
+      printf("rom,script,offset,cmd,kind,start,end,dst\n");
+   }
+   for (i = 0; i < config.file_count; i++) {
+      walk_result *res = &state.results[i];
+      if (res->error[0]) {
+         ERROR("%s: %s\n", res->filename, res->error);
+         ret_val = EXIT_FAILURE;
+      }
+      if (!config.diff) {
+         if (config.file_count > 1 && (config.format == OUTPUT_LISTING || config.format == OUTPUT_GRAPH)) {
+            printf("# %s\n", res->filename);
+         }
+         fwrite(res->out.buf, 1, res->out.index, stdout);
+      }
+   }
+   if (config.diff && ret_val == EXIT_SUCCESS) {
+      // exit status like diff: 0 if same, 1 if different
+      ret_val = diff_graphs(&state.results[0], &state.results[1]) ? 1 : EXIT_SUCCESS;
+   }
 
    // cleanup
-   free(in_buf);
+   for (i = 0; i < config.file_count; i++) {
+      level_graph_free(&state.results[i].graph);
+      strbuf_free(&state.results[i].out);
+   }
+   free(state.results);
+   free(config.in_filenames);
 
-   return EXIT_SUCCESS;
+   return ret_val;
 }
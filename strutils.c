@@ -5,9 +5,6 @@
 
 #include "strutils.h"
 
-// buffer for local sprintf
-static char tmpbuf[4096];
-
 void strbuf_alloc(strbuf *sbuf, size_t allocate)
 {
    // some sane default allocation
@@ -23,15 +20,18 @@ void strbuf_sprintf(strbuf *sbuf, const char *format, ...)
 {
    va_list args;
 
+   // measure first and format straight into the buffer so separate buffers can be used from several threads
    va_start(args, format);
-   int len = vsprintf(tmpbuf, format, args);
+   int len = vsnprintf(NULL, 0, format, args);
    va_end(args);
 
    while (sbuf->allocated <= sbuf->index + len) {
       sbuf->allocated *= 2;
       sbuf->buf = realloc(sbuf->buf, sbuf->allocated);
    }
-   memcpy(&sbuf->buf[sbuf->index], tmpbuf, len + 1);
+   va_start(args, format);
+   vsnprintf(&sbuf->buf[sbuf->index], sbuf->allocated - sbuf->index, format, args);
+   va_end(args);
    sbuf->index += len;
 }
 
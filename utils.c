@@ -18,7 +18,7 @@
 // global verbosity setting
 int g_verbosity = 0;
 
-int read_s16_be(unsigned char *buf)
+int read_s16_be(const unsigned char *buf)
 {
    unsigned tmp = read_u16_be(buf);
    int ret;
@@ -105,6 +105,17 @@ long filesize(const char *filename)
    return -1;
 }
 
+long long filemtime(const char *filename)
+{
+   struct stat st;
+
+   if (stat(filename, &st) == 0) {
+      return (long long)st.st_mtime;
+   }
+
+   return -1;
+}
+
 void touch_file(const char *filename)
 {
    int fd;
@@ -165,6 +176,112 @@ long write_file(const char *file_name, unsigned char *data, long length)
    return bytes_written;
 }
 
+#define COMPARE_CHUNK_SIZE (64*KB)
+
+// compare an open file against a buffer, stopping at the first difference
+static int stream_matches(FILE *fp, const unsigned char *data, long length)
+{
+   unsigned char chunk[COMPARE_CHUNK_SIZE];
+   long offset = 0;
+   while (offset < length) {
+      size_t count = MIN(length - offset, COMPARE_CHUNK_SIZE);
+      if (fread(chunk, 1, count, fp) != count || memcmp(chunk, &data[offset], count)) {
+         return 0;
+      }
+      offset += count;
+   }
+   return 1;
+}
+
+// remove file_name if other names are hard linked to it so rewriting it leaves them alone
+static void unshare_file(const char *file_name)
+{
+   struct stat st;
+   if (stat(file_name, &st) == 0 && st.st_nlink > 1) {
+      remove(file_name);
+   }
+}
+
+int write_file_if_changed(const char *file_name, const unsigned char *data, long length)
+{
+   if (filesize(file_name) == length) {
+      FILE *fp = fopen(file_name, "rb");
+      if (fp) {
+         int same = stream_matches(fp, data, length);
+         fclose(fp);
+         if (same) {
+            return 0;
+         }
+      }
+   }
+   unshare_file(file_name);
+   if (write_file(file_name, (unsigned char *)data, length) != length) {
+      return -1;
+   }
+   return 1;
+}
+
+int rename_if_changed(const char *src_name, const char *dst_name)
+{
+   long length = filesize(src_name);
+   int same = 0;
+   if (length < 0) {
+      return -1;
+   }
+   if (filesize(dst_name) == length) {
+      FILE *fsrc = fopen(src_name, "rb");
+      FILE *fdst = fopen(dst_name, "rb");
+      if (fsrc && fdst) {
+         unsigned char chunk[COMPARE_CHUNK_SIZE];
+         long offset = 0;
+         same = 1;
+         while (same && offset < length) {
+            size_t count = MIN(length - offset, COMPARE_CHUNK_SIZE);
+            same = fread(chunk, 1, count, fsrc) == count && stream_matches(fdst, chunk, count);
+            offset += count;
+         }
+      }
+      if (fsrc) fclose(fsrc);
+      if (fdst) fclose(fdst);
+   }
+   if (same) {
+      remove(src_name);
+      return 0;
+   }
+#if defined(_MSC_VER) || defined(__MINGW32__)
+   // rename() does not replace existing files on Windows
+   remove(dst_name);
+#endif
+   if (rename(src_name, dst_name) != 0) {
+      perror(dst_name);
+      return -1;
+   }
+   return 1;
+}
+
+FILE *fopen_if_changed(const char *file_name)
+{
+   char tmp_name[FILENAME_MAX];
+   FILE *fp;
+   sprintf(tmp_name, "%s.tmp", file_name);
+   fp = fopen(tmp_name, "wb");
+   if (fp == NULL) {
+      perror(tmp_name);
+   }
+   return fp;
+}
+
+int fclose_if_changed(FILE *fp, const char *file_name)
+{
+   char tmp_name[FILENAME_MAX];
+   sprintf(tmp_name, "%s.tmp", file_name);
+   if (fclose(fp) != 0) {
+      remove(tmp_name);
+      return -1;
+   }
+   return rename_if_changed(tmp_name, file_name);
+}
+
 void generate_filename(const char *in_name, char *out_name, char *extension)
 {
    char tmp_name[FILENAME_MAX];
@@ -222,6 +339,27 @@ long copy_file(const char *src_name, const char *dst_name)
    return bytes_read;
 }
 
+int link_file(const char *src_name, const char *dst_name)
+{
+#if defined(_MSC_VER) || defined(__MINGW32__)
+   return copy_file(src_name, dst_name) < 0 ? -1 : 1;
+#else
+   struct stat src_st;
+   struct stat dst_st;
+   if (stat(src_name, &src_st) != 0) {
+      return -1;
+   }
+   if (stat(dst_name, &dst_st) == 0 && dst_st.st_dev == src_st.st_dev && dst_st.st_ino == src_st.st_ino) {
+      return 0;
+   }
+   remove(dst_name);
+   if (link(src_name, dst_name) != 0 && copy_file(src_name, dst_name) < 0) {
+      return -1;
+   }
+   return 1;
+#endif
+}
+
 void dir_list_ext(const char *dir, const char *extension, dir_list *list)
 {
    char *pool;
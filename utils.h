@@ -76,7 +76,7 @@ extern int g_verbosity;
 // functions
 
 // convert two bytes in big-endian to signed int
-int read_s16_be(unsigned char *buf);
+int read_s16_be(const unsigned char *buf);
 
 // convert four bytes in big-endian to float
 float read_f32_be(unsigned char *buf);
@@ -103,6 +103,10 @@ void reverse_endian(unsigned char *data, long length);
 // returns file size or negative on error
 long filesize(const char *file_name);
 
+// get modification time of file without opening it
+// returns seconds since epoch or negative on error
+long long filemtime(const char *file_name);
+
 // update file timestamp to now, creating it if it doesn't exist
 void touch_file(const char *filename);
 
@@ -114,6 +118,24 @@ long read_file(const char *file_name, unsigned char **data);
 // returns number of bytes written out or -1 on failure
 long write_file(const char *file_name, unsigned char *data, long length);
 
+// write buffer to file only if it differs from the file's current contents
+// unchanged files are not rewritten so their timestamps are preserved
+// files hard linked to other names are replaced rather than written through
+// returns 1 if file was written, 0 if unchanged, or -1 on failure
+int write_file_if_changed(const char *file_name, const unsigned char *data, long length);
+
+// replace dst_name with src_name only if their contents differ, otherwise remove src_name
+// returns 1 if dst_name was replaced, 0 if unchanged, or -1 on failure
+int rename_if_changed(const char *src_name, const char *dst_name);
+
+// open a temporary file to write what will become file_name
+// must be closed with fclose_if_changed() using the same file_name
+FILE *fopen_if_changed(const char *file_name);
+
+// close file opened with fopen_if_changed() and update file_name if its contents changed
+// returns 1 if file_name was updated, 0 if unchanged, or -1 on failure
+int fclose_if_changed(FILE *fp, const char *file_name);
+
 // generate an output file name from input name by replacing file extension
 // in_name: input file name
 // out_name: buffer to write output name in
@@ -134,6 +156,12 @@ void make_dir(const char *dir_name);
 // dst_name: destination file name
 long copy_file(const char *src_name, const char *dst_name);
 
+// make dst_name a hard link to src_name, copying where hard links are not supported
+// src_name: existing file name
+// dst_name: name to link, replaced if it exists
+// returns 1 if dst_name was replaced, 0 if it was already linked, or -1 on failure
+int link_file(const char *src_name, const char *dst_name);
+
 // list a directory, optionally filtering files by extension
 // dir: directory to list files in
 // extension: extension to filter files by (NULL if no filtering)
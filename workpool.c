@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#if defined(_MSC_VER)
+  #include <windows.h>
+  #define WORKPOOL_SERIAL
+#else
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+#include "utils.h"
+#include "workpool.h"
+
+#define WORKPOOL_MAX_THREADS 64
+
+typedef struct
+{
+   workpool_job job;
+   void *ctx;
+   int job_count;
+   int next;
+#ifndef WORKPOOL_SERIAL
+   pthread_mutex_t lock;
+#endif
+} workpool;
+
+int workpool_default_threads(void)
+{
+   long count = 1;
+#if defined(_MSC_VER)
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   count = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+   count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+   return (int)MAX(1, MIN(count, WORKPOOL_MAX_THREADS));
+}
+
+#ifndef WORKPOOL_SERIAL
+static void *workpool_thread(void *arg)
+{
+   workpool *pool = arg;
+   while (1) {
+      int index;
+      pthread_mutex_lock(&pool->lock);
+      index = pool->next++;
+      pthread_mutex_unlock(&pool->lock);
+      if (index >= pool->job_count) {
+         break;
+      }
+      pool->job(pool->ctx, index);
+   }
+   return NULL;
+}
+#endif
+
+void workpool_run(int job_count, int thread_count, workpool_job job, void *ctx)
+{
+   if (thread_count <= 0) {
+      thread_count = workpool_default_threads();
+   }
+   thread_count = MIN(thread_count, MIN(job_count, WORKPOOL_MAX_THREADS));
+
+#ifndef WORKPOOL_SERIAL
+   if (thread_count > 1) {
+      pthread_t threads[WORKPOOL_MAX_THREADS];
+      workpool pool;
+      int started = 0;
+      pool.job = job;
+      pool.ctx = ctx;
+      pool.job_count = job_count;
+      pool.next = 0;
+      pthread_mutex_init(&pool.lock, NULL);
+      for (int i = 0; i < thread_count; i++) {
+         if (pthread_create(&threads[started], NULL, workpool_thread, &pool) == 0) {
+            started++;
+         }
+      }
+      // if no threads could be created, fall through to running jobs here
+      if (started == 0) {
+         workpool_thread(&pool);
+      }
+      for (int i = 0; i < started; i++) {
+         pthread_join(threads[i], NULL);
+      }
+      pthread_mutex_destroy(&pool.lock);
+      return;
+   }
+#endif
+
+   for (int i = 0; i < job_count; i++) {
+      job(ctx, i);
+   }
+}
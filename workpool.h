@@ -0,0 +1,25 @@
+#ifndef WORKPOOL_H_
+#define WORKPOOL_H_
+
+// typedefs
+
+// job callback run on a worker thread
+// ctx: context pointer passed to workpool_run()
+// index: job index in [0, job_count)
+typedef void (*workpool_job)(void *ctx, int index);
+
+// function prototypes
+
+// determine number of worker threads to use by default
+// returns number of online processors, at least 1
+int workpool_default_threads(void);
+
+// run 'job_count' jobs on a pool of worker threads and wait for all of them
+// jobs are handed out in index order, but may complete in any order
+// job_count: number of jobs to run
+// thread_count: number of worker threads (<= 0 uses workpool_default_threads())
+// job: callback to run for each job index
+// ctx: context pointer passed to each job
+void workpool_run(int job_count, int thread_count, workpool_job job, void *ctx);
+
+#endif // WORKPOOL_H_
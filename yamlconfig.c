@@ -4,10 +4,30 @@
 
 #include <yaml.h>
 
+#if defined(_WIN32)
+  #define CONFIG_NO_MMAP
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
 #include "config.h"
 #include "utils.h"
 
 #define MAX_SIZE 2048
+
+// compiled config binary format, all values big-endian
+// header: magic, version, checksum1, checksum2, section/child/label counts,
+//         string table size, name and basename string offsets
+// records follow in order: sections, children, labels, string table
+#define CONFIG_BIN_MAGIC "N64SPCFG"
+#define CONFIG_BIN_VERSION 1
+#define CONFIG_BIN_HEADER_SIZE 0x30
+#define CONFIG_BIN_SECTION_SIZE 0x34
+#define CONFIG_BIN_LABEL_SIZE 0x8
+#define CONFIG_BIN_NO_CHILDREN 0xFFFFFFFF
 typedef struct
 {
    const char *name;
@@ -80,6 +100,123 @@ const char *config_section2str(section_type section)
    return "";
 }
 
+static unsigned int str_hash(const char *str)
+{
+   // FNV-1a
+   unsigned int h = 2166136261u;
+   while (*str) {
+      h = (h ^ (unsigned char)*str++) * 16777619u;
+   }
+   return h;
+}
+
+// string pool: every distinct string is stored once in large blocks that never move
+#define POOL_BLOCK_SIZE (64*KB)
+#define POOL_HASH_SIZE 1024
+
+typedef struct _pool_block
+{
+   struct _pool_block *next;
+   size_t used;
+   size_t size;
+   char data[];
+} pool_block;
+
+struct _string_pool
+{
+   pool_block *blocks;
+   const char **hash;
+   unsigned int hash_size;
+   unsigned int count;
+   // compiled configs reference strings in the mapped file directly
+   void *mapping;
+   size_t mapping_size;
+};
+
+static string_pool *pool_create(void)
+{
+   string_pool *pool = calloc(1, sizeof(*pool));
+   pool->hash_size = POOL_HASH_SIZE;
+   pool->hash = calloc(pool->hash_size, sizeof(*pool->hash));
+   return pool;
+}
+
+static void pool_destroy(string_pool *pool)
+{
+   if (pool) {
+      pool_block *block = pool->blocks;
+      while (block) {
+         pool_block *next = block->next;
+         free(block);
+         block = next;
+      }
+      free(pool->hash);
+#ifdef CONFIG_NO_MMAP
+      free(pool->mapping);
+#else
+      if (pool->mapping) {
+         munmap(pool->mapping, pool->mapping_size);
+      }
+#endif
+      free(pool);
+   }
+}
+
+static void pool_rehash(string_pool *pool)
+{
+   const char **old_hash = pool->hash;
+   unsigned int old_size = pool->hash_size;
+   pool->hash_size *= 2;
+   pool->hash = calloc(pool->hash_size, sizeof(*pool->hash));
+   for (unsigned int i = 0; i < old_size; i++) {
+      if (old_hash[i]) {
+         unsigned int slot = str_hash(old_hash[i]) & (pool->hash_size - 1);
+         while (pool->hash[slot]) {
+            slot = (slot + 1) & (pool->hash_size - 1);
+         }
+         pool->hash[slot] = old_hash[i];
+      }
+   }
+   free(old_hash);
+}
+
+// returns pooled copy of str, shared with any identical string already in the pool
+static const char *pool_intern(string_pool *pool, const char *str)
+{
+   pool_block *block = pool->blocks;
+   unsigned int slot;
+   size_t len;
+   char *copy;
+   if (str == NULL || str[0] == '\0') {
+      return "";
+   }
+   slot = str_hash(str) & (pool->hash_size - 1);
+   while (pool->hash[slot]) {
+      if (!strcmp(pool->hash[slot], str)) {
+         return pool->hash[slot];
+      }
+      slot = (slot + 1) & (pool->hash_size - 1);
+   }
+   len = strlen(str) + 1;
+   if (block == NULL || block->used + len > block->size) {
+      size_t size = MAX(len, POOL_BLOCK_SIZE);
+      block = malloc(sizeof(*block) + size);
+      block->next = pool->blocks;
+      block->used = 0;
+      block->size = size;
+      pool->blocks = block;
+   }
+   copy = &block->data[block->used];
+   memcpy(copy, str, len);
+   block->used += len;
+   pool->hash[slot] = copy;
+   // keep load factor under 1/2
+   if (++pool->count * 2 > pool->hash_size) {
+      pool_rehash(pool);
+   }
+   return copy;
+}
+
 int get_scalar_value(char *scalar, yaml_node_t *node)
 {
    if (node->type == YAML_SCALAR_NODE) {
@@ -103,6 +240,8 @@ int get_scalar_uint(unsigned int *val, yaml_node_t *node)
 
 void load_child_node(split_section *section, yaml_document_t *doc, yaml_node_t *node)
 {
+   section->label = "";
+   section->section_name = "";
    char val[MAX_SIZE];
    yaml_node_item_t *i_node;
    yaml_node_t *next_node;
@@ -149,9 +288,11 @@ void load_child_node(split_section *section, yaml_document_t *doc, yaml_node_t *
    }
 }
 
-void load_behavior(split_section *beh, yaml_document_t *doc, yaml_node_t *node)
+void load_behavior(split_section *beh, string_pool *pool, yaml_document_t *doc, yaml_node_t *node)
 {
    char val[64];
+   beh->label = "";
+   beh->section_name = "";
    yaml_node_item_t *i_node;
    yaml_node_t *next_node;
    size_t count = node->data.sequence.items.top - node->data.sequence.items.start;
@@ -166,7 +307,7 @@ void load_behavior(split_section *beh, yaml_document_t *doc, yaml_node_t *node)
          get_scalar_value(val, next_node);
          switch (i) {
             case 0: beh->start = strtoul(val, NULL, 0); break;
-            case 1: strcpy(beh->label, val); break;
+            case 1: beh->label = pool_intern(pool, val); break;
          }
       } else {
          ERROR("Error: non-scalar value in behavior sequence\n");
@@ -174,7 +315,7 @@ void load_behavior(split_section *beh, yaml_document_t *doc, yaml_node_t *node)
    }
 }
 
-void load_section_data(split_section *section, yaml_document_t *doc, yaml_node_t *node)
+void load_section_data(split_section *section, string_pool *pool, yaml_document_t *doc, yaml_node_t *node)
 {
    yaml_node_item_t *i_node;
    yaml_node_t *next_node;
@@ -207,7 +348,7 @@ void load_section_data(split_section *section, yaml_document_t *doc, yaml_node_t
          for (size_t i = 0; i < count; i++) {
             next_node = yaml_document_get_node(doc, i_node[i]);
             if (next_node->type == YAML_SEQUENCE_NODE) {
-               load_behavior(&beh[i], doc, next_node);
+               load_behavior(&beh[i], pool, doc, next_node);
             } else {
                ERROR("Error: non-sequence behavior node\n");
                return;
@@ -223,12 +364,14 @@ void load_section_data(split_section *section, yaml_document_t *doc, yaml_node_t
    }
 }
 
-void load_section(split_section *section, yaml_document_t *doc, yaml_node_t *node)
+void load_section(split_section *section, string_pool *pool, yaml_document_t *doc, yaml_node_t *node)
 {
    char val[MAX_SIZE];
    yaml_node_item_t *i_node;
    yaml_node_t *next_node;
    size_t count = node->data.sequence.items.top - node->data.sequence.items.start;
+   section->label = "";
+   section->section_name = "";
    if (count >= 3) {
       i_node = node->data.sequence.items.start;
       for (int i = 0; i < 3; i++) {
@@ -240,7 +383,7 @@ void load_section(split_section *section, yaml_document_t *doc, yaml_node_t *nod
                case 1: section->end = strtoul(val, NULL, 0); break;
                case 2: 
                   section->type = config_str2section(val); 
-                  strcpy(section->section_name, val);
+                  section->section_name = pool_intern(pool, val);
                   break;
                case 3: section->vaddr = strtoul(val, NULL, 0); break;
             }
@@ -295,14 +438,12 @@ void load_section(split_section *section, yaml_document_t *doc, yaml_node_t *nod
                   section->subtype = strtoul(val, NULL, 0);
                   break;
                default:
-                  strcpy(section->label, val);
+                  section->label = pool_intern(pool, val);
                   break;
             }
          } else {
             ERROR("Error: non-scalar value in section sequence\n");
          }
-      } else {
-         section->label[0] = '\0';
       }
       // extra parameters for some types
       if (count > 4) {
@@ -346,7 +487,7 @@ int load_sections_sequence(rom_config *c, yaml_document_t *doc, yaml_node_t *nod
          next_node = yaml_document_get_node(doc, i_node[i]);
          if (next_node) {
             if (next_node->type == YAML_SEQUENCE_NODE) {
-               load_section(&c->sections[c->section_count], doc, next_node);
+               load_section(&c->sections[c->section_count], c->strings, doc, next_node);
                c->section_count++;
             } else if (next_node->type == YAML_MAPPING_NODE) {
                yaml_node_pair_t *i_node_p;
@@ -355,8 +496,8 @@ int load_sections_sequence(rom_config *c, yaml_document_t *doc, yaml_node_t *nod
                   key_node = yaml_document_get_node(doc, i_node_p->key);
                   val_node = yaml_document_get_node(doc, i_node_p->value);
                   if (key_node && val_node && key_node->type == YAML_SEQUENCE_NODE && val_node->type == YAML_SEQUENCE_NODE) {
-                     load_section(&c->sections[c->section_count], doc, key_node);
-                     load_section_data(&c->sections[c->section_count], doc, val_node);
+                     load_section(&c->sections[c->section_count], c->strings, doc, key_node);
+                     load_section_data(&c->sections[c->section_count], c->strings, doc, val_node);
                      c->section_count++;
                   } else {
                      ERROR("ERROR: sections sequence map is not sequence\n");
@@ -372,8 +513,9 @@ int load_sections_sequence(rom_config *c, yaml_document_t *doc, yaml_node_t *nod
    return ret_val;
 }
 
-void load_label(label *lab, yaml_document_t *doc, yaml_node_t *node)
+void load_label(label *lab, string_pool *pool, yaml_document_t *doc, yaml_node_t *node)
 {
+   lab->name = "";
    char val[MAX_SIZE];
    yaml_node_item_t *i_node;
    yaml_node_t *next_node;
@@ -387,7 +529,7 @@ void load_label(label *lab, yaml_document_t *doc, yaml_node_t *node)
                get_scalar_value(val, next_node);
                switch (i) {
                   case 0: lab->ram_addr = strtoul(val, NULL, 0); break;
-                  case 1: strcpy(lab->name, val); break;
+                  case 1: lab->name = pool_intern(pool, val); break;
                }
             } else {
                ERROR("Error: non-scalar value in label sequence\n");
@@ -411,7 +553,7 @@ int load_labels_sequence(rom_config *c, yaml_document_t *doc, yaml_node_t *node)
       for (size_t i = 0; i < count; i++) {
          next_node = yaml_document_get_node(doc, i_node[i]);
          if (next_node && next_node->type == YAML_SEQUENCE_NODE) {
-            load_label(&c->labels[c->label_count], doc, next_node);
+            load_label(&c->labels[c->label_count], c->strings, doc, next_node);
             c->label_count++;
          } else {
             ERROR("Error: non-sequence in labels sequence\n");
@@ -425,6 +567,7 @@ int load_labels_sequence(rom_config *c, yaml_document_t *doc, yaml_node_t *node)
 void parse_yaml_root(yaml_document_t *doc, yaml_node_t *node, rom_config *c)
 {
    char key[128];
+   char val[MAX_SIZE];
    yaml_node_pair_t *i_node_p;
 
    yaml_node_t *key_node;
@@ -439,17 +582,19 @@ void parse_yaml_root(yaml_document_t *doc, yaml_node_t *node, rom_config *c)
                get_scalar_value(key, key_node);
                val_node = yaml_document_get_node(doc, i_node_p->value);
                if (!strcmp(key, "name")) {
-                  get_scalar_value(c->name, val_node);
+                  get_scalar_value(val, val_node);
+                  c->name = pool_intern(c->strings, val);
                   INFO("config.name: %s\n", c->name);
                } else if (!strcmp(key, "basename")) {
-                  get_scalar_value(c->basename, val_node);
+                  get_scalar_value(val, val_node);
+                  c->basename = pool_intern(c->strings, val);
                   INFO("config.basename: %s\n", c->basename);
                } else if (!strcmp(key, "checksum1")) {
-                  unsigned int val;
+                  unsigned int val = 0;
                   get_scalar_uint(&val, val_node);
                   c->checksum1 = (unsigned int)val;
                } else if (!strcmp(key, "checksum2")) {
-                  unsigned int val;
+                  unsigned int val = 0;
                   get_scalar_uint(&val, val_node);
                   c->checksum2 = (unsigned int)val;
                } else if (!strcmp(key, "ranges")) {
@@ -468,17 +613,28 @@ void parse_yaml_root(yaml_document_t *doc, yaml_node_t *node, rom_config *c)
    }
 }
 
+static int config_load_binary(const char *filename, rom_config *c);
+
 int config_parse_file(const char *filename, rom_config *c)
 {
+   char magic[8];
    yaml_parser_t parser;
    yaml_document_t doc;
    yaml_node_t *root;
    FILE *file;
 
-   c->name[0] = '\0';
-   c->basename[0] = '\0';
+   c->name = "";
+   c->basename = "";
+   c->strings = NULL;
+   c->sections = NULL;
    c->section_count = 0;
+   c->labels = NULL;
    c->label_count = 0;
+   c->start_index = NULL;
+   c->end_index = NULL;
+   c->behavior_section = -1;
+   c->behavior_index = NULL;
+   c->behavior_index_size = 0;
 
    // read config file, exit if problem
    file = fopen(filename, "rb");
@@ -486,6 +642,13 @@ int config_parse_file(const char *filename, rom_config *c)
       ERROR("Error: cannot open %s\n", filename);
       return -1;
    }
+   // compiled configs skip YAML parsing entirely
+   if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && !memcmp(magic, CONFIG_BIN_MAGIC, sizeof(magic))) {
+      fclose(file);
+      return config_load_binary(filename, c);
+   }
+   rewind(file);
+   c->strings = pool_create();
    yaml_parser_initialize(&parser);
    yaml_parser_set_input_file(&parser, file);
 
@@ -511,20 +674,10 @@ void config_free(rom_config *config)
    if (config) {
       if (config->sections) {
          for (int i = 0; i < config->section_count; i++) {
-            switch (config->sections[i].type) {
-               case TYPE_BLAST:
-               case TYPE_GZIP:
-               case TYPE_MIO0:
-               case TYPE_SM64_BEHAVIOR:
-                  if (config->sections[i].child_count) {
-                     free(config->sections[i].children);
-                     config->sections[i].children = NULL;
-                     config->sections[i].child_count = 0;
-                  }
-                  break;
-               default:
-                  break;
-            }
+            // only some types have children, others leave this NULL
+            free(config->sections[i].children);
+            config->sections[i].children = NULL;
+            config->sections[i].child_count = 0;
          }
          free(config->sections);
          config->sections = NULL;
@@ -535,7 +688,151 @@ void config_free(rom_config *config)
          config->labels = NULL;
          config->label_count = 0;
       }
+      free(config->start_index);
+      free(config->end_index);
+      config->start_index = NULL;
+      config->end_index = NULL;
+      free(config->behavior_index);
+      config->behavior_index = NULL;
+      config->behavior_index_size = 0;
+      config->behavior_section = -1;
+      pool_destroy(config->strings);
+      config->strings = NULL;
+   }
+}
+
+// order by address, then by section so equal addresses keep config order
+static int compare_section_index(const void *a, const void *b)
+{
+   const section_index *ia = a;
+   const section_index *ib = b;
+   if (ia->addr != ib->addr) {
+      return ia->addr < ib->addr ? -1 : 1;
+   }
+   return ia->section - ib->section;
+}
+
+void config_index_sections(rom_config *config)
+{
+   free(config->start_index);
+   free(config->end_index);
+   config->start_index = malloc(config->section_count * sizeof(*config->start_index));
+   config->end_index = malloc(config->section_count * sizeof(*config->end_index));
+   for (int i = 0; i < config->section_count; i++) {
+      config->start_index[i].addr = config->sections[i].start;
+      config->start_index[i].section = i;
+      config->end_index[i].addr = config->sections[i].end;
+      config->end_index[i].section = i;
+   }
+   qsort(config->start_index, config->section_count, sizeof(*config->start_index), compare_section_index);
+   qsort(config->end_index, config->section_count, sizeof(*config->end_index), compare_section_index);
+}
+
+int config_find_section(const rom_config *config, unsigned int addr, int is_end)
+{
+   const section_index *index = is_end ? config->end_index : config->start_index;
+   int lo = 0;
+   int hi = config->section_count;
+   if (index == NULL) {
+      // not indexed, fall back to scanning
+      for (int i = 0; i < config->section_count; i++) {
+         if ((is_end ? config->sections[i].end : config->sections[i].start) == addr) {
+            return i;
+         }
+      }
+      return -1;
+   }
+   // lower bound of addr
+   while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (index[mid].addr < addr) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   if (lo < config->section_count && index[lo].addr == addr) {
+      return index[lo].section;
    }
+   return -1;
+}
+
+// index of the behavior section, using the one found by config_index_behaviors() when available
+static int find_behavior_section(const rom_config *config)
+{
+   if (config->behavior_index) {
+      return config->behavior_section;
+   }
+   for (int i = 0; i < config->section_count; i++) {
+      if (config->sections[i].type == TYPE_SM64_BEHAVIOR) {
+         return i;
+      }
+   }
+   return -1;
+}
+
+static unsigned int behavior_slot(unsigned int offset, unsigned int size)
+{
+   unsigned int slot = offset * 2654435761u;
+   return (slot ^ (slot >> 16)) & (size - 1);
+}
+
+void config_index_behaviors(rom_config *config)
+{
+   const split_section *beh;
+   int count;
+
+   free(config->behavior_index);
+   config->behavior_index = NULL;
+   config->behavior_index_size = 0;
+   config->behavior_section = find_behavior_section(config);
+   if (config->behavior_section < 0) {
+      return;
+   }
+   beh = config->sections[config->behavior_section].children;
+   count = config->sections[config->behavior_section].child_count;
+   // keep load under one half
+   config->behavior_index_size = 16;
+   while (config->behavior_index_size < 2 * (unsigned int)count) {
+      config->behavior_index_size *= 2;
+   }
+   config->behavior_index = calloc(config->behavior_index_size, sizeof(*config->behavior_index));
+   for (int i = 0; i < count; i++) {
+      unsigned int slot = behavior_slot(beh[i].start, config->behavior_index_size);
+      while (config->behavior_index[slot] && beh[config->behavior_index[slot] - 1].start != beh[i].start) {
+         slot = (slot + 1) & (config->behavior_index_size - 1);
+      }
+      if (!config->behavior_index[slot]) {
+         config->behavior_index[slot] = i + 1;
+      }
+   }
+}
+
+const split_section *config_find_behavior(const rom_config *config, unsigned int offset)
+{
+   const split_section *beh;
+   int beh_i = find_behavior_section(config);
+   if (beh_i < 0) {
+      return NULL;
+   }
+   beh = config->sections[beh_i].children;
+   if (config->behavior_index == NULL) {
+      // not indexed, fall back to scanning
+      for (int i = 0; i < config->sections[beh_i].child_count; i++) {
+         if (beh[i].start == offset) {
+            return &beh[i];
+         }
+      }
+      return NULL;
+   }
+   for (unsigned int slot = behavior_slot(offset, config->behavior_index_size);
+        config->behavior_index[slot];
+        slot = (slot + 1) & (config->behavior_index_size - 1)) {
+      if (beh[config->behavior_index[slot] - 1].start == offset) {
+         return &beh[config->behavior_index[slot] - 1];
+      }
+   }
+   return NULL;
 }
 
 void config_print(const rom_config *config)
@@ -600,12 +897,174 @@ void config_print(const rom_config *config)
    }
 }
 
-int config_validate(const rom_config *config, unsigned int max_len)
+// one problem found by config_validate_report(), collected so diagnostics keep their original order
+typedef struct
 {
-   // error on overlapped and out-of-order sections
-   int i, j, beh_i;
+   int first;  // item reported first: later section for overlaps, earlier item for duplicates
+   int second; // the other item
+   int kind;   // validate_kind
+} validate_issue;
+
+typedef enum
+{
+   VALIDATE_OVERLAP,
+   VALIDATE_LABEL_ADDR,
+   VALIDATE_LABEL_NAME,
+   VALIDATE_BEH_OFFSET,
+   VALIDATE_BEH_NAME,
+} validate_kind;
+
+typedef struct
+{
+   validate_issue *issues;
+   int count;
+   int alloc;
+} issue_list;
+
+static void issue_add(issue_list *list, int first, int second, int kind)
+{
+   if (list->count >= list->alloc) {
+      list->alloc = list->alloc ? 2 * list->alloc : 64;
+      list->issues = realloc(list->issues, list->alloc * sizeof(*list->issues));
+   }
+   list->issues[list->count].first = first;
+   list->issues[list->count].second = second;
+   list->issues[list->count].kind = kind;
+   list->count++;
+}
+
+static int compare_issue(const void *a, const void *b)
+{
+   const validate_issue *ia = a;
+   const validate_issue *ib = b;
+   if (ia->first != ib->first) {
+      return ia->first < ib->first ? -1 : 1;
+   }
+   if (ia->second != ib->second) {
+      return ia->second < ib->second ? -1 : 1;
+   }
+   return ia->kind - ib->kind;
+}
+
+// add an issue for every pair of items with equal keys, visiting each item once through a hash set
+// addrs/names: key of item 0, following items are 'stride' bytes apart; names is NULL to compare addrs
+static void find_duplicates(const unsigned int *addrs, const char * const *names, size_t stride, int count,
+                            int kind, issue_list *list)
+{
+   unsigned int hash_size = 16;
+   int *table;   // latest item + 1 for each distinct key
+   int *earlier; // previous item with the same key, or -1
+#define DUP_ADDR(I_) (*(const unsigned int *)((const char *)addrs + (size_t)(I_) * stride))
+#define DUP_NAME(I_) (*(const char * const *)((const char *)names + (size_t)(I_) * stride))
+   while (hash_size < 2 * (unsigned int)count) {
+      hash_size *= 2;
+   }
+   table = calloc(hash_size, sizeof(*table));
+   earlier = malloc((count ? count : 1) * sizeof(*earlier));
+   for (int i = 0; i < count; i++) {
+      unsigned int slot = names ? str_hash(DUP_NAME(i)) : DUP_ADDR(i) * 2654435761u;
+      slot = (slot ^ (slot >> 16)) & (hash_size - 1);
+      earlier[i] = -1;
+      while (table[slot]) {
+         int k = table[slot] - 1;
+         if (names ? !strcmp(DUP_NAME(k), DUP_NAME(i)) : DUP_ADDR(k) == DUP_ADDR(i)) {
+            earlier[i] = k;
+            break;
+         }
+         slot = (slot + 1) & (hash_size - 1);
+      }
+      table[slot] = i + 1;
+      for (int k = earlier[i]; k >= 0; k = earlier[k]) {
+         issue_add(list, k, i, kind);
+      }
+   }
+#undef DUP_ADDR
+#undef DUP_NAME
+   free(earlier);
+   free(table);
+}
+
+// section range for the overlap sweep
+typedef struct
+{
+   unsigned int start;
+   unsigned int end;
+   int index;
+} section_range;
+
+static int compare_section_start(const void *a, const void *b)
+{
+   const section_range *ra = a;
+   const section_range *rb = b;
+   if (ra->start != rb->start) {
+      return ra->start < rb->start ? -1 : 1;
+   }
+   return ra->index - rb->index;
+}
+
+// add an issue for every pair of overlapping sections
+// sweeps sections in start order, keeping only those not yet ended
+static void find_overlaps(const split_section *sections, const unsigned int *ends, int count, issue_list *list)
+{
+   section_range *ranges;
+   int *open;
+   int open_count = 0;
+   if (count <= 0) {
+      return;
+   }
+   ranges = malloc((size_t)count * sizeof(*ranges));
+   open = malloc((size_t)count * sizeof(*open));
+   for (int i = 0; i < count; i++) {
+      ranges[i].start = sections[i].start;
+      ranges[i].end = ends[i];
+      ranges[i].index = i;
+   }
+   qsort(ranges, count, sizeof(*ranges), compare_section_start);
+   for (int o = 0; o < count; o++) {
+      const section_range *ri = &ranges[o];
+      int kept = 0;
+      for (int k = 0; k < open_count; k++) {
+         const section_range *rj = &ranges[open[k]];
+         if (rj->end > ri->start) {
+            if (ri->end > rj->start) {
+               issue_add(list, MAX(ri->index, rj->index), MIN(ri->index, rj->index), VALIDATE_OVERLAP);
+            }
+            open[kept++] = open[k];
+         }
+      }
+      open_count = kept;
+      open[open_count++] = o;
+   }
+   free(open);
+   free(ranges);
+}
+
+static void report_issue(FILE *report, const char *kind, int index, const char *name, unsigned int start, unsigned int end)
+{
+   if (report) {
+      fprintf(report, "%s\t%d\t%s\t0x%X\t0x%X", kind, index, name, start, end);
+   }
+}
+
+static void report_other(FILE *report, int index, const char *name, unsigned int start, unsigned int end)
+{
+   if (report) {
+      fprintf(report, "\t%d\t%s\t0x%X\t0x%X\n", index, name, start, end);
+   }
+}
+
+int config_validate_report(const rom_config *config, unsigned int max_len, FILE *report)
+{
+   issue_list overlaps = {NULL, 0, 0};
+   issue_list dups = {NULL, 0, 0};
+   issue_list beh_dups = {NULL, 0, 0};
+   unsigned int *ends;
    unsigned int last_end = 0;
+   int i, n, beh_i;
    int ret_val = 0;
+
+   // settle out-of-order sections first, overlaps are checked on the adjusted ranges
+   ends = malloc((config->section_count ? config->section_count : 1) * sizeof(*ends));
    for (i = 0; i < config->section_count; i++) {
       split_section *isec = &config->sections[i];
       if (isec->start < last_end) {
@@ -614,71 +1073,422 @@ int config_validate(const rom_config *config, unsigned int max_len)
          isec->start = last_end;
          // ret_val = -2;
       }
+      ends[i] = MAX(isec->start, isec->end);
+      last_end = ends[i];
+   }
+   find_overlaps(config->sections, ends, config->section_count, &overlaps);
+   qsort(overlaps.issues, overlaps.count, sizeof(*overlaps.issues), compare_issue);
+   free(ends);
+
+   // error on overlapped sections
+   n = 0;
+   for (i = 0; i < config->section_count; i++) {
+      split_section *isec = &config->sections[i];
       if (isec->end > max_len) {
          ERROR("Error: section %d \"%s\" (%X-%X) past end of file (%X)\n",
                i, isec->label, isec->start, isec->end, max_len);
+         report_issue(report, "past_end", i, isec->label, isec->start, isec->end);
+         report_other(report, -1, "", 0, max_len);
          ret_val = -3;
       }
       if (isec->start >= isec->end) {
          ERROR("Error: section %d \"%s\" (%X-%X) invalid range\n",
                i, isec->label, isec->start, isec->end);
+         report_issue(report, "invalid_range", i, isec->label, isec->start, isec->end);
+         report_other(report, -1, "", 0, 0);
          isec->end=isec->start;
          //ret_val = -4;
       }
-      for (j = 0; j < i; j++) {
+      for (; n < overlaps.count && overlaps.issues[n].first == i; n++) {
+         int j = overlaps.issues[n].second;
          split_section *jsec = &config->sections[j];
-         if (!((isec->end <= jsec->start) || (isec->start >= jsec->end))) {
-            ERROR("Error: section %d \"%s\" (%X-%X) overlaps %d \"%s\" (%X-%X)\n",
-                  i, isec->label, isec->start, isec->end,
-                  j, jsec->label, jsec->start, jsec->end);
-            // ret_val = -1;
-         }
+         ERROR("Error: section %d \"%s\" (%X-%X) overlaps %d \"%s\" (%X-%X)\n",
+               i, isec->label, isec->start, isec->end,
+               j, jsec->label, jsec->start, jsec->end);
+         report_issue(report, "overlap", i, isec->label, isec->start, isec->end);
+         report_other(report, j, jsec->label, jsec->start, jsec->end);
+         // ret_val = -1;
       }
-      last_end = isec->end;
    }
+
    // error duplicate label addresses
-   for (i = 0; i < config->label_count; i++) {
-      for (j = i+1; j < config->label_count; j++) {
-         if (config->labels[i].ram_addr == config->labels[j].ram_addr) {
-            ERROR("Error: duplicate label %X \"%s\" \"%s\"\n", config->labels[i].ram_addr,
-                  config->labels[i].name, config->labels[j].name);
-            ret_val = -5;
+   if (config->label_count > 0) {
+      find_duplicates(&config->labels[0].ram_addr, NULL, sizeof(*config->labels),
+                      config->label_count, VALIDATE_LABEL_ADDR, &dups);
+      find_duplicates(&config->labels[0].ram_addr, &config->labels[0].name, sizeof(*config->labels),
+                      config->label_count, VALIDATE_LABEL_NAME, &dups);
+      qsort(dups.issues, dups.count, sizeof(*dups.issues), compare_issue);
+   }
+   for (n = 0; n < dups.count; n++) {
+      const label *li = &config->labels[dups.issues[n].first];
+      const label *lj = &config->labels[dups.issues[n].second];
+      if (dups.issues[n].kind == VALIDATE_LABEL_ADDR) {
+         ERROR("Error: duplicate label %X \"%s\" \"%s\"\n", li->ram_addr, li->name, lj->name);
+         report_issue(report, "duplicate_label_address", dups.issues[n].first, li->name, li->ram_addr, li->ram_addr);
+      } else {
+         ERROR("Error: duplicate label name \"%s\" %X %X\n", li->name, li->ram_addr, lj->ram_addr);
+         report_issue(report, "duplicate_label_name", dups.issues[n].first, li->name, li->ram_addr, li->ram_addr);
+      }
+      report_other(report, dups.issues[n].second, lj->name, lj->ram_addr, lj->ram_addr);
+      ret_val = -5;
+   }
+
+   // error duplicate behavior addresses
+   beh_i = find_behavior_section(config);
+   if (beh_i >= 0 && config->sections[beh_i].child_count > 0) {
+      split_section *beh = config->sections[beh_i].children;
+      int count = config->sections[beh_i].child_count;
+      find_duplicates(&beh[0].start, NULL, sizeof(*beh), count, VALIDATE_BEH_OFFSET, &beh_dups);
+      find_duplicates(&beh[0].start, &beh[0].label, sizeof(*beh), count, VALIDATE_BEH_NAME, &beh_dups);
+      qsort(beh_dups.issues, beh_dups.count, sizeof(*beh_dups.issues), compare_issue);
+      for (n = 0; n < beh_dups.count; n++) {
+         const split_section *bi = &beh[beh_dups.issues[n].first];
+         const split_section *bj = &beh[beh_dups.issues[n].second];
+         if (beh_dups.issues[n].kind == VALIDATE_BEH_OFFSET) {
+            ERROR("Error: duplicate behavior offset %04X \"%s\" \"%s\"\n", bi->start, bi->label, bj->label);
+            report_issue(report, "duplicate_behavior_offset", beh_dups.issues[n].first, bi->label, bi->start, bi->end);
+         } else {
+            ERROR("Error: duplicate behavior name \"%s\" %04X %04X\n", bi->label, bi->start, bj->start);
+            report_issue(report, "duplicate_behavior_name", beh_dups.issues[n].first, bi->label, bi->start, bi->end);
          }
-         if (0 == strcmp(config->labels[i].name, config->labels[j].name)) {
-            ERROR("Error: duplicate label name \"%s\" %X %X\n", config->labels[i].name,
-                  config->labels[i].ram_addr, config->labels[j].ram_addr);
-            ret_val = -5;
+         report_other(report, beh_dups.issues[n].second, bj->label, bj->start, bj->end);
+         ret_val = -6;
+      }
+   }
+
+   free(overlaps.issues);
+   free(dups.issues);
+   free(beh_dups.issues);
+   return ret_val;
+}
+
+int config_validate(const rom_config *config, unsigned int max_len)
+{
+   return config_validate_report(config, max_len, NULL);
+}
+
+// string table builder used when compiling configs
+// identical strings are stored once, offset 0 is always the empty string
+#define STRTAB_HASH_SIZE 4096
+
+typedef struct
+{
+   char *data;
+   unsigned int size;
+   unsigned int alloc;
+   unsigned int *hash; // string offset + 1 per slot, 0 if empty
+   unsigned int hash_size;
+   unsigned int count;
+} strtab;
+
+static void strtab_init(strtab *tab)
+{
+   tab->alloc = 64 * KB;
+   tab->data = malloc(tab->alloc);
+   tab->data[0] = '\0';
+   tab->size = 1;
+   tab->hash_size = STRTAB_HASH_SIZE;
+   tab->hash = calloc(tab->hash_size, sizeof(*tab->hash));
+   tab->count = 0;
+}
+
+static void strtab_free(strtab *tab)
+{
+   free(tab->data);
+   free(tab->hash);
+}
+
+static void strtab_rehash(strtab *tab)
+{
+   unsigned int *old_hash = tab->hash;
+   unsigned int old_size = tab->hash_size;
+   tab->hash_size *= 2;
+   tab->hash = calloc(tab->hash_size, sizeof(*tab->hash));
+   for (unsigned int i = 0; i < old_size; i++) {
+      if (old_hash[i]) {
+         unsigned int slot = str_hash(&tab->data[old_hash[i] - 1]) & (tab->hash_size - 1);
+         while (tab->hash[slot]) {
+            slot = (slot + 1) & (tab->hash_size - 1);
          }
+         tab->hash[slot] = old_hash[i];
       }
    }
-   // error duplicate behavior addresses
-   beh_i = -1;
+   free(old_hash);
+}
+
+// returns offset of string in table, adding it if not already present
+static unsigned int strtab_add(strtab *tab, const char *str)
+{
+   unsigned int slot;
+   unsigned int len;
+   unsigned int offset;
+   if (str == NULL || str[0] == '\0') {
+      return 0;
+   }
+   slot = str_hash(str) & (tab->hash_size - 1);
+   while (tab->hash[slot]) {
+      if (!strcmp(&tab->data[tab->hash[slot] - 1], str)) {
+         return tab->hash[slot] - 1;
+      }
+      slot = (slot + 1) & (tab->hash_size - 1);
+   }
+   len = strlen(str) + 1;
+   while (tab->size + len > tab->alloc) {
+      tab->alloc *= 2;
+      tab->data = realloc(tab->data, tab->alloc);
+   }
+   offset = tab->size;
+   memcpy(&tab->data[offset], str, len);
+   tab->size += len;
+   tab->hash[slot] = offset + 1;
+   // keep load factor under 1/2
+   if (++tab->count * 2 > tab->hash_size) {
+      strtab_rehash(tab);
+   }
+   return offset;
+}
+
+static void write_section_record(unsigned char *rec, const split_section *sec, strtab *tab, unsigned int child_index)
+{
+   write_u32_be(&rec[0x00], sec->start);
+   write_u32_be(&rec[0x04], sec->end);
+   write_u32_be(&rec[0x08], sec->vaddr);
+   write_u32_be(&rec[0x0C], sec->type);
+   write_u32_be(&rec[0x10], sec->subtype);
+   write_u32_be(&rec[0x14], strtab_add(tab, sec->label));
+   write_u32_be(&rec[0x18], strtab_add(tab, sec->section_name));
+   write_u32_be(&rec[0x1C], sec->children ? child_index : CONFIG_BIN_NO_CHILDREN);
+   write_u32_be(&rec[0x20], sec->child_count);
+   write_u32_be(&rec[0x24], sec->tex.offset);
+   write_u32_be(&rec[0x28], sec->tex.palette);
+   write_u16_be(&rec[0x2C], sec->tex.width);
+   write_u16_be(&rec[0x2E], sec->tex.height);
+   write_u16_be(&rec[0x30], sec->tex.depth);
+   write_u16_be(&rec[0x32], sec->tex.format);
+}
+
+int config_compile(const rom_config *config, const char *filename)
+{
+   strtab tab;
+   unsigned char *buf;
+   unsigned char *rec;
+   unsigned int child_total = 0;
+   unsigned int child_index = 0;
+   unsigned int records_size;
+   unsigned int name_off, basename_off;
+   long length;
+   int i, j;
+
    for (i = 0; i < config->section_count; i++) {
-      split_section *isec = &config->sections[i];
-      if (isec->type == TYPE_SM64_BEHAVIOR) {
-         beh_i = i;
-         break;
+      if (config->sections[i].children) {
+         child_total += config->sections[i].child_count;
       }
    }
-   if (beh_i >= 0) {
-      split_section *beh = config->sections[beh_i].children;
-      int count = config->sections[beh_i].child_count;
-      for (i = 0; i < count; i++) {
-         for (j = i+1; j < count; j++) {
-            if (beh[i].start == beh[j].start) {
-               ERROR("Error: duplicate behavior offset %04X \"%s\" \"%s\"\n", beh[i].start,
-                     beh[i].label, beh[j].label);
-               ret_val = -6;
-            }
-            if (0 == strcmp(beh[i].label, beh[j].label)) {
-               ERROR("Error: duplicate behavior name \"%s\" %04X %04X\n", beh[i].label,
-                     beh[i].start, beh[j].start);
-               ret_val = -6;
+   records_size = CONFIG_BIN_HEADER_SIZE
+                + (config->section_count + child_total) * CONFIG_BIN_SECTION_SIZE
+                + config->label_count * CONFIG_BIN_LABEL_SIZE;
+   buf = malloc(records_size);
+   if (!buf) {
+      return -1;
+   }
+
+   strtab_init(&tab);
+   name_off = strtab_add(&tab, config->name);
+   basename_off = strtab_add(&tab, config->basename);
+
+   // sections, with children stored after all top-level sections
+   rec = &buf[CONFIG_BIN_HEADER_SIZE];
+   for (i = 0; i < config->section_count; i++) {
+      const split_section *sec = &config->sections[i];
+      write_section_record(rec, sec, &tab, child_index);
+      rec += CONFIG_BIN_SECTION_SIZE;
+      if (sec->children) {
+         child_index += sec->child_count;
+      }
+   }
+   for (i = 0; i < config->section_count; i++) {
+      const split_section *sec = &config->sections[i];
+      if (sec->children) {
+         for (j = 0; j < sec->child_count; j++) {
+            write_section_record(rec, &sec->children[j], &tab, 0);
+            // children never have children of their own
+            write_u32_be(&rec[0x1C], CONFIG_BIN_NO_CHILDREN);
+            rec += CONFIG_BIN_SECTION_SIZE;
+         }
+      }
+   }
+   for (i = 0; i < config->label_count; i++) {
+      write_u32_be(&rec[0], config->labels[i].ram_addr);
+      write_u32_be(&rec[4], strtab_add(&tab, config->labels[i].name));
+      rec += CONFIG_BIN_LABEL_SIZE;
+   }
+
+   memcpy(&buf[0x00], CONFIG_BIN_MAGIC, 8);
+   write_u32_be(&buf[0x08], CONFIG_BIN_VERSION);
+   write_u32_be(&buf[0x0C], config->checksum1);
+   write_u32_be(&buf[0x10], config->checksum2);
+   write_u32_be(&buf[0x14], config->section_count);
+   write_u32_be(&buf[0x18], child_total);
+   write_u32_be(&buf[0x1C], config->label_count);
+   write_u32_be(&buf[0x20], tab.size);
+   write_u32_be(&buf[0x24], name_off);
+   write_u32_be(&buf[0x28], basename_off);
+   write_u32_be(&buf[0x2C], 0);
+
+   buf = realloc(buf, records_size + tab.size);
+   memcpy(&buf[records_size], tab.data, tab.size);
+   length = write_file_if_changed(filename, buf, records_size + tab.size);
+   INFO("Compiled %d sections, %u children, %d labels, %u bytes of strings to %s\n",
+        config->section_count, child_total, config->label_count, tab.size, filename);
+
+   strtab_free(&tab);
+   free(buf);
+   return length < 0 ? -1 : 0;
+}
+
+// reference string in the mapped string table, which is known to end with '\0'
+static int read_string(const char **dst, const unsigned char *strings, unsigned int strings_size, unsigned int offset)
+{
+   if (offset >= strings_size) {
+      return -1;
+   }
+   *dst = (const char *)&strings[offset];
+   return 0;
+}
+
+static int read_section_record(split_section *sec, const unsigned char *rec, const unsigned char *strings,
+                               unsigned int strings_size)
+{
+   sec->start = read_u32_be(&rec[0x00]);
+   sec->end = read_u32_be(&rec[0x04]);
+   sec->vaddr = read_u32_be(&rec[0x08]);
+   sec->type = read_u32_be(&rec[0x0C]);
+   sec->subtype = read_u32_be(&rec[0x10]);
+   sec->child_count = read_u32_be(&rec[0x20]);
+   sec->tex.offset = read_u32_be(&rec[0x24]);
+   sec->tex.palette = read_u32_be(&rec[0x28]);
+   sec->tex.width = read_u16_be(&rec[0x2C]);
+   sec->tex.height = read_u16_be(&rec[0x2E]);
+   sec->tex.depth = read_u16_be(&rec[0x30]);
+   sec->tex.format = read_u16_be(&rec[0x32]);
+   sec->children = NULL;
+   if (read_string(&sec->label, strings, strings_size, read_u32_be(&rec[0x14])) ||
+       read_string(&sec->section_name, strings, strings_size, read_u32_be(&rec[0x18]))) {
+      return -1;
+   }
+   return 0;
+}
+
+// load compiled config from a read-only mapping of the file
+static int config_load_binary(const char *filename, rom_config *c)
+{
+   const unsigned char *buf;
+   const unsigned char *rec;
+   const unsigned char *child_recs;
+   const unsigned char *strings;
+   unsigned int child_total, strings_size;
+   unsigned long long records_size;
+   size_t size;
+   int i;
+#ifdef CONFIG_NO_MMAP
+   unsigned char *data;
+   long file_size = read_file(filename, &data);
+   if (file_size < 0) {
+      ERROR("Error: cannot read %s\n", filename);
+      return -1;
+   }
+   buf = data;
+   size = file_size;
+#else
+   struct stat st;
+   int fd = open(filename, O_RDONLY);
+   if (fd < 0 || fstat(fd, &st) != 0) {
+      ERROR("Error: cannot open %s\n", filename);
+      if (fd >= 0) {
+         close(fd);
+      }
+      return -1;
+   }
+   size = st.st_size;
+   buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (buf == MAP_FAILED) {
+      ERROR("Error: cannot map %s\n", filename);
+      return -1;
+   }
+#endif
+   // strings are referenced in place, so the pool keeps the mapping alive until config_free()
+   c->strings = pool_create();
+   c->strings->mapping = (void *)buf;
+   c->strings->mapping_size = size;
+
+   if (size < CONFIG_BIN_HEADER_SIZE || read_u32_be(&buf[0x08]) != CONFIG_BIN_VERSION) {
+      ERROR("Error: %s is not a supported compiled config\n", filename);
+      config_free(c);
+      return -2;
+   }
+   c->checksum1 = read_u32_be(&buf[0x0C]);
+   c->checksum2 = read_u32_be(&buf[0x10]);
+   c->section_count = read_u32_be(&buf[0x14]);
+   child_total = read_u32_be(&buf[0x18]);
+   c->label_count = read_u32_be(&buf[0x1C]);
+   strings_size = read_u32_be(&buf[0x20]);
+   records_size = CONFIG_BIN_HEADER_SIZE
+                + ((unsigned long long)c->section_count + child_total) * CONFIG_BIN_SECTION_SIZE
+                + (unsigned long long)c->label_count * CONFIG_BIN_LABEL_SIZE;
+   if (c->section_count < 0 || c->label_count < 0 || strings_size == 0 ||
+       records_size + strings_size != size || buf[size - 1] != '\0') {
+      ERROR("Error: %s is truncated or corrupt\n", filename);
+      c->section_count = c->label_count = 0;
+      config_free(c);
+      return -2;
+   }
+   strings = &buf[records_size];
+   if (read_string(&c->name, strings, strings_size, read_u32_be(&buf[0x24])) ||
+       read_string(&c->basename, strings, strings_size, read_u32_be(&buf[0x28]))) {
+      goto corrupt;
+   }
+
+   c->sections = calloc(c->section_count ? c->section_count : 1, sizeof(*c->sections));
+   c->labels = calloc(c->label_count ? c->label_count : 1, sizeof(*c->labels));
+   rec = &buf[CONFIG_BIN_HEADER_SIZE];
+   child_recs = &rec[c->section_count * CONFIG_BIN_SECTION_SIZE];
+   for (i = 0; i < c->section_count; i++) {
+      split_section *sec = &c->sections[i];
+      unsigned int child_index = read_u32_be(&rec[0x1C]);
+      if (read_section_record(sec, rec, strings, strings_size)) {
+         goto corrupt;
+      }
+      if (child_index != CONFIG_BIN_NO_CHILDREN) {
+         if (child_index > child_total || (unsigned int)sec->child_count > child_total - child_index) {
+            sec->child_count = 0;
+            goto corrupt;
+         }
+         sec->children = calloc(sec->child_count ? sec->child_count : 1, sizeof(*sec->children));
+         for (int j = 0; j < sec->child_count; j++) {
+            const unsigned char *child_rec = &child_recs[(child_index + j) * CONFIG_BIN_SECTION_SIZE];
+            if (read_section_record(&sec->children[j], child_rec, strings, strings_size)) {
+               goto corrupt;
             }
          }
       }
+      rec += CONFIG_BIN_SECTION_SIZE;
    }
-   return ret_val;
+   rec = &child_recs[child_total * CONFIG_BIN_SECTION_SIZE];
+   for (i = 0; i < c->label_count; i++) {
+      c->labels[i].ram_addr = read_u32_be(&rec[0]);
+      if (read_string(&c->labels[i].name, strings, strings_size, read_u32_be(&rec[4]))) {
+         goto corrupt;
+      }
+      rec += CONFIG_BIN_LABEL_SIZE;
+   }
+   INFO("Loaded compiled config %s: %d sections, %d labels\n", filename, c->section_count, c->label_count);
+   return 0;
+
+corrupt:
+   ERROR("Error: %s is corrupt\n", filename);
+   config_free(c);
+   return -2;
 }
 
 const char *config_get_version(void)